@@ -0,0 +1,907 @@
+/** @file batch.c
+ *
+ * @brief Decodes many bitmap files on a pool of worker threads.
+ * @author Daniel Jaramillo
+ */
+
+#include <dirent.h>
+#include <glob.h>
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "bitmap.h"
+#include "decoder.h"
+#include "decodestream.h"
+#include "lsbplane.h"
+#include "paramsearch.h"
+#include "probe.h"
+#include "readahead.h"
+#include "stats.h"
+#include "threadpool.h"
+
+/**
+ * State shared by all jobs of a batch run. Output streams and counters are protected by lock.
+ */
+typedef struct batchShared {
+    const batchOptions_t *options;
+    pthread_mutex_t lock;
+    size_t decoded;
+    size_t failed;
+    stats_t stats;              // phases of all files, with --stats
+} batchShared_t;
+
+/**
+ * One input file of a batch run.
+ */
+typedef struct batchJob {
+    const char *path;
+    batchShared_t *shared;
+    readAhead_t *readAhead;     // read-ahead that read buffer, or NULL
+    readAheadBuffer_t buffer;   // file contents read ahead of the decode
+    stats_t stats;              // phases of this file, with --stats
+} batchJob_t;
+
+/**
+ * Initializes an empty input list.
+ *
+ * @param list input list.
+ */
+void batchListInit(batchList_t *list) {
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+/**
+ * Appends a copy of a path to the list.
+ *
+ * @param list input list.
+ * @param path path to append.
+ * @return 1 on success, 0 if memory ran out.
+ */
+static uint32_t batchListAppend(batchList_t *list, const char *path) {
+    if(list->count == list->capacity) {
+        size_t capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if(paths == NULL)
+            return 0;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+
+    list->paths[list->count] = strdup(path);
+    if(list->paths[list->count] == NULL)
+        return 0;
+    list->count++;
+    return 1;
+}
+
+/**
+ * Returns 1 if the file name ends in .bmp, ignoring case.
+ *
+ * @param name file name.
+ * @return 1 for bitmap file names, 0 otherwise.
+ */
+static uint32_t hasBitmapExtension(const char *name) {
+    size_t length = strlen(name);
+    return length >= 4 && strcasecmp(name + length - 4, ".bmp") == 0;
+}
+
+/**
+ * Adds every .bmp file below a directory to the list.
+ *
+ * @param list input list.
+ * @param directory directory to search.
+ * @return 1 on success, 0 if the directory could not be read or memory ran out.
+ */
+static uint32_t batchListAddDirectory(batchList_t *list, const char *directory) {
+    DIR *dir = opendir(directory);
+    if(dir == NULL)
+        return 0;
+
+    uint32_t success = 1;
+    struct dirent *entry;
+    while(success && (entry = readdir(dir)) != NULL) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+        char *path = malloc(length);
+        if(path == NULL) {
+            success = 0;
+            break;
+        }
+        snprintf(path, length, "%s/%s", directory, entry->d_name);
+
+        struct stat pathStat;
+        if(stat(path, &pathStat) == 0) {
+            if(S_ISDIR(pathStat.st_mode))
+                success = batchListAddDirectory(list, path);
+            else if(S_ISREG(pathStat.st_mode) && hasBitmapExtension(entry->d_name))
+                success = batchListAppend(list, path);
+        }
+        free(path);
+    }
+    closedir(dir);
+    return success;
+}
+
+/**
+ * Adds an input to the list. Directories are searched recursively for .bmp files and glob patterns are expanded.
+ *
+ * Any other input is added as a file path, so a missing file is reported as a failure of that file by runBatch().
+ *
+ * @param list input list.
+ * @param input file path, directory or glob pattern.
+ * @return 1 on success, 0 if the input matched nothing or memory ran out.
+ */
+uint32_t batchListAdd(batchList_t *list, const char *input) {
+    struct stat inputStat;
+
+    if(stat(input, &inputStat) == 0 && S_ISDIR(inputStat.st_mode))
+        return batchListAddDirectory(list, input);
+
+    if(strpbrk(input, "*?[") != NULL) {
+        glob_t matches;
+        if(glob(input, 0, NULL, &matches) != 0)
+            return 0;
+        uint32_t success = 1;
+        for(size_t m = 0; success && m < matches.gl_pathc; m++)
+            success = batchListAppend(list, matches.gl_pathv[m]);
+        globfree(&matches);
+        return success;
+    }
+
+    return batchListAppend(list, input);
+}
+
+/**
+ * Adds every line of a file list to the input list with batchListAdd(). Empty lines are skipped.
+ *
+ * @param list input list.
+ * @param listFilePtr file with one input per line.
+ * @return 1 on success, 0 if any line failed.
+ */
+uint32_t batchListAddFromFile(batchList_t *list, FILE *listFilePtr) {
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    uint32_t success = 1;
+
+    while((length = getline(&line, &lineCapacity, listFilePtr)) >= 0) {
+        while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = '\0';
+        if(length > 0 && batchListAdd(list, line) == 0)
+            success = 0;
+    }
+    free(line);
+    return success;
+}
+
+/**
+ * Frees all paths held by the list.
+ *
+ * @param list input list.
+ */
+void batchListFree(batchList_t *list) {
+    for(size_t p = 0; p < list->count; p++)
+        free(list->paths[p]);
+    free(list->paths);
+    batchListInit(list);
+}
+
+/**
+ * Returns the length of the well-formed UTF-8 sequence at the start of the bytes. Overlong forms, surrogates and code
+ * points past U+10FFFF are not well-formed.
+ *
+ * @param bytes bytes to look at.
+ * @param length number of bytes, at least 1.
+ * @return length of the sequence, 1 to 4, or 0 if the bytes do not start with one.
+ */
+static size_t getUTF8SequenceLength(const uint8_t *bytes, size_t length) {
+    uint8_t lead = bytes[0];
+    uint8_t low = 0x80;     // range of the second byte, narrower after some lead bytes
+    uint8_t high = 0xBF;
+    size_t count;
+
+    if(lead < 0x80)
+        return 1;
+    if(lead >= 0xC2 && lead <= 0xDF) {
+        count = 2;
+    } else if(lead >= 0xE0 && lead <= 0xEF) {
+        count = 3;
+        low = lead == 0xE0 ? 0xA0 : low;
+        high = lead == 0xED ? 0x9F : high;
+    } else if(lead >= 0xF0 && lead <= 0xF4) {
+        count = 4;
+        low = lead == 0xF0 ? 0x90 : low;
+        high = lead == 0xF4 ? 0x8F : high;
+    } else {
+        return 0;
+    }
+    if(length < count || bytes[1] < low || bytes[1] > high)
+        return 0;
+    for(size_t b = 2; b < count; b++) {
+        if((bytes[b] & 0xC0) != 0x80)
+            return 0;
+    }
+    return count;
+}
+
+/**
+ * Writes a string as a quoted JSON string. Valid UTF-8 is written unchanged, only control characters, quotes and
+ * backslashes are escaped. A byte that is not part of valid UTF-8 is written as U+FFFD.
+ *
+ * @param outputFilePtr stream to write to.
+ * @param str bytes to write.
+ * @param length number of bytes.
+ * @return 1 if the bytes were valid UTF-8, 0 if any were replaced.
+ */
+static uint32_t writeJSONString(FILE *outputFilePtr, const char *str, size_t length) {
+    const uint8_t *bytes = (const uint8_t *) str;
+    uint32_t valid = 1;
+
+    fputc('"', outputFilePtr);
+    for(size_t c = 0; c < length;) {
+        uint8_t ch = bytes[c];
+        size_t count = getUTF8SequenceLength(bytes + c, length - c);
+        if(count == 0) {
+            fputs("\\ufffd", outputFilePtr);
+            valid = 0;
+            count = 1;
+        } else if(ch == '"' || ch == '\\') {
+            fprintf(outputFilePtr, "\\%c", ch);
+        } else if(ch == '\n') {
+            fputs("\\n", outputFilePtr);
+        } else if(ch < 0x20 || ch == 0x7F) {
+            fprintf(outputFilePtr, "\\u%04x", ch);
+        } else {
+            fwrite(bytes + c, 1, count, outputFilePtr);
+        }
+        c += count;
+    }
+    fputc('"', outputFilePtr);
+    return valid;
+}
+
+/**
+ * Writes bytes as a quoted base64 string, with padding.
+ *
+ * @param outputFilePtr stream to write to.
+ * @param bytes bytes to write.
+ * @param length number of bytes.
+ */
+static void writeBase64String(FILE *outputFilePtr, const uint8_t *bytes, size_t length) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    fputc('"', outputFilePtr);
+    for(size_t c = 0; c < length; c += 3) {
+        uint32_t group = (uint32_t) bytes[c] << 16;
+        if(c + 1 < length)
+            group |= (uint32_t) bytes[c + 1] << 8;
+        if(c + 2 < length)
+            group |= bytes[c + 2];
+        fputc(alphabet[(group >> 18) & 0x3F], outputFilePtr);
+        fputc(alphabet[(group >> 12) & 0x3F], outputFilePtr);
+        fputc(c + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=', outputFilePtr);
+        fputc(c + 2 < length ? alphabet[group & 0x3F] : '=', outputFilePtr);
+    }
+    fputc('"', outputFilePtr);
+}
+
+/**
+ * Writes a JSON member holding a string with writeJSONString(). If the string is not valid UTF-8, the exact bytes
+ * follow in a second member named <name>_base64, so nothing is lost to the replaced bytes.
+ *
+ * @param outputFilePtr stream to write to.
+ * @param name name of the member.
+ * @param str bytes to write.
+ * @param length number of bytes.
+ */
+static void writeJSONMember(FILE *outputFilePtr, const char *name, const char *str, size_t length) {
+    fprintf(outputFilePtr, "\"%s\":", name);
+    if(writeJSONString(outputFilePtr, str, length) == 0) {
+        fprintf(outputFilePtr, ",\"%s_base64\":", name);
+        writeBase64String(outputFilePtr, (const uint8_t *) str, length);
+    }
+}
+
+/**
+ * Writes a message to <outputDir>/<input file name>.txt.
+ *
+ * @param outputDir output directory.
+ * @param inputPath path of the decoded bitmap.
+ * @param message decoded message.
+ * @param length length of message.
+ * @return 1 on success, 0 otherwise.
+ */
+static uint32_t writeMessageFile(const char *outputDir, const char *inputPath, const char *message, size_t length) {
+    const char *name = strrchr(inputPath, '/');
+    name = (name == NULL) ? inputPath : name + 1;
+
+    size_t pathLength = strlen(outputDir) + strlen(name) + 6;
+    char *path = malloc(pathLength);
+    if(path == NULL)
+        return 0;
+    snprintf(path, pathLength, "%s/%s.txt", outputDir, name);
+
+    FILE *outputFilePtr = fopen(path, "wb");
+    free(path);
+    if(outputFilePtr == NULL)
+        return 0;
+    uint32_t success = fwrite(message, 1, length, outputFilePtr) == length;
+    if(fclose(outputFilePtr) != 0)
+        success = 0;
+    return success;
+}
+
+/**
+ * Adds the phases of a job to the totals and writes them into its JSONL record, when the options ask for stats.
+ * Called with the shared lock held, before the record is closed.
+ *
+ * @param job finished job.
+ * @param jsonlFilePtr stream holding the open record of the job, or NULL.
+ */
+static void recordJobStats(batchJob_t *job, FILE *jsonlFilePtr) {
+    if(!job->shared->options->stats)
+        return;
+    statsAdd(&job->shared->stats, &job->stats);
+    if(jsonlFilePtr != NULL) {
+        fputs(",\"stats\":", jsonlFilePtr);
+        writeStatsJSON(jsonlFilePtr, &job->stats);
+    }
+}
+
+/**
+ * Records the result of one file in the counters and the JSONL stream.
+ *
+ * @param job finished job.
+ * @param error error description, NULL on success.
+ * @param message decoded message on success.
+ * @param length length of message.
+ */
+static void reportResult(batchJob_t *job, const char *error, const char *message, size_t length) {
+    batchShared_t *shared = job->shared;
+    FILE *jsonlFilePtr = shared->options->jsonlFilePtr;
+
+    pthread_mutex_lock(&shared->lock);
+    if(error == NULL)
+        shared->decoded++;
+    else
+        shared->failed++;
+
+    if(jsonlFilePtr != NULL) {
+        fputc('{', jsonlFilePtr);
+        writeJSONMember(jsonlFilePtr, "file", job->path, strlen(job->path));
+        if(error == NULL) {
+            fprintf(jsonlFilePtr, ",\"status\":\"ok\",\"length\":%zu,", length);
+            writeJSONMember(jsonlFilePtr, "message", message, length);
+        } else {
+            fputs(",\"status\":\"error\",", jsonlFilePtr);
+            writeJSONMember(jsonlFilePtr, "error", error, strlen(error));
+        }
+        recordJobStats(job, jsonlFilePtr);
+        fputs("}\n", jsonlFilePtr);
+    } else {
+        recordJobStats(job, NULL);
+        if(error != NULL)
+            fprintf(stderr, "Error: %s: %s\n", job->path, error);
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ * Worker task probing one file and recording its headers and capacity.
+ *
+ * @param arg batchJob_t to run.
+ */
+static void probeFileTask(void *arg) {
+    batchJob_t *job = arg;
+    batchShared_t *shared = job->shared;
+    FILE *jsonlFilePtr = shared->options->jsonlFilePtr;
+    bitmapProbe_t probe;
+
+    statsBind(shared->options->stats ? &(job->stats) : NULL);
+    uint32_t success = probeBitmapFile(job->path, &probe);
+    statsBind(NULL);
+    if(success != 1) {
+        reportResult(job, "unable to read bitmap file header", NULL, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&shared->lock);
+    shared->decoded++;
+    if(jsonlFilePtr != NULL) {
+        fputc('{', jsonlFilePtr);
+        writeJSONMember(jsonlFilePtr, "file", job->path, strlen(job->path));
+        char signature[2] = {(char) (probe.signature >> 8), (char) (probe.signature & 0xFF)};
+        fputs(",\"status\":\"ok\",", jsonlFilePtr);
+        writeJSONMember(jsonlFilePtr, "signature", signature, sizeof(signature));
+        fprintf(jsonlFilePtr, ",\"dib_header_size\":%u", probe.dib_header_size);
+        if(probe.parsed)
+            fprintf(jsonlFilePtr, ",\"width\":%u,\"height\":%d,\"bits_per_pixel\":%u,\"compression\":%u",
+                    probe.width, probe.height, probe.bits_per_pixel, probe.compression_method);
+        fprintf(jsonlFilePtr, ",\"decodeable\":%s,\"capacity\":%llu", probe.decodeable ? "true" : "false",
+                (unsigned long long) probe.capacity);
+        recordJobStats(job, jsonlFilePtr);
+        fputs("}\n", jsonlFilePtr);
+    } else {
+        recordJobStats(job, NULL);
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ * Writes a decoded message to the output directory and reports it.
+ *
+ * @param job job the message belongs to.
+ * @param message decoded message.
+ * @param length length of message.
+ */
+static void finishMessage(batchJob_t *job, const char *message, size_t length) {
+    const batchOptions_t *options = job->shared->options;
+    uint32_t written = 1;
+    if(options->outputDir != NULL) {
+        STATS_START(outputTimer);
+        written = writeMessageFile(options->outputDir, job->path, message, length);
+        STATS_STOP(outputTimer, STATS_OUTPUT, length);
+    }
+    if(written == 0)
+        reportResult(job, "unable to write output file", NULL, 0);
+    else
+        reportResult(job, NULL, message, length);
+}
+
+/**
+ * Prints the headers of a bitmap when the options ask for them.
+ *
+ * @param job job the bitmap belongs to.
+ * @param bitmap bitmap with parsed headers.
+ */
+static void printJobHeaders(batchJob_t *job, const bitmap_t *bitmap) {
+    if(job->shared->options->printHeaders) {
+        pthread_mutex_lock(&job->shared->lock);
+        printf("%s\n", job->path);
+        printBitmapHeaders(bitmap);
+        pthread_mutex_unlock(&job->shared->lock);
+    }
+}
+
+/**
+ * Adapter of fwrite() to messageWriter_t, collecting a message in a memory stream.
+ *
+ * @param context FILE pointer of the memory stream.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+static uint32_t writeMemoryStream(void *context, const uint8_t *bytes, size_t count) {
+    return fwrite(bytes, 1, count, (FILE *) context) == count;
+}
+
+/**
+ * Decodes a file whose pixel array is larger than the memory budget in bounded windows of rows.
+ *
+ * The message is collected in a memory stream, so memory use follows the message length and not the carrier size. A
+ * framed payload is detected by its header and checked against its CRC-32C while it is streamed, like
+ * decodeLoadedBitmap() does for loaded files.
+ *
+ * @param job job to run.
+ * @param bitmapFilePtr bitmap file positioned after its headers.
+ * @param headers bitmap with the headers read from the file.
+ * @param config decode configuration.
+ */
+static void decodeFileWindowed(batchJob_t *job, FILE *bitmapFilePtr, const bitmap_t *headers,
+                               const decodeConfig_t *config) {
+    char *message = NULL;
+    size_t length = 0;
+    uint64_t written;
+
+    FILE *messageFilePtr = open_memstream(&message, &length);
+    if(messageFilePtr == NULL) {
+        reportResult(job, "unable to decode message", NULL, 0);
+        return;
+    }
+    STATS_START(decodeTimer);
+    uint32_t result = decodeMessageStreamToWriter(bitmapFilePtr, headers, config, STREAM_DEFAULT_CHUNK_SIZE,
+                                                  writeMemoryStream, messageFilePtr, &written);
+    if(fclose(messageFilePtr) != 0 && result == DECODE_OK)
+        result = DECODE_ERROR;
+    STATS_STOP(decodeTimer, STATS_DECODE, length);
+
+    if(result == DECODE_OK)
+        finishMessage(job, message, length);
+    else
+        reportResult(job, result == DECODE_CORRUPT ? "framed payload is corrupt" : "unable to decode message", NULL,
+                     0);
+    free(message);
+}
+
+/**
+ * Decodes a file from its LSB plane with the plane variant of the options.
+ *
+ * A framed payload is detected by its header and decoded with decodeLSBPlaneFrame(), like decodeLoadedBitmap() does.
+ *
+ * @param job job to run.
+ */
+static void decodeFilePlane(batchJob_t *job) {
+    const batchOptions_t *options = job->shared->options;
+    lsbPlane_t plane;
+
+    STATS_START(planeTimer);
+    uint32_t loaded = loadLSBPlaneFile(job->path, options->planeSidecar, &plane);
+    STATS_STOP(planeTimer, STATS_PIXELS, loaded == 1 ? plane.bit_count / 8 : 0);
+    if(loaded != 1) {
+        reportResult(job, "unable to extract LSB plane", NULL, 0);
+        return;
+    }
+    // a framed payload is read by its length and checked, anything else is a C string
+    uint8_t *payload;
+    uint64_t payloadLength;
+    STATS_START(frameTimer);
+    uint32_t frame = decodeLSBPlaneFrame(&plane, &(options->planeVariant), &payload, &payloadLength);
+    STATS_STOP(frameTimer, STATS_DECODE, frame == FRAME_OK ? payloadLength : 0);
+    if(frame != FRAME_NOT_FOUND) {
+        releaseLSBPlane(&plane);
+        if(frame == FRAME_OK)
+            finishMessage(job, (const char *) payload, (size_t) payloadLength);
+        else
+            reportResult(job, frame == FRAME_CORRUPT ? "framed payload is corrupt" : "unable to decode message",
+                         NULL, 0);
+        free(payload);
+        return;
+    }
+
+    STATS_START(decodeTimer);
+    char *message = decodeLSBPlaneMessage(&plane, &(options->planeVariant));
+    STATS_STOP(decodeTimer, STATS_DECODE, message != NULL ? strlen(message) : 0);
+    releaseLSBPlane(&plane);
+    if(message == NULL) {
+        reportResult(job, "unable to decode message", NULL, 0);
+        return;
+    }
+
+    finishMessage(job, message, strlen(message));
+    free(message);
+}
+
+/**
+ * Returns the decode configuration of the options.
+ *
+ * @param options batch options.
+ * @param config decode configuration.
+ */
+static void getBatchDecodeConfig(const batchOptions_t *options, decodeConfig_t *config) {
+    config->bits_per_channel = options->bitsPerChannel ? options->bitsPerChannel : 1;
+    config->channel_mask = options->channelMask ? options->channelMask : CHANNEL_RGB;
+    config->order_key = options->orderKey;
+}
+
+/**
+ * Decodes a bitmap loaded into memory and reports the result.
+ *
+ * A framed payload is detected by its header and decoded with decodeFramedPayload(). An owned pixel array is released
+ * as soon as the message is out of it, a borrowed one is left to the caller.
+ *
+ * @param job job the bitmap belongs to.
+ * @param bitmap bitmap in memory.
+ * @param config decode configuration.
+ * @param borrowed 1 if the pixel array is borrowed and must not be released with releaseBitmap().
+ */
+static void decodeLoadedBitmap(batchJob_t *job, bitmap_t *bitmap, const decodeConfig_t *config, uint32_t borrowed) {
+    // print headers
+    printJobHeaders(job, bitmap);
+
+    // check if decodeable and decode message
+    if(isDecodeable(bitmap) != 1) {
+        if(!borrowed)
+            releaseBitmap(bitmap);
+        reportResult(job, "file not decodeable", NULL, 0);
+        return;
+    }
+
+    // a framed payload is read by its length and checked, anything else is a C string
+    uint8_t *payload;
+    uint64_t payloadLength;
+    STATS_START(frameTimer);
+    uint32_t frame = decodeFramedPayload(bitmap, config, &payload, &payloadLength);
+    STATS_STOP(frameTimer, STATS_DECODE, frame == FRAME_OK ? payloadLength : 0);
+    if(frame != FRAME_NOT_FOUND) {
+        if(!borrowed)
+            releaseBitmap(bitmap);
+        if(frame == FRAME_OK)
+            finishMessage(job, (const char *) payload, (size_t) payloadLength);
+        else
+            reportResult(job, frame == FRAME_CORRUPT ? "framed payload is corrupt" : "unable to decode message",
+                         NULL, 0);
+        free(payload);
+        return;
+    }
+
+    STATS_START(decodeTimer);
+    char *message = decodeMessageWithConfig(bitmap, config);
+    STATS_STOP(decodeTimer, STATS_DECODE, message != NULL ? strlen(message) : 0);
+    if(!borrowed)
+        releaseBitmap(bitmap);
+    if(message == NULL) {
+        reportResult(job, "unable to decode message", NULL, 0);
+        return;
+    }
+
+    finishMessage(job, message, strlen(message));
+    free(message);
+}
+
+/**
+ * Decodes one file.
+ *
+ * Files are read with readBitmapFile() unless memory mapping is requested. A file whose pixel array exceeds the
+ * memory budget is never loaded whole, it is decoded in windows by decodeFileWindowed(). In plane mode the file is
+ * decoded from its LSB plane by decodeFilePlane(). Loaded files are decoded by decodeLoadedBitmap().
+ *
+ * @param job job to run.
+ */
+static void decodeFile(batchJob_t *job) {
+    const batchOptions_t *options = job->shared->options;
+    bitmap_t bitmap;
+    uint32_t loaded;
+
+    if(options->usePlane) {
+        decodeFilePlane(job);
+        return;
+    }
+
+    decodeConfig_t config;
+    getBatchDecodeConfig(options, &config);
+    uint64_t memoryBudget = options->memoryBudget ? options->memoryBudget : BATCH_DEFAULT_MEMORY_BUDGET;
+
+    // read file, a mapped one is paged in while it is decoded
+    if(options->useMmap) {
+        STATS_START(mapTimer);
+        loaded = mapBitmapFile(job->path, &bitmap);
+        STATS_STOP(mapTimer, STATS_OPEN, 0);
+    } else {
+        STATS_START(openTimer);
+        FILE *bitmapFilePtr = fopen(job->path, "rb");
+        STATS_STOP(openTimer, STATS_OPEN, 0);
+        if(bitmapFilePtr == NULL) {
+            reportResult(job, "unable to open bitmap file", NULL, 0);
+            return;
+        }
+
+        // look at the headers first, so an oversized pixel array is never allocated
+        STATS_START(headerTimer);
+        uint32_t dibHeaderSize = readBMPFileHeader(bitmapFilePtr, &(bitmap.bmpFileHeader));
+        uint32_t parsed = dibHeaderSize != 0 && readDIBHeader(bitmapFilePtr, dibHeaderSize, &(bitmap.dibHeader)) != 0;
+        STATS_STOP(headerTimer, STATS_HEADERS, (uint64_t) BMPFILEHEADERSIZE + dibHeaderSize);
+        uint32_t oversized = parsed && getPixelArraySize(&(bitmap.dibHeader)) > memoryBudget;
+        if(oversized && config.order_key == 0) {
+            printJobHeaders(job, &bitmap);
+            if(isDecodeable(&bitmap) != 1)
+                reportResult(job, "file not decodeable", NULL, 0);
+            else
+                decodeFileWindowed(job, bitmapFilePtr, &bitmap, &config);
+            fclose(bitmapFilePtr);
+            return;
+        }
+
+        // a keyed pixel order visits the rows out of order, so an oversized pixel array is mapped instead
+        if(oversized) {
+            fclose(bitmapFilePtr);
+            STATS_START(mapTimer);
+            loaded = mapBitmapFile(job->path, &bitmap);
+            STATS_STOP(mapTimer, STATS_OPEN, 0);
+        } else {
+            rewind(bitmapFilePtr);
+            loaded = readBitmapFile(bitmapFilePtr, &bitmap);
+            fclose(bitmapFilePtr);
+        }
+    }
+    if(loaded != 1) {
+        reportResult(job, "unable to read/parse bitmap file", NULL, 0);
+        return;
+    }
+
+    decodeLoadedBitmap(job, &bitmap, &config, 0);
+}
+
+/**
+ * Worker task decoding one file with decodeFile(), recording its phases into the job when the options ask for stats.
+ *
+ * @param arg batchJob_t to run.
+ */
+static void decodeFileTask(void *arg) {
+    batchJob_t *job = arg;
+    statsBind(job->shared->options->stats ? &(job->stats) : NULL);
+    decodeFile(job);
+    statsBind(NULL);
+}
+
+/**
+ * Worker task decoding one file whose contents were read ahead, parsed in place without a copy.
+ *
+ * A file the read-ahead did not read, because it failed, is larger than the memory budget or is not a regular file,
+ * and a file that does not parse are handed to decodeFile(), which reports the failure or decodes it the usual way.
+ * The reads overlap the decoding, so the pixels phase of a file read ahead counts its bytes and next to no time, the
+ * time waited for reads is recorded by runBatch().
+ *
+ * @param arg batchJob_t to run.
+ */
+static void decodeBufferTask(void *arg) {
+    batchJob_t *job = arg;
+    bitmap_t bitmap;
+
+    statsBind(job->shared->options->stats ? &(job->stats) : NULL);
+    if(job->buffer.data == NULL || parseBitmapMemory(job->buffer.data, job->buffer.size, &bitmap) != 1) {
+        readAheadRelease(job->readAhead, &(job->buffer));
+        decodeFile(job);
+    } else {
+        STATS_START(pixelTimer);
+        STATS_STOP(pixelTimer, STATS_PIXELS, job->buffer.size);
+        decodeConfig_t config;
+        getBatchDecodeConfig(job->shared->options, &config);
+        decodeLoadedBitmap(job, &bitmap, &config, 1);
+        readAheadRelease(job->readAhead, &(job->buffer));
+    }
+    statsBind(NULL);
+}
+
+/**
+ * Searches the embedding parameters of one file and records its best results, one JSON record per result.
+ *
+ * The file is memory mapped, so only the pages holding the scored prefixes and the reported messages are read. The
+ * best message is also written to the output directory.
+ *
+ * @param job job to run.
+ * @param pool thread pool scoring the candidates of the file.
+ */
+static void searchFile(batchJob_t *job, threadPool_t *pool) {
+    batchShared_t *shared = job->shared;
+    const batchOptions_t *options = shared->options;
+    FILE *jsonlFilePtr = options->jsonlFilePtr;
+    bitmap_t bitmap;
+    size_t resultCount;
+
+    if(mapBitmapFile(job->path, &bitmap) != 1) {
+        reportResult(job, "unable to read/parse bitmap file", NULL, 0);
+        return;
+    }
+    printJobHeaders(job, &bitmap);
+
+    uint32_t topCount = options->searchOptions.topCount ? options->searchOptions.topCount : SEARCH_DEFAULT_TOP_COUNT;
+    searchResult_t *results = calloc(topCount, sizeof(searchResult_t));
+    uint32_t success = results != NULL &&
+                       searchParameters(&bitmap, &(options->searchOptions), pool, results, &resultCount) == 1;
+    releaseBitmap(&bitmap);
+    if(!success || resultCount == 0) {
+        free(results);
+        reportResult(job, "unable to search parameters", NULL, 0);
+        return;
+    }
+
+    if(options->outputDir != NULL &&
+            writeMessageFile(options->outputDir, job->path, results[0].message, results[0].length) == 0) {
+        releaseSearchResults(results, resultCount);
+        free(results);
+        reportResult(job, "unable to write output file", NULL, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&shared->lock);
+    shared->decoded++;
+    for(size_t r = 0; jsonlFilePtr != NULL && r < resultCount; r++) {
+        const searchResult_t *result = &results[r];
+        fputc('{', jsonlFilePtr);
+        writeJSONMember(jsonlFilePtr, "file", job->path, strlen(job->path));
+        fprintf(jsonlFilePtr, ",\"status\":\"ok\",\"rank\":%zu,\"score\":%.4f,\"bits\":%u,\"channels\":\"%s\"",
+                r + 1, result->score, result->candidate.bits_per_channel, result->channels);
+        fprintf(jsonlFilePtr, ",\"msb_first\":%s,\"top_down\":%s,\"start_bit\":%llu,\"length\":%zu,",
+                result->candidate.msb_first ? "true" : "false", result->candidate.top_down ? "true" : "false",
+                (unsigned long long) result->candidate.start_bit, result->length);
+        writeJSONMember(jsonlFilePtr, "message", result->message, result->length);
+        fputs("}\n", jsonlFilePtr);
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    releaseSearchResults(results, resultCount);
+    free(results);
+}
+
+/**
+ * Decodes every file in the list on a thread pool. A failed file is reported and does not stop the run.
+ *
+ * Each file is decoded by one worker with decodeMessageWithConfig(), so throughput scales with the number of files.
+ * Results go to the output directory and/or JSONL stream of the options. Without a JSONL stream, failures go to
+ * stderr. In probe mode only the headers of each file are read and one record with format and capacity is written
+ * per file. Files larger than the memory budget are decoded in bounded windows of rows instead of being loaded. In
+ * search mode files are searched one after another by searchFile(), each spreading its candidates over the pool.
+ *
+ * With a read-ahead depth, files are read whole by a read-ahead with that many reads in flight while the workers
+ * decode the files read before, and each completed file is queued to the pool. Files the read-ahead never returned
+ * are decoded the usual way afterwards.
+ *
+ * With stats in the options, the phases of each file are added to its JSONL record and to the summary.
+ *
+ * @param list input list.
+ * @param options batch options.
+ * @param summary totals of the run, may be NULL.
+ * @return 1 if every file decoded, 0 otherwise.
+ */
+uint32_t runBatch(const batchList_t *list, const batchOptions_t *options, batchSummary_t *summary) {
+    batchShared_t shared;
+    shared.options = options;
+    shared.decoded = 0;
+    shared.failed = 0;
+    statsReset(&shared.stats);
+    pthread_mutex_init(&shared.lock, NULL);
+
+    batchJob_t *jobs = calloc(list->count ? list->count : 1, sizeof(batchJob_t));
+    threadPool_t *pool = threadPoolCreate(options->threadCount);
+    for(size_t j = 0; jobs != NULL && j < list->count; j++) {
+        jobs[j].path = list->paths[j];
+        jobs[j].shared = &shared;
+    }
+
+    // the read-ahead may hold one buffer per worker besides the reads in flight
+    readAhead_t *readAhead = NULL;
+    if(options->readAhead > 0 && jobs != NULL && pool != NULL && !options->search && !options->probeOnly &&
+            !options->usePlane && !options->useMmap)
+        readAhead = readAheadCreate(list->paths, list->count, options->readAhead, threadPoolSize(pool),
+                                    options->memoryBudget ? options->memoryBudget : BATCH_DEFAULT_MEMORY_BUDGET);
+    stats_t waitStats;
+    statsReset(&waitStats);
+    if(readAhead != NULL) {
+        readAheadBuffer_t buffer;
+        for(;;) {
+            // the time waited for reads is the part of reading the pixels that decoding did not hide
+            statsBind(options->stats ? &waitStats : NULL);
+            STATS_START(waitTimer);
+            uint32_t found = readAheadNext(readAhead, &buffer);
+            STATS_STOP(waitTimer, STATS_PIXELS, 0);
+            statsBind(NULL);
+            if(!found)
+                break;
+
+            batchJob_t *job = &jobs[buffer.index];
+            job->readAhead = readAhead;
+            job->buffer = buffer;
+            if(threadPoolSubmit(pool, NULL, decodeBufferTask, job) == 0)
+                decodeBufferTask(job);
+        }
+    }
+
+    for(size_t j = 0; jobs != NULL && j < list->count; j++) {
+        if(jobs[j].readAhead != NULL)
+            continue;
+
+        if(options->search) {
+            searchFile(&jobs[j], pool);
+            continue;
+        }
+
+        // run the job on the calling thread if it cannot be queued
+        threadPoolTask_t task = options->probeOnly ? probeFileTask : decodeFileTask;
+        if(pool == NULL || threadPoolSubmit(pool, NULL, task, &jobs[j]) == 0)
+            task(&jobs[j]);
+    }
+    threadPoolDestroy(pool);
+    readAheadDestroy(readAhead);
+    statsAdd(&shared.stats, &waitStats);
+
+    if(jobs == NULL)
+        shared.failed = list->count;
+    if(options->jsonlFilePtr != NULL)
+        fflush(options->jsonlFilePtr);
+    free(jobs);
+    pthread_mutex_destroy(&shared.lock);
+
+    if(summary != NULL) {
+        summary->decoded = shared.decoded;
+        summary->failed = shared.failed;
+        summary->stats = shared.stats;
+    }
+    return shared.failed == 0;
+}
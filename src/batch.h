@@ -0,0 +1,109 @@
+/** @file batch.h
+ *
+ * @brief Decodes many bitmap files on a pool of worker threads.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lsbplane.h"
+#include "paramsearch.h"
+#include "stats.h"
+
+/**
+ * Default largest pixel array loaded into memory by a batch run.
+ */
+#define BATCH_DEFAULT_MEMORY_BUDGET     (1024ULL * 1024 * 1024)
+
+/**
+ * Options for a batch run.
+ */
+typedef struct batchOptions {
+    uint32_t threadCount;       // worker threads, 0 for one per online processor
+    uint32_t printHeaders;      // print headers of each bitmap to stdout
+    uint32_t useMmap;           // load bitmaps with mapBitmapFile() instead of readBitmapFile()
+    uint32_t probeOnly;         // report headers and capacity with probeBitmapFile() instead of decoding
+    uint32_t bitsPerChannel;    // message bits in each selected channel, 0 for 1
+    uint32_t channelMask;       // CHANNEL_ bits of the channels holding message bits, 0 for all
+    uint64_t orderKey;          // key of the keyed pixel order, see pixelorder.h, 0 for the rows in decode order
+    uint64_t memoryBudget;      // largest pixel array loaded into memory, larger files are decoded in windows,
+                                // 0 for BATCH_DEFAULT_MEMORY_BUDGET
+    uint32_t readAhead;         // files read ahead of the decode workers, 0 to let each worker read its own file
+    uint32_t stats;             // time the phases of each file, see stats.h
+    uint32_t usePlane;          // decode from the LSB plane of each file with planeVariant
+    uint32_t planeSidecar;      // keep each plane in a <file>.lsbplane sidecar and reuse it on later runs
+    lsbPlaneVariant_t planeVariant;
+    uint32_t search;            // search the embedding parameters of each file instead of decoding with given ones
+    searchOptions_t searchOptions;
+    const char *outputDir;      // directory for one <name>.txt per input, or NULL
+    FILE *jsonlFilePtr;         // stream for one JSON record per input, or NULL
+} batchOptions_t;
+
+/**
+ * Growable list of input file paths.
+ */
+typedef struct batchList {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} batchList_t;
+
+/**
+ * Totals of a batch run.
+ */
+typedef struct batchSummary {
+    size_t decoded;
+    size_t failed;
+    stats_t stats;              // phases of all files when the options ask for stats
+} batchSummary_t;
+
+/**
+ * Initializes an empty input list.
+ *
+ * @param list input list.
+ */
+void batchListInit(batchList_t *list);
+
+/**
+ * Adds an input to the list. Directories are searched recursively for .bmp files and glob patterns are expanded.
+ *
+ * @param list input list.
+ * @param input file path, directory or glob pattern.
+ * @return 1 on success, 0 if the input matched nothing or memory ran out.
+ */
+uint32_t batchListAdd(batchList_t *list, const char *input);
+
+/**
+ * Adds every line of a file list to the input list with batchListAdd(). Empty lines are skipped.
+ *
+ * @param list input list.
+ * @param listFilePtr file with one input per line.
+ * @return 1 on success, 0 if any line failed.
+ */
+uint32_t batchListAddFromFile(batchList_t *list, FILE *listFilePtr);
+
+/**
+ * Frees all paths held by the list.
+ *
+ * @param list input list.
+ */
+void batchListFree(batchList_t *list);
+
+/**
+ * Decodes every file in the list on a thread pool. A failed file is reported and does not stop the run.
+ *
+ * In search mode files are searched one after another and the candidates of each file are spread over the pool.
+ *
+ * @param list input list.
+ * @param options batch options.
+ * @param summary totals of the run, may be NULL.
+ * @return 1 if every file decoded, 0 otherwise.
+ */
+uint32_t runBatch(const batchList_t *list, const batchOptions_t *options, batchSummary_t *summary);
+
+#endif
@@ -0,0 +1,469 @@
+/** @file bench.c
+ *
+ * @brief Benchmarks loading and decoding of synthetic carrier bitmaps.
+ * @author Daniel Jaramillo
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "decodecontext.h"
+#include "decoder.h"
+#include "lsbkernels.h"
+
+#define DEFAULT_SIZES           "64K,1M,16M,256M"
+#define DEFAULT_BPP             "24,32,32bf"
+#define DEFAULT_PAYLOAD_SIZE    4096
+#define DEFAULT_REPETITIONS     3
+#define DEFAULT_DIRECTORY       "/tmp"
+#define PARSE_ITERATIONS        1000000
+
+/**
+ * One synthetic carrier of the sweep.
+ */
+typedef struct benchCase {
+    uint32_t width;
+    uint32_t height;
+    uint16_t bitsPerPixel;
+    uint32_t bitfields;         // 32 bit pixels described by BI_BITFIELDS masks following a BITMAPINFOHEADER
+    uint32_t padded;
+    uint64_t pixelBytes;
+} benchCase_t;
+
+/**
+ * Settings shared by all cases.
+ */
+typedef struct benchSettings {
+    const char *directory;
+    size_t payloadSize;
+    uint32_t repetitions;
+    uint32_t threadCount;
+    uint32_t keep;
+} benchSettings_t;
+
+/**
+ * Returns a monotonic time stamp in seconds.
+ *
+ * @return seconds since an arbitrary point.
+ */
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * Fast deterministic pseudo random generator for pixel data.
+ *
+ * @param state generator state, must not be 0.
+ * @return next 64 bit value.
+ */
+static uint64_t xorshift64(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Parses a size such as 64K, 16M or 2G.
+ *
+ * @param text size text.
+ * @return size in bytes, 0 if invalid.
+ */
+static uint64_t parseSize(const char *text) {
+    char *end;
+    uint64_t size = strtoull(text, &end, 10);
+    switch(*end) {
+        case 'k': case 'K': return size << 10;
+        case 'm': case 'M': return size << 20;
+        case 'g': case 'G': return size << 30;
+        case '\0': case ',': return size;
+        default: return 0;
+    }
+}
+
+/**
+ * Returns the item after the next comma of a comma separated list.
+ *
+ * @param item current item.
+ * @return next item, NULL at the end of the list.
+ */
+static const char *nextListItem(const char *item) {
+    const char *comma = strchr(item, ',');
+    return (comma != NULL && comma[1] != '\0') ? comma + 1 : NULL;
+}
+
+/**
+ * Picks dimensions of a roughly square bitmap with a pixel array of about the given size.
+ *
+ * Unpadded widths are a multiple of 4 pixels, padded widths are one more so every row needs padding.
+ *
+ * @param benchCase case to fill in, bitsPerPixel and padded must be set.
+ * @param size target pixel array size in bytes.
+ */
+static void setDimensions(benchCase_t *benchCase, uint64_t size) {
+    uint64_t bytesPerPixel = (benchCase->bitsPerPixel + 7) / 8;
+    uint64_t width = 4;
+    while((width + 4) * (width + 4) * bytesPerPixel <= size)
+        width += 4;
+    if(benchCase->padded)
+        width++;
+
+    uint64_t rowSize = ((benchCase->bitsPerPixel * width + 31) / 32) * 4;
+    uint64_t height = size / rowSize;
+    benchCase->width = (uint32_t) width;
+    benchCase->height = (uint32_t) (height ? height : 1);
+    benchCase->pixelBytes = rowSize * benchCase->height;
+}
+
+/**
+ * Writes a synthetic carrier of random pixels with a known payload embedded, one row at a time.
+ *
+ * @param path path of the file to write.
+ * @param benchCase dimensions and bit depth of the carrier.
+ * @param payload payload including end of string marker.
+ * @param length length of payload.
+ * @return 1 on success, 0 otherwise.
+ */
+static uint32_t writeCarrier(const char *path, const benchCase_t *benchCase, const uint8_t *payload, size_t length) {
+    bitmap_t bitmap;
+    memset(&bitmap, 0, sizeof(bitmap));
+    bitmap.bmpFileHeader.signature = BM;
+    bitmap.dibHeader.type = BITMAPINFOHEADER;
+    bitmap.dibHeader.header.bitMapInfoHeader.header_size = BITMAPINFOHEADER;
+    bitmap.dibHeader.header.bitMapInfoHeader.bitmap_width = benchCase->width;
+    bitmap.dibHeader.header.bitMapInfoHeader.bitmap_height = (int32_t) benchCase->height;
+    bitmap.dibHeader.header.bitMapInfoHeader.color_planes = 1;
+    bitmap.dibHeader.header.bitMapInfoHeader.bits_per_pixel = benchCase->bitsPerPixel;
+    bitmap.dibHeader.header.bitMapInfoHeader.compression_method = BI_RGB;
+    bitmap.dibHeader.header.bitMapInfoHeader.image_size =
+            benchCase->pixelBytes > UINT32_MAX ? 0 : (uint32_t) benchCase->pixelBytes;
+    if(benchCase->bitfields) {
+        // masks of the BI_RGB layout, written after the header
+        bitmap.dibHeader.header.bitMapInfoHeader.compression_method = BI_BITFIELDS;
+        bitmap.dibHeader.header.bitMapInfoHeader.red_mask = 0x00FF0000;
+        bitmap.dibHeader.header.bitMapInfoHeader.green_mask = 0x0000FF00;
+        bitmap.dibHeader.header.bitMapInfoHeader.blue_mask = 0x000000FF;
+    }
+    bitmap.bmpFileHeader.img_offset = BMPFILEHEADERSIZE + BITMAPINFOHEADER + getBitfieldMasksSize(&(bitmap.dibHeader));
+    // size fields are 32 bit, carriers past 4 GB store 0 like other writers do
+    uint64_t fileSize = bitmap.bmpFileHeader.img_offset + benchCase->pixelBytes;
+    bitmap.bmpFileHeader.file_size = fileSize > UINT32_MAX ? 0 : (uint32_t) fileSize;
+
+    FILE *carrierFilePtr = fopen(path, "wb");
+    if(carrierFilePtr == NULL)
+        return 0;
+    uint32_t success = writeBitmapHeaders(carrierFilePtr, &bitmap) != 0;
+
+    size_t rowSize = getRowSize(&(bitmap.dibHeader));
+    size_t pixelBytes = (size_t) benchCase->bitsPerPixel * benchCase->width / 8;
+    uint64_t bitCount = (uint64_t) length * 8;
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint8_t *row = malloc(rowSize + 8);
+    if(row == NULL)
+        success = 0;
+
+    for(uint32_t r = 0; success && r < benchCase->height; r++) {
+        for(size_t b = 0; b < rowSize; b += 8) {
+            uint64_t value = xorshift64(&state);
+            memcpy(row + b, &value, 8);
+        }
+        memset(row + pixelBytes, 0, rowSize - pixelBytes);
+
+        // embed the payload in the first rows, same layout as decodeMessage() reads, skipping the fourth byte of
+        // 32 bit pixels
+        uint64_t colorBytes = (uint64_t) benchCase->width * 3;
+        uint64_t firstBit = (uint64_t) r * colorBytes;
+        if(benchCase->bitsPerPixel == 24 && firstBit < bitCount)
+            embedLSBBitRange(row, bitCount - firstBit < pixelBytes ? bitCount - firstBit : pixelBytes, payload,
+                             firstBit);
+        for(uint32_t p = 0; benchCase->bitsPerPixel == 32 && p < benchCase->width; p++) {
+            uint64_t bit = firstBit + (uint64_t) p * 3;
+            if(bit >= bitCount)
+                break;
+            embedLSBBitRange(row + (size_t) p * 4, bitCount - bit < 3 ? bitCount - bit : 3, payload, bit);
+        }
+
+        success = fwrite(row, 1, rowSize, carrierFilePtr) == rowSize;
+    }
+    free(row);
+    if(fclose(carrierFilePtr) != 0)
+        success = 0;
+    return success;
+}
+
+/**
+ * Returns the peak resident set size of this process in kilobytes.
+ *
+ * @return peak RSS in kB.
+ */
+static long getPeakRSS(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * Prints one JSON result record.
+ *
+ * @param benchCase case measured.
+ * @param phase name of the measured function.
+ * @param seconds best time of one call.
+ * @param bytes bytes processed by one call.
+ * @param verified 1 if the decoded payload matched, 0 if not, -1 if not checked.
+ */
+static void printResult(const benchCase_t *benchCase, const char *phase, double seconds, uint64_t bytes,
+                        int verified) {
+    printf("{\"phase\":\"%s\",\"width\":%u,\"height\":%u,\"bpp\":%u,\"bitfields\":%s,\"padded\":%s,"
+           "\"pixel_bytes\":%llu,\"seconds\":%.9f,\"mb_per_s\":%.1f,\"ns_per_byte\":%.4f,\"peak_rss_kb\":%ld,"
+           "\"kernel\":\"%s\"",
+           phase, benchCase->width, benchCase->height, benchCase->bitsPerPixel,
+           benchCase->bitfields ? "true" : "false", benchCase->padded ? "true" : "false",
+           (unsigned long long) benchCase->pixelBytes, seconds, bytes / seconds / 1e6, seconds * 1e9 / bytes,
+           getPeakRSS(), packLSBBytesKernelName());
+    if(verified >= 0)
+        printf(",\"verified\":%s", verified ? "true" : "false");
+    printf("}\n");
+    fflush(stdout);
+}
+
+/**
+ * Runs every phase of one case. Called in a child process so peak RSS belongs to this case alone.
+ *
+ * @param path path of the carrier file.
+ * @param benchCase case to measure.
+ * @param settings benchmark settings.
+ * @param payload embedded payload.
+ * @return 0 on success, 1 otherwise.
+ */
+static int runCase(const char *path, const benchCase_t *benchCase, const benchSettings_t *settings,
+                   const uint8_t *payload) {
+    bitmap_t bitmap;
+    double best = 1e30;
+    uint8_t header[BITMAPINFOHEADER];
+
+    // parseDIBHeader() on the header bytes of the carrier
+    FILE *bitmapFilePtr = fopen(path, "rb");
+    if(bitmapFilePtr == NULL || fseek(bitmapFilePtr, BMPFILEHEADERSIZE + 4, SEEK_SET) != 0 ||
+            fread(header, 1, BITMAPINFOHEADER - 4, bitmapFilePtr) != BITMAPINFOHEADER - 4)
+        return 1;
+    fclose(bitmapFilePtr);
+    double start = now();
+    for(uint32_t i = 0; i < PARSE_ITERATIONS; i++) {
+        __asm__ volatile("" : : "r"(header) : "memory");
+        parseDIBHeader(header, BITMAPINFOHEADER - 4, &(bitmap.dibHeader));
+    }
+    printResult(benchCase, "parseDIBHeader", (now() - start) / PARSE_ITERATIONS, BITMAPINFOHEADER - 4, -1);
+
+    // readBitmapFile(), the last load is kept for the decode phases
+    for(uint32_t r = 0; r < settings->repetitions; r++) {
+        if(r > 0)
+            releaseBitmap(&bitmap);
+        bitmapFilePtr = fopen(path, "rb");
+        if(bitmapFilePtr == NULL)
+            return 1;
+        start = now();
+        uint32_t loaded = readBitmapFile(bitmapFilePtr, &bitmap);
+        double elapsed = now() - start;
+        fclose(bitmapFilePtr);
+        if(loaded != 1)
+            return 1;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    printResult(benchCase, "readBitmapFile", best, benchCase->pixelBytes, -1);
+
+    if(isDecodeable(&bitmap) == 1) {
+        // decodeMessage()
+        best = 1e30;
+        int verified = 1;
+        for(uint32_t r = 0; r < settings->repetitions; r++) {
+            start = now();
+            char *message = decodeMessage(&bitmap);
+            double elapsed = now() - start;
+            if(message == NULL)
+                return 1;
+            if(strcmp(message, (const char *) payload) != 0)
+                verified = 0;
+            free(message);
+            if(elapsed < best)
+                best = elapsed;
+        }
+        printResult(benchCase, "decodeMessage", best, benchCase->pixelBytes, verified);
+
+        // decodeMessageParallel()
+        best = 1e30;
+        verified = 1;
+        for(uint32_t r = 0; r < settings->repetitions; r++) {
+            start = now();
+            char *message = decodeMessageParallel(&bitmap, settings->threadCount);
+            double elapsed = now() - start;
+            if(message == NULL)
+                return 1;
+            if(strcmp(message, (const char *) payload) != 0)
+                verified = 0;
+            free(message);
+            if(elapsed < best)
+                best = elapsed;
+        }
+        printResult(benchCase, "decodeMessageParallel", best, benchCase->pixelBytes, verified);
+    }
+    releaseBitmap(&bitmap);
+
+    // mapBitmapFile() followed by decodeMessage(), which is when the mapped pages are read
+    if(mapBitmapFile(path, &bitmap) == 1) {
+        start = now();
+        char *message = isDecodeable(&bitmap) == 1 ? decodeMessage(&bitmap) : NULL;
+        double elapsed = now() - start;
+        if(message != NULL)
+            printResult(benchCase, "mapBitmapFile+decodeMessage", elapsed, benchCase->pixelBytes,
+                        strcmp(message, (const char *) payload) == 0);
+        free(message);
+        releaseBitmap(&bitmap);
+    }
+
+    // decodeContextReadFile() followed by decodeContextMessage() with one context, buffers are reused after the first
+    decodeContext_t context;
+    decodeContextInit(&context, NULL);
+    best = 1e30;
+    int verified = 1;
+    for(uint32_t r = 0; r < settings->repetitions; r++) {
+        const uint8_t *message;
+        uint64_t length;
+        bitmapFilePtr = fopen(path, "rb");
+        if(bitmapFilePtr == NULL)
+            break;
+        start = now();
+        uint32_t loaded = decodeContextReadFile(&context, bitmapFilePtr);
+        uint32_t result = loaded ? decodeContextMessage(&context, &message, &length) : DECODE_ERROR;
+        double elapsed = now() - start;
+        fclose(bitmapFilePtr);
+        if(result != DECODE_OK)
+            break;
+        if(strcmp((const char *) message, (const char *) payload) != 0)
+            verified = 0;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    if(best < 1e30)
+        printResult(benchCase, "decodeContext", best, benchCase->pixelBytes, verified);
+    decodeContextRelease(&context);
+    return 0;
+}
+
+/**
+ * Prints command line usage.
+ *
+ * @param program name of the program.
+ */
+static void printUsage(const char *program) {
+    printf("Usage: %s [options]\n"
+           "Writes synthetic carriers and prints one JSON record per measured phase.\n"
+           "\n"
+           "  -s, --sizes LIST       pixel array sizes, e.g. 64K,1M,4G (default " DEFAULT_SIZES ")\n"
+           "  -b, --bpp LIST         bit depths, 32bf for 32 bit BI_BITFIELDS (default " DEFAULT_BPP ")\n"
+           "  -p, --payload N        embedded payload size in bytes (default %d)\n"
+           "  -r, --reps N           repetitions per phase, best is reported (default %d)\n"
+           "  -j, --jobs N           threads for decodeMessageParallel(), default one per processor\n"
+           "  -d, --dir DIR          directory for carrier files (default " DEFAULT_DIRECTORY ")\n"
+           "  -k, --keep             keep carrier files\n"
+           "  -h, --help             print this help\n", program, DEFAULT_PAYLOAD_SIZE, DEFAULT_REPETITIONS);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"sizes",   required_argument, NULL, 's'},
+        {"bpp",     required_argument, NULL, 'b'},
+        {"payload", required_argument, NULL, 'p'},
+        {"reps",    required_argument, NULL, 'r'},
+        {"jobs",    required_argument, NULL, 'j'},
+        {"dir",     required_argument, NULL, 'd'},
+        {"keep",    no_argument,       NULL, 'k'},
+        {"help",    no_argument,       NULL, 'h'},
+        {NULL,      0,                 NULL, 0}
+    };
+    benchSettings_t settings = {DEFAULT_DIRECTORY, DEFAULT_PAYLOAD_SIZE, DEFAULT_REPETITIONS, 0, 0};
+    const char *sizes = DEFAULT_SIZES;
+    const char *depths = DEFAULT_BPP;
+    int opt;
+
+    while((opt = getopt_long(argc, argv, "s:b:p:r:j:d:kh", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 's': sizes = optarg; break;
+            case 'b': depths = optarg; break;
+            case 'p': settings.payloadSize = strtoull(optarg, NULL, 10); break;
+            case 'r': settings.repetitions = (uint32_t) strtoul(optarg, NULL, 10); break;
+            case 'j': settings.threadCount = (uint32_t) strtoul(optarg, NULL, 10); break;
+            case 'd': settings.directory = optarg; break;
+            case 'k': settings.keep = 1; break;
+            case 'h': printUsage(argv[0]); return 0;
+            default: printUsage(argv[0]); return -1;
+        }
+    }
+    if(settings.repetitions == 0)
+        settings.repetitions = 1;
+
+    // known printable payload with end of string marker
+    uint8_t *payload = malloc(settings.payloadSize + 1);
+    if(payload == NULL)
+        return -1;
+    for(size_t c = 0; c < settings.payloadSize; c++)
+        payload[c] = 'a' + c % 26;
+    payload[settings.payloadSize] = '\0';
+
+    int failures = 0;
+    for(const char *size = sizes; size != NULL; size = nextListItem(size)) {
+        for(const char *depth = depths; depth != NULL; depth = nextListItem(depth)) {
+            for(uint32_t padded = 0; padded <= 1; padded++) {
+                benchCase_t benchCase;
+                char *suffix;
+                benchCase.bitsPerPixel = (uint16_t) strtoul(depth, &suffix, 10);
+                benchCase.bitfields = benchCase.bitsPerPixel == 32 && strncmp(suffix, "bf", 2) == 0;
+                benchCase.padded = padded;
+                setDimensions(&benchCase, parseSize(size));
+
+                // payload must fit, capacity follows the rules of getMessageCapacity()
+                if((benchCase.pixelBytes / 8) <= settings.payloadSize) {
+                    fprintf(stderr, "Skipping %s: too small for payload.\n", size);
+                    continue;
+                }
+
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/bench_%ux%u_%u%s.bmp", settings.directory, benchCase.width,
+                         benchCase.height, benchCase.bitsPerPixel, benchCase.bitfields ? "bf" : "");
+                if(writeCarrier(path, &benchCase, payload, settings.payloadSize + 1) != 1) {
+                    fprintf(stderr, "Error: Unable to write %s.\n", path);
+                    failures++;
+                    continue;
+                }
+
+                // measure in a child so peak RSS is per case
+                pid_t child = fork();
+                if(child == 0)
+                    _exit(runCase(path, &benchCase, &settings, payload));
+                int status = 1;
+                if(child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+                        WEXITSTATUS(status) != 0) {
+                    fprintf(stderr, "Error: Benchmark of %s failed.\n", path);
+                    failures++;
+                }
+                if(!settings.keep)
+                    unlink(path);
+            }
+        }
+    }
+
+    free(payload);
+    return failures == 0 ? 0 : -1;
+}
+/*** end of file ***/
@@ -4,7 +4,14 @@
  * @author Daniel Jaramillo
  */
 
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "bitmap.h"
+#include "stats.h"
 
 /**
  * Reads the bitmap file header and parses it to a bmpFileHeader struct.
@@ -21,28 +28,41 @@ uint32_t readBMPFileHeader(FILE *bitmapFilePtr, bmpFileHeader_t *bmpFileHeader)
 
     size_t count = fread(&buffer, 1, BMPFILEHEADERSIZE + 4, bitmapFilePtr);
     if(count != (BMPFILEHEADERSIZE + 4))
-        return -1;
+        return 0;
 
     return parseBMPFileHeader((const uint8_t *) &buffer, bmpFileHeader);
 }
 
 /**
- * Parses the block of memory containing bitmap file header into bitmap file header struct.
+ * Reads the DIB header, bitmap information header, to a dibHeader struct.
  *
- * The first 4 bytes of the DIB header are read by readBMPFileHeader() to determine type of header.
+ * The first 4 bytes of the DIB header are read by readBMPFileHeader() to determine type of header. The BI_BITFIELDS
+ * masks following a BITMAPINFOHEADER are read with it, so the file is left positioned after them.
  *
- * @param buffer block of memory containing bitmap file header.
- * @param bmpFileHeader bitmap file header struct.
- * @return size of BMP file header on success, 0 otherwise.
+ * @param bitmapFilePtr FILE pointer for bitmap file.
+ * @param dibHeaderSize size of DIB header.
+ * @param dibHeader dib header struct.
+ * @return 1 on success, 0 otherwise.
  */
 uint32_t readDIBHeader(FILE *bitmapFilePtr, uint32_t dibHeaderSize, dibHeader_t *dibHeader) {
+    // size comes from the file, bound it before using it for the buffer
+    if(dibHeaderSize < BITMAPCOREHEADER || dibHeaderSize > BITMAPV5HEADER)
+        return 0;
     uint8_t buffer[dibHeaderSize - 4];
 
     size_t count = fread(&buffer, 1, dibHeaderSize - 4, bitmapFilePtr);
     if(count != (dibHeaderSize - 4))
-        return -1;
+        return 0;
+
+    if(parseDIBHeader(buffer, dibHeaderSize - 4, dibHeader) == 0)
+        return 0;
 
-    return parseDIBHeader(buffer, dibHeaderSize - 4, dibHeader);
+    // masks of a BITMAPINFOHEADER follow it
+    uint8_t masks[BITFIELDSMASKSSIZE];
+    uint32_t masksSize = getBitfieldMasksSize(dibHeader);
+    if(masksSize != 0 && fread(masks, 1, masksSize, bitmapFilePtr) != masksSize)
+        return 0;
+    return parseBitfieldMasks(masks, masksSize, dibHeader);
 }
 
 /**
@@ -66,7 +86,7 @@ uint32_t parseBMPFileHeader(const uint8_t *buffer, bmpFileHeader_t *bmpFileHeade
             ((uint32_t)buffer[13] << 24) | ((uint32_t)buffer[12] << 16) | ((uint16_t)buffer[11] << 8) | buffer[10];
 
     // retrieve bitmap information header size
-    return ((uint32_t)buffer[17]) | ((uint32_t)buffer[16]) | ((uint16_t)buffer[15]) | buffer[14];
+    return ((uint32_t)buffer[17] << 24) | ((uint32_t)buffer[16] << 16) | ((uint16_t)buffer[15] << 8) | buffer[14];
 }
 
 /**
@@ -99,8 +119,8 @@ uint32_t parseBITMAPINFOHEADER(const uint8_t *buffer, dibHeader_t *dibHeader) {
     dibHeader->header.bitMapInfoHeader.header_size = BITMAPINFOHEADER;
     dibHeader->header.bitMapInfoHeader.bitmap_width =
             ((uint32_t)buffer[3] << 24) |((uint32_t)buffer[2] << 16) | ((uint16_t)buffer[1] << 8) | buffer[0];
-    dibHeader->header.bitMapInfoHeader.bitmap_height =
-            ((uint32_t)buffer[7] << 24) |((uint32_t)buffer[6] << 16) | ((uint16_t)buffer[5] << 8) | buffer[4];
+    dibHeader->header.bitMapInfoHeader.bitmap_height = (int32_t)
+            (((uint32_t)buffer[7] << 24) |((uint32_t)buffer[6] << 16) | ((uint16_t)buffer[5] << 8) | buffer[4]);
     dibHeader->header.bitMapInfoHeader.color_planes =
             ((uint16_t)buffer[9] << 8) | buffer[8];
     dibHeader->header.bitMapInfoHeader.bits_per_pixel =
@@ -117,6 +137,83 @@ uint32_t parseBITMAPINFOHEADER(const uint8_t *buffer, dibHeader_t *dibHeader) {
             ((uint32_t)buffer[31] << 24) |((uint32_t)buffer[30] << 16) | ((uint16_t)buffer[29] << 8) | buffer[28];
     dibHeader->header.bitMapInfoHeader.important_colors =
             ((uint32_t)buffer[35] << 24) |((uint32_t)buffer[34] << 16) | ((uint16_t)buffer[33] << 8) | buffer[32];
+    dibHeader->header.bitMapInfoHeader.red_mask = 0;
+    dibHeader->header.bitMapInfoHeader.green_mask = 0;
+    dibHeader->header.bitMapInfoHeader.blue_mask = 0;
+
+    return 1;
+}
+
+/**
+ * Loads a 32 bit value stored little endian.
+ *
+ * @param buffer source.
+ * @return loaded value.
+ */
+static uint32_t loadUint32(const uint8_t *buffer) {
+    return ((uint32_t)buffer[3] << 24) | ((uint32_t)buffer[2] << 16) | ((uint16_t)buffer[1] << 8) | buffer[0];
+}
+
+/**
+ * Parses DIB header, bitmap information header, of BITMAPV4HEADER format.
+ *
+ * The first 36 bytes have the BITMAPINFOHEADER layout and are parsed by parseBITMAPINFOHEADER().
+ *
+ * @param buffer block of memory containing bitmap header, dib header.
+ * @param dibHeader struct to hold bitmap header, dib header.
+ * @return 1 on success, 0 on failure.
+ */
+uint32_t parseBITMAPV4HEADER(const uint8_t *buffer, dibHeader_t *dibHeader) {
+    bitMapInfoHeader_t infoHeader;
+    parseBITMAPINFOHEADER(buffer, dibHeader);
+    infoHeader = dibHeader->header.bitMapInfoHeader;
+
+    bitMapV5Header_t *v5Header = &(dibHeader->header.bitMapV5Header);
+    memset(v5Header, 0, sizeof(bitMapV5Header_t));
+    dibHeader->type = BITMAPV4HEADER;
+    v5Header->header_size = BITMAPV4HEADER;
+    v5Header->bitmap_width = infoHeader.bitmap_width;
+    v5Header->bitmap_height = infoHeader.bitmap_height;
+    v5Header->color_planes = infoHeader.color_planes;
+    v5Header->bits_per_pixel = infoHeader.bits_per_pixel;
+    v5Header->compression_method = infoHeader.compression_method;
+    v5Header->image_size = infoHeader.image_size;
+    v5Header->horizontal_res = infoHeader.horizontal_res;
+    v5Header->vertical_res = infoHeader.vertical_res;
+    v5Header->color_palette = infoHeader.color_palette;
+    v5Header->important_colors = infoHeader.important_colors;
+    v5Header->red_mask = loadUint32(buffer + 36);
+    v5Header->green_mask = loadUint32(buffer + 40);
+    v5Header->blue_mask = loadUint32(buffer + 44);
+    v5Header->alpha_mask = loadUint32(buffer + 48);
+    v5Header->color_space_type = loadUint32(buffer + 52);
+    memcpy(v5Header->endpoints, buffer + 56, sizeof(v5Header->endpoints));
+    v5Header->gamma_red = loadUint32(buffer + 92);
+    v5Header->gamma_green = loadUint32(buffer + 96);
+    v5Header->gamma_blue = loadUint32(buffer + 100);
+
+    return 1;
+}
+
+/**
+ * Parses DIB header, bitmap information header, of BITMAPV5HEADER format.
+ *
+ * The first 104 bytes have the BITMAPV4HEADER layout and are parsed by parseBITMAPV4HEADER().
+ *
+ * @param buffer block of memory containing bitmap header, dib header.
+ * @param dibHeader struct to hold bitmap header, dib header.
+ * @return 1 on success, 0 on failure.
+ */
+uint32_t parseBITMAPV5HEADER(const uint8_t *buffer, dibHeader_t *dibHeader) {
+    parseBITMAPV4HEADER(buffer, dibHeader);
+
+    bitMapV5Header_t *v5Header = &(dibHeader->header.bitMapV5Header);
+    dibHeader->type = BITMAPV5HEADER;
+    v5Header->header_size = BITMAPV5HEADER;
+    v5Header->intent = loadUint32(buffer + 104);
+    v5Header->profile_data = loadUint32(buffer + 108);
+    v5Header->profile_size = loadUint32(buffer + 112);
+    v5Header->reserved = loadUint32(buffer + 116);
 
     return 1;
 }
@@ -139,72 +236,635 @@ uint32_t parseDIBHeader(const uint8_t *buffer, uint32_t dibHeaderSize, dibHeader
         case BITMAPINFOHEADER:
             return parseBITMAPINFOHEADER(buffer, dibHeader);
 
+        case BITMAPV4HEADER:
+            return parseBITMAPV4HEADER(buffer, dibHeader);
+
+        case BITMAPV5HEADER:
+            return parseBITMAPV5HEADER(buffer, dibHeader);
+
+        case OS22XBITMAPHEADER:
+        case OS22XBITMAPHEADER_S:
+        case BITMAPV2INFOHEADER:
+        case BITMAPV3INFOHEADER:
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Returns the size of the channel masks stored after the DIB header.
+ *
+ * A BITMAPINFOHEADER with BI_BITFIELDS compression is followed by three DWORD masks for red, green and blue. Later
+ * headers hold their masks inside the header.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return BITFIELDSMASKSSIZE or 0.
+ */
+uint32_t getBitfieldMasksSize(const dibHeader_t *dibHeader) {
+    if(dibHeader->type == BITMAPINFOHEADER && dibHeader->header.bitMapInfoHeader.compression_method == BI_BITFIELDS)
+        return BITFIELDSMASKSSIZE;
+    return 0;
+}
+
+/**
+ * Parses the channel masks stored after a BITMAPINFOHEADER with BI_BITFIELDS compression into the DIB header.
+ *
+ * @param buffer block of memory following the DIB header.
+ * @param size number of bytes in the block.
+ * @param dibHeader parsed DIB header, receives the masks.
+ * @return 1 on success or if the DIB header has no masks after it, 0 if the block is too short.
+ */
+uint32_t parseBitfieldMasks(const uint8_t *buffer, size_t size, dibHeader_t *dibHeader) {
+    uint32_t masksSize = getBitfieldMasksSize(dibHeader);
+    if(masksSize == 0)
+        return 1;
+    if(size < masksSize)
+        return 0;
+
+    dibHeader->header.bitMapInfoHeader.red_mask = loadUint32(buffer);
+    dibHeader->header.bitMapInfoHeader.green_mask = loadUint32(buffer + 4);
+    dibHeader->header.bitMapInfoHeader.blue_mask = loadUint32(buffer + 8);
+    return 1;
+}
+
+/**
+ * Stores a 16 bit value little endian.
+ *
+ * @param buffer destination.
+ * @param value value to store.
+ */
+static void storeUint16(uint8_t *buffer, uint16_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+/**
+ * Stores a 32 bit value little endian.
+ *
+ * @param buffer destination.
+ * @param value value to store.
+ */
+static void storeUint32(uint8_t *buffer, uint32_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = value >> 24;
+}
+
+/**
+ * Serializes a bitmap file header struct into the block of memory written to the file.
+ *
+ * Inverse of parseBMPFileHeader(), without the DIB header size.
+ *
+ * @param bmpFileHeader bitmap file header struct.
+ * @param buffer destination, at least BMPFILEHEADERSIZE bytes long.
+ * @return size of BMP file header.
+ */
+uint32_t serializeBMPFileHeader(const bmpFileHeader_t *bmpFileHeader, uint8_t *buffer) {
+    buffer[0] = bmpFileHeader->signature >> 8;
+    buffer[1] = bmpFileHeader->signature & 0xFF;
+    storeUint32(buffer + 2, bmpFileHeader->file_size);
+    storeUint16(buffer + 6, bmpFileHeader->rsv0);
+    storeUint16(buffer + 8, bmpFileHeader->rsv1);
+    storeUint32(buffer + 10, bmpFileHeader->img_offset);
+
+    return BMPFILEHEADERSIZE;
+}
+
+/**
+ * Serializes a DIB header struct into the block of memory written to the file, including its size field and the
+ * BI_BITFIELDS masks following a BITMAPINFOHEADER.
+ *
+ * @param dibHeader dib header struct.
+ * @param buffer destination, at least as long as the DIB header and its masks.
+ * @return size of DIB header and masks on success, 0 if the DIB header type is not supported.
+ */
+uint32_t serializeDIBHeader(const dibHeader_t *dibHeader, uint8_t *buffer) {
+    switch(dibHeader->type) {
+        case BITMAPCOREHEADER:
+            storeUint32(buffer, BITMAPCOREHEADER);
+            storeUint16(buffer + 4, dibHeader->header.bitMapCoreHeader.bitmap_width);
+            storeUint16(buffer + 6, dibHeader->header.bitMapCoreHeader.bitmap_height);
+            storeUint16(buffer + 8, dibHeader->header.bitMapCoreHeader.color_planes);
+            storeUint16(buffer + 10, dibHeader->header.bitMapCoreHeader.bits_per_pixel);
+            return BITMAPCOREHEADER;
+
+        case BITMAPINFOHEADER:
+            storeUint32(buffer, BITMAPINFOHEADER);
+            storeUint32(buffer + 4, dibHeader->header.bitMapInfoHeader.bitmap_width);
+            storeUint32(buffer + 8, (uint32_t) dibHeader->header.bitMapInfoHeader.bitmap_height);
+            storeUint16(buffer + 12, dibHeader->header.bitMapInfoHeader.color_planes);
+            storeUint16(buffer + 14, dibHeader->header.bitMapInfoHeader.bits_per_pixel);
+            storeUint32(buffer + 16, dibHeader->header.bitMapInfoHeader.compression_method);
+            storeUint32(buffer + 20, dibHeader->header.bitMapInfoHeader.image_size);
+            storeUint32(buffer + 24, dibHeader->header.bitMapInfoHeader.horizontal_res);
+            storeUint32(buffer + 28, dibHeader->header.bitMapInfoHeader.vertical_res);
+            storeUint32(buffer + 32, dibHeader->header.bitMapInfoHeader.color_palette);
+            storeUint32(buffer + 36, dibHeader->header.bitMapInfoHeader.important_colors);
+            if(getBitfieldMasksSize(dibHeader) == 0)
+                return BITMAPINFOHEADER;
+            storeUint32(buffer + 40, dibHeader->header.bitMapInfoHeader.red_mask);
+            storeUint32(buffer + 44, dibHeader->header.bitMapInfoHeader.green_mask);
+            storeUint32(buffer + 48, dibHeader->header.bitMapInfoHeader.blue_mask);
+            return BITMAPINFOHEADER + BITFIELDSMASKSSIZE;
+
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER: {
+            const bitMapV5Header_t *v5Header = &(dibHeader->header.bitMapV5Header);
+            storeUint32(buffer, dibHeader->type);
+            storeUint32(buffer + 4, v5Header->bitmap_width);
+            storeUint32(buffer + 8, (uint32_t) v5Header->bitmap_height);
+            storeUint16(buffer + 12, v5Header->color_planes);
+            storeUint16(buffer + 14, v5Header->bits_per_pixel);
+            storeUint32(buffer + 16, v5Header->compression_method);
+            storeUint32(buffer + 20, v5Header->image_size);
+            storeUint32(buffer + 24, v5Header->horizontal_res);
+            storeUint32(buffer + 28, v5Header->vertical_res);
+            storeUint32(buffer + 32, v5Header->color_palette);
+            storeUint32(buffer + 36, v5Header->important_colors);
+            storeUint32(buffer + 40, v5Header->red_mask);
+            storeUint32(buffer + 44, v5Header->green_mask);
+            storeUint32(buffer + 48, v5Header->blue_mask);
+            storeUint32(buffer + 52, v5Header->alpha_mask);
+            storeUint32(buffer + 56, v5Header->color_space_type);
+            memcpy(buffer + 60, v5Header->endpoints, sizeof(v5Header->endpoints));
+            storeUint32(buffer + 96, v5Header->gamma_red);
+            storeUint32(buffer + 100, v5Header->gamma_green);
+            storeUint32(buffer + 104, v5Header->gamma_blue);
+            if(dibHeader->type == BITMAPV5HEADER) {
+                storeUint32(buffer + 108, v5Header->intent);
+                storeUint32(buffer + 112, v5Header->profile_data);
+                storeUint32(buffer + 116, v5Header->profile_size);
+                storeUint32(buffer + 120, v5Header->reserved);
+            }
+            return dibHeader->type;
+        }
+
         case OS22XBITMAPHEADER:
         case OS22XBITMAPHEADER_S:
         case BITMAPV2INFOHEADER:
         case BITMAPV3INFOHEADER:
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Writes the bitmap file header and DIB header, then pads with zeros up to the pixel array offset.
+ *
+ * @param bitmapFilePtr FILE pointer for bitmap file being written.
+ * @param bitmap bitmap whose headers are written.
+ * @return number of bytes written on success, 0 otherwise.
+ */
+uint32_t writeBitmapHeaders(FILE *bitmapFilePtr, const bitmap_t *bitmap) {
+    uint8_t buffer[BMPFILEHEADERSIZE + BITMAPV5HEADER] = {0};
+
+    uint32_t size = serializeBMPFileHeader(&(bitmap->bmpFileHeader), buffer);
+    uint32_t dibHeaderSize = serializeDIBHeader(&(bitmap->dibHeader), buffer + size);
+    if(dibHeaderSize == 0 || bitmap->bmpFileHeader.img_offset < size + dibHeaderSize)
+        return 0;
+    size += dibHeaderSize;
+    if(fwrite(buffer, 1, size, bitmapFilePtr) != size)
+        return 0;
+
+    // color table is not read, so the gap before the pixel array is written as zeros
+    uint8_t zero[256] = {0};
+    while(size < bitmap->bmpFileHeader.img_offset) {
+        uint32_t step = bitmap->bmpFileHeader.img_offset - size;
+        if(step > sizeof(zero))
+            step = sizeof(zero);
+        if(fwrite(zero, 1, step, bitmapFilePtr) != step)
+            return 0;
+        size += step;
+    }
+    return size;
+}
+
+/**
+ * Returns the width of the bitmap in pixels.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return width in pixels, 0 if the DIB header type is not supported.
+ */
+uint32_t getBitmapWidth(const dibHeader_t *dibHeader) {
+    switch(dibHeader->type) {
+        case BITMAPCOREHEADER:
+            return dibHeader->header.bitMapCoreHeader.bitmap_width;
+
+        case BITMAPINFOHEADER:
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER:
+            return dibHeader->header.bitMapInfoHeader.bitmap_width;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Returns the height of the bitmap in pixels.
+ *
+ * The sign of a BITMAPINFOHEADER, BITMAPV4HEADER or BITMAPV5HEADER height only gives the row order, see isTopDown().
+ *
+ * @param dibHeader parsed DIB header.
+ * @return height in pixels, 0 if the DIB header type is not supported.
+ */
+uint32_t getBitmapHeight(const dibHeader_t *dibHeader) {
+    switch(dibHeader->type) {
+        case BITMAPCOREHEADER:
+            return dibHeader->header.bitMapCoreHeader.bitmap_height;
+
+        case BITMAPINFOHEADER:
         case BITMAPV4HEADER:
         case BITMAPV5HEADER:
+            if(dibHeader->header.bitMapInfoHeader.bitmap_height < 0)
+                return -(int64_t) dibHeader->header.bitMapInfoHeader.bitmap_height;
+            return dibHeader->header.bitMapInfoHeader.bitmap_height;
+
         default:
-            printf("Bitmap format with header size %u not yet supported.\n", dibHeaderSize + 4);
-            return -1;
+            return 0;
     }
 }
 
+/**
+ * Returns 1 if rows are stored top row first, which BITMAPINFOHEADER and later headers mark with a negative height.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return 1 if top-down, 0 if bottom-up.
+ */
+uint32_t isTopDown(const dibHeader_t *dibHeader) {
+    switch(dibHeader->type) {
+        case BITMAPINFOHEADER:
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER:
+            return dibHeader->header.bitMapInfoHeader.bitmap_height < 0;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Returns the number of bits per pixel of the bitmap.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return bits per pixel, 0 if the DIB header type is not supported.
+ */
+uint16_t getBitsPerPixel(const dibHeader_t *dibHeader) {
+    switch(dibHeader->type) {
+        case BITMAPCOREHEADER:
+            return dibHeader->header.bitMapCoreHeader.bits_per_pixel;
+
+        case BITMAPINFOHEADER:
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER:
+            return dibHeader->header.bitMapInfoHeader.bits_per_pixel;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Returns the index of the byte a channel mask selects, or 4 if the mask is not exactly one whole byte.
+ *
+ * @param mask channel mask from the DIB header.
+ * @return byte index within a little endian pixel, 4 if not byte aligned.
+ */
+static uint32_t getMaskByte(uint32_t mask) {
+    for(uint32_t b = 0; b < 4; b++) {
+        if(mask == (0xFFu << (8 * b)))
+            return b;
+    }
+    return 4;
+}
+
+/**
+ * Describes where the color channels are stored in each pixel.
+ *
+ * 24 bit pixels and 32 bit BI_RGB pixels store blue, green and red in bytes 0 to 2, the fourth byte of a 32 bit pixel
+ * is unused. 32 bit BI_BITFIELDS pixels are supported when each color mask selects a different whole byte, the
+ * remaining byte is alpha or unused. The masks of a BITMAPINFOHEADER follow it in the file and are parsed to the same
+ * offsets as those of a BITMAPV4HEADER or BITMAPV5HEADER.
+ *
+ * @param dibHeader parsed DIB header.
+ * @param format pixel layout.
+ * @return 1 for uncompressed 24 and 32 bit pixels with one byte per channel, 0 otherwise.
+ */
+uint32_t getPixelFormat(const dibHeader_t *dibHeader, pixelFormat_t *format) {
+    uint32_t compression = BI_RGB;
+    if(dibHeader->type == BITMAPINFOHEADER || dibHeader->type == BITMAPV4HEADER || dibHeader->type == BITMAPV5HEADER)
+        compression = dibHeader->header.bitMapInfoHeader.compression_method;
+    else if(dibHeader->type != BITMAPCOREHEADER)
+        return 0;
+
+    format->bytes_per_pixel = getBitsPerPixel(dibHeader) / 8;
+    format->blue_byte = 0;
+    format->green_byte = 1;
+    format->red_byte = 2;
+    switch(getBitsPerPixel(dibHeader)) {
+        case 24:
+            return compression == BI_RGB;
+
+        case 32:
+            if(compression == BI_RGB)
+                return dibHeader->type != BITMAPCOREHEADER;
+            if(compression != BI_BITFIELDS)
+                return 0;
+
+            format->blue_byte = getMaskByte(dibHeader->header.bitMapInfoHeader.blue_mask);
+            format->green_byte = getMaskByte(dibHeader->header.bitMapInfoHeader.green_mask);
+            format->red_byte = getMaskByte(dibHeader->header.bitMapInfoHeader.red_mask);
+            return format->blue_byte < 4 && format->green_byte < 4 && format->red_byte < 4 &&
+                    format->blue_byte != format->green_byte && format->blue_byte != format->red_byte &&
+                    format->green_byte != format->red_byte;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Calculates the size in bytes of one row of the pixel array. Each row is padded to a multiple of 4 bytes.
+ *
+ * Computed in 64 bits, which cannot overflow for any 32 bit width and 16 bit depth.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return size of a row including padding, 0 if the DIB header type is not supported.
+ */
+uint64_t getRowSize(const dibHeader_t *dibHeader) {
+    return (((uint64_t) getBitsPerPixel(dibHeader) * getBitmapWidth(dibHeader) + 31) / 32) * 4;
+}
+
+/**
+ * Calculates the size in bytes of the pixel array, including row padding.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return size of pixel array, 0 if the DIB header type is not supported or the size does not fit in 64 bits.
+ */
+uint64_t getPixelArraySize(const dibHeader_t *dibHeader) {
+    uint64_t size;
+    if(__builtin_mul_overflow(getRowSize(dibHeader), (uint64_t) getBitmapHeight(dibHeader), &size))
+        return 0;
+    return size;
+}
+
+/**
+ * Checks that the pixel array described by the headers can be addressed and lies completely inside the file.
+ *
+ * Sizes come from the file, so every step is overflow checked. Headers claiming dimensions larger than the file are
+ * rejected before anything is allocated or mapped.
+ *
+ * @param bitmap bitmap with parsed headers.
+ * @param fileSize size of the bitmap file in bytes.
+ * @return 1 if the pixel array fits, 0 otherwise.
+ */
+uint32_t checkPixelArrayBounds(const bitmap_t *bitmap, uint64_t fileSize) {
+    uint64_t size = getPixelArraySize(&(bitmap->dibHeader));
+    uint64_t end;
+    if(size == 0 || size > SIZE_MAX ||
+            __builtin_add_overflow((uint64_t) bitmap->bmpFileHeader.img_offset, size, &end))
+        return 0;
+    return end <= fileSize;
+}
+
+/**
+ * Describes the rows of a bitmap's pixel array in decode order.
+ *
+ * Rows are visited from the bottom of the image up, which is storage order for bottom-up bitmaps. For top-down
+ * bitmaps the walk starts at the last stored row with a negative stride. Padding is skipped by only using row_bytes
+ * of each row, so no row is ever copied.
+ *
+ * @param bitmap bitmap in memory.
+ * @param rows row description.
+ * @return 1 on success, 0 if the DIB header type is not supported.
+ */
+uint32_t getBitmapRows(const bitmap_t *bitmap, bitmapRows_t *rows) {
+    uint64_t rowSize = getRowSize(&(bitmap->dibHeader));
+    if(rowSize == 0 || getPixelArraySize(&(bitmap->dibHeader)) == 0 ||
+            getPixelArraySize(&(bitmap->dibHeader)) > SIZE_MAX)
+        return 0;
+
+    rows->row_count = getBitmapHeight(&(bitmap->dibHeader));
+    rows->row_pixels = getBitmapWidth(&(bitmap->dibHeader));
+    rows->row_bytes = ((size_t) getBitsPerPixel(&(bitmap->dibHeader)) * getBitmapWidth(&(bitmap->dibHeader))) / 8;
+    if(isTopDown(&(bitmap->dibHeader)) && rows->row_count > 0) {
+        rows->first = bitmap->pixel_array + (size_t) ((rows->row_count - 1) * rowSize);
+        rows->stride = -(ptrdiff_t) rowSize;
+    } else {
+        rows->first = bitmap->pixel_array;
+        rows->stride = (ptrdiff_t) rowSize;
+    }
+    return 1;
+}
+
+/**
+ * Returns a pointer to a row of the pixel array in decode order.
+ *
+ * @param rows row description.
+ * @param row index of row, 0 is the bottom row of the image.
+ * @return pointer to the first pixel byte of the row.
+ */
+const uint8_t *getRow(const bitmapRows_t *rows, uint32_t row) {
+    return rows->first + (ptrdiff_t) row * rows->stride;
+}
+
 /**
  * Reads the bitmap file and parses it into structs in memory.
  *
- * Calls readBMPFileHeader() and readDIBHeader to parse bitmap file header and dib header.
+ * Calls readBitmapFileInto() with a new pixel buffer, which the bitmap owns.
  *
  * @param bitmapFilePtr file pointer to the bitmap file being read.
  * @param bitmap struct containing bitmap in memory.
  * @return 1 on success, 0 on error.
  */
 uint32_t readBitmapFile(FILE *bitmapFilePtr, bitmap_t *bitmap) {
-    // read file header
-    uint32_t dibHeaderType = readBMPFileHeader(bitmapFilePtr, &(bitmap->bmpFileHeader));
-    if(dibHeaderType == 0) {
+    uint8_t *buffer = NULL;
+    size_t capacity = 0;
+
+    if(readBitmapFileInto(bitmapFilePtr, bitmap, &buffer, &capacity) == 0) {
+        free(buffer);
         return 0;
     }
+    return 1;
+}
+
+/**
+ * Reads the bitmap file and parses it into structs in memory, reading the pixel array into a buffer of the caller.
+ *
+ * Calls readBMPFileHeader() and readDIBHeader to parse bitmap file header and dib header. The buffer is only
+ * replaced when the pixel array does not fit, so reading many files of similar size allocates nothing after the
+ * first. The bitmap borrows the buffer and must not be released with releaseBitmap().
+ *
+ * @param bitmapFilePtr file pointer to the bitmap file being read.
+ * @param bitmap struct containing bitmap in memory.
+ * @param buffer pixel buffer, NULL for none yet. Replaced by a larger one when too small, owned by the caller.
+ * @param capacity size of the pixel buffer, updated when it is replaced.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t readBitmapFileInto(FILE *bitmapFilePtr, bitmap_t *bitmap, uint8_t **buffer, size_t *capacity) {
+    bitmap->pixel_array = NULL;
+    bitmap->color_table = NULL;
+    bitmap->file_mapping = NULL;
+    bitmap->file_mapping_size = 0;
 
-    // read dib header
-    uint32_t error = readDIBHeader(bitmapFilePtr, dibHeaderType, &(bitmap->dibHeader));
+    // read file header and dib header
+    STATS_START(headerTimer);
+    uint32_t dibHeaderType = readBMPFileHeader(bitmapFilePtr, &(bitmap->bmpFileHeader));
+    uint32_t error = dibHeaderType != 0 && readDIBHeader(bitmapFilePtr, dibHeaderType, &(bitmap->dibHeader)) != 0;
+    STATS_STOP(headerTimer, STATS_HEADERS, (uint64_t) BMPFILEHEADERSIZE + dibHeaderType);
     if(error == 0)
         return 0;
 
     // calculate space for pixel_array
-    uint32_t pixel_array_size;
-    switch(bitmap->dibHeader.type) {
-        case BITMAPCOREHEADER:
-            pixel_array_size  = ((bitmap->dibHeader.header.bitMapCoreHeader.bits_per_pixel *
-                    bitmap->dibHeader.header.bitMapCoreHeader.bitmap_width + 31) / 32) * 4 *
-                    bitmap->dibHeader.header.bitMapCoreHeader.bitmap_height;
-            break;
+    uint64_t pixel_array_size = getPixelArraySize(&(bitmap->dibHeader));
+    if(getRowSize(&(bitmap->dibHeader)) == 0)
+        return 0;
 
-        case BITMAPINFOHEADER:
-            pixel_array_size  = ((bitmap->dibHeader.header.bitMapInfoHeader.bits_per_pixel *
-                    bitmap->dibHeader.header.bitMapInfoHeader.bitmap_width + 31) / 32) * 4 *
-                    bitmap->dibHeader.header.bitMapInfoHeader.bitmap_height;
-            break;
+    // reject sizes that overflow or that a regular file is too short to hold, before allocating
+    struct stat fileStat;
+    uint64_t fileSize = UINT64_MAX;
+    if(fstat(fileno(bitmapFilePtr), &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+        fileSize = (uint64_t) fileStat.st_size;
+    if(checkPixelArrayBounds(bitmap, fileSize) == 0)
+        return 0;
 
-        case OS22XBITMAPHEADER:
-        case OS22XBITMAPHEADER_S:
-        case BITMAPV2INFOHEADER:
-        case BITMAPV3INFOHEADER:
-        case BITMAPV4HEADER:
-        case BITMAPV5HEADER:
-        default:
-            printf("Bitmap format with header size %u not yet supported.\n", bitmap->dibHeader.type);
+    // replace the buffer if the pixel array does not fit, its old contents are not needed
+    if(*buffer == NULL || pixel_array_size > *capacity) {
+        free(*buffer);
+        *capacity = 0;
+        *buffer = malloc((size_t) pixel_array_size);
+        if(*buffer == NULL)
             return 0;
+        *capacity = (size_t) pixel_array_size;
     }
 
-    // allocate space for pixel array
-    bitmap->pixel_array = malloc(pixel_array_size);
-
     // move to offset of array
+    STATS_START(pixelTimer);
     fseek(bitmapFilePtr, bitmap->bmpFileHeader.img_offset, SEEK_SET);
-    fread(bitmap->pixel_array, 1, pixel_array_size, bitmapFilePtr);
+    error = fread(*buffer, 1, (size_t) pixel_array_size, bitmapFilePtr) == pixel_array_size;
+    STATS_STOP(pixelTimer, STATS_PIXELS, pixel_array_size);
+    if(error == 0)
+        return 0;
+
+    bitmap->pixel_array = *buffer;
+    return 1;
+}
+
+/**
+ * Parses a bitmap file held in memory, without copying its pixel array.
+ *
+ * Headers are parsed in place with parseBMPFileHeader() and parseDIBHeader(). Header and pixel array bounds are
+ * checked against the size of the data, so truncated data is rejected instead of read past. The bitmap borrows the
+ * data, its pixel array must not be written to and it must not be released with releaseBitmap().
+ *
+ * @param data bitmap file bytes.
+ * @param size number of bytes.
+ * @param bitmap struct containing bitmap in memory.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t parseBitmapMemory(const uint8_t *data, size_t size, bitmap_t *bitmap) {
+    bitmap->pixel_array = NULL;
+    bitmap->color_table = NULL;
+    bitmap->file_mapping = NULL;
+    bitmap->file_mapping_size = 0;
+    if(size < BMPFILEHEADERSIZE + 4)
+        return 0;
+
+    // parse file header and dib header in place
+    uint32_t dibHeaderSize = parseBMPFileHeader(data, &(bitmap->bmpFileHeader));
+    if(dibHeaderSize < 4 || dibHeaderSize > size - BMPFILEHEADERSIZE ||
+            parseDIBHeader(data + BMPFILEHEADERSIZE + 4, dibHeaderSize - 4, &(bitmap->dibHeader)) != 1 ||
+            parseBitfieldMasks(data + BMPFILEHEADERSIZE + dibHeaderSize, size - BMPFILEHEADERSIZE - dibHeaderSize,
+                               &(bitmap->dibHeader)) != 1)
+        return 0;
+
+    // pixel array must lie completely inside the data
+    if(checkPixelArrayBounds(bitmap, size) == 0)
+        return 0;
+
+    bitmap->pixel_array = (uint8_t *) data + bitmap->bmpFileHeader.img_offset;
+    return 1;
+}
+
+/**
+ * Maps the bitmap file read-only into memory and parses its headers.
+ *
+ * Headers are parsed straight from the mapping with parseBitmapMemory(), so a truncated file is rejected instead of
+ * faulting later. Pages are only read from disk when the decoder touches them.
+ *
+ * @param path path of the bitmap file.
+ * @param bitmap struct containing bitmap in memory.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t mapBitmapFile(const char *path, bitmap_t *bitmap) {
+    bitmap->pixel_array = NULL;
+    bitmap->color_table = NULL;
+    bitmap->file_mapping = NULL;
+    bitmap->file_mapping_size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || fileStat.st_size < BMPFILEHEADERSIZE + 4) {
+        close(fd);
+        return 0;
+    }
+    size_t fileSize = (size_t) fileStat.st_size;
+
+    uint8_t *mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return 0;
+    if(parseBitmapMemory(mapping, fileSize, bitmap) == 0) {
+        munmap(mapping, fileSize);
+        return 0;
+    }
+
+    bitmap->file_mapping = mapping;
+    bitmap->file_mapping_size = fileSize;
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+    return 1;
+}
+
+/**
+ * Releases the pixel array of a bitmap loaded by readBitmapFile() or mapBitmapFile().
+ *
+ * Unmaps the file for mapped bitmaps and frees the pixel array otherwise.
+ *
+ * @param bitmap bitmap to release.
+ */
+void releaseBitmap(bitmap_t *bitmap) {
+    if(bitmap->file_mapping != NULL)
+        munmap(bitmap->file_mapping, bitmap->file_mapping_size);
+    else
+        free(bitmap->pixel_array);
+
+    bitmap->pixel_array = NULL;
+    bitmap->file_mapping = NULL;
+    bitmap->file_mapping_size = 0;
+}
 
+/**
+ * Writes the bitmap in memory to a file.
+ *
+ * Calls writeBitmapHeaders() then writes the pixel array as stored, padding included.
+ *
+ * @param bitmapFilePtr FILE pointer for bitmap file being written.
+ * @param bitmap bitmap in memory.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t writeBitmapFile(FILE *bitmapFilePtr, const bitmap_t *bitmap) {
+    if(writeBitmapHeaders(bitmapFilePtr, bitmap) == 0)
+        return 0;
+
+    uint64_t pixel_array_size = getPixelArraySize(&(bitmap->dibHeader));
+    if(pixel_array_size == 0 || pixel_array_size > SIZE_MAX ||
+            fwrite(bitmap->pixel_array, 1, (size_t) pixel_array_size, bitmapFilePtr) != pixel_array_size)
+        return 0;
     return 1;
 }
 
@@ -240,7 +900,7 @@ void printDIBHeader(const dibHeader_t *dibHeader) {
         case BITMAPINFOHEADER:
             printf("DIB Header size: %u\n", dibHeader->header.bitMapInfoHeader.header_size);
             printf("Width in pixels: %u\n", dibHeader->header.bitMapInfoHeader.bitmap_width);
-            printf("Height in pixels: %u\n", dibHeader->header.bitMapInfoHeader.bitmap_height);
+            printf("Height in pixels: %d\n", dibHeader->header.bitMapInfoHeader.bitmap_height);
             printf("Color planes: %u\n", dibHeader->header.bitMapInfoHeader.color_planes);
             printf("Bits per pixel: %u: \n", dibHeader->header.bitMapInfoHeader.bits_per_pixel);
             printf("Compression method: %u: \n", dibHeader->header.bitMapInfoHeader.compression_method);
@@ -249,14 +909,42 @@ void printDIBHeader(const dibHeader_t *dibHeader) {
             printf("Vertical res: %u: \n", dibHeader->header.bitMapInfoHeader.vertical_res);
             printf("Colors in palette: %u: \n", dibHeader->header.bitMapInfoHeader.color_palette);
             printf("Important colors: %u: \n", dibHeader->header.bitMapInfoHeader.important_colors);
+            if(getBitfieldMasksSize(dibHeader) != 0) {
+                printf("Red mask: 0x%08X\n", dibHeader->header.bitMapInfoHeader.red_mask);
+                printf("Green mask: 0x%08X\n", dibHeader->header.bitMapInfoHeader.green_mask);
+                printf("Blue mask: 0x%08X\n", dibHeader->header.bitMapInfoHeader.blue_mask);
+            }
+            break;
+
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER:
+            printf("DIB Header size: %u\n", dibHeader->header.bitMapV5Header.header_size);
+            printf("Width in pixels: %u\n", dibHeader->header.bitMapV5Header.bitmap_width);
+            printf("Height in pixels: %d\n", dibHeader->header.bitMapV5Header.bitmap_height);
+            printf("Color planes: %u\n", dibHeader->header.bitMapV5Header.color_planes);
+            printf("Bits per pixel: %u: \n", dibHeader->header.bitMapV5Header.bits_per_pixel);
+            printf("Compression method: %u: \n", dibHeader->header.bitMapV5Header.compression_method);
+            printf("Image size: %u: \n", dibHeader->header.bitMapV5Header.image_size);
+            printf("Horizontal res: %u: \n", dibHeader->header.bitMapV5Header.horizontal_res);
+            printf("Vertical res: %u: \n", dibHeader->header.bitMapV5Header.vertical_res);
+            printf("Colors in palette: %u: \n", dibHeader->header.bitMapV5Header.color_palette);
+            printf("Important colors: %u: \n", dibHeader->header.bitMapV5Header.important_colors);
+            printf("Red mask: 0x%08X\n", dibHeader->header.bitMapV5Header.red_mask);
+            printf("Green mask: 0x%08X\n", dibHeader->header.bitMapV5Header.green_mask);
+            printf("Blue mask: 0x%08X\n", dibHeader->header.bitMapV5Header.blue_mask);
+            printf("Alpha mask: 0x%08X\n", dibHeader->header.bitMapV5Header.alpha_mask);
+            printf("Color space type: 0x%08X\n", dibHeader->header.bitMapV5Header.color_space_type);
+            if(dibHeader->type == BITMAPV5HEADER) {
+                printf("Intent: %u\n", dibHeader->header.bitMapV5Header.intent);
+                printf("Profile data: %u\n", dibHeader->header.bitMapV5Header.profile_data);
+                printf("Profile size: %u\n", dibHeader->header.bitMapV5Header.profile_size);
+            }
             break;
 
         case OS22XBITMAPHEADER:
         case OS22XBITMAPHEADER_S:
         case BITMAPV2INFOHEADER:
         case BITMAPV3INFOHEADER:
-        case BITMAPV4HEADER:
-        case BITMAPV5HEADER:
         default:
             printf("Bitmap format with header size %u not yet supported for print.\n", dibHeader->type);
     }
@@ -7,6 +7,7 @@
 #ifndef BITMAP_H_
 #define BITMAP_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,11 +38,14 @@ typedef struct bitMapCoreHeader {
 
 /**
  * Struct to hold DIB header of type BITMAPINFOHEADER.
+ *
+ * With BI_BITFIELDS compression three masks follow the header in the file, they are kept at the offsets of the
+ * bitMapV5Header_t masks.
  */
 typedef struct bitMapInfoHeader {
     uint32_t header_size;
     uint32_t bitmap_width;
-    uint32_t bitmap_height;
+    int32_t bitmap_height;      // negative for top-down bitmaps
     uint16_t color_planes;
     uint16_t bits_per_pixel;
     uint32_t compression_method;
@@ -50,8 +54,44 @@ typedef struct bitMapInfoHeader {
     uint32_t vertical_res;
     uint32_t color_palette;
     uint32_t important_colors;
+    uint32_t red_mask;          // BI_BITFIELDS only, read from after the header
+    uint32_t green_mask;
+    uint32_t blue_mask;
 } bitMapInfoHeader_t;
 
+/**
+ * Struct to hold DIB header of type BITMAPV4HEADER or BITMAPV5HEADER.
+ *
+ * Starts with the fields of bitMapInfoHeader_t in the same order, so those fields can be read through either union
+ * member. The V5 only fields are zero for BITMAPV4HEADER.
+ */
+typedef struct bitMapV5Header {
+    uint32_t header_size;
+    uint32_t bitmap_width;
+    int32_t bitmap_height;      // negative for top-down bitmaps
+    uint16_t color_planes;
+    uint16_t bits_per_pixel;
+    uint32_t compression_method;
+    uint32_t image_size;
+    uint32_t horizontal_res;
+    uint32_t vertical_res;
+    uint32_t color_palette;
+    uint32_t important_colors;
+    uint32_t red_mask;          // channel masks, only used with BI_BITFIELDS
+    uint32_t green_mask;
+    uint32_t blue_mask;
+    uint32_t alpha_mask;
+    uint32_t color_space_type;
+    uint8_t endpoints[36];
+    uint32_t gamma_red;
+    uint32_t gamma_green;
+    uint32_t gamma_blue;
+    uint32_t intent;            // V5 only
+    uint32_t profile_data;      // V5 only
+    uint32_t profile_size;      // V5 only
+    uint32_t reserved;          // V5 only
+} bitMapV5Header_t;
+
 /**
  * Struct to hold DIB header of type OS22XBITMAPHEADER.
  * Not yet implemented.
@@ -86,6 +126,7 @@ typedef struct dibHeader {
         bitMapCoreHeader_t bitMapCoreHeader;
         bitMapInfoHeader_t bitMapInfoHeader;
         os22xBitMapHeader_t os22XBitMapHeader;
+        bitMapV5Header_t bitMapV5Header;
     } header;
 } dibHeader_t;
 
@@ -97,8 +138,34 @@ typedef struct bitmap {
     dibHeader_t dibHeader;
     uint8_t *pixel_array;
     uint8_t *color_table;   // not currently implemented.
+    void *file_mapping;         // read-only mapping of the file when loaded by mapBitmapFile(), NULL otherwise.
+    size_t file_mapping_size;
 }bitmap_t;
 
+/**
+ * Byte layout of pixels with 8 bit color channels.
+ */
+typedef struct pixelFormat {
+    uint32_t bytes_per_pixel;   // 3, or 4 with an alpha or unused byte
+    uint8_t blue_byte;          // index of the byte holding each channel within a pixel
+    uint8_t green_byte;
+    uint8_t red_byte;
+} pixelFormat_t;
+
+/**
+ * Rows of a pixel array in decode order, bottom row of the image first.
+ *
+ * Row n starts at first + n * stride. Stride includes row padding and is negative for top-down bitmaps, whose bottom
+ * row is stored last.
+ */
+typedef struct bitmapRows {
+    const uint8_t *first;
+    ptrdiff_t stride;
+    size_t row_bytes;       // pixel bytes per row, excluding padding
+    uint32_t row_pixels;
+    uint32_t row_count;
+} bitmapRows_t;
+
 /**
  * Reads the bitmap file header and parses it to a bmpFileHeader struct.
  *
@@ -109,7 +176,8 @@ typedef struct bitmap {
 uint32_t readBMPFileHeader(FILE *bitmapFilePtr, bmpFileHeader_t *bmpFileHeader);
 
 /**
- * Reads the DIB header, bitmap information header, to a dibHeader struct.
+ * Reads the DIB header, bitmap information header, to a dibHeader struct, and the BI_BITFIELDS masks following a
+ * BITMAPINFOHEADER.
  *
  * @param bitmapFilePtr FILE pointer for bitmap file.
  * @param dibHeaderSize size of DIB header.
@@ -145,6 +213,24 @@ uint32_t parseBITMAPCOREHEADER(const uint8_t *buffer, dibHeader_t *dibHeader);
  */
 uint32_t parseBITMAPINFOHEADER(const uint8_t *buffer, dibHeader_t *dibHeader);
 
+/**
+ * Parses DIB header, bitmap information header, of BITMAPV4HEADER format.
+ *
+ * @param buffer block of memory containing bitmap header, dib header.
+ * @param dibHeader struct to hold bitmap header, dib header.
+ * @return 1 on success, 0 on failure.
+ */
+uint32_t parseBITMAPV4HEADER(const uint8_t *buffer, dibHeader_t *dibHeader);
+
+/**
+ * Parses DIB header, bitmap information header, of BITMAPV5HEADER format.
+ *
+ * @param buffer block of memory containing bitmap header, dib header.
+ * @param dibHeader struct to hold bitmap header, dib header.
+ * @return 1 on success, 0 on failure.
+ */
+uint32_t parseBITMAPV5HEADER(const uint8_t *buffer, dibHeader_t *dibHeader);
+
 /**
  * Parses all formats of DIB header/bitmap information header.
  *
@@ -155,6 +241,137 @@ uint32_t parseBITMAPINFOHEADER(const uint8_t *buffer, dibHeader_t *dibHeader);
  */
 uint32_t parseDIBHeader(const uint8_t *buffer, uint32_t dibHeaderSize, dibHeader_t *dibHeader);
 
+/**
+ * Returns the size of the channel masks stored after the DIB header, which only a BITMAPINFOHEADER with
+ * BI_BITFIELDS compression has.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return BITFIELDSMASKSSIZE or 0.
+ */
+uint32_t getBitfieldMasksSize(const dibHeader_t *dibHeader);
+
+/**
+ * Parses the channel masks stored after a BITMAPINFOHEADER with BI_BITFIELDS compression into the DIB header.
+ *
+ * @param buffer block of memory following the DIB header.
+ * @param size number of bytes in the block.
+ * @param dibHeader parsed DIB header, receives the masks.
+ * @return 1 on success or if the DIB header has no masks after it, 0 if the block is too short.
+ */
+uint32_t parseBitfieldMasks(const uint8_t *buffer, size_t size, dibHeader_t *dibHeader);
+
+/**
+ * Serializes a bitmap file header struct into the block of memory written to the file.
+ *
+ * @param bmpFileHeader bitmap file header struct.
+ * @param buffer destination, at least BMPFILEHEADERSIZE bytes long.
+ * @return size of BMP file header.
+ */
+uint32_t serializeBMPFileHeader(const bmpFileHeader_t *bmpFileHeader, uint8_t *buffer);
+
+/**
+ * Serializes a DIB header struct into the block of memory written to the file, including its size field and the
+ * BI_BITFIELDS masks following a BITMAPINFOHEADER.
+ *
+ * @param dibHeader dib header struct.
+ * @param buffer destination, at least as long as the DIB header and its masks.
+ * @return size of DIB header and masks on success, 0 if the DIB header type is not supported.
+ */
+uint32_t serializeDIBHeader(const dibHeader_t *dibHeader, uint8_t *buffer);
+
+/**
+ * Writes the bitmap file header and DIB header, then pads with zeros up to the pixel array offset.
+ *
+ * @param bitmapFilePtr FILE pointer for bitmap file being written.
+ * @param bitmap bitmap whose headers are written.
+ * @return number of bytes written on success, 0 otherwise.
+ */
+uint32_t writeBitmapHeaders(FILE *bitmapFilePtr, const bitmap_t *bitmap);
+
+/**
+ * Returns the width of the bitmap in pixels.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return width in pixels, 0 if the DIB header type is not supported.
+ */
+uint32_t getBitmapWidth(const dibHeader_t *dibHeader);
+
+/**
+ * Returns the height of the bitmap in pixels.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return height in pixels, 0 if the DIB header type is not supported.
+ */
+uint32_t getBitmapHeight(const dibHeader_t *dibHeader);
+
+/**
+ * Returns 1 if rows are stored top row first, which BITMAPINFOHEADER and later headers mark with a negative height.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return 1 if top-down, 0 if bottom-up.
+ */
+uint32_t isTopDown(const dibHeader_t *dibHeader);
+
+/**
+ * Returns the number of bits per pixel of the bitmap.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return bits per pixel, 0 if the DIB header type is not supported.
+ */
+uint16_t getBitsPerPixel(const dibHeader_t *dibHeader);
+
+/**
+ * Describes where the color channels are stored in each pixel.
+ *
+ * @param dibHeader parsed DIB header.
+ * @param format pixel layout.
+ * @return 1 for uncompressed 24 and 32 bit pixels with one byte per channel, 0 otherwise.
+ */
+uint32_t getPixelFormat(const dibHeader_t *dibHeader, pixelFormat_t *format);
+
+/**
+ * Calculates the size in bytes of one row of the pixel array, including padding.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return size of a row including padding, 0 if the DIB header type is not supported.
+ */
+uint64_t getRowSize(const dibHeader_t *dibHeader);
+
+/**
+ * Calculates the size in bytes of the pixel array, including row padding.
+ *
+ * @param dibHeader parsed DIB header.
+ * @return size of pixel array, 0 if the DIB header type is not supported or the size does not fit in 64 bits.
+ */
+uint64_t getPixelArraySize(const dibHeader_t *dibHeader);
+
+/**
+ * Checks that the pixel array described by the headers can be addressed and lies completely inside the file.
+ *
+ * @param bitmap bitmap with parsed headers.
+ * @param fileSize size of the bitmap file in bytes.
+ * @return 1 if the pixel array fits, 0 otherwise.
+ */
+uint32_t checkPixelArrayBounds(const bitmap_t *bitmap, uint64_t fileSize);
+
+/**
+ * Describes the rows of a bitmap's pixel array in decode order.
+ *
+ * @param bitmap bitmap in memory.
+ * @param rows row description.
+ * @return 1 on success, 0 if the DIB header type is not supported.
+ */
+uint32_t getBitmapRows(const bitmap_t *bitmap, bitmapRows_t *rows);
+
+/**
+ * Returns a pointer to a row of the pixel array in decode order.
+ *
+ * @param rows row description.
+ * @param row index of row, 0 is the bottom row of the image.
+ * @return pointer to the first pixel byte of the row.
+ */
+const uint8_t *getRow(const bitmapRows_t *rows, uint32_t row);
+
 /**
  * Reads the bitmap file and parses it into structs in memory.
  *
@@ -164,6 +381,59 @@ uint32_t parseDIBHeader(const uint8_t *buffer, uint32_t dibHeaderSize, dibHeader
  */
 uint32_t readBitmapFile(FILE *bitmapFilePtr, bitmap_t *bitmap);
 
+/**
+ * Reads the bitmap file and parses it into structs in memory, reading the pixel array into a buffer of the caller.
+ *
+ * The bitmap borrows the buffer and must not be released with releaseBitmap().
+ *
+ * @param bitmapFilePtr file pointer to the bitmap file being read.
+ * @param bitmap struct containing bitmap in memory.
+ * @param buffer pixel buffer, NULL for none yet. Replaced by a larger one when too small, owned by the caller.
+ * @param capacity size of the pixel buffer, updated when it is replaced.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t readBitmapFileInto(FILE *bitmapFilePtr, bitmap_t *bitmap, uint8_t **buffer, size_t *capacity);
+
+/**
+ * Parses a bitmap file held in memory, without copying its pixel array.
+ *
+ * The bitmap borrows the data, its pixel array must not be written to and it must not be released with
+ * releaseBitmap().
+ *
+ * @param data bitmap file bytes.
+ * @param size number of bytes.
+ * @param bitmap struct containing bitmap in memory.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t parseBitmapMemory(const uint8_t *data, size_t size, bitmap_t *bitmap);
+
+/**
+ * Maps the bitmap file read-only into memory and parses its headers.
+ *
+ * The pixel array is not copied; pixel_array points into the mapping and must not be written to.
+ *
+ * @param path path of the bitmap file.
+ * @param bitmap struct containing bitmap in memory.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t mapBitmapFile(const char *path, bitmap_t *bitmap);
+
+/**
+ * Releases the pixel array of a bitmap loaded by readBitmapFile() or mapBitmapFile().
+ *
+ * @param bitmap bitmap to release.
+ */
+void releaseBitmap(bitmap_t *bitmap);
+
+/**
+ * Writes the bitmap in memory to a file.
+ *
+ * @param bitmapFilePtr FILE pointer for bitmap file being written.
+ * @param bitmap bitmap in memory.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t writeBitmapFile(FILE *bitmapFilePtr, const bitmap_t *bitmap);
+
 /**
  * Prints all fields of bitmap file header.
  *
@@ -7,6 +7,11 @@
      */
     #define BMPFILEHEADERSIZE       14
 
+    /**
+     * Size of the red, green and blue masks following a BITMAPINFOHEADER with BI_BITFIELDS compression.
+     */
+    #define BITFIELDSMASKSSIZE      12
+
 /**
  * Value of file signitures for supported file types in bitmap file header.
  */
@@ -0,0 +1,156 @@
+/** @file crc32c.c
+ *
+ * @brief CRC-32C (Castagnoli) checksum, using the SSE4.2 CRC32 instruction where available.
+ * @author Daniel Jaramillo
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+/**
+ * Reflected CRC-32C polynomial.
+ */
+#define CRC32C_POLYNOMIAL   0x82F63B78u
+
+typedef uint32_t (*crc32cUpdateFn_t)(uint32_t crc, const uint8_t *data, size_t length);
+
+// slicing-by-8 tables of the scalar kernel, table n advances a byte n bytes ahead of the end
+static uint32_t crc32cTables[8][256];
+static pthread_once_t crc32cTablesOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Fills the slicing-by-8 tables.
+ */
+static void initCRC32CTables(void) {
+    for(uint32_t value = 0; value < 256; value++) {
+        uint32_t crc = value;
+        for(uint32_t bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1)));
+        crc32cTables[0][value] = crc;
+    }
+    for(uint32_t value = 0; value < 256; value++) {
+        for(uint32_t table = 1; table < 8; table++) {
+            uint32_t previous = crc32cTables[table - 1][value];
+            crc32cTables[table][value] = (previous >> 8) ^ crc32cTables[0][previous & 0xFF];
+        }
+    }
+}
+
+/**
+ * Portable reference implementation of crc32cUpdate().
+ *
+ * Processes 8 bytes per step with the slicing-by-8 tables, which are filled on first use.
+ *
+ * @param crc CRC-32C of the bytes fed so far, 0 for none.
+ * @param data next bytes.
+ * @param length number of bytes.
+ * @return CRC-32C of all bytes fed.
+ */
+uint32_t crc32cUpdateScalar(uint32_t crc, const uint8_t *data, size_t length) {
+    pthread_once(&crc32cTablesOnce, initCRC32CTables);
+
+    crc = ~crc;
+    for(; length >= 8; length -= 8, data += 8) {
+        uint32_t low = crc ^ ((uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 |
+                              (uint32_t) data[3] << 24);
+        crc = crc32cTables[7][low & 0xFF] ^ crc32cTables[6][(low >> 8) & 0xFF] ^
+              crc32cTables[5][(low >> 16) & 0xFF] ^ crc32cTables[4][low >> 24] ^
+              crc32cTables[3][data[4]] ^ crc32cTables[2][data[5]] ^ crc32cTables[1][data[6]] ^
+              crc32cTables[0][data[7]];
+    }
+    for(; length > 0; length--, data++)
+        crc = (crc >> 8) ^ crc32cTables[0][(crc ^ *data) & 0xFF];
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+/**
+ * SSE4.2 kernel. Feeds 8 bytes per CRC32 instruction.
+ *
+ * @param crc CRC-32C of the bytes fed so far, 0 for none.
+ * @param data next bytes.
+ * @param length number of bytes.
+ * @return CRC-32C of all bytes fed.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32cUpdateSSE42(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+#ifdef __x86_64__
+    uint64_t wide = crc;
+    for(; length >= 8; length -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t) wide;
+#endif
+    for(; length >= 4; length -= 4, data += 4) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for(; length > 0; length--, data++)
+        crc = _mm_crc32_u8(crc, *data);
+    return ~crc;
+}
+#endif
+
+/**
+ * Selects the fastest kernel supported by the running CPU.
+ *
+ * @return kernel function.
+ */
+static crc32cUpdateFn_t selectCRC32CUpdate(void) {
+#ifdef CRC32C_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2"))
+        return crc32cUpdateSSE42;
+#endif
+    return crc32cUpdateScalar;
+}
+
+static uint32_t crc32cUpdateResolve(uint32_t crc, const uint8_t *data, size_t length);
+
+// kernel used by crc32cUpdate(), replaced by the selected kernel on first call
+static crc32cUpdateFn_t crc32cUpdateImpl = crc32cUpdateResolve;
+
+/**
+ * Resolves the kernel on first use and forwards the call to it.
+ */
+static uint32_t crc32cUpdateResolve(uint32_t crc, const uint8_t *data, size_t length) {
+    crc32cUpdateFn_t kernel = selectCRC32CUpdate();
+    __atomic_store_n(&crc32cUpdateImpl, kernel, __ATOMIC_RELAXED);
+    return kernel(crc, data, length);
+}
+
+/**
+ * Continues a CRC-32C over more bytes.
+ *
+ * @param crc CRC-32C of the bytes fed so far, 0 for none.
+ * @param data next bytes.
+ * @param length number of bytes.
+ * @return CRC-32C of all bytes fed.
+ */
+uint32_t crc32cUpdate(uint32_t crc, const uint8_t *data, size_t length) {
+    return __atomic_load_n(&crc32cUpdateImpl, __ATOMIC_RELAXED)(crc, data, length);
+}
+
+/**
+ * Returns the name of the kernel selected by crc32cUpdate() on this CPU.
+ *
+ * @return "sse4.2" or "scalar".
+ */
+const char *crc32cKernelName(void) {
+#ifdef CRC32C_X86
+    if(selectCRC32CUpdate() == crc32cUpdateSSE42)
+        return "sse4.2";
+#endif
+    return "scalar";
+}
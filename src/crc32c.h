@@ -0,0 +1,44 @@
+/** @file crc32c.h
+ *
+ * @brief CRC-32C (Castagnoli) checksum, using the SSE4.2 CRC32 instruction where available.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Continues a CRC-32C over more bytes.
+ *
+ * Start with a crc of 0. The value returned after the last block is the CRC-32C of all bytes fed, so a checksum can
+ * be computed block by block while the data is produced. Dispatches at runtime to the fastest kernel supported by
+ * the CPU.
+ *
+ * @param crc CRC-32C of the bytes fed so far, 0 for none.
+ * @param data next bytes.
+ * @param length number of bytes.
+ * @return CRC-32C of all bytes fed.
+ */
+uint32_t crc32cUpdate(uint32_t crc, const uint8_t *data, size_t length);
+
+/**
+ * Portable reference implementation of crc32cUpdate().
+ *
+ * @param crc CRC-32C of the bytes fed so far, 0 for none.
+ * @param data next bytes.
+ * @param length number of bytes.
+ * @return CRC-32C of all bytes fed.
+ */
+uint32_t crc32cUpdateScalar(uint32_t crc, const uint8_t *data, size_t length);
+
+/**
+ * Returns the name of the kernel selected by crc32cUpdate() on this CPU.
+ *
+ * @return "sse4.2" or "scalar".
+ */
+const char *crc32cKernelName(void);
+
+#endif
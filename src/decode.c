@@ -4,77 +4,827 @@
  * @author Daniel Jaramillo
  */
 
+#include <fcntl.h>
+#include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "batch.h"
 #include "bitmap.h"
 #include "decoder.h"
+#include "decodestream.h"
+#include "lsbkernels.h"
+#include "lsbplane.h"
+#include "outputsink.h"
+#include "readahead.h"
+#include "regionread.h"
+#include "shard.h"
+#include "stats.h"
 
 #define DEFAULT_INPUT_FILENAME "nothing_to_see_here.bmp"
 #define DEFAULT_OUTPUT_FILENAME "output.txt"
 
-int main(int argc, char *argv[])
-{
-    FILE *bitmapFilePtr, *outputFilePtr;
+/**
+ * Prints command line usage.
+ *
+ * @param program name of the program.
+ */
+static void printUsage(const char *program) {
+    printf("Usage: %s [options] [input...]\n"
+           "Decodes each input, a bitmap file, directory of .bmp files or glob pattern.\n"
+           "Without inputs, decodes " DEFAULT_INPUT_FILENAME " to " DEFAULT_OUTPUT_FILENAME ".\n"
+           "\n"
+           "  -l, --list FILE        read inputs from FILE, one per line, - for stdin\n"
+           "  -j, --jobs N           number of worker threads, default one per processor\n"
+           "  -o, --output-dir DIR   write each message to DIR/<input name>.txt\n"
+           "  -w, --write FILE       decode a single input and write its message to FILE, - for stdout, block by\n"
+           "                         block as it is decoded\n"
+           "      --jsonl FILE       write one JSON record per input to FILE, - for stdout (default)\n"
+           "  -H, --headers          print bitmap headers to stdout, so JSONL records need --jsonl FILE\n"
+           "  -m, --mmap             memory map bitmap files instead of reading them\n"
+           "      --read-ahead N     read files whole with N reads in flight while the workers decode the files read\n"
+           "                         before, io_uring when available\n"
+           "  -b, --bits N           decode N low bits of each channel, 1 to 4, default 1\n"
+           "  -c, --channels LIST    channels holding the message, any of r, g and b, default rgb\n"
+           "      --key PASSPHRASE   take the pixels in the keyed order of PASSPHRASE instead of along the rows\n"
+           "      --plane            decode from the LSB plane of each input, the order of the -c LIST is the order\n"
+           "                         bits are taken from each pixel\n"
+           "      --plane-cache      like --plane, and keep each plane in <input>.lsbplane for later runs\n"
+           "      --msb-first        fill message bytes from the most significant bit, implies --plane\n"
+           "      --offset N         skip the first N message bits, implies --plane\n"
+           "      --search           find bits per channel, channel order, bit order, row direction and start bit of\n"
+           "                         each input and report the most plausible decodings\n"
+           "      --top N            number of decodings reported by --search, default 5\n"
+           "      --memory-budget SIZE\n"
+           "                         largest pixel array loaded into memory such as 512M, larger files are\n"
+           "                         decoded in windows, default 1G\n"
+           "      --range START:END  with --write, write only bytes START to END - 1 of the message, or of the\n"
+           "                         payload of a framed message, reading only the rows holding them\n"
+           "      --rect X,Y,W,H     with --write, write the message bits of the W x H pixels at X,Y, counted from\n"
+           "                         the top left\n"
+           "      --shards           with --write, decode the inputs in parallel as the shards of one message and\n"
+           "                         write each shard to FILE as soon as it is decoded\n"
+           "  -p, --probe            only read headers and report format and capacity of each input\n"
+           "      --stats            time opening, header parsing, pixel reads, decoding and output, add them to\n"
+           "                         each JSON record and print a JSON summary to stderr\n"
+           "  -h, --help             print this help\n", program);
+}
+
+/**
+ * Parses a channel list such as "rgb" or "g" into CHANNEL_ bits.
+ *
+ * @param list channel letters, any of r, g and b.
+ * @return channel mask, 0 if the list is empty or has other characters.
+ */
+static uint32_t parseChannelList(const char *list) {
+    uint32_t mask = 0;
+    for(; *list != '\0'; list++) {
+        switch(*list) {
+            case 'r': case 'R': mask |= CHANNEL_RED; break;
+            case 'g': case 'G': mask |= CHANNEL_GREEN; break;
+            case 'b': case 'B': mask |= CHANNEL_BLUE; break;
+            default: return 0;
+        }
+    }
+    return mask;
+}
+
+/**
+ * Parses a channel list such as "rgb" or "g" into the channel order of a plane variant.
+ *
+ * @param list channel letters, each of r, g and b at most once.
+ * @param variant plane variant whose channel order is set.
+ * @return 1 on success, 0 if the list is empty, repeats a channel or has other characters.
+ */
+static uint32_t parseChannelOrder(const char *list, lsbPlaneVariant_t *variant) {
+    uint32_t seen = 0, count = 0;
+    memset(variant->channel_order, 0, sizeof(variant->channel_order));
+    for(; *list != '\0'; list++) {
+        char letter[2] = {*list, '\0'};
+        uint32_t channel = parseChannelList(letter);
+        if(channel == 0 || (seen & channel) != 0)
+            return 0;
+        seen |= channel;
+        variant->channel_order[count++] = (uint8_t) channel;
+    }
+    return count > 0;
+}
+
+/**
+ * Parses a size such as 64K, 16M or 2G.
+ *
+ * @param text size text.
+ * @return size in bytes, 0 if invalid.
+ */
+static uint64_t parseSize(const char *text) {
+    char *end;
+    uint64_t size = strtoull(text, &end, 10);
+    switch(*end) {
+        case 'k': case 'K': return size << 10;
+        case 'm': case 'M': return size << 20;
+        case 'g': case 'G': return size << 30;
+        case '\0': return size;
+        default: return 0;
+    }
+}
+
+/**
+ * Parses a byte range such as 4096:8192, end excluded.
+ *
+ * @param text range text.
+ * @param start first byte.
+ * @param end byte after the last one.
+ * @return 1 on success, 0 if invalid or empty.
+ */
+static uint32_t parseRange(const char *text, uint64_t *start, uint64_t *end) {
+    char *separator;
+    char *last;
+    *start = strtoull(text, &separator, 10);
+    if(separator == text || *separator != ':')
+        return 0;
+    *end = strtoull(separator + 1, &last, 10);
+    return last != separator + 1 && *last == '\0' && *end > *start;
+}
+
+/**
+ * Parses a rectangle such as 16,32,64,64 as x, y, width and height.
+ *
+ * @param text rectangle text.
+ * @param rect rectangle.
+ * @return 1 on success, 0 if invalid or empty.
+ */
+static uint32_t parseRect(const char *text, pixelRect_t *rect) {
+    uint32_t values[4];
+    const char *next = text;
+    for(uint32_t i = 0; i < 4; i++) {
+        char *end;
+        unsigned long value = strtoul(next, &end, 10);
+        if(end == next || value > UINT32_MAX || *end != (i < 3 ? ',' : '\0'))
+            return 0;
+        values[i] = (uint32_t) value;
+        next = end + 1;
+    }
+    rect->x = values[0];
+    rect->y = values[1];
+    rect->width = values[2];
+    rect->height = values[3];
+    return rect->width > 0 && rect->height > 0;
+}
+
+/**
+ * Decodes a bitmap file larger than the memory budget to an output sink in bounded windows of rows, like batch mode.
+ *
+ * @param bitmapFilePtr bitmap file positioned after its headers, which need not be seekable.
+ * @param bitmap bitmap with the parsed headers.
+ * @param outputPath output file, - for stdout.
+ * @param config decode configuration.
+ * @return 1 on success, 0 if the message cannot be decoded, 2 if it cannot be written out, with the error printed.
+ */
+static uint32_t decodeWindowedToSink(FILE *bitmapFilePtr, bitmap_t *bitmap, const char *outputPath,
+                                     const decodeConfig_t *config) {
+    outputSink_t sink;
+    uint64_t length;
+
+    if(isDecodeable(bitmap) != 1) {
+        fprintf(stderr, "Error: File not decodeable.\n");
+        return 0;
+    }
+    if(outputSinkOpen(&sink, outputPath) != 1) {
+        fprintf(stderr, "Error: Unable to open output file.\n");
+        return 0;
+    }
+
+    // decode message straight to the output
+    STATS_START(decodeTimer);
+    uint32_t result = decodeMessageStreamToWriter(bitmapFilePtr, bitmap, config, STREAM_DEFAULT_CHUNK_SIZE,
+                                                  outputSinkWriter, &sink, &length);
+    STATS_STOP(decodeTimer, STATS_DECODE, length);
+    uint32_t error = result == DECODE_OK;
+    if(outputSinkClose(&sink) != 1 && error == 1) {
+        fprintf(stderr, "Error: Unable to write output file.\n");
+        error = 2;
+    }
+    if(error == 0)
+        fprintf(stderr, "Error: %s.\n", result == DECODE_CORRUPT ? "Framed payload is corrupt"
+                                                                 : "Unable to decode message");
+    return error;
+}
+
+/**
+ * Decodes one bitmap file to an output sink, writing the message out block by block as it is decoded.
+ *
+ * The message is written with its length and not as a C string, so framed payloads with NUL bytes arrive whole, and
+ * a reader of a pipe can start on the first block before the last one is decoded. A file whose pixel array exceeds
+ * the memory budget is never loaded whole, it is decoded in windows by decodeWindowedToSink(), or mapped when a
+ * keyed pixel order visits its rows out of order. Input that is not a regular file, like a pipe, is never rewound or
+ * mapped, it is decoded in windows from its headers on. Errors are printed to stderr, as stdout may be the output.
+ *
+ * @param inputPath bitmap file.
+ * @param outputPath output file, - for stdout.
+ * @param config decode configuration.
+ * @param useMmap memory map the bitmap file instead of reading it.
+ * @param printHeaders print the headers of the bitmap.
+ * @param memoryBudget largest pixel array read into memory, 0 for BATCH_DEFAULT_MEMORY_BUDGET.
+ * @return 0 on success, -1 otherwise.
+ */
+static int decodeFileToSink(const char *inputPath, const char *outputPath, const decodeConfig_t *config,
+                            uint32_t useMmap, uint32_t printHeaders, uint64_t memoryBudget) {
+    FILE *bitmapFilePtr;
     bitmap_t bitmap;
-    char *message = NULL;
+    outputSink_t sink;
+    uint64_t length;
     uint32_t error;
 
-    // open bitmap file
-    bitmapFilePtr = fopen(DEFAULT_INPUT_FILENAME, "r");
-    if(bitmapFilePtr == NULL) {
-        printf("Error: Unable to open bitmap file.\n");
-        return -1;
-    }
+    if(memoryBudget == 0)
+        memoryBudget = BATCH_DEFAULT_MEMORY_BUDGET;
 
-    // read file
-    error = readBitmapFile(bitmapFilePtr, &bitmap);
+    // read file, a pipe cannot be mapped and is read instead
+    struct stat fileStat;
+    if(useMmap && stat(inputPath, &fileStat) == 0 && !S_ISREG(fileStat.st_mode))
+        useMmap = 0;
+    STATS_START(openTimer);
+    if(useMmap) {
+        error = mapBitmapFile(inputPath, &bitmap);
+        STATS_STOP(openTimer, STATS_OPEN, 0);
+    } else {
+        bitmapFilePtr = fopen(inputPath, "r");
+        STATS_STOP(openTimer, STATS_OPEN, 0);
+        if(bitmapFilePtr == NULL) {
+            fprintf(stderr, "Error: Unable to open bitmap file.\n");
+            return -1;
+        }
+
+        // look at the headers first, so an oversized pixel array is never allocated
+        STATS_START(headerTimer);
+        uint32_t dibHeaderSize = readBMPFileHeader(bitmapFilePtr, &(bitmap.bmpFileHeader));
+        uint32_t parsed = dibHeaderSize != 0 && readDIBHeader(bitmapFilePtr, dibHeaderSize, &(bitmap.dibHeader)) != 0;
+        STATS_STOP(headerTimer, STATS_HEADERS, (uint64_t) BMPFILEHEADERSIZE + dibHeaderSize);
+        if(parsed == 0) {
+            fprintf(stderr, "Error: Unable to read/parse bitmap file.\n");
+            fclose(bitmapFilePtr);
+            return -1;
+        }
+
+        // only a regular file can be rewound or mapped, a pipe is decoded on from its headers in windows
+        uint32_t seekable = fstat(fileno(bitmapFilePtr), &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+        uint32_t oversized = getPixelArraySize(&(bitmap.dibHeader)) > memoryBudget;
+        if(!seekable && config->order_key != 0) {
+            fprintf(stderr, "Error: A keyed pixel order needs a seekable bitmap file.\n");
+            fclose(bitmapFilePtr);
+            return -1;
+        }
+        if(!seekable || (oversized && config->order_key == 0)) {
+            bitmap.pixel_array = NULL;
+            bitmap.color_table = NULL;
+            bitmap.file_mapping = NULL;
+            bitmap.file_mapping_size = 0;
+            if(printHeaders)
+                printBitmapHeaders(&bitmap);
+            error = decodeWindowedToSink(bitmapFilePtr, &bitmap, outputPath, config);
+            fclose(bitmapFilePtr);
+            return error == 1 ? 0 : -1;
+        }
+
+        // a keyed pixel order visits the rows out of order, so an oversized pixel array is mapped instead
+        if(oversized) {
+            fclose(bitmapFilePtr);
+            STATS_START(mapTimer);
+            error = mapBitmapFile(inputPath, &bitmap);
+            STATS_STOP(mapTimer, STATS_OPEN, 0);
+        } else {
+            rewind(bitmapFilePtr);
+            error = readBitmapFile(bitmapFilePtr, &bitmap);
+            fclose(bitmapFilePtr);
+        }
+    }
     if(error != 1) {
-        printf("Error: Unable to read/parse bitmap file.\n");
-        fclose(bitmapFilePtr);
+        fprintf(stderr, "Error: Unable to read/parse bitmap file.\n");
         return -1;
     }
 
     // print headers
-    printBitmapHeaders(&bitmap);
+    if(printHeaders)
+        printBitmapHeaders(&bitmap);
 
     // check if decodeable
     error = isDecodeable(&bitmap);
     if(error != 1) {
-        printf("Error: File not decodeable.\n");
-        fclose(bitmapFilePtr);
-        free(bitmap.pixel_array);
+        fprintf(stderr, "Error: File not decodeable.\n");
+        releaseBitmap(&bitmap);
         return -1;
     }
 
-    // decode message
-    message = decodeMessage(&bitmap);
-    if(message == NULL) {
-        printf("Error: Unable to decode message.");
-        fclose(bitmapFilePtr);
-        free(bitmap.pixel_array);
+    // open output file
+    if(outputSinkOpen(&sink, outputPath) != 1) {
+        fprintf(stderr, "Error: Unable to open output file.\n");
+        releaseBitmap(&bitmap);
         return -1;
     }
 
-    // open output file
-    outputFilePtr = fopen(DEFAULT_OUTPUT_FILENAME, "w");
-    if(outputFilePtr == NULL) {
-        printf("Error: Unable to open output file.\n");
-        fclose(bitmapFilePtr);
-        free(bitmap.pixel_array);
+    // decode message straight to the output
+    STATS_START(decodeTimer);
+    error = decodeMessageToWriter(&bitmap, config, outputSinkWriter, &sink, &length);
+    STATS_STOP(decodeTimer, STATS_DECODE, length);
+    if(outputSinkClose(&sink) != 1 && error == 1) {
+        fprintf(stderr, "Error: Unable to write output file.\n");
+        error = 2;
+    }
+    if(error == 0)
+        fprintf(stderr, "Error: Unable to decode message.\n");
+
+    // cleanup
+    releaseBitmap(&bitmap);
+
+    return error == 1 ? 0 : -1;
+}
+
+/**
+ * Writes a payload byte range or the bits of a pixel rectangle of one bitmap file to an output sink, reading only
+ * the rows holding them with a regionReader_t.
+ *
+ * @param inputPath bitmap file.
+ * @param outputPath output file, - for stdout.
+ * @param config decode configuration.
+ * @param range first byte and byte after the last one of the payload range, NULL to write the rectangle.
+ * @param rect pixel rectangle, used when range is NULL.
+ * @return 0 on success, -1 otherwise.
+ */
+static int decodeRegionToSink(const char *inputPath, const char *outputPath, const decodeConfig_t *config,
+                              const uint64_t *range, const pixelRect_t *rect) {
+    regionReader_t reader;
+    outputSink_t sink;
+    uint8_t *buffer = NULL;
+    uint64_t size;
+    uint32_t success = 1;
+
+    STATS_START(openTimer);
+    int fd = open(inputPath, O_RDONLY);
+    STATS_STOP(openTimer, STATS_OPEN, 0);
+    if(fd < 0) {
+        fprintf(stderr, "Error: Unable to open bitmap file.\n");
+        return -1;
+    }
+    if(regionReaderOpen(&reader, fd, config) != 1) {
+        fprintf(stderr, "Error: Unable to read/parse bitmap file or file not decodeable.\n");
+        regionReaderClose(&reader);
+        close(fd);
+        return -1;
+    }
+
+    // a range is copied through a bounded buffer, a rectangle whole
+    if(range != NULL) {
+        size = range[1] - range[0] < REGION_READ_SIZE ? range[1] - range[0] : REGION_READ_SIZE;
+    } else if(getPixelRectSize(&reader, rect, &size) != 1 || size > SIZE_MAX) {
+        fprintf(stderr, "Error: Rectangle does not lie inside the bitmap.\n");
+        regionReaderClose(&reader);
+        close(fd);
+        return -1;
+    }
+    buffer = malloc((size_t) size);
+    if(buffer == NULL || outputSinkOpen(&sink, outputPath) != 1) {
+        fprintf(stderr, "Error: Unable to open output file.\n");
+        free(buffer);
+        regionReaderClose(&reader);
+        close(fd);
         return -1;
     }
-    // write message to file
-    fputs(message, outputFilePtr);
-    // fwrite(message, 145801, 1, outputFilePtr);   // used to ignore char string terminator. Not needed for assignment.
-    // printf("Message: %s\n", message);
+
+    // read errors and write errors are reported apart
+    uint32_t written = 1;
+    if(range != NULL) {
+        for(uint64_t offset = range[0]; success && written && offset < range[1]; offset += size) {
+            size_t count = (size_t) (range[1] - offset < size ? range[1] - offset : size);
+            success = readPayloadRange(&reader, offset, count, buffer, NULL);
+            written = success && outputSinkWrite(&sink, buffer, count);
+        }
+    } else {
+        success = readPixelRectBits(&reader, rect, buffer, (size_t) size, &size);
+        written = success && outputSinkWrite(&sink, buffer, (size_t) size);
+    }
+    if(outputSinkClose(&sink) != 1 || (success && !written)) {
+        fprintf(stderr, "Error: Unable to write output file.\n");
+        success = 0;
+    } else if(!success) {
+        fprintf(stderr, "Error: Unable to read %s.\n", range != NULL ? "payload range" : "rectangle");
+    }
+
+    // cleanup
+    free(buffer);
+    regionReaderClose(&reader);
+    close(fd);
+
+    return success ? 0 : -1;
+}
+
+/**
+ * Prints the stats of a run as one JSON object to stderr.
+ *
+ * @param stats phases of all files.
+ * @param decoded number of files decoded.
+ * @param failed number of files that failed.
+ * @param start monotonic clock at the start of the run, see statsNow().
+ */
+static void printStatsSummary(const stats_t *stats, size_t decoded, size_t failed, uint64_t start) {
+    fprintf(stderr, "{\"stats\":{\"files\":%zu,\"decoded\":%zu,\"failed\":%zu,\"seconds\":%.9f,\"phases\":",
+            decoded + failed, decoded, failed, (statsNow() - start) / 1e9);
+    writeStatsJSON(stderr, stats);
+    fputs("}}\n", stderr);
+}
+
+/**
+ * Decodes one bitmap file with decodeFileToSink(), timing its phases and printing a stats summary if asked to.
+ *
+ * @param inputPath bitmap file.
+ * @param outputPath output file, - for stdout.
+ * @param config decode configuration.
+ * @param useMmap memory map the bitmap file instead of reading it.
+ * @param printHeaders print the headers of the bitmap.
+ * @param memoryBudget largest pixel array read into memory, 0 for BATCH_DEFAULT_MEMORY_BUDGET.
+ * @param withStats print a stats summary.
+ * @return 0 on success, -1 otherwise.
+ */
+static int decodeSingleFile(const char *inputPath, const char *outputPath, const decodeConfig_t *config,
+                            uint32_t useMmap, uint32_t printHeaders, uint64_t memoryBudget, uint32_t withStats) {
+    stats_t stats;
+    statsReset(&stats);
+    uint64_t start = statsNow();
+
+    statsBind(withStats ? &stats : NULL);
+    int result = decodeFileToSink(inputPath, outputPath, config, useMmap, printHeaders, memoryBudget);
+    statsBind(NULL);
+    if(withStats)
+        printStatsSummary(&stats, result == 0, result != 0, start);
+    return result;
+}
+
+/**
+ * Writes a payload byte range or the bits of a pixel rectangle with decodeRegionToSink(), timing its phases and
+ * printing a stats summary if asked to.
+ *
+ * @param inputPath bitmap file.
+ * @param outputPath output file, - for stdout.
+ * @param config decode configuration.
+ * @param range first byte and byte after the last one of the payload range, NULL to write the rectangle.
+ * @param rect pixel rectangle, used when range is NULL.
+ * @param withStats print a stats summary.
+ * @return 0 on success, -1 otherwise.
+ */
+static int decodeRegion(const char *inputPath, const char *outputPath, const decodeConfig_t *config,
+                        const uint64_t *range, const pixelRect_t *rect, uint32_t withStats) {
+    stats_t stats;
+    statsReset(&stats);
+    uint64_t start = statsNow();
+
+    statsBind(withStats ? &stats : NULL);
+    int result = decodeRegionToSink(inputPath, outputPath, config, range, rect);
+    statsBind(NULL);
+    if(withStats)
+        printStatsSummary(&stats, result == 0, result != 0, start);
+    return result;
+}
+
+/**
+ * Decodes the carriers of a sharded message in parallel into one output file, see shard.h.
+ *
+ * @param list inputs read from list files, freed.
+ * @param inputs inputs given on the command line.
+ * @param inputCount number of inputs on the command line.
+ * @param outputPath output file, - for stdout.
+ * @param options batch options holding the decode configuration, threads and mmap choice.
+ * @return 0 if the message was written whole, -1 otherwise.
+ */
+static int decodeShards(batchList_t *list, char *const *inputs, int inputCount, const char *outputPath,
+                        const batchOptions_t *options) {
+    outputSink_t sink;
+    shardSummary_t summary;
+
+    for(int i = 0; i < inputCount; i++) {
+        if(batchListAdd(list, inputs[i]) != 1)
+            fprintf(stderr, "Warning: %s matched no files.\n", inputs[i]);
+    }
+    if(outputSinkOpen(&sink, outputPath) != 1) {
+        fprintf(stderr, "Error: Unable to open output file.\n");
+        batchListFree(list);
+        return -1;
+    }
+
+    // decode the shards into the output
+    decodeConfig_t config;
+    config.bits_per_channel = options->bitsPerChannel ? options->bitsPerChannel : 1;
+    config.channel_mask = options->channelMask ? options->channelMask : CHANNEL_RGB;
+    config.order_key = options->orderKey;
+    uint32_t whole = decodeShardFiles(list->paths, list->count, &sink, &config, options->threadCount,
+                                      options->useMmap, &summary);
+    if(outputSinkClose(&sink) != 1 && whole) {
+        fprintf(stderr, "Error: Unable to write output file.\n");
+        whole = 0;
+    }
+    fprintf(stderr, "Decoded %zu of %zu carriers.\n", summary.decoded, summary.decoded + summary.failed);
+    if(!whole && summary.decoded == 0)
+        fprintf(stderr, "Error: No shard found.\n");
+    else if(!whole && summary.missing > 0)
+        fprintf(stderr, "Error: %u shards missing.\n", summary.missing);
+    else if(!whole)
+        fprintf(stderr, "Error: Unable to reassemble message.\n");
+
+    batchListFree(list);
+    return whole ? 0 : -1;
+}
+
+/**
+ * Decodes the default input file to the default output file, printing its headers.
+ *
+ * @param withStats print a stats summary.
+ * @return 0 on success, -1 otherwise.
+ */
+static int decodeDefaultFile(uint32_t withStats) {
+    decodeConfig_t config = {1, CHANNEL_RGB, 0};
+    return decodeSingleFile(DEFAULT_INPUT_FILENAME, DEFAULT_OUTPUT_FILENAME, &config, 0, 1, 0, withStats);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"list",       required_argument, NULL, 'l'},
+        {"jobs",       required_argument, NULL, 'j'},
+        {"output-dir", required_argument, NULL, 'o'},
+        {"write",      required_argument, NULL, 'w'},
+        {"jsonl",      required_argument, NULL, 'J'},
+        {"headers",    no_argument,       NULL, 'H'},
+        {"mmap",       no_argument,       NULL, 'm'},
+        {"read-ahead", required_argument, NULL, 'R'},
+        {"probe",      no_argument,       NULL, 'p'},
+        {"bits",       required_argument, NULL, 'b'},
+        {"channels",   required_argument, NULL, 'c'},
+        {"memory-budget", required_argument, NULL, 'M'},
+        {"plane",      no_argument,       NULL, 'P'},
+        {"plane-cache", no_argument,      NULL, 'C'},
+        {"msb-first",  no_argument,       NULL, 'F'},
+        {"offset",     required_argument, NULL, 'O'},
+        {"search",     no_argument,       NULL, 'S'},
+        {"top",        required_argument, NULL, 'T'},
+        {"range",      required_argument, NULL, 'A'},
+        {"rect",       required_argument, NULL, 'X'},
+        {"key",        required_argument, NULL, 'K'},
+        {"shards",     no_argument,       NULL, 'Z'},
+        {"stats",      no_argument,       NULL, 's'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL,         0,                 NULL, 0}
+    };
+    batchOptions_t options = {0};
+    batchList_t list;
+    const char *jsonlPath = NULL;
+    const char *channelList = NULL;
+    const char *writePath = NULL;
+    uint64_t range[2];
+    pixelRect_t rect;
+    uint32_t hasRange = 0;
+    uint32_t hasRect = 0;
+    uint32_t shards = 0;
+    uint32_t listed = 0;
+    int opt;
+
+    batchListInit(&list);
+    while((opt = getopt_long(argc, argv, "l:j:o:w:Hmpb:c:h", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 'l': {
+                FILE *listFilePtr = strcmp(optarg, "-") == 0 ? stdin : fopen(optarg, "r");
+                if(listFilePtr == NULL) {
+                    printf("Error: Unable to open list file %s.\n", optarg);
+                    batchListFree(&list);
+                    return -1;
+                }
+                if(batchListAddFromFile(&list, listFilePtr) != 1)
+                    fprintf(stderr, "Warning: Some inputs in %s matched no files.\n", optarg);
+                if(listFilePtr != stdin)
+                    fclose(listFilePtr);
+                listed = 1;
+                break;
+            }
+            case 'j':
+                options.threadCount = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                options.outputDir = optarg;
+                break;
+            case 'w':
+                writePath = optarg;
+                break;
+            case 'J':
+                jsonlPath = optarg;
+                break;
+            case 'H':
+                options.printHeaders = 1;
+                break;
+            case 'm':
+                options.useMmap = 1;
+                break;
+            case 'R':
+                options.readAhead = (uint32_t) strtoul(optarg, NULL, 10);
+                if(options.readAhead == 0 || options.readAhead > READ_AHEAD_MAX_DEPTH) {
+                    printf("Error: Read-ahead depth must be 1 to %d.\n", READ_AHEAD_MAX_DEPTH);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'p':
+                options.probeOnly = 1;
+                break;
+            case 'b':
+                options.bitsPerChannel = (uint32_t) strtoul(optarg, NULL, 10);
+                if(options.bitsPerChannel < 1 || options.bitsPerChannel > LSB_MAX_BITS_PER_CHANNEL) {
+                    printf("Error: Bits per channel must be 1 to %d.\n", LSB_MAX_BITS_PER_CHANNEL);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'c':
+                channelList = optarg;
+                options.channelMask = parseChannelList(optarg);
+                if(options.channelMask == 0) {
+                    printf("Error: Invalid channel list %s.\n", optarg);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'M':
+                options.memoryBudget = parseSize(optarg);
+                if(options.memoryBudget == 0) {
+                    printf("Error: Invalid memory budget %s.\n", optarg);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'P':
+                options.usePlane = 1;
+                break;
+            case 'C':
+                options.usePlane = 1;
+                options.planeSidecar = 1;
+                break;
+            case 'F':
+                options.usePlane = 1;
+                options.planeVariant.msb_first = 1;
+                break;
+            case 'O':
+                options.usePlane = 1;
+                options.planeVariant.start_bit = strtoull(optarg, NULL, 10);
+                break;
+            case 'S':
+                options.search = 1;
+                break;
+            case 'T':
+                options.searchOptions.topCount = (uint32_t) strtoul(optarg, NULL, 10);
+                if(options.searchOptions.topCount == 0) {
+                    printf("Error: Invalid number of decodings %s.\n", optarg);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'A':
+                hasRange = 1;
+                if(parseRange(optarg, &range[0], &range[1]) == 0) {
+                    printf("Error: Invalid byte range %s.\n", optarg);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'X':
+                hasRect = 1;
+                if(parseRect(optarg, &rect) == 0) {
+                    printf("Error: Invalid rectangle %s.\n", optarg);
+                    batchListFree(&list);
+                    return -1;
+                }
+                break;
+            case 'K':
+                options.orderKey = getPixelOrderKey(optarg);
+                break;
+            case 'Z':
+                shards = 1;
+                break;
+            case 's':
+                if(!STATS_ENABLED) {
+                    printf("Error: Built without --stats support (NO_STATS).\n");
+                    batchListFree(&list);
+                    return -1;
+                }
+                options.stats = 1;
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                batchListFree(&list);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                batchListFree(&list);
+                return -1;
+        }
+    }
+
+    // the plane holds only the lowest bit, and bits are taken from the channels in the listed order
+    if(options.usePlane) {
+        if(options.bitsPerChannel > 1) {
+            printf("Error: Plane decoding reads 1 bit per channel.\n");
+            batchListFree(&list);
+            return -1;
+        }
+        if(channelList != NULL && parseChannelOrder(channelList, &(options.planeVariant)) == 0) {
+            printf("Error: Invalid channel order %s.\n", channelList);
+            batchListFree(&list);
+            return -1;
+        }
+    }
+
+    // a keyed order takes every bit in its own order, so there is no plane, parameter or region to find
+    if(options.orderKey != 0 && (options.usePlane || options.search || hasRange || hasRect)) {
+        printf("Error: --key cannot be combined with --plane, --search, --range or --rect.\n");
+        batchListFree(&list);
+        return -1;
+    }
+
+    if((hasRange || hasRect) && (writePath == NULL || (hasRange && hasRect))) {
+        printf("Error: --range or --rect needs --write, and only one of them.\n");
+        batchListFree(&list);
+        return -1;
+    }
+
+    // keep the original single file behaviour when no inputs are given
+    if(optind == argc && !listed)
+        return decodeDefaultFile(options.stats);
+
+    // the shards of one message are decoded in parallel into one output
+    if(shards) {
+        if(writePath == NULL || options.usePlane || options.search || options.probeOnly || hasRange || hasRect ||
+                options.stats) {
+            printf("Error: --shards needs --write, and no --plane, --search, --probe, --range, --rect or --stats.\n");
+            batchListFree(&list);
+            return -1;
+        }
+        return decodeShards(&list, argv + optind, argc - optind, writePath, &options);
+    }
+
+    // a single input can be written out raw as it is decoded
+    if(writePath != NULL) {
+        batchListFree(&list);
+        if(optind != argc - 1 || listed || options.usePlane || options.search || options.probeOnly) {
+            printf("Error: --write decodes exactly one input file and no --list, --plane, --search or --probe.\n");
+            return -1;
+        }
+        if(options.printHeaders && strcmp(writePath, "-") == 0) {
+            printf("Error: --headers prints to stdout, which --write - holds the message on.\n");
+            return -1;
+        }
+        decodeConfig_t config;
+        config.bits_per_channel = options.bitsPerChannel ? options.bitsPerChannel : 1;
+        config.channel_mask = options.channelMask ? options.channelMask : CHANNEL_RGB;
+        config.order_key = options.orderKey;
+        if(hasRange || hasRect)
+            return decodeRegion(argv[optind], writePath, &config, hasRange ? range : NULL, &rect, options.stats);
+        return decodeSingleFile(argv[optind], writePath, &config, options.useMmap, options.printHeaders,
+                                options.memoryBudget, options.stats);
+    }
+
+    for(int i = optind; i < argc; i++) {
+        if(batchListAdd(&list, argv[i]) != 1)
+            fprintf(stderr, "Warning: %s matched no files.\n", argv[i]);
+    }
+
+    // JSONL to stdout unless results only go to an output directory
+    if(jsonlPath == NULL && options.outputDir == NULL)
+        jsonlPath = "-";
+    if(jsonlPath != NULL) {
+        options.jsonlFilePtr = strcmp(jsonlPath, "-") == 0 ? stdout : fopen(jsonlPath, "w");
+        if(options.jsonlFilePtr == NULL) {
+            printf("Error: Unable to open output file %s.\n", jsonlPath);
+            batchListFree(&list);
+            return -1;
+        }
+    }
+    if(options.printHeaders && options.jsonlFilePtr == stdout) {
+        printf("Error: --headers prints to stdout, which holds the JSONL records, give --jsonl FILE or -o DIR.\n");
+        batchListFree(&list);
+        return -1;
+    }
+
+    batchSummary_t summary;
+    uint64_t start = statsNow();
+    uint32_t success = runBatch(&list, &options, &summary);
+    fprintf(stderr, "%s %zu of %zu files.\n",
+            options.probeOnly ? "Probed" : options.search ? "Searched" : "Decoded", summary.decoded,
+            summary.decoded + summary.failed);
+    if(options.stats)
+        printStatsSummary(&summary.stats, summary.decoded, summary.failed, start);
 
     // cleanup
-    free(bitmap.pixel_array);
-    free(message);
-    fclose(bitmapFilePtr);
-    fclose(outputFilePtr);
+    if(options.jsonlFilePtr != NULL && options.jsonlFilePtr != stdout)
+        fclose(options.jsonlFilePtr);
+    batchListFree(&list);
 
-    return 0;
+    return success == 1 ? 0 : -1;
 }
 /*** end of file ***/
@@ -0,0 +1,199 @@
+/** @file decodecontext.c
+ *
+ * @brief Reusable decode state for long running callers. Buffers are kept across images, so decoding one image
+ *        after another allocates nothing once the buffers are large enough.
+ * @author Daniel Jaramillo
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "decodecontext.h"
+
+/**
+ * Initializes a context without buffers.
+ *
+ * @param context context to initialize.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ */
+void decodeContextInit(decodeContext_t *context, const decodeConfig_t *config) {
+    context->config.bits_per_channel = config ? config->bits_per_channel : 1;
+    context->config.channel_mask = config ? config->channel_mask : CHANNEL_RGB;
+    context->config.order_key = config ? config->order_key : 0;
+    context->loaded = 0;
+    context->pixels = NULL;
+    context->pixelCapacity = 0;
+    context->message = NULL;
+    context->messageCapacity = 0;
+}
+
+/**
+ * Frees the buffers of a context.
+ *
+ * @param context context to release.
+ */
+void decodeContextRelease(decodeContext_t *context) {
+    free(context->pixels);
+    free(context->message);
+    decodeContextInit(context, &(context->config));
+}
+
+/**
+ * Replaces a buffer by a larger one. The old contents are not kept.
+ *
+ * @param buffer buffer, NULL for none yet.
+ * @param capacity size of the buffer, updated when it is replaced.
+ * @param size size needed.
+ * @return 1 on success, 0 if memory ran out.
+ */
+static uint32_t reserveBuffer(uint8_t **buffer, size_t *capacity, size_t size) {
+    if(*buffer != NULL && size <= *capacity)
+        return 1;
+
+    free(*buffer);
+    *capacity = 0;
+    *buffer = malloc(size);
+    if(*buffer == NULL)
+        return 0;
+    *capacity = size;
+    return 1;
+}
+
+/**
+ * Sizes the buffers of a context up front, so the first images allocate nothing either.
+ *
+ * Drops the current image, whose pixel array may live in the pixel buffer.
+ *
+ * @param context context.
+ * @param pixelBytes largest pixel array read with decodeContextReadFile().
+ * @param messageBytes largest message buffer needed by decodeContextMessage(), see decodeContextRequiredSize().
+ * @return 1 on success, 0 if memory ran out.
+ */
+uint32_t decodeContextReserve(decodeContext_t *context, size_t pixelBytes, size_t messageBytes) {
+    context->loaded = 0;
+    return reserveBuffer(&(context->pixels), &(context->pixelCapacity), pixelBytes) &&
+           reserveBuffer(&(context->message), &(context->messageCapacity), messageBytes);
+}
+
+/**
+ * Reads a bitmap file into the pixel buffer of the context, which only grows when the pixel array does not fit.
+ *
+ * @param context context.
+ * @param bitmapFilePtr bitmap file positioned at its start.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeContextReadFile(decodeContext_t *context, FILE *bitmapFilePtr) {
+    context->loaded = readBitmapFileInto(bitmapFilePtr, &(context->bitmap), &(context->pixels),
+                                         &(context->pixelCapacity));
+    return context->loaded;
+}
+
+/**
+ * Reads a whole bitmap file from a file descriptor into the pixel buffer of the context, which only grows when the
+ * file does not fit, and parses it in place.
+ *
+ * Needs no stream, so reading a file allocates nothing once the buffer is large enough.
+ *
+ * @param context context.
+ * @param fd file descriptor of a regular file. Read from its start with pread(), so its file offset is left alone.
+ * @param maxSize largest file size accepted, 0 for no limit.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeContextReadFd(decodeContext_t *context, int fd, uint64_t maxSize) {
+    struct stat fileStat;
+
+    context->loaded = 0;
+    if(fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || (uint64_t) fileStat.st_size >= SIZE_MAX ||
+            (maxSize != 0 && (uint64_t) fileStat.st_size > maxSize))
+        return 0;
+    size_t size = (size_t) fileStat.st_size;
+    if(reserveBuffer(&(context->pixels), &(context->pixelCapacity), size ? size : 1) == 0)
+        return 0;
+
+    size_t done = 0;
+    while(done < size) {
+        ssize_t count = pread(fd, context->pixels + done, size - done, (off_t) done);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return 0;
+        done += (size_t) count;
+    }
+    context->loaded = parseBitmapMemory(context->pixels, size, &(context->bitmap));
+    return context->loaded;
+}
+
+/**
+ * Parses a bitmap file held in memory of the caller, without copying it. The memory must stay valid while the
+ * image is decoded.
+ *
+ * @param context context.
+ * @param data bitmap file bytes.
+ * @param size number of bytes.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeContextLoadMemory(decodeContext_t *context, const uint8_t *data, size_t size) {
+    context->loaded = parseBitmapMemory(data, size, &(context->bitmap));
+    return context->loaded;
+}
+
+/**
+ * Reports the buffer size decodeContextDecodeInto() needs for the current image, before decoding.
+ *
+ * A framed payload needs its length plus an end of string marker, any other message at most the capacity plus an
+ * end of string marker.
+ *
+ * @param context context holding an image.
+ * @param size buffer size in bytes.
+ * @return DECODE_OK, DECODE_ERROR if no decodeable image is loaded or DECODE_CORRUPT.
+ */
+uint32_t decodeContextRequiredSize(decodeContext_t *context, uint64_t *size) {
+    *size = 0;
+    if(!context->loaded || isDecodeable(&(context->bitmap)) != 1)
+        return DECODE_ERROR;
+    return getDecodeBufferSize(&(context->bitmap), &(context->config), size);
+}
+
+/**
+ * Decodes the message of the current image into a buffer of the caller.
+ *
+ * @param context context holding an image.
+ * @param dst destination buffer, the message is followed by an end of string marker.
+ * @param size size of the destination buffer.
+ * @param length number of message bytes on DECODE_OK, buffer size needed on DECODE_BUFFER_TOO_SMALL.
+ * @return DECODE_OK, DECODE_BUFFER_TOO_SMALL, DECODE_CORRUPT or DECODE_ERROR if no decodeable image is loaded.
+ */
+uint32_t decodeContextDecodeInto(decodeContext_t *context, uint8_t *dst, size_t size, uint64_t *length) {
+    *length = 0;
+    if(!context->loaded || isDecodeable(&(context->bitmap)) != 1)
+        return DECODE_ERROR;
+    return decodeMessageIntoBuffer(&(context->bitmap), &(context->config), dst, size, length);
+}
+
+/**
+ * Decodes the message of the current image into the message buffer of the context, which only grows when the
+ * message does not fit.
+ *
+ * The message is decoded into the buffer as it is. Only if it does not fit is the buffer grown to the size reported
+ * by decodeMessageIntoBuffer() and the message decoded again.
+ *
+ * @param context context holding an image.
+ * @param message message followed by an end of string marker, owned by the context and valid until its next call.
+ * @param length number of message bytes.
+ * @return DECODE_OK, DECODE_CORRUPT or DECODE_ERROR if no decodeable image is loaded or memory ran out.
+ */
+uint32_t decodeContextMessage(decodeContext_t *context, const uint8_t **message, uint64_t *length) {
+    *message = NULL;
+    uint32_t result = decodeContextDecodeInto(context, context->message, context->messageCapacity, length);
+    if(result == DECODE_BUFFER_TOO_SMALL) {
+        if(*length > SIZE_MAX || reserveBuffer(&(context->message), &(context->messageCapacity),
+                                               (size_t) *length) == 0)
+            return DECODE_ERROR;
+        result = decodeContextDecodeInto(context, context->message, context->messageCapacity, length);
+    }
+    if(result == DECODE_OK)
+        *message = context->message;
+    return result;
+}
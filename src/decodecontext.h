@@ -0,0 +1,118 @@
+/** @file decodecontext.h
+ *
+ * @brief Reusable decode state for long running callers. Buffers are kept across images, so decoding one image
+ *        after another allocates nothing once the buffers are large enough.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef DECODECONTEXT_H_
+#define DECODECONTEXT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitmap.h"
+#include "decoder.h"
+
+/**
+ * Decode state reused across images.
+ */
+typedef struct decodeContext {
+    decodeConfig_t config;      // decode configuration used for every image
+    bitmap_t bitmap;            // current image, its pixel array lives in pixels or in memory of the caller
+    uint32_t loaded;            // 1 while bitmap holds a parsed image
+    uint8_t *pixels;            // pixel array buffer of decodeContextReadFile(), whole file of decodeContextReadFd()
+    size_t pixelCapacity;
+    uint8_t *message;           // message buffer reused by decodeContextMessage()
+    size_t messageCapacity;
+} decodeContext_t;
+
+/**
+ * Initializes a context without buffers.
+ *
+ * @param context context to initialize.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ */
+void decodeContextInit(decodeContext_t *context, const decodeConfig_t *config);
+
+/**
+ * Frees the buffers of a context.
+ *
+ * @param context context to release.
+ */
+void decodeContextRelease(decodeContext_t *context);
+
+/**
+ * Sizes the buffers of a context up front, so the first images allocate nothing either.
+ *
+ * @param context context.
+ * @param pixelBytes largest pixel array read with decodeContextReadFile().
+ * @param messageBytes largest message buffer needed by decodeContextMessage(), see decodeContextRequiredSize().
+ * @return 1 on success, 0 if memory ran out.
+ */
+uint32_t decodeContextReserve(decodeContext_t *context, size_t pixelBytes, size_t messageBytes);
+
+/**
+ * Reads a bitmap file into the pixel buffer of the context, which only grows when the pixel array does not fit.
+ *
+ * @param context context.
+ * @param bitmapFilePtr bitmap file positioned at its start.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeContextReadFile(decodeContext_t *context, FILE *bitmapFilePtr);
+
+/**
+ * Reads a whole bitmap file from a file descriptor into the pixel buffer of the context, which only grows when the
+ * file does not fit, and parses it in place.
+ *
+ * @param context context.
+ * @param fd file descriptor of a regular file. Read from its start with pread(), so its file offset is left alone.
+ * @param maxSize largest file size accepted, 0 for no limit.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeContextReadFd(decodeContext_t *context, int fd, uint64_t maxSize);
+
+/**
+ * Parses a bitmap file held in memory of the caller, without copying it. The memory must stay valid while the
+ * image is decoded.
+ *
+ * @param context context.
+ * @param data bitmap file bytes.
+ * @param size number of bytes.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeContextLoadMemory(decodeContext_t *context, const uint8_t *data, size_t size);
+
+/**
+ * Reports the buffer size decodeContextDecodeInto() needs for the current image, before decoding.
+ *
+ * @param context context holding an image.
+ * @param size buffer size in bytes.
+ * @return DECODE_OK, DECODE_ERROR if no decodeable image is loaded or DECODE_CORRUPT.
+ */
+uint32_t decodeContextRequiredSize(decodeContext_t *context, uint64_t *size);
+
+/**
+ * Decodes the message of the current image into a buffer of the caller.
+ *
+ * @param context context holding an image.
+ * @param dst destination buffer, the message is followed by an end of string marker.
+ * @param size size of the destination buffer.
+ * @param length number of message bytes on DECODE_OK, buffer size needed on DECODE_BUFFER_TOO_SMALL.
+ * @return DECODE_OK, DECODE_BUFFER_TOO_SMALL, DECODE_CORRUPT or DECODE_ERROR if no decodeable image is loaded.
+ */
+uint32_t decodeContextDecodeInto(decodeContext_t *context, uint8_t *dst, size_t size, uint64_t *length);
+
+/**
+ * Decodes the message of the current image into the message buffer of the context, which only grows when the
+ * message does not fit.
+ *
+ * @param context context holding an image.
+ * @param message message followed by an end of string marker, owned by the context and valid until its next call.
+ * @param length number of message bytes.
+ * @return DECODE_OK, DECODE_CORRUPT or DECODE_ERROR if no decodeable image is loaded or memory ran out.
+ */
+uint32_t decodeContextMessage(decodeContext_t *context, const uint8_t **message, uint64_t *length);
+
+#endif
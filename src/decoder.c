@@ -3,19 +3,42 @@
  * @brief Decodes message hidden in bitmap file.
  * @author Daniel Jaramillo
  */
+#include <string.h>
+
+#include "crc32c.h"
 #include "decoder.h"
+#include "lsbkernels.h"
+#include "lz.h"
+
+/**
+ * Message bytes the block decoders, such as decodeFramedPayload(), decode at a time, small enough to stay in the L2
+ * cache.
+ */
+#define DECODE_BLOCK_BYTES          (64 * 1024)
+
+/**
+ * Compressed stream bytes a compressed frame is decoded in at a time, into a buffer on the stack.
+ */
+#define COMPRESSED_BLOCK_BYTES      (16 * 1024)
+
+/**
+ * Message bytes decoded with a frame header, the header and at most one group of 8 pixels more.
+ */
+#define FRAME_HEAD_BYTES            (FRAME_HEADER_SIZE + 3 * LSB_MAX_BITS_PER_CHANNEL)
 
 /**
  * Returns 1 if the bitmap is of a currently implemented decodable type.
  *
  * File can have any bitmap file signature but
- * must be of type BITMAPCOREHEADER or BITMAPINFOHEADER, have 1 color plane, 24 bits per pixel, no compression, and no
- * color palette.
+ * must be of type BITMAPCOREHEADER, BITMAPINFOHEADER, BITMAPV4HEADER or BITMAPV5HEADER, have 1 color plane, no color
+ * palette and 24 or 32 bits per pixel with one byte per color channel, see getPixelFormat().
  *
  * @param bitmap bitmap in memory to be checked
  * @return 1 if decodeable, 0 otherwise.
  */
 uint16_t isDecodeable(bitmap_t *bitmap){
+    pixelFormat_t format;
+
     // Check signature type
     if(bitmap->bmpFileHeader.signature != BM)
         return 0;
@@ -29,10 +52,11 @@ uint16_t isDecodeable(bitmap_t *bitmap){
             break;
 
         case BITMAPINFOHEADER:
-            // must have 1 color plane, 24 bits per pixel, no compression, and no color palette
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER:
+            // must have 1 color plane, byte aligned 24 or 32 bit pixels, and no color palette
             if(bitmap->dibHeader.header.bitMapInfoHeader.color_planes != 1 ||
-                bitmap->dibHeader.header.bitMapInfoHeader.bits_per_pixel != 24 ||
-                bitmap->dibHeader.header.bitMapInfoHeader.compression_method != BI_RGB ||
+                getPixelFormat(&(bitmap->dibHeader), &format) != 1 ||
                 bitmap->dibHeader.header.bitMapInfoHeader.color_palette !=0)
                 return 0;
             break;
@@ -41,8 +65,6 @@ uint16_t isDecodeable(bitmap_t *bitmap){
         case OS22XBITMAPHEADER_S:
         case BITMAPV2INFOHEADER:
         case BITMAPV3INFOHEADER:
-        case BITMAPV4HEADER:
-        case BITMAPV5HEADER:
         default:
             // dib header types not yet supported
             return 0;
@@ -51,63 +73,1026 @@ uint16_t isDecodeable(bitmap_t *bitmap){
 }
 
 /**
- * Decodes the secret message embedded in bitmap data.
+ * Returns the number of whole message bytes held by a number of pixels.
  *
- * Assumes file is of a decodeable type.
+ * Divides before multiplying, so no pixel count of a 32 bit wide and 31 bit high bitmap overflows.
  *
- * @param bitmap bitmap in memory to be decoded.
- * @return pointer to char string with secret message.
+ * @param pixels number of pixels.
+ * @param bitsPerPixel message bits held by each pixel, at most 16.
+ * @return number of whole message bytes.
  */
-char *decodeMessage(bitmap_t *bitmap) {
-    uint32_t charCount;
-    uint32_t byteCount;
-    uint32_t width;
-    uint32_t height;
+static uint64_t getCapacityOfPixels(uint64_t pixels, uint32_t bitsPerPixel) {
+    return pixels / 8 * bitsPerPixel + pixels % 8 * bitsPerPixel / 8;
+}
 
-    // allocate memory for string and add end of string marker
-    // cases are redundant to allow for more formats
+/**
+ * Calculates the number of message characters that fit in the bitmap.
+ *
+ * Every pixel holds one bit in each of its 3 color channels, an alpha byte holds none.
+ *
+ * @param bitmap bitmap in memory.
+ * @param charCount number of characters the bitmap holds, excluding end of string marker.
+ * @return 1 on success, 0 if the DIB header type is not supported.
+ */
+uint32_t getMessageCapacity(const bitmap_t *bitmap, uint64_t *charCount) {
     switch(bitmap->dibHeader.type) {
         case BITMAPCOREHEADER:
-            width = bitmap->dibHeader.header.bitMapCoreHeader.bitmap_width;
-            height = bitmap->dibHeader.header.bitMapCoreHeader.bitmap_height;
-            byteCount = 3 * width * height;
-            charCount = byteCount / 8;
-            break;
-
         case BITMAPINFOHEADER:
-            width = bitmap->dibHeader.header.bitMapInfoHeader.bitmap_width;
-            height = bitmap->dibHeader.header.bitMapInfoHeader.bitmap_height;
-            byteCount = 3 * width * height;
-            charCount = byteCount / 8;
-            break;
+        case BITMAPV4HEADER:
+        case BITMAPV5HEADER:
+            *charCount = getCapacityOfPixels(
+                    (uint64_t) getBitmapWidth(&(bitmap->dibHeader)) * getBitmapHeight(&(bitmap->dibHeader)), 3);
+            return 1;
 
         case OS22XBITMAPHEADER:
         case OS22XBITMAPHEADER_S:
         case BITMAPV2INFOHEADER:
         case BITMAPV3INFOHEADER:
-        case BITMAPV4HEADER:
-        case BITMAPV5HEADER:
         default:
-            byteCount = 0;
-            charCount = 0;
-            return NULL;
+            *charCount = 0;
+            return 0;
     }
-    char *str = malloc(charCount + 1);
+}
+
+/**
+ * Returns 1 if the bitmap has 4 bytes per pixel, which decodeMessageWithConfig() decodes by skipping the alpha byte.
+ *
+ * @param bitmap bitmap in memory.
+ * @return 1 for 32 bit pixels, 0 otherwise.
+ */
+static uint32_t hasAlphaByte(const bitmap_t *bitmap) {
+    pixelFormat_t format;
+    return getPixelFormat(&(bitmap->dibHeader), &format) == 1 && format.bytes_per_pixel == 4;
+}
+
+/**
+ * Decodes a range of message characters by walking the rows of the pixel array in place.
+ *
+ * Character n is packed from subpixel bytes 8 * n to 8 * n + 7 counted along the rows with padding left out. Rows
+ * are fed to an lsbUnpacker_t, which carries characters that straddle two rows.
+ *
+ * @param rows rows of the pixel array.
+ * @param firstChar index of the first character to decode.
+ * @param count number of characters to decode.
+ * @param dst destination for count characters.
+ */
+static void decodeRows(const bitmapRows_t *rows, uint64_t firstChar, size_t count, uint8_t *dst) {
+    if(count == 0 || rows->row_bytes == 0)
+        return;
+
+    uint64_t firstByte = firstChar * 8;
+    uint32_t row = (uint32_t) (firstByte / rows->row_bytes);
+    size_t column = (size_t) (firstByte % rows->row_bytes);
+
+    lsbUnpacker_t unpacker;
+    lsbUnpackerInit(&unpacker);
+    size_t written = 0;
+    for(; written < count && row < rows->row_count; row++) {
+        // never feed more bits than the characters still needed
+        size_t needed = (count - written) * 8 - unpacker.bitCount;
+        size_t length = rows->row_bytes - column;
+        if(length > needed)
+            length = needed;
+
+        written += lsbUnpackerFeed(&unpacker, getRow(rows, row) + column, length, dst + written);
+        column = 0;
+    }
+}
+
+/**
+ * Decodes the payload of a frame in place of a C string, so the decodeMessage() functions hand out framed payloads
+ * transparently.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param str payload of the frame, NULL if the frame is corrupt or memory ran out.
+ * @return 1 if the message is a frame, 0 otherwise.
+ */
+static uint32_t decodeFrameAsMessage(bitmap_t *bitmap, const decodeConfig_t *config, char **str) {
+    uint8_t *payload;
+    uint64_t length;
+
+    if(decodeFramedPayload(bitmap, config, &payload, &length) == FRAME_NOT_FOUND)
+        return 0;
+    *str = (char *) payload;
+    return 1;
+}
+
+/**
+ * Decodes the secret message embedded in bitmap data.
+ *
+ * Assumes file is of a decodeable type. Rows are decoded in place from the bottom of the image up, skipping row
+ * padding. 32 bit pixels are decoded by decodeMessageWithConfig(), which skips the alpha byte. A message starting
+ * with a frame header, see frame.h, is decoded by decodeFramedPayload() and its payload returned, decompressed if
+ * the frame is compressed.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @return pointer to char string with secret message, NULL if a framed payload is corrupt.
+ */
+char *decodeMessage(bitmap_t *bitmap) {
+    uint64_t charCount;
+    bitmapRows_t rows;
+    char *str;
+
+    if(hasAlphaByte(bitmap)) {
+        decodeConfig_t config = {1, CHANNEL_RGB, 0};
+        return decodeMessageWithConfig(bitmap, &config);
+    }
+    if(decodeFrameAsMessage(bitmap, NULL, &str))
+        return str;
+
+    // allocate memory for string and add end of string marker
+    if(getMessageCapacity(bitmap, &charCount) == 0 || getBitmapRows(bitmap, &rows) == 0)
+        return NULL;
+    if(charCount >= SIZE_MAX)
+        return NULL;
+    str = malloc((size_t) charCount + 1);
+    if(str == NULL)
+        return NULL;
     str[charCount] = '\0';
 
-    //TODO: this version does not work with row padding
-    uint8_t tempChar = 0;
-    uint32_t cCounter = 0;
-    uint8_t bit = 0;
-    for(uint32_t bCounter = 0; bCounter < byteCount && cCounter < charCount; bCounter++) {
-        tempChar = tempChar | ((bitmap->pixel_array[bCounter] & 1) << bit);
-        bit++;
-        if(bit > 7) {
-            str[cCounter] = tempChar;
-            cCounter++;
-            bit = 0;
-            tempChar = 0;
+    decodeRows(&rows, 0, charCount, (uint8_t *) str);
+    return str;
+}
+
+/**
+ * Range of message characters decoded by one worker.
+ */
+typedef struct decodeRange {
+    const bitmapRows_t *rows;
+    uint64_t firstChar;
+    size_t count;
+    uint8_t *dst;
+} decodeRange_t;
+
+/**
+ * Worker task decoding one range straight into the shared output buffer.
+ *
+ * @param arg decodeRange_t to decode.
+ */
+static void decodeRangeTask(void *arg) {
+    decodeRange_t *range = arg;
+    decodeRows(range->rows, range->firstChar, range->count, range->dst);
+}
+
+/**
+ * Decodes the secret message embedded in bitmap data on a thread pool.
+ *
+ * Splits the message into one contiguous range per worker. Each range starts on a multiple of 8 subpixel bytes, so
+ * every character is decoded by exactly one worker, and on a multiple of PARALLEL_DECODE_ALIGN characters so workers
+ * do not share cache lines of the output buffer. Ranges are counted along the rows in decode order, bottom row
+ * first with padding skipped, so the result matches decodeMessage(). 32 bit pixels are decoded by
+ * decodeMessageOnPoolWithConfig().
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param pool thread pool running the decode.
+ * @return pointer to char string with secret message.
+ */
+char *decodeMessageOnPool(bitmap_t *bitmap, threadPool_t *pool) {
+    uint64_t charCount;
+    bitmapRows_t rows;
+    char *str;
+
+    if(hasAlphaByte(bitmap)) {
+        decodeConfig_t config = {1, CHANNEL_RGB, 0};
+        return decodeMessageOnPoolWithConfig(bitmap, &config, pool);
+    }
+    if(decodeFrameAsMessage(bitmap, NULL, &str))
+        return str;
+
+    if(getMessageCapacity(bitmap, &charCount) == 0 || getBitmapRows(bitmap, &rows) == 0)
+        return NULL;
+    if(charCount >= SIZE_MAX)
+        return NULL;
+    str = malloc((size_t) charCount + 1);
+    if(str == NULL)
+        return NULL;
+    str[charCount] = '\0';
+
+    // split evenly, but never into ranges so small that scheduling costs more than decoding
+    uint32_t rangeCount = threadPoolSize(pool);
+    size_t rangeSize = ((size_t) charCount + rangeCount - 1) / rangeCount;
+    rangeSize = (rangeSize + PARALLEL_DECODE_ALIGN - 1) / PARALLEL_DECODE_ALIGN * PARALLEL_DECODE_ALIGN;
+    if(rangeSize < PARALLEL_DECODE_MIN_RANGE)
+        rangeSize = PARALLEL_DECODE_MIN_RANGE;
+
+    decodeRange_t ranges[rangeCount];
+    taskGroup_t group;
+    taskGroupInit(&group);
+    size_t start = 0;
+    for(uint32_t r = 0; r < rangeCount && start < charCount; r++) {
+        ranges[r].rows = &rows;
+        ranges[r].firstChar = start;
+        ranges[r].count = (charCount - start < rangeSize) ? charCount - start : rangeSize;
+        ranges[r].dst = (uint8_t *) str + start;
+        start += ranges[r].count;
+
+        // run the range on the calling thread if it cannot be queued
+        if(threadPoolSubmit(pool, &group, decodeRangeTask, &ranges[r]) == 0)
+            decodeRangeTask(&ranges[r]);
+    }
+    taskGroupWait(&group);
+    taskGroupDestroy(&group);
+
+    return str;
+}
+/**
+ * Decodes the secret message embedded in bitmap data using multiple threads.
+ *
+ * Creates a thread pool for the call. Use decodeMessageOnPool() to reuse a pool across images.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param threadCount number of worker threads, 0 for one per online processor.
+ * @return pointer to char string with secret message.
+ */
+char *decodeMessageParallel(bitmap_t *bitmap, uint32_t threadCount) {
+    threadPool_t *pool = threadPoolCreate(threadCount);
+    if(pool == NULL)
+        return decodeMessage(bitmap);
+
+    char *str = decodeMessageOnPool(bitmap, pool);
+    threadPoolDestroy(pool);
+    return str;
+}
+
+/**
+ * Returns 1 if the configuration is the one decodeMessage() uses, which has a vectorized kernel.
+ *
+ * @param config decode configuration.
+ * @return 1 for the default configuration, 0 otherwise.
+ */
+static uint32_t isDefaultConfig(const decodeConfig_t *config) {
+    return config->bits_per_channel == 1 && config->channel_mask == CHANNEL_RGB && config->order_key == 0;
+}
+
+/**
+ * Returns the number of message bits held by one pixel.
+ *
+ * @param config decode configuration.
+ * @return message bits per pixel.
+ */
+static uint32_t getBitsPerPixelOfMessage(const decodeConfig_t *config) {
+    return config->bits_per_channel * (uint32_t) __builtin_popcount(config->channel_mask);
+}
+
+/**
+ * Selects the kernel for a decode configuration and the pixel layout of the bitmap.
+ *
+ * Channels of the configuration are mapped to the bytes holding them, so bits are taken in the byte order of each
+ * pixel and an alpha byte is never selected.
+ *
+ * @param bitmap bitmap with parsed headers.
+ * @param config decode configuration.
+ * @return kernel, NULL if the pixel layout or configuration is not supported.
+ */
+lsbPixelKernel_t selectDecodeKernel(const bitmap_t *bitmap, const decodeConfig_t *config) {
+    pixelFormat_t format;
+    if(getPixelFormat(&(bitmap->dibHeader), &format) == 0 || (config->channel_mask & ~CHANNEL_RGB) != 0)
+        return NULL;
+
+    uint32_t byteMask = 0;
+    if(config->channel_mask & CHANNEL_BLUE)
+        byteMask |= 1u << format.blue_byte;
+    if(config->channel_mask & CHANNEL_GREEN)
+        byteMask |= 1u << format.green_byte;
+    if(config->channel_mask & CHANNEL_RED)
+        byteMask |= 1u << format.red_byte;
+    return selectLSBPixelKernel(format.bytes_per_pixel, config->bits_per_channel, byteMask);
+}
+
+/**
+ * Calculates the number of message characters that fit in the bitmap with a decode configuration.
+ *
+ * @param bitmap bitmap in memory.
+ * @param config decode configuration.
+ * @param charCount number of characters the bitmap holds, excluding end of string marker.
+ * @return 1 on success, 0 if the DIB header type or configuration is not supported.
+ */
+uint32_t getMessageCapacityWithConfig(const bitmap_t *bitmap, const decodeConfig_t *config, uint64_t *charCount) {
+    *charCount = 0;
+    if(selectDecodeKernel(bitmap, config) == NULL || getMessageCapacity(bitmap, charCount) == 0)
+        return 0;
+
+    uint64_t pixels = (uint64_t) getBitmapWidth(&(bitmap->dibHeader)) * getBitmapHeight(&(bitmap->dibHeader));
+    *charCount = getCapacityOfPixels(pixels, getBitsPerPixelOfMessage(config));
+    return 1;
+}
+
+/**
+ * Decodes a range of positions in a keyed pixel order with a specialized kernel.
+ *
+ * The pixels of each block of the order are gathered next to each other on the stack, see gatherOrderedPixels(),
+ * and the kernel runs over them with its bit accumulator carried from block to block.
+ *
+ * @param order keyed pixel order.
+ * @param rows rows of the pixel array.
+ * @param kernel kernel selected for the decode configuration.
+ * @param firstSlot first position in the keyed order, a multiple of 8.
+ * @param slotCount number of positions to decode.
+ * @param dst destination for the message bytes.
+ * @return number of message bytes written.
+ */
+static size_t decodeOrderedPixels(const pixelOrder_t *order, const bitmapRows_t *rows, lsbPixelKernel_t kernel,
+                                  uint64_t firstSlot, uint64_t slotCount, uint8_t *dst) {
+    uint8_t pixels[PIXEL_ORDER_BLOCK_PIXELS * 4];
+    bitAccumulator_t accumulator = {0, 0};
+    size_t written = 0;
+    while(slotCount > 0) {
+        uint64_t count = PIXEL_ORDER_BLOCK_PIXELS - (firstSlot & (PIXEL_ORDER_BLOCK_PIXELS - 1));
+        if(count > slotCount)
+            count = slotCount;
+
+        gatherOrderedPixels(order, rows, firstSlot, (size_t) count, pixels);
+        written += kernel(pixels, (size_t) count, &accumulator, dst + written);
+        firstSlot += count;
+        slotCount -= count;
+    }
+    return written;
+}
+
+/**
+ * Decodes a range of pixels with a specialized kernel by walking the rows in place, or the pixel order of a key.
+ *
+ * The range must start on a multiple of 8 pixels, so it starts on a message byte boundary. Only completed message
+ * bytes are written.
+ *
+ * @param rows rows of the pixel array.
+ * @param order keyed pixel order, NULL for the rows in decode order.
+ * @param kernel kernel selected for the decode configuration.
+ * @param firstPixel index of the first pixel, counted along the rows in decode order or in the keyed order.
+ * @param pixelCount number of pixels to decode.
+ * @param dst destination for the message bytes.
+ * @return number of message bytes written.
+ */
+static size_t decodePixels(const bitmapRows_t *rows, const pixelOrder_t *order, lsbPixelKernel_t kernel,
+                           uint64_t firstPixel, uint64_t pixelCount, uint8_t *dst) {
+    if(pixelCount == 0 || rows->row_pixels == 0)
+        return 0;
+    if(order != NULL)
+        return decodeOrderedPixels(order, rows, kernel, firstPixel, pixelCount, dst);
+
+    size_t pixelBytes = rows->row_bytes / rows->row_pixels;
+    uint32_t row = (uint32_t) (firstPixel / rows->row_pixels);
+    uint32_t column = (uint32_t) (firstPixel % rows->row_pixels);
+    bitAccumulator_t accumulator = {0, 0};
+    size_t written = 0;
+    for(; pixelCount > 0 && row < rows->row_count; row++) {
+        uint64_t count = rows->row_pixels - column;
+        if(count > pixelCount)
+            count = pixelCount;
+
+        written += kernel(getRow(rows, row) + column * pixelBytes, (size_t) count, &accumulator, dst + written);
+        pixelCount -= count;
+        column = 0;
+    }
+    return written;
+}
+
+/**
+ * Decodes the secret message embedded with a given number of bits per channel in the selected channels.
+ *
+ * Message bits are taken pixel by pixel along the rows in decode order. For each pixel the low bits of every selected
+ * channel are appended in the byte order of the pixel, blue, green, red for 24 bit pixels, least significant bit
+ * first. An alpha byte is skipped. The kernel for the configuration and pixel layout is chosen once before the walk.
+ * With an order key the pixels are taken in the keyed order of pixelorder.h instead of along the rows. The default
+ * configuration on 24 bit pixels uses decodeMessage().
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration.
+ * @return pointer to char string with secret message, NULL if the configuration is not supported.
+ */
+char *decodeMessageWithConfig(bitmap_t *bitmap, const decodeConfig_t *config) {
+    uint64_t charCount;
+    bitmapRows_t rows;
+    char *str;
+
+    if(isDefaultConfig(config) && !hasAlphaByte(bitmap))
+        return decodeMessage(bitmap);
+    if(decodeFrameAsMessage(bitmap, config, &str))
+        return str;
+
+    lsbPixelKernel_t kernel = selectDecodeKernel(bitmap, config);
+    if(getMessageCapacityWithConfig(bitmap, config, &charCount) == 0 || getBitmapRows(bitmap, &rows) == 0)
+        return NULL;
+    if(charCount >= SIZE_MAX)
+        return NULL;
+    str = malloc((size_t) charCount + 1);
+    if(str == NULL)
+        return NULL;
+    str[charCount] = '\0';
+
+    if(config->order_key != 0) {
+        pixelOrder_t order;
+        pixelOrderInit(&order, config->order_key, (uint64_t) rows.row_pixels * rows.row_count);
+        decodePixels(&rows, &order, kernel, 0, order.pixel_count, (uint8_t *) str);
+        return str;
+    }
+    decodePixels(&rows, NULL, kernel, 0, (uint64_t) rows.row_pixels * rows.row_count, (uint8_t *) str);
+    return str;
+}
+
+/**
+ * Decodes a range of pixels starting on a multiple of 8 pixels, with decodeRows() for the configuration of
+ * decodeMessage() on 24 bit pixels and with a kernel otherwise.
+ *
+ * @param rows rows of the pixel array.
+ * @param order keyed pixel order, NULL for the rows in decode order, which decodeRows() needs.
+ * @param kernel kernel selected for the decode configuration, NULL for decodeRows().
+ * @param bitsPerPixel message bits held by each pixel.
+ * @param firstPixel index of the first pixel, a multiple of 8.
+ * @param pixelCount number of pixels to decode.
+ * @param dst destination for the message bytes.
+ * @return number of message bytes written.
+ */
+static size_t decodePixelGroups(const bitmapRows_t *rows, const pixelOrder_t *order, lsbPixelKernel_t kernel,
+                                uint32_t bitsPerPixel, uint64_t firstPixel, uint64_t pixelCount, uint8_t *dst) {
+    if(kernel != NULL)
+        return decodePixels(rows, order, kernel, firstPixel, pixelCount, dst);
+
+    size_t count = (size_t) (pixelCount * bitsPerPixel / 8);
+    decodeRows(rows, firstPixel * bitsPerPixel / 8, count, dst);
+    return count;
+}
+
+/**
+ * Pixels of a message still to be decoded, walked one block at a time.
+ */
+typedef struct messageReader {
+    bitmapRows_t rows;
+    lsbPixelKernel_t kernel;    // kernel for the decode configuration, NULL for decodeRows()
+    uint32_t bitsPerPixel;      // message bits held by each pixel
+    uint64_t pixel;             // next pixel to decode, a multiple of 8
+    uint64_t totalPixels;
+    uint32_t ordered;           // 1 if the pixels are walked in the keyed order
+    pixelOrder_t order;
+} messageReader_t;
+
+/**
+ * Prepares a reader starting at the first pixel of the message embedded with a decode configuration.
+ *
+ * @param reader message reader.
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration.
+ * @param charCount number of characters the bitmap holds.
+ * @return 1 on success, 0 if the DIB header type or configuration is not supported.
+ */
+static uint32_t initMessageReader(messageReader_t *reader, bitmap_t *bitmap, const decodeConfig_t *config,
+                                  uint64_t *charCount) {
+    reader->kernel = NULL;
+    if(!isDefaultConfig(config) || hasAlphaByte(bitmap))
+        reader->kernel = selectDecodeKernel(bitmap, config);
+    if(getMessageCapacityWithConfig(bitmap, config, charCount) == 0 || getBitmapRows(bitmap, &(reader->rows)) == 0)
+        return 0;
+
+    reader->bitsPerPixel = getBitsPerPixelOfMessage(config);
+    reader->pixel = 0;
+    reader->totalPixels = (uint64_t) reader->rows.row_pixels * reader->rows.row_count;
+    reader->ordered = config->order_key != 0;
+    if(reader->ordered)
+        pixelOrderInit(&(reader->order), config->order_key, reader->totalPixels);
+    return 1;
+}
+
+/**
+ * Decodes the smallest whole groups of 8 pixels holding a number of message bytes, or the pixels left if fewer.
+ *
+ * @param reader message reader.
+ * @param count number of message bytes wanted.
+ * @param dst destination, room for count + bitsPerPixel bytes.
+ * @return number of message bytes written, count or more unless the pixels ran out.
+ */
+static size_t readMessageBytes(messageReader_t *reader, uint64_t count, uint8_t *dst) {
+    uint64_t pixels = ((count * 8 + reader->bitsPerPixel - 1) / reader->bitsPerPixel + 7) / 8 * 8;
+    if(pixels > reader->totalPixels - reader->pixel)
+        pixels = reader->totalPixels - reader->pixel;
+
+    size_t written = decodePixelGroups(&(reader->rows), reader->ordered ? &(reader->order) : NULL, reader->kernel,
+                                       reader->bitsPerPixel, reader->pixel, pixels, dst);
+    reader->pixel += pixels;
+    return written;
+}
+
+/**
+ * Decodes exactly a number of message bytes, or the bytes left if the pixels run out, without writing past them.
+ *
+ * Whole groups of 8 pixels hold bitsPerPixel bytes each and are decoded in place. A last partial group is decoded
+ * into a small buffer and only the bytes asked for are copied. The reader then no longer starts on a message byte
+ * boundary, so only the last read of a message may ask for a count that is not a multiple of bitsPerPixel.
+ *
+ * @param reader message reader.
+ * @param count number of message bytes.
+ * @param dst destination, room for count bytes.
+ * @return number of message bytes written.
+ */
+static size_t readMessageBytesExact(messageReader_t *reader, uint64_t count, uint8_t *dst) {
+    uint8_t tail[3 * LSB_MAX_BITS_PER_CHANNEL];
+
+    uint64_t whole = count / reader->bitsPerPixel * reader->bitsPerPixel;
+    size_t written = readMessageBytes(reader, whole, dst);
+    if(written < whole || whole == count)
+        return written;
+
+    size_t extra = readMessageBytes(reader, count - whole, tail);
+    if(extra > count - whole)
+        extra = (size_t) (count - whole);
+    memcpy(dst + written, tail, extra);
+    return written + extra;
+}
+
+/**
+ * Returns the largest multiple of bitsPerPixel bytes in DECODE_BLOCK_BYTES, so blocks read by
+ * readMessageBytesExact() stay on message byte boundaries.
+ *
+ * @param reader message reader.
+ * @return block size in bytes.
+ */
+static uint64_t getMessageBlockBytes(const messageReader_t *reader) {
+    return DECODE_BLOCK_BYTES / reader->bitsPerPixel * reader->bitsPerPixel;
+}
+
+/**
+ * Decodes the payload of an uncompressed frame.
+ *
+ * Without a writer the payload is decoded straight into its buffer. With a writer each block is decoded into the
+ * start of dst and handed to the writer.
+ *
+ * @param reader message reader positioned after the pixels of the head.
+ * @param header parsed frame header.
+ * @param head message bytes decoded with the header, their payload bytes come first.
+ * @param headBytes number of bytes in head.
+ * @param dst destination, room for header->length bytes, or for DECODE_BLOCK_BYTES bytes with a writer.
+ * @param writer writer receiving the payload, NULL to keep it in dst.
+ * @param context context of the writer.
+ * @param crc CRC-32C of the payload.
+ * @return FRAME_OK, FRAME_CORRUPT if the pixels ran out, or FRAME_ERROR if the writer failed.
+ */
+static uint32_t readPlainPayload(messageReader_t *reader, const frameHeader_t *header, const uint8_t *head,
+                                 size_t headBytes, uint8_t *dst, messageWriter_t writer, void *context,
+                                 uint32_t *crc) {
+    uint64_t blockBytes = getMessageBlockBytes(reader);
+    uint64_t written = headBytes - FRAME_HEADER_SIZE;
+    if(written > header->length)
+        written = header->length;
+    *crc = crc32cUpdate(0, head + FRAME_HEADER_SIZE, (size_t) written);
+    if(writer == NULL)
+        memcpy(dst, head + FRAME_HEADER_SIZE, (size_t) written);
+    else if(written > 0 && writer(context, head + FRAME_HEADER_SIZE, (size_t) written) == 0)
+        return FRAME_ERROR;
+
+    while(written < header->length) {
+        uint8_t *block = (writer == NULL) ? dst + written : dst;
+        uint64_t wanted = header->length - written;
+        if(wanted > blockBytes)
+            wanted = blockBytes;
+        size_t count = readMessageBytesExact(reader, wanted, block);
+        if(count < wanted)
+            return FRAME_CORRUPT;
+
+        *crc = crc32cUpdate(*crc, block, count);
+        if(writer != NULL && writer(context, block, count) == 0)
+            return FRAME_ERROR;
+        written += count;
+    }
+    return FRAME_OK;
+}
+
+/**
+ * Decodes the payload of a compressed frame by feeding the decoded stream to an lzDecoder_t one block at a time.
+ *
+ * Only one block of the compressed stream exists at a time, in a buffer on the stack. The bytes each block
+ * decompresses to are checksummed, and handed to the writer if there is one, right after they are written.
+ *
+ * @param reader message reader positioned after the pixels of the head.
+ * @param header parsed frame header.
+ * @param head message bytes decoded with the header, their stream bytes are fed first.
+ * @param headBytes number of bytes in head.
+ * @param dst destination, room for header->length bytes, which matches are copied from.
+ * @param writer writer receiving the payload, NULL to only keep it in dst.
+ * @param context context of the writer.
+ * @param crc CRC-32C of the payload.
+ * @return FRAME_OK, FRAME_CORRUPT if the stream is malformed or ends early, or FRAME_ERROR if the writer failed.
+ */
+static uint32_t readCompressedPayload(messageReader_t *reader, const frameHeader_t *header, const uint8_t *head,
+                                      size_t headBytes, uint8_t *dst, messageWriter_t writer, void *context,
+                                      uint32_t *crc) {
+    uint8_t block[COMPRESSED_BLOCK_BYTES + 3 * LSB_MAX_BITS_PER_CHANNEL];
+    lzDecoder_t decoder;
+
+    lzDecoderInit(&decoder, dst, header->length);
+    uint32_t status = lzDecoderFeed(&decoder, head + FRAME_HEADER_SIZE, headBytes - FRAME_HEADER_SIZE);
+    *crc = crc32cUpdate(0, dst, (size_t) decoder.written);
+    if(writer != NULL && decoder.written > 0 && writer(context, dst, (size_t) decoder.written) == 0)
+        return FRAME_ERROR;
+
+    while(status == LZ_NEED_MORE) {
+        size_t count = readMessageBytes(reader, COMPRESSED_BLOCK_BYTES, block);
+        if(count == 0)
+            break;
+
+        uint64_t written = decoder.written;
+        status = lzDecoderFeed(&decoder, block, count);
+        size_t produced = (size_t) (decoder.written - written);
+        *crc = crc32cUpdate(*crc, dst + written, produced);
+        if(writer != NULL && produced > 0 && writer(context, dst + written, produced) == 0)
+            return FRAME_ERROR;
+    }
+    return status == LZ_DONE ? FRAME_OK : FRAME_CORRUPT;
+}
+
+/**
+ * Decodes the pixels holding a frame header and checks the header against the capacity.
+ *
+ * @param reader message reader at the first pixel, left after the pixels of the head.
+ * @param charCount number of characters the bitmap holds.
+ * @param head destination for the message bytes decoded with the header, FRAME_HEAD_BYTES long.
+ * @param headBytes number of bytes in head.
+ * @param header parsed frame header.
+ * @return FRAME_OK if a frame header was found, FRAME_NOT_FOUND, or FRAME_CORRUPT if its length cannot be right.
+ */
+static uint32_t readFrameHeader(messageReader_t *reader, uint64_t charCount, uint8_t *head, size_t *headBytes,
+                                frameHeader_t *header) {
+    if(charCount < FRAME_HEADER_SIZE)
+        return FRAME_NOT_FOUND;
+    *headBytes = readMessageBytes(reader, FRAME_HEADER_SIZE, head);
+    if(parseFrameHeader(head, header) == 0)
+        return FRAME_NOT_FOUND;
+
+    // a compressed payload may be longer than the capacity, but not by more than the best compression ratio
+    uint64_t maxLength = charCount - FRAME_HEADER_SIZE;
+    if(header->compressed)
+        maxLength = (maxLength > UINT64_MAX / LZ_MAX_RATIO) ? UINT64_MAX : maxLength * LZ_MAX_RATIO;
+    if(header->length > maxLength || header->length >= SIZE_MAX)
+        return FRAME_CORRUPT;
+    return FRAME_OK;
+}
+
+/**
+ * Decodes the payload of a frame whose header was read by readFrameHeader() and verifies its checksum.
+ *
+ * @param reader message reader positioned after the pixels of the head.
+ * @param header parsed frame header.
+ * @param head message bytes decoded with the header.
+ * @param headBytes number of bytes in head.
+ * @param dst destination, see readPlainPayload() and readCompressedPayload().
+ * @param writer writer receiving the payload, NULL to keep it in dst.
+ * @param context context of the writer.
+ * @return FRAME_OK, FRAME_CORRUPT or FRAME_ERROR.
+ */
+static uint32_t readFramePayload(messageReader_t *reader, const frameHeader_t *header, const uint8_t *head,
+                                 size_t headBytes, uint8_t *dst, messageWriter_t writer, void *context) {
+    uint32_t crc;
+    uint32_t result;
+
+    if(header->compressed)
+        result = readCompressedPayload(reader, header, head, headBytes, dst, writer, context, &crc);
+    else
+        result = readPlainPayload(reader, header, head, headBytes, dst, writer, context, &crc);
+    if(result == FRAME_OK && crc != header->crc)
+        result = FRAME_CORRUPT;
+    return result;
+}
+
+/**
+ * Decodes a framed payload into a buffer, or through a writer.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param writer writer receiving the payload as it is decoded, NULL to return the payload.
+ * @param context context of the writer.
+ * @param payload payload on FRAME_OK without a writer, followed by an end of string marker.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR.
+ */
+static uint32_t decodeFrame(bitmap_t *bitmap, const decodeConfig_t *config, messageWriter_t writer, void *context,
+                            uint8_t **payload, uint64_t *length) {
+    static const decodeConfig_t defaultConfig = {1, CHANNEL_RGB, 0};
+    uint8_t head[FRAME_HEAD_BYTES];
+    size_t headBytes;
+    frameHeader_t header;
+    messageReader_t reader;
+    uint64_t charCount;
+
+    *payload = NULL;
+    *length = 0;
+    if(config == NULL)
+        config = &defaultConfig;
+    if(initMessageReader(&reader, bitmap, config, &charCount) == 0)
+        return FRAME_NOT_FOUND;
+    uint32_t result = readFrameHeader(&reader, charCount, head, &headBytes, &header);
+    if(result != FRAME_OK)
+        return result;
+
+    // a writer takes an uncompressed payload block by block, a compressed one is the history of its own matches
+    size_t size = (size_t) header.length + 1;
+    if(writer != NULL && !header.compressed && header.length > DECODE_BLOCK_BYTES)
+        size = DECODE_BLOCK_BYTES;
+    uint8_t *dst = malloc(size);
+    if(dst == NULL)
+        return FRAME_ERROR;
+    result = readFramePayload(&reader, &header, head, headBytes, dst, writer, context);
+
+    if(result != FRAME_OK || writer != NULL) {
+        free(dst);
+        if(result == FRAME_OK)
+            *length = header.length;
+        return result;
+    }
+    dst[header.length] = '\0';
+    *payload = dst;
+    *length = header.length;
+    return FRAME_OK;
+}
+
+/**
+ * Decodes a framed payload, see frame.h, embedded with a decode configuration.
+ *
+ * Only the pixels holding the frame header are decoded first. A message without a frame header costs nothing more.
+ * Otherwise only the pixels holding the payload are decoded, one block of DECODE_BLOCK_BYTES at a time. The blocks
+ * of an uncompressed frame are written straight to the payload, the blocks of a compressed frame are piped through a
+ * streaming decompressor. Either way each payload block is fed to crc32cUpdate() right after it is written, while it
+ * is still in cache, so the checksum needs no second pass over memory.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param payload payload on FRAME_OK, followed by an end of string marker, to be freed by the caller.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR.
+ */
+uint32_t decodeFramedPayload(bitmap_t *bitmap, const decodeConfig_t *config, uint8_t **payload, uint64_t *length) {
+    return decodeFrame(bitmap, config, NULL, NULL, payload, length);
+}
+
+/**
+ * Decodes a framed payload, see frame.h, handing it to a writer block by block as it is decoded.
+ *
+ * Works like decodeFramedPayload(), but an uncompressed payload is never held whole. The checksum can only be
+ * verified after the last block, so a writer may have received a payload that turns out to be corrupt.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param writer writer receiving the payload.
+ * @param context context of the writer.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR if memory ran out or the writer failed.
+ */
+uint32_t decodeFramedPayloadToWriter(bitmap_t *bitmap, const decodeConfig_t *config, messageWriter_t writer,
+                                     void *context, uint64_t *length) {
+    uint8_t *payload;
+    return decodeFrame(bitmap, config, writer, context, &payload, length);
+}
+
+/**
+ * Decodes the secret message embedded with a decode configuration, handing it to a writer block by block as it is
+ * decoded.
+ *
+ * A framed payload is decoded by decodeFramedPayloadToWriter(). Otherwise the message is decoded one block of
+ * DECODE_BLOCK_BYTES at a time and each block is handed to the writer up to the end of string marker. So the message
+ * is never held whole and the writer can pass it on before the decode finishes.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param writer writer receiving the message.
+ * @param context context of the writer.
+ * @param length number of message bytes handed to the writer.
+ * @return 1 on success, 0 if the configuration is not supported, a framed payload is corrupt, memory ran out or the
+ *         writer failed.
+ */
+uint32_t decodeMessageToWriter(bitmap_t *bitmap, const decodeConfig_t *config, messageWriter_t writer, void *context,
+                               uint64_t *length) {
+    static const decodeConfig_t defaultConfig = {1, CHANNEL_RGB, 0};
+    messageReader_t reader;
+    uint64_t charCount;
+
+    if(config == NULL)
+        config = &defaultConfig;
+    uint32_t frame = decodeFramedPayloadToWriter(bitmap, config, writer, context, length);
+    if(frame != FRAME_NOT_FOUND)
+        return frame == FRAME_OK;
+
+    if(initMessageReader(&reader, bitmap, config, &charCount) == 0)
+        return 0;
+    uint64_t blockBytes = getMessageBlockBytes(&reader);
+    uint8_t *block = malloc((size_t) blockBytes);
+    if(block == NULL)
+        return 0;
+
+    uint32_t success = 1;
+    while(*length < charCount) {
+        uint64_t wanted = charCount - *length;
+        if(wanted > blockBytes)
+            wanted = blockBytes;
+        size_t count = readMessageBytesExact(&reader, wanted, block);
+
+        uint8_t *end = memchr(block, '\0', count);
+        size_t used = (end != NULL) ? (size_t) (end - block) : count;
+        if(used > 0 && writer(context, block, used) == 0) {
+            success = 0;
+            break;
+        }
+        *length += used;
+        if(end != NULL || count < wanted)
+            break;
+    }
+    free(block);
+    return success;
+}
+
+/**
+ * Reports the size of the buffer decodeMessageIntoBuffer() needs, before decoding.
+ *
+ * Only the pixels holding a frame header are decoded. A framed payload needs its length plus an end of string
+ * marker. Any other message needs the capacity plus an end of string marker, a message that ends early fits in less.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param size buffer size in bytes.
+ * @return DECODE_OK, DECODE_ERROR if the configuration is not supported or DECODE_CORRUPT.
+ */
+uint32_t getDecodeBufferSize(bitmap_t *bitmap, const decodeConfig_t *config, uint64_t *size) {
+    static const decodeConfig_t defaultConfig = {1, CHANNEL_RGB, 0};
+    uint8_t head[FRAME_HEAD_BYTES];
+    size_t headBytes;
+    frameHeader_t header;
+    messageReader_t reader;
+    uint64_t charCount;
+
+    *size = 0;
+    if(config == NULL)
+        config = &defaultConfig;
+    if(initMessageReader(&reader, bitmap, config, &charCount) == 0)
+        return DECODE_ERROR;
+
+    uint32_t frame = readFrameHeader(&reader, charCount, head, &headBytes, &header);
+    if(frame == FRAME_CORRUPT)
+        return DECODE_CORRUPT;
+    *size = ((frame == FRAME_OK) ? header.length : charCount) + 1;
+    return DECODE_OK;
+}
+
+/**
+ * Decodes the secret message embedded with a decode configuration into a buffer of the caller, without allocating.
+ *
+ * A framed payload is decoded whole, compressed ones through a decompressor whose input block lives on the stack.
+ * Any other message is decoded one block at a time straight into the buffer until its end of string marker, so a
+ * buffer smaller than the capacity is enough for a short message. The message is followed by an end of string
+ * marker either way.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param dst destination buffer.
+ * @param size size of the destination buffer.
+ * @param length number of message bytes on DECODE_OK, buffer size needed on DECODE_BUFFER_TOO_SMALL.
+ * @return DECODE_OK, DECODE_BUFFER_TOO_SMALL, DECODE_CORRUPT or DECODE_ERROR if the configuration is not supported.
+ */
+uint32_t decodeMessageIntoBuffer(bitmap_t *bitmap, const decodeConfig_t *config, uint8_t *dst, size_t size,
+                                 uint64_t *length) {
+    static const decodeConfig_t defaultConfig = {1, CHANNEL_RGB, 0};
+    uint8_t head[FRAME_HEAD_BYTES];
+    size_t headBytes;
+    frameHeader_t header;
+    messageReader_t reader;
+    uint64_t charCount;
+
+    *length = 0;
+    if(config == NULL)
+        config = &defaultConfig;
+    if(initMessageReader(&reader, bitmap, config, &charCount) == 0)
+        return DECODE_ERROR;
+
+    uint32_t frame = readFrameHeader(&reader, charCount, head, &headBytes, &header);
+    if(frame == FRAME_CORRUPT)
+        return DECODE_CORRUPT;
+    if(frame == FRAME_OK) {
+        if(size == 0 || header.length > size - 1) {
+            *length = header.length + 1;
+            return DECODE_BUFFER_TOO_SMALL;
+        }
+        frame = readFramePayload(&reader, &header, head, headBytes, dst, NULL, NULL);
+        if(frame != FRAME_OK)
+            return frame == FRAME_CORRUPT ? DECODE_CORRUPT : DECODE_ERROR;
+        dst[header.length] = '\0';
+        *length = header.length;
+        return DECODE_OK;
+    }
+
+    // a C string, decoded from the first pixel again until its end of string marker or the end of the buffer
+    if(size == 0) {
+        *length = charCount + 1;
+        return DECODE_BUFFER_TOO_SMALL;
+    }
+    reader.pixel = 0;
+    uint64_t blockBytes = getMessageBlockBytes(&reader);
+    uint64_t room = (size < charCount) ? size : charCount;
+    while(*length < room) {
+        uint64_t wanted = room - *length;
+        if(wanted > blockBytes)
+            wanted = blockBytes;
+        size_t count = readMessageBytesExact(&reader, wanted, dst + *length);
+
+        uint8_t *end = memchr(dst + *length, '\0', count);
+        if(end != NULL) {
+            *length = (uint64_t) (end - dst);
+            return DECODE_OK;
         }
+        *length += count;
+        if(count < wanted)
+            break;
+    }
+    if(*length >= size) {
+        *length = charCount + 1;
+        return DECODE_BUFFER_TOO_SMALL;
+    }
+    dst[*length] = '\0';
+    return DECODE_OK;
+}
+
+/**
+ * Range of pixels decoded by one worker.
+ */
+typedef struct pixelRange {
+    const bitmapRows_t *rows;
+    const pixelOrder_t *order;  // NULL for the rows in decode order
+    lsbPixelKernel_t kernel;
+    uint64_t firstPixel;
+    uint64_t pixelCount;
+    uint8_t *dst;
+} pixelRange_t;
+
+/**
+ * Worker task decoding one pixel range straight into the shared output buffer.
+ *
+ * @param arg pixelRange_t to decode.
+ */
+static void decodePixelRangeTask(void *arg) {
+    pixelRange_t *range = arg;
+    decodePixels(range->rows, range->order, range->kernel, range->firstPixel, range->pixelCount, range->dst);
+}
+
+/**
+ * Decodes the secret message embedded with a decode configuration on a thread pool.
+ *
+ * Ranges are whole groups of 8 pixels, which hold a whole number of message bytes for every configuration, rounded
+ * so each range writes a multiple of PARALLEL_DECODE_ALIGN bytes. The default configuration on 24 bit pixels uses
+ * decodeMessageOnPool().
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration.
+ * @param pool thread pool running the decode.
+ * @return pointer to char string with secret message, NULL if the configuration is not supported.
+ */
+char *decodeMessageOnPoolWithConfig(bitmap_t *bitmap, const decodeConfig_t *config, threadPool_t *pool) {
+    uint64_t charCount;
+    bitmapRows_t rows;
+    char *str;
+
+    if(isDefaultConfig(config) && !hasAlphaByte(bitmap))
+        return decodeMessageOnPool(bitmap, pool);
+    if(decodeFrameAsMessage(bitmap, config, &str))
+        return str;
+
+    lsbPixelKernel_t kernel = selectDecodeKernel(bitmap, config);
+    if(getMessageCapacityWithConfig(bitmap, config, &charCount) == 0 || getBitmapRows(bitmap, &rows) == 0)
+        return NULL;
+    if(charCount >= SIZE_MAX)
+        return NULL;
+    str = malloc((size_t) charCount + 1);
+    if(str == NULL)
+        return NULL;
+    str[charCount] = '\0';
+
+    uint64_t totalPixels = (uint64_t) rows.row_pixels * rows.row_count;
+    uint32_t bitsPerPixel = getBitsPerPixelOfMessage(config);
+    uint64_t pixelAlign = 8 * PARALLEL_DECODE_ALIGN;
+    pixelOrder_t order;
+    if(config->order_key != 0)
+        pixelOrderInit(&order, config->order_key, totalPixels);
+    uint64_t minPixels = (uint64_t) PARALLEL_DECODE_MIN_RANGE * 8 / bitsPerPixel;
+
+    uint32_t rangeCount = threadPoolSize(pool);
+    uint64_t rangeSize = (totalPixels + rangeCount - 1) / rangeCount;
+    if(rangeSize < minPixels)
+        rangeSize = minPixels;
+    rangeSize = (rangeSize + pixelAlign - 1) / pixelAlign * pixelAlign;
+
+    pixelRange_t ranges[rangeCount];
+    taskGroup_t group;
+    taskGroupInit(&group);
+    uint64_t start = 0;
+    for(uint32_t r = 0; r < rangeCount && start < totalPixels; r++) {
+        ranges[r].rows = &rows;
+        ranges[r].order = (config->order_key != 0) ? &order : NULL;
+        ranges[r].kernel = kernel;
+        ranges[r].firstPixel = start;
+        ranges[r].pixelCount = (totalPixels - start < rangeSize) ? totalPixels - start : rangeSize;
+        ranges[r].dst = (uint8_t *) str + start * bitsPerPixel / 8;
+        start += ranges[r].pixelCount;
+
+        // run the range on the calling thread if it cannot be queued
+        if(threadPoolSubmit(pool, &group, decodePixelRangeTask, &ranges[r]) == 0)
+            decodePixelRangeTask(&ranges[r]);
     }
+    taskGroupWait(&group);
+    taskGroupDestroy(&group);
+
     return str;
 }
@@ -7,9 +7,59 @@
 #ifndef FIRMWARE_QUIZ_DECODER_H
 #define FIRMWARE_QUIZ_DECODER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "bitmap.h"
+#include "frame.h"
+#include "lsbkernels.h"
+#include "pixelorder.h"
+#include "threadpool.h"
+
+/**
+ * Output characters per parallel decode range are rounded up to a multiple of this, one cache line.
+ */
+#define PARALLEL_DECODE_ALIGN       64
+
+/**
+ * Smallest number of output characters handed to one worker by a parallel decode.
+ */
+#define PARALLEL_DECODE_MIN_RANGE   (64 * 1024)
+
+/**
+ * Channel selection bits of decodeConfig_t, in the byte order of a 24 bit pixel.
+ */
+#define CHANNEL_BLUE    0x1
+#define CHANNEL_GREEN   0x2
+#define CHANNEL_RED     0x4
+#define CHANNEL_RGB     (CHANNEL_BLUE | CHANNEL_GREEN | CHANNEL_RED)
+
+/**
+ * Results of decodeMessageStreamToWriter(), decodeMessageIntoBuffer() and getDecodeBufferSize().
+ */
+#define DECODE_ERROR            0   // DIB header type or configuration not supported
+#define DECODE_OK               1
+#define DECODE_CORRUPT          2   // framed payload whose length does not fit or whose checksum does not match
+#define DECODE_BUFFER_TOO_SMALL 3   // the message does not fit, the size needed is reported
+
+/**
+ * How a message is embedded in the pixels. decodeMessage() uses 1 bit per channel from all channels, along the rows.
+ */
+typedef struct decodeConfig {
+    uint32_t bits_per_channel;  // low bits of each selected channel holding message bits, 1 to 4
+    uint32_t channel_mask;      // CHANNEL_ bits of the channels holding message bits
+    uint64_t order_key;         // key of the keyed pixel order, see pixelorder.h, 0 for the rows in decode order
+} decodeConfig_t;
+
+/**
+ * Receives message bytes in order as they are decoded, see decodeMessageToWriter().
+ *
+ * @param context context passed to the decode.
+ * @param bytes next message bytes.
+ * @param count number of bytes.
+ * @return 1 on success, 0 to stop the decode.
+ */
+typedef uint32_t (*messageWriter_t)(void *context, const uint8_t *bytes, size_t count);
 
 /**
  * Returns 1 if the bitmap is of a currently implemented decodable type.
@@ -19,12 +69,145 @@
  */
 uint16_t isDecodeable(bitmap_t *bitmap);
 
+/**
+ * Calculates the number of message characters that fit in the bitmap.
+ *
+ * @param bitmap bitmap in memory.
+ * @param charCount number of characters the bitmap holds, excluding end of string marker.
+ * @return 1 on success, 0 if the DIB header type is not supported.
+ */
+uint32_t getMessageCapacity(const bitmap_t *bitmap, uint64_t *charCount);
+
 /**
  * Decodes the secret message embedded in bitmap data.
  *
+ * A framed payload, compressed or not, is detected by its header and returned in place of the message. Every
+ * decodeMessage function does the same.
+ *
  * @param bitmap bitmap in memory to be decoded.
- * @return pointer to char string with secret message.
+ * @return pointer to char string with secret message, NULL if a framed payload is corrupt.
  */
 char *decodeMessage(bitmap_t *bitmap);
 
+/**
+ * Selects the kernel for a decode configuration and the pixel layout of the bitmap.
+ *
+ * @param bitmap bitmap with parsed headers.
+ * @param config decode configuration.
+ * @return kernel, NULL if the pixel layout or configuration is not supported.
+ */
+lsbPixelKernel_t selectDecodeKernel(const bitmap_t *bitmap, const decodeConfig_t *config);
+
+/**
+ * Calculates the number of message characters that fit in the bitmap with a decode configuration.
+ *
+ * @param bitmap bitmap in memory.
+ * @param config decode configuration.
+ * @param charCount number of characters the bitmap holds, excluding end of string marker.
+ * @return 1 on success, 0 if the DIB header type or configuration is not supported.
+ */
+uint32_t getMessageCapacityWithConfig(const bitmap_t *bitmap, const decodeConfig_t *config, uint64_t *charCount);
+
+/**
+ * Decodes the secret message embedded with a given number of bits per channel in the selected channels.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration.
+ * @return pointer to char string with secret message, NULL if the configuration is not supported.
+ */
+char *decodeMessageWithConfig(bitmap_t *bitmap, const decodeConfig_t *config);
+
+/**
+ * Decodes a framed payload, see frame.h, embedded with a decode configuration. A compressed payload is
+ * decompressed.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param payload payload on FRAME_OK, followed by an end of string marker, to be freed by the caller.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR.
+ */
+uint32_t decodeFramedPayload(bitmap_t *bitmap, const decodeConfig_t *config, uint8_t **payload, uint64_t *length);
+
+/**
+ * Decodes a framed payload, see frame.h, handing it to a writer block by block as it is decoded.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param writer writer receiving the payload.
+ * @param context context of the writer.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR if memory ran out or the writer failed.
+ */
+uint32_t decodeFramedPayloadToWriter(bitmap_t *bitmap, const decodeConfig_t *config, messageWriter_t writer,
+                                     void *context, uint64_t *length);
+
+/**
+ * Decodes the secret message embedded with a decode configuration, handing it to a writer block by block as it is
+ * decoded. Framed payloads are detected and handed over whole, NUL bytes included.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param writer writer receiving the message.
+ * @param context context of the writer.
+ * @param length number of message bytes handed to the writer.
+ * @return 1 on success, 0 if the configuration is not supported, a framed payload is corrupt, memory ran out or the
+ *         writer failed.
+ */
+uint32_t decodeMessageToWriter(bitmap_t *bitmap, const decodeConfig_t *config, messageWriter_t writer, void *context,
+                               uint64_t *length);
+
+/**
+ * Reports the size of the buffer decodeMessageIntoBuffer() needs, before decoding. Only the pixels holding a frame
+ * header are decoded.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param size buffer size in bytes, the payload length of a frame or the capacity, plus an end of string marker.
+ * @return DECODE_OK, DECODE_ERROR if the configuration is not supported or DECODE_CORRUPT.
+ */
+uint32_t getDecodeBufferSize(bitmap_t *bitmap, const decodeConfig_t *config, uint64_t *size);
+
+/**
+ * Decodes the secret message embedded with a decode configuration into a buffer of the caller, without allocating.
+ * Framed payloads are detected and decoded whole, NUL bytes included.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param dst destination buffer, the message is followed by an end of string marker.
+ * @param size size of the destination buffer.
+ * @param length number of message bytes on DECODE_OK, buffer size needed on DECODE_BUFFER_TOO_SMALL.
+ * @return DECODE_OK, DECODE_BUFFER_TOO_SMALL, DECODE_CORRUPT or DECODE_ERROR if the configuration is not supported.
+ */
+uint32_t decodeMessageIntoBuffer(bitmap_t *bitmap, const decodeConfig_t *config, uint8_t *dst, size_t size,
+                                 uint64_t *length);
+
+/**
+ * Decodes the secret message embedded with a decode configuration on a thread pool.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param config decode configuration.
+ * @param pool thread pool running the decode.
+ * @return pointer to char string with secret message, NULL if the configuration is not supported.
+ */
+char *decodeMessageOnPoolWithConfig(bitmap_t *bitmap, const decodeConfig_t *config, threadPool_t *pool);
+
+/**
+ * Decodes the secret message embedded in bitmap data on a thread pool.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param pool thread pool running the decode.
+ * @return pointer to char string with secret message.
+ */
+char *decodeMessageOnPool(bitmap_t *bitmap, threadPool_t *pool);
+
+/**
+ * Decodes the secret message embedded in bitmap data using multiple threads.
+ *
+ * @param bitmap bitmap in memory to be decoded.
+ * @param threadCount number of worker threads, 0 for one per online processor.
+ * @return pointer to char string with secret message.
+ */
+char *decodeMessageParallel(bitmap_t *bitmap, uint32_t threadCount);
+
 #endif //FIRMWARE_QUIZ_DECODER_H
@@ -0,0 +1,677 @@
+/** @file decodeserver.c
+ *
+ * @brief Resident decode server answering requests on a Unix domain socket with a pool of warm decode contexts.
+ * @author Daniel Jaramillo
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "decodecontext.h"
+#include "decodeserver.h"
+#include "lsbkernels.h"
+#include "threadpool.h"
+
+/**
+ * Milliseconds a wait on a socket lasts before the stop flag is checked again.
+ */
+#define DECODE_SERVER_POLL_MS       200
+
+/**
+ * Milliseconds the rest of a request may take once its first byte arrived. A client that stalls in the middle of a
+ * request is disconnected, so it cannot hold a worker.
+ */
+#define DECODE_SERVER_REQUEST_TIMEOUT_MS    1000
+
+/**
+ * Most file descriptors taken from a request. Any beyond the first are closed, so a client cannot leak them into
+ * the server.
+ */
+#define DECODE_SERVER_MAX_FDS       4
+
+/**
+ * Connection handed to a worker for one request, and back to the accept loop after it.
+ */
+typedef struct decodeConnection {
+    struct decodeServer *server;
+    int fd;
+    struct decodeConnection *next;      // next connection handed back
+} decodeConnection_t;
+
+/**
+ * Decode server state. The free list of contexts and the connections handed back are protected by lock.
+ */
+struct decodeServer {
+    int listenFd;
+    int wakeFds[2];                     // pipe waking the accept loop when a connection is handed back
+    char *socketPath;
+    uint64_t maxFileSize;
+    uint32_t stopping;                  // set by decodeServerStop(), read with __atomic_load_n()
+    threadPool_t *pool;
+    pthread_mutex_t lock;
+    decodeContext_t *contexts;          // one per worker, so a running connection always finds a free one
+    decodeContext_t **freeContexts;
+    uint32_t freeCount;
+    uint32_t contextCount;
+    decodeConnection_t *returned;       // connections waiting for their next request, taken by the accept loop
+};
+
+/**
+ * Reads a little endian 32 bit value.
+ *
+ * @param buffer 4 bytes.
+ * @return value.
+ */
+static uint32_t readUint32(const uint8_t *buffer) {
+    uint32_t value = 0;
+    for(uint32_t b = 0; b < 4; b++)
+        value |= (uint32_t) buffer[b] << (8 * b);
+    return value;
+}
+
+/**
+ * Returns a monotonic time stamp in milliseconds.
+ *
+ * @return milliseconds since an arbitrary point.
+ */
+static uint64_t getMonotonicMs(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000 + (uint64_t) time.tv_nsec / 1000000;
+}
+
+/**
+ * Checks whether the server was asked to stop.
+ *
+ * @param server decode server.
+ * @return 1 if stopping, 0 otherwise.
+ */
+static uint32_t isStopping(decodeServer_t *server) {
+    return __atomic_load_n(&server->stopping, __ATOMIC_RELAXED);
+}
+
+/**
+ * Waits until a socket is readable, checking the stop flag every DECODE_SERVER_POLL_MS.
+ *
+ * @param server decode server.
+ * @param fd socket.
+ * @param deadline getMonotonicMs() time the wait ends at.
+ * @return 1 once readable, 0 if the server is stopping, the deadline passed or polling failed.
+ */
+static uint32_t waitReadable(decodeServer_t *server, int fd, uint64_t deadline) {
+    struct pollfd entry = {fd, POLLIN, 0};
+
+    while(!isStopping(server)) {
+        uint64_t now = getMonotonicMs();
+        if(now >= deadline)
+            return 0;
+        int ready = poll(&entry, 1, deadline - now < DECODE_SERVER_POLL_MS ? (int) (deadline - now)
+                                                                          : DECODE_SERVER_POLL_MS);
+        if(ready > 0)
+            return 1;
+        if(ready < 0 && errno != EINTR)
+            return 0;
+    }
+    return 0;
+}
+
+/**
+ * Reads exactly count bytes from a socket.
+ *
+ * @param server decode server.
+ * @param fd socket.
+ * @param buffer destination.
+ * @param count number of bytes.
+ * @param deadline getMonotonicMs() time the bytes have to arrive by.
+ * @return 1 on success, 0 if the peer closed the connection, reading failed or timed out or the server is stopping.
+ */
+static uint32_t receiveAll(decodeServer_t *server, int fd, uint8_t *buffer, size_t count, uint64_t deadline) {
+    while(count > 0) {
+        if(waitReadable(server, fd, deadline) == 0)
+            return 0;
+        ssize_t received = recv(fd, buffer, count, 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+        if(received <= 0)
+            return 0;
+        buffer += received;
+        count -= (size_t) received;
+    }
+    return 1;
+}
+
+/**
+ * Reads a request header along with a file descriptor passed as SCM_RIGHTS ancillary data.
+ *
+ * The ancillary data arrives with the first byte of the header, so it is read with recvmsg() and the rest of the
+ * header with receiveAll(). Descriptors are received close-on-exec, and all but the first one are closed.
+ *
+ * @param server decode server.
+ * @param fd socket.
+ * @param header destination, DECODE_SERVER_REQUEST_SIZE bytes.
+ * @param passedFd first file descriptor passed with the header, -1 if none.
+ * @param deadline getMonotonicMs() time the header has to arrive by.
+ * @return 1 on success, 0 if the peer closed the connection, reading failed or timed out or the server is stopping.
+ */
+static uint32_t receiveHeader(decodeServer_t *server, int fd, uint8_t *header, int *passedFd, uint64_t deadline) {
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * DECODE_SERVER_MAX_FDS)];
+    } control;
+    struct iovec vector = {header, DECODE_SERVER_REQUEST_SIZE};
+    struct msghdr message;
+    ssize_t received;
+
+    *passedFd = -1;
+    do {
+        if(waitReadable(server, fd, deadline) == 0)
+            return 0;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while(received < 0 && errno == EINTR);
+
+    // keep the first descriptor, even if the header is cut short, so it is always closed
+    for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); received >= 0 && cmsg != NULL;
+            cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for(size_t i = 0; i < count; i++) {
+            int descriptor;
+            memcpy(&descriptor, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if(*passedFd < 0)
+                *passedFd = descriptor;
+            else
+                close(descriptor);
+        }
+    }
+    if(received <= 0)
+        return 0;
+    return receiveAll(server, fd, header + received, DECODE_SERVER_REQUEST_SIZE - (size_t) received, deadline);
+}
+
+/**
+ * Sends a response header followed by its payload, continuing after partial writes and interrupted calls.
+ *
+ * @param fd socket.
+ * @param status DECODE_SERVER_ status.
+ * @param payload payload bytes, may be NULL if length is 0.
+ * @param length number of payload bytes.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t sendResponse(int fd, uint32_t status, const uint8_t *payload, uint64_t length) {
+    uint8_t header[DECODE_SERVER_RESPONSE_SIZE];
+    for(uint32_t b = 0; b < 4; b++)
+        header[b] = (uint8_t) (status >> (8 * b));
+    for(uint32_t b = 0; b < 8; b++)
+        header[4 + b] = (uint8_t) (length >> (8 * b));
+
+    struct iovec vectors[2] = {{header, sizeof(header)}, {(void *) payload, (size_t) length}};
+    struct iovec *next = vectors;
+    size_t count = length ? 2 : 1;
+    while(count > 0) {
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = next;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        // drop the buffers sent completely and move into the one sent partly
+        size_t done = (size_t) sent;
+        while(count > 0 && done >= next->iov_len) {
+            done -= next->iov_len;
+            next++;
+            count--;
+        }
+        if(count > 0) {
+            next->iov_base = (uint8_t *) next->iov_base + done;
+            next->iov_len -= done;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Decodes the file of a request with a warm context.
+ *
+ * @param server decode server.
+ * @param context decode context.
+ * @param fd file descriptor of the bitmap file.
+ * @param config decode configuration.
+ * @param message message owned by the context on DECODE_SERVER_OK.
+ * @param length number of message bytes on DECODE_SERVER_OK.
+ * @return DECODE_SERVER_ status.
+ */
+static uint32_t decodeRequest(decodeServer_t *server, decodeContext_t *context, int fd,
+                              const decodeConfig_t *config, const uint8_t **message, uint64_t *length) {
+    *message = NULL;
+    *length = 0;
+    context->config = *config;
+    if(decodeContextReadFd(context, fd, server->maxFileSize) != 1)
+        return DECODE_SERVER_UNREADABLE;
+    if(isDecodeable(&(context->bitmap)) != 1)
+        return DECODE_SERVER_NOT_DECODEABLE;
+
+    switch(decodeContextMessage(context, message, length)) {
+        case DECODE_OK:
+            return DECODE_SERVER_OK;
+        case DECODE_CORRUPT:
+            return DECODE_SERVER_CORRUPT;
+        default:
+            // the configuration was checked, so only an unsupported header or lack of memory remain
+            return selectDecodeKernel(&(context->bitmap), config) == NULL ? DECODE_SERVER_NOT_DECODEABLE
+                                                                           : DECODE_SERVER_ERROR;
+    }
+}
+
+/**
+ * Serves one request of a connection, whose socket is readable. The request has to arrive whole within
+ * DECODE_SERVER_REQUEST_TIMEOUT_MS.
+ *
+ * @param server decode server.
+ * @param context decode context.
+ * @param fd socket.
+ * @param path buffer of DECODE_SERVER_MAX_PATH + 1 bytes for the path of the request.
+ * @return 1 if the connection may carry another request, 0 if it has to be closed.
+ */
+static uint32_t serveRequest(decodeServer_t *server, decodeContext_t *context, int fd, char *path) {
+    uint8_t header[DECODE_SERVER_REQUEST_SIZE];
+    int fileFd;
+
+    uint64_t deadline = getMonotonicMs() + DECODE_SERVER_REQUEST_TIMEOUT_MS;
+    if(receiveHeader(server, fd, header, &fileFd, deadline) == 0) {
+        if(fileFd >= 0)
+            close(fileFd);
+        return 0;
+    }
+    uint32_t type = readUint32(header);
+    decodeConfig_t config = {readUint32(header + 4), readUint32(header + 8), 0};
+    uint32_t pathLength = readUint32(header + 12);
+    if(config.bits_per_channel == 0 && config.channel_mask == 0) {
+        config.bits_per_channel = 1;
+        config.channel_mask = CHANNEL_RGB;
+    }
+
+    // a path that cannot be read whole leaves the stream out of step, so the connection is closed after answering
+    uint32_t status = DECODE_SERVER_OK;
+    uint32_t keep = 1;
+    if(type == DECODE_SERVER_REQUEST_PATH) {
+        if(fileFd >= 0) {
+            close(fileFd);
+            fileFd = -1;
+        }
+        if(pathLength == 0 || pathLength > DECODE_SERVER_MAX_PATH) {
+            status = DECODE_SERVER_BAD_REQUEST;
+            keep = 0;
+        } else if(receiveAll(server, fd, (uint8_t *) path, pathLength, deadline) == 0) {
+            return 0;
+        } else {
+            path[pathLength] = '\0';
+            if(strlen(path) != pathLength)
+                status = DECODE_SERVER_BAD_REQUEST;
+            else if((fileFd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+                status = DECODE_SERVER_UNREADABLE;
+        }
+    } else if(type != DECODE_SERVER_REQUEST_FD || pathLength != 0) {
+        status = DECODE_SERVER_BAD_REQUEST;
+        keep = 0;
+    } else if(fileFd < 0) {
+        status = DECODE_SERVER_BAD_REQUEST;
+    }
+    if(status == DECODE_SERVER_OK && (config.bits_per_channel < 1 ||
+            config.bits_per_channel > LSB_MAX_BITS_PER_CHANNEL || config.channel_mask == 0 ||
+            (config.channel_mask & ~CHANNEL_RGB) != 0))
+        status = DECODE_SERVER_BAD_REQUEST;
+
+    const uint8_t *message = NULL;
+    uint64_t length = 0;
+    if(status == DECODE_SERVER_OK)
+        status = decodeRequest(server, context, fileFd, &config, &message, &length);
+    if(fileFd >= 0)
+        close(fileFd);
+    if(status != DECODE_SERVER_OK)
+        length = 0;
+    return sendResponse(fd, status, message, length) && keep;
+}
+
+/**
+ * Takes a free decode context.
+ *
+ * @param server decode server.
+ * @return decode context, never NULL as there are as many contexts as workers.
+ */
+static decodeContext_t *acquireContext(decodeServer_t *server) {
+    pthread_mutex_lock(&server->lock);
+    decodeContext_t *context = server->freeContexts[--server->freeCount];
+    pthread_mutex_unlock(&server->lock);
+    return context;
+}
+
+/**
+ * Returns a decode context to the free list, keeping its buffers warm for the next connection.
+ *
+ * @param server decode server.
+ * @param context decode context.
+ */
+static void releaseContext(decodeServer_t *server, decodeContext_t *context) {
+    pthread_mutex_lock(&server->lock);
+    server->freeContexts[server->freeCount++] = context;
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Closes a connection and frees it.
+ *
+ * @param connection connection.
+ */
+static void closeConnection(decodeConnection_t *connection) {
+    close(connection->fd);
+    free(connection);
+}
+
+/**
+ * Hands a connection back to the accept loop to wait for its next request, and wakes the loop.
+ *
+ * @param server decode server.
+ * @param connection connection.
+ */
+static void returnConnection(decodeServer_t *server, decodeConnection_t *connection) {
+    pthread_mutex_lock(&server->lock);
+    connection->next = server->returned;
+    server->returned = connection;
+    pthread_mutex_unlock(&server->lock);
+
+    // a full pipe wakes the loop already
+    uint8_t wake = 1;
+    ssize_t written = write(server->wakeFds[1], &wake, 1);
+    (void) written;
+}
+
+/**
+ * Worker task serving one request of a connection, then handing the connection back to the accept loop.
+ *
+ * A connection holds a worker only while a request is served, so idle connections cannot keep other clients from
+ * being served.
+ *
+ * @param arg connection, freed by the task once closed.
+ */
+static void connectionTask(void *arg) {
+    decodeConnection_t *connection = arg;
+    decodeServer_t *server = connection->server;
+    char path[DECODE_SERVER_MAX_PATH + 1];
+
+    decodeContext_t *context = acquireContext(server);
+    uint32_t keep = serveRequest(server, context, connection->fd, path);
+    releaseContext(server, context);
+    if(keep && !isStopping(server))
+        returnConnection(server, connection);
+    else
+        closeConnection(connection);
+}
+
+/**
+ * Connections waiting for their next request, polled by the accept loop along with the listening socket and the
+ * wake pipe.
+ */
+typedef struct connectionSet {
+    decodeConnection_t **connections;
+    struct pollfd *entries;             // listening socket, wake pipe, then one entry per connection
+    size_t count;
+    size_t capacity;
+} connectionSet_t;
+
+/**
+ * Adds a connection to the set, growing it when full.
+ *
+ * @param set connection set.
+ * @param connection connection.
+ * @return 1 on success, 0 if memory ran out.
+ */
+static uint32_t addConnection(connectionSet_t *set, decodeConnection_t *connection) {
+    if(set->count == set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 16;
+        decodeConnection_t **connections = realloc(set->connections, capacity * sizeof(decodeConnection_t *));
+        if(connections == NULL)
+            return 0;
+        set->connections = connections;
+        struct pollfd *entries = realloc(set->entries, (capacity + 2) * sizeof(struct pollfd));
+        if(entries == NULL)
+            return 0;
+        set->entries = entries;
+        set->capacity = capacity;
+    }
+    set->connections[set->count++] = connection;
+    return 1;
+}
+
+/**
+ * Moves the connections handed back by the workers into the set, closing any that do not fit.
+ *
+ * @param server decode server.
+ * @param set connection set.
+ */
+static void adoptReturnedConnections(decodeServer_t *server, connectionSet_t *set) {
+    uint8_t drain[64];
+    while(read(server->wakeFds[0], drain, sizeof(drain)) > 0)
+        ;
+
+    pthread_mutex_lock(&server->lock);
+    decodeConnection_t *connection = server->returned;
+    server->returned = NULL;
+    pthread_mutex_unlock(&server->lock);
+    while(connection != NULL) {
+        decodeConnection_t *next = connection->next;
+        if(addConnection(set, connection) != 1)
+            closeConnection(connection);
+        connection = next;
+    }
+}
+
+/**
+ * Checks whether nothing listens on a socket any more, so it was left behind by a server that did not shut down.
+ *
+ * @param address address of the socket.
+ * @return 1 if connecting is refused, 0 otherwise.
+ */
+static uint32_t isStaleSocket(const struct sockaddr_un *address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return 0;
+    uint32_t stale = connect(fd, (const struct sockaddr *) address, sizeof(*address)) != 0 && errno == ECONNREFUSED;
+    close(fd);
+    return stale;
+}
+
+/**
+ * Binds and listens on the socket and starts the worker threads.
+ *
+ * A stale socket left at the path by a server that did not shut down is replaced, any other file is left alone.
+ *
+ * @param options server options.
+ * @return pointer to server on success, NULL otherwise.
+ */
+decodeServer_t *decodeServerCreate(const decodeServerOptions_t *options) {
+    struct sockaddr_un address;
+    struct stat fileStat;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(options->socketPath) >= sizeof(address.sun_path))
+        return NULL;
+    strcpy(address.sun_path, options->socketPath);
+
+    decodeServer_t *server = calloc(1, sizeof(decodeServer_t));
+    if(server == NULL)
+        return NULL;
+    server->listenFd = -1;
+    server->wakeFds[0] = -1;
+    server->wakeFds[1] = -1;
+    server->maxFileSize = options->maxFileSize ? options->maxFileSize : DECODE_SERVER_DEFAULT_MAX_FILE_SIZE;
+    server->contextCount = options->threadCount ? options->threadCount : getProcessorCount();
+    server->socketPath = strdup(options->socketPath);
+    server->contexts = calloc(server->contextCount, sizeof(decodeContext_t));
+    server->freeContexts = calloc(server->contextCount, sizeof(decodeContext_t *));
+    if(server->socketPath == NULL || server->contexts == NULL || server->freeContexts == NULL) {
+        free(server->socketPath);
+        free(server->contexts);
+        free(server->freeContexts);
+        free(server);
+        return NULL;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    for(uint32_t i = 0; i < server->contextCount; i++) {
+        decodeContextInit(&(server->contexts[i]), NULL);
+        server->freeContexts[i] = &(server->contexts[i]);
+    }
+    server->freeCount = server->contextCount;
+
+    if(lstat(options->socketPath, &fileStat) == 0 && S_ISSOCK(fileStat.st_mode) && isStaleSocket(&address))
+        unlink(options->socketPath);
+    server->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(server->listenFd < 0 || bind(server->listenFd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        // nothing was bound, so the path must not be removed
+        free(server->socketPath);
+        server->socketPath = NULL;
+        decodeServerDestroy(server);
+        return NULL;
+    }
+    if(listen(server->listenFd, SOMAXCONN) != 0 || pipe2(server->wakeFds, O_CLOEXEC | O_NONBLOCK) != 0 ||
+            (server->pool = threadPoolCreate(server->contextCount)) == NULL) {
+        decodeServerDestroy(server);
+        return NULL;
+    }
+    return server;
+}
+
+/**
+ * Accepts connections and hands each request to a worker until decodeServerStop() is called.
+ *
+ * Connections waiting for a request are polled here and hold no worker. A connection with a request, or closed by its
+ * peer, is handed to a worker, which serves one request and hands it back. Requests beyond the number of workers
+ * wait in the queue of the pool.
+ *
+ * @param server decode server.
+ * @return 1 once stopped, 0 if accepting failed.
+ */
+uint32_t decodeServerRun(decodeServer_t *server) {
+    connectionSet_t set = {NULL, NULL, 0, 0};
+    uint32_t success = 1;
+
+    // entries for the listening socket and the wake pipe
+    set.entries = malloc(2 * sizeof(struct pollfd));
+    if(set.entries == NULL)
+        return 0;
+    while(success && !isStopping(server)) {
+        for(size_t i = 0; i < set.count; i++)
+            set.entries[2 + i] = (struct pollfd) {set.connections[i]->fd, POLLIN, 0};
+        set.entries[0] = (struct pollfd) {server->listenFd, POLLIN, 0};
+        set.entries[1] = (struct pollfd) {server->wakeFds[0], POLLIN, 0};
+        int ready = poll(set.entries, 2 + set.count, DECODE_SERVER_POLL_MS);
+        if(ready <= 0) {
+            success = ready == 0 || errno == EINTR;
+            continue;
+        }
+
+        // hand connections with a request to the workers, a closed one is noticed there too
+        for(size_t i = set.count; i-- > 0;) {
+            if(set.entries[2 + i].revents == 0)
+                continue;
+            decodeConnection_t *connection = set.connections[i];
+            set.connections[i] = set.connections[--set.count];
+            if(threadPoolSubmit(server->pool, NULL, connectionTask, connection) != 1)
+                closeConnection(connection);
+        }
+        if(set.entries[1].revents != 0)
+            adoptReturnedConnections(server, &set);
+        if(set.entries[0].revents == 0)
+            continue;
+
+        int fd = accept4(server->listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if(fd < 0) {
+            // the peer may give up before it is accepted, and running out of descriptors passes
+            success = errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE;
+            continue;
+        }
+        decodeConnection_t *connection = malloc(sizeof(decodeConnection_t));
+        if(connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->server = server;
+        connection->fd = fd;
+        connection->next = NULL;
+        if(addConnection(&set, connection) != 1)
+            closeConnection(connection);
+    }
+
+    for(size_t i = 0; i < set.count; i++)
+        closeConnection(set.connections[i]);
+    free(set.connections);
+    free(set.entries);
+    return success && isStopping(server);
+}
+
+/**
+ * Asks a running server to stop. Only sets a flag, so it may be called from a signal handler.
+ *
+ * @param server decode server.
+ */
+void decodeServerStop(decodeServer_t *server) {
+    __atomic_store_n(&server->stopping, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Waits for the requests being served, stops the workers, closes the connections, removes the socket and frees the
+ * server.
+ *
+ * Requests being received see the stop flag within DECODE_SERVER_POLL_MS.
+ *
+ * @param server decode server.
+ */
+void decodeServerDestroy(decodeServer_t *server) {
+    if(server == NULL)
+        return;
+
+    decodeServerStop(server);
+    if(server->pool != NULL)
+        threadPoolDestroy(server->pool);
+    while(server->returned != NULL) {
+        decodeConnection_t *next = server->returned->next;
+        closeConnection(server->returned);
+        server->returned = next;
+    }
+    if(server->listenFd >= 0)
+        close(server->listenFd);
+    for(uint32_t i = 0; i < 2; i++) {
+        if(server->wakeFds[i] >= 0)
+            close(server->wakeFds[i]);
+    }
+    if(server->socketPath != NULL)
+        unlink(server->socketPath);
+    for(uint32_t i = 0; i < server->contextCount; i++)
+        decodeContextRelease(&(server->contexts[i]));
+    pthread_mutex_destroy(&server->lock);
+    free(server->socketPath);
+    free(server->contexts);
+    free(server->freeContexts);
+    free(server);
+}
@@ -0,0 +1,102 @@
+/** @file decodeserver.h
+ *
+ * @brief Resident decode server answering requests on a Unix domain socket with a pool of warm decode contexts.
+ *
+ * A request is a header of DECODE_SERVER_REQUEST_SIZE bytes, four little endian 32 bit fields: request type,
+ * bits per channel, channel mask and path length. A DECODE_SERVER_REQUEST_PATH request is followed by that many
+ * bytes of path, a DECODE_SERVER_REQUEST_FD request has a path length of 0 and carries the file descriptor of the
+ * bitmap file as SCM_RIGHTS ancillary data of its header. Bits per channel and channel mask of 0 select the default
+ * configuration of decodeMessage().
+ *
+ * Every request is answered with a header of DECODE_SERVER_RESPONSE_SIZE bytes, a little endian 32 bit status and
+ * 64 bit payload length, followed by the payload, the message without end of string marker on DECODE_SERVER_OK.
+ * A connection carries any number of requests, one after the other. It holds a worker only while a request is served,
+ * and a request has to arrive whole within a second of its first byte.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef DECODESERVER_H_
+#define DECODESERVER_H_
+
+#include <stdint.h>
+
+/**
+ * Request types.
+ */
+#define DECODE_SERVER_REQUEST_PATH  1   // decode the file at the path following the header
+#define DECODE_SERVER_REQUEST_FD    2   // decode the file descriptor passed with the header
+
+/**
+ * Sizes of the request and response headers.
+ */
+#define DECODE_SERVER_REQUEST_SIZE  16
+#define DECODE_SERVER_RESPONSE_SIZE 12
+
+/**
+ * Longest path of a request, in bytes.
+ */
+#define DECODE_SERVER_MAX_PATH      4096
+
+/**
+ * Largest bitmap file read by default, in bytes.
+ */
+#define DECODE_SERVER_DEFAULT_MAX_FILE_SIZE (1024ULL * 1024 * 1024)
+
+/**
+ * Response statuses.
+ */
+#define DECODE_SERVER_OK                0   // payload holds the message
+#define DECODE_SERVER_BAD_REQUEST       1   // malformed header, path or configuration, or missing file descriptor
+#define DECODE_SERVER_UNREADABLE        2   // file could not be opened, read or parsed, or is too large
+#define DECODE_SERVER_NOT_DECODEABLE    3   // file is not decodeable with the configuration
+#define DECODE_SERVER_CORRUPT           4   // framed payload whose length does not fit or whose checksum does not match
+#define DECODE_SERVER_ERROR             5   // memory ran out
+
+/**
+ * Options of a decode server.
+ */
+typedef struct decodeServerOptions {
+    const char *socketPath;     // path the socket is bound to
+    uint32_t threadCount;       // number of worker threads and decode contexts, 0 for one per processor
+    uint64_t maxFileSize;       // largest bitmap file read, 0 for DECODE_SERVER_DEFAULT_MAX_FILE_SIZE
+} decodeServerOptions_t;
+
+/**
+ * Opaque decode server handle.
+ */
+typedef struct decodeServer decodeServer_t;
+
+/**
+ * Binds and listens on the socket and starts the worker threads.
+ *
+ * A stale socket left at the path by a server that did not shut down is replaced, any other file is left alone.
+ *
+ * @param options server options.
+ * @return pointer to server on success, NULL otherwise.
+ */
+decodeServer_t *decodeServerCreate(const decodeServerOptions_t *options);
+
+/**
+ * Accepts connections and hands each request to a worker until decodeServerStop() is called.
+ *
+ * @param server decode server.
+ * @return 1 once stopped, 0 if accepting failed.
+ */
+uint32_t decodeServerRun(decodeServer_t *server);
+
+/**
+ * Asks a running server to stop. Only sets a flag, so it may be called from a signal handler.
+ *
+ * @param server decode server.
+ */
+void decodeServerStop(decodeServer_t *server);
+
+/**
+ * Waits for the requests being served, stops the workers, closes the connections, removes the socket and frees the
+ * server.
+ *
+ * @param server decode server.
+ */
+void decodeServerDestroy(decodeServer_t *server);
+
+#endif
@@ -0,0 +1,501 @@
+/** @file decodestream.c
+ *
+ * @brief Decodes message hidden in bitmap file while streaming it, without loading the pixel array.
+ * @author Daniel Jaramillo
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "crc32c.h"
+#include "decoder.h"
+#include "decodestream.h"
+#include "frame.h"
+#include "lsbkernels.h"
+#include "lz.h"
+#include "stats.h"
+
+/**
+ * Pixel decoding state carried from one read to the next.
+ */
+typedef struct streamPixels {
+    lsbPixelKernel_t kernel;        // NULL for the unpacker of 24 bit pixels with the default configuration
+    bitAccumulator_t accumulator;
+    lsbUnpacker_t unpacker;
+    uint32_t bytes_per_pixel;
+} streamPixels_t;
+
+/**
+ * Decoded message and where it is written.
+ */
+typedef struct streamOutput {
+    messageWriter_t writer;
+    void *context;
+    uint64_t payload_length;        // message bytes to write, 0 to stop at the end of string marker
+    uint64_t total;                 // message bytes written
+    uint32_t done;                  // 1 once the end of string marker or payload_length was reached
+    uint32_t find_frame;            // 1 while the first message bytes are collected to look for a frame header
+    uint64_t capacity;              // message bytes the bitmap holds, which a frame must fit
+    uint8_t head[FRAME_HEADER_SIZE];
+    size_t head_bytes;
+    frameHeader_t header;
+    uint32_t framed;                // 1 if the message is a frame, whose payload is written
+    uint32_t crc;                   // CRC-32C of the payload written so far
+    lzDecoder_t decoder;            // decompressor of a compressed frame
+    uint8_t *expanded;              // payload of a compressed frame, the history its matches are copied from
+    uint32_t result;                // DECODE_OK, DECODE_CORRUPT or DECODE_ERROR
+} streamOutput_t;
+
+/**
+ * Reads and discards bytes. Used instead of fseek() so pipes can be decoded.
+ *
+ * @param bitmapFilePtr file to read from.
+ * @param count number of bytes to skip.
+ * @param buffer scratch buffer.
+ * @param bufferSize size of scratch buffer.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t skipBytes(FILE *bitmapFilePtr, uint64_t count, uint8_t *buffer, size_t bufferSize) {
+    while(count > 0) {
+        size_t step = count < bufferSize ? (size_t) count : bufferSize;
+        if(fread(buffer, 1, step, bitmapFilePtr) != step)
+            return 0;
+        count -= step;
+    }
+    return 1;
+}
+
+/**
+ * Decodes the secret message while reading the bitmap file in chunks of rows.
+ *
+ * Uses the default configuration of decodeMessage(), see decodeMessageStreamWithConfig().
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start. Only top-down bitmaps need a seekable file.
+ * @param outputFilePtr file the message is written to.
+ * @param payloadLength number of message bytes to decode, 0 to stop at the end of string marker.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param written number of message bytes written, may be NULL.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeMessageStream(FILE *bitmapFilePtr, FILE *outputFilePtr, uint64_t payloadLength, size_t chunkSize,
+                             uint64_t *written) {
+    decodeConfig_t config = {1, CHANNEL_RGB, 0};
+    return decodeMessageStreamWithConfig(bitmapFilePtr, outputFilePtr, &config, payloadLength, chunkSize, written);
+}
+
+/**
+ * Decodes the message bits of a run of whole pixels. The bits of a message byte split between two runs are carried
+ * in the accumulator or the unpacker.
+ *
+ * @param pixels decoding state.
+ * @param src pixel bytes.
+ * @param pixelCount number of pixels.
+ * @param message destination for the completed message bytes.
+ * @return number of message bytes written.
+ */
+static size_t decodeStreamPixels(streamPixels_t *pixels, const uint8_t *src, size_t pixelCount, uint8_t *message) {
+    if(pixels->kernel != NULL)
+        return pixels->kernel(src, pixelCount, &(pixels->accumulator), message);
+    return lsbUnpackerFeed(&(pixels->unpacker), src, pixelCount * pixels->bytes_per_pixel, message);
+}
+
+/**
+ * Adapter of fwrite() to messageWriter_t.
+ *
+ * @param context FILE pointer.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+static uint32_t writeStreamFile(void *context, const uint8_t *bytes, size_t count) {
+    return fwrite(bytes, 1, count, (FILE *) context) == count;
+}
+
+/**
+ * Writes decoded message bytes up to the end of string marker or the payload length. The payload of a frame is fed
+ * to crc32cUpdate() on the way and checked once it is complete.
+ *
+ * @param output output state.
+ * @param message decoded message bytes.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+static uint32_t writeStreamPayload(streamOutput_t *output, const uint8_t *message, size_t count) {
+    // stop at end of string marker or once the payload is complete
+    if(output->payload_length == 0 && !output->framed) {
+        const uint8_t *end = memchr(message, '\0', count);
+        if(end != NULL) {
+            count = (size_t) (end - message);
+            output->done = 1;
+        }
+    } else if(count >= output->payload_length - output->total) {
+        count = (size_t) (output->payload_length - output->total);
+        output->done = 1;
+    }
+
+    if(count > 0 && output->writer(output->context, message, count) == 0) {
+        output->result = DECODE_ERROR;
+        return 0;
+    }
+    output->total += count;
+    if(output->framed) {
+        output->crc = crc32cUpdate(output->crc, message, count);
+        if(output->done && output->crc != output->header.crc)
+            output->result = DECODE_CORRUPT;
+    }
+    return 1;
+}
+
+/**
+ * Feeds the decoded bytes of a compressed frame to its decompressor and writes the bytes they decompress to. The
+ * payload is fed to crc32cUpdate() on the way and checked once it is complete.
+ *
+ * @param output output state.
+ * @param message decoded message bytes, the compressed stream.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if the stream is malformed or writing failed.
+ */
+static uint32_t writeStreamCompressed(streamOutput_t *output, const uint8_t *message, size_t count) {
+    uint64_t written = output->decoder.written;
+    uint32_t status = lzDecoderFeed(&(output->decoder), message, count);
+    size_t produced = (size_t) (output->decoder.written - written);
+    if(status == LZ_CORRUPT) {
+        output->result = DECODE_CORRUPT;
+        return 0;
+    }
+
+    if(produced > 0 && output->writer(output->context, output->expanded + written, produced) == 0) {
+        output->result = DECODE_ERROR;
+        return 0;
+    }
+    output->total += produced;
+    output->crc = crc32cUpdate(output->crc, output->expanded + written, produced);
+    if(status == LZ_DONE) {
+        output->done = 1;
+        if(output->crc != output->header.crc)
+            output->result = DECODE_CORRUPT;
+    }
+    return 1;
+}
+
+/**
+ * Decides whether the collected first message bytes are a frame header, and writes them as the start of the
+ * message otherwise.
+ *
+ * @param output output state with the head collected.
+ * @return 1 on success, 0 if the frame header is corrupt or writing failed.
+ */
+static uint32_t acceptStreamHead(streamOutput_t *output) {
+    output->find_frame = 0;
+    if(output->head_bytes < FRAME_HEADER_SIZE || output->capacity < FRAME_HEADER_SIZE ||
+            parseFrameHeader(output->head, &(output->header)) == 0)
+        return writeStreamPayload(output, output->head, output->head_bytes);
+
+    // a compressed payload may be longer than the capacity, but not by more than the best compression ratio
+    uint64_t maxLength = output->capacity - FRAME_HEADER_SIZE;
+    if(output->header.compressed)
+        maxLength = (maxLength > UINT64_MAX / LZ_MAX_RATIO) ? UINT64_MAX : maxLength * LZ_MAX_RATIO;
+    if(output->header.length > maxLength || output->header.length >= SIZE_MAX) {
+        output->result = DECODE_CORRUPT;
+        return 0;
+    }
+    output->framed = 1;
+    output->payload_length = output->header.length;
+    output->crc = 0;
+    if(!output->header.compressed)
+        return writeStreamPayload(output, output->head, 0);
+
+    // matches reach back anywhere into the payload, so the decompressed payload is kept while it is streamed
+    output->expanded = malloc((size_t) output->header.length + 1);
+    if(output->expanded == NULL) {
+        output->result = DECODE_ERROR;
+        return 0;
+    }
+    lzDecoderInit(&(output->decoder), output->expanded, output->header.length);
+    return writeStreamCompressed(output, output->head, 0);
+}
+
+/**
+ * Writes decoded message bytes, collecting the first FRAME_HEADER_SIZE of them first when frames are looked for.
+ *
+ * @param output output state.
+ * @param message decoded message bytes.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if a frame header is corrupt or writing failed.
+ */
+static uint32_t writeStreamMessage(streamOutput_t *output, const uint8_t *message, size_t count) {
+    if(output->find_frame) {
+        size_t used = FRAME_HEADER_SIZE - output->head_bytes;
+        if(used > count)
+            used = count;
+        memcpy(output->head + output->head_bytes, message, used);
+        output->head_bytes += used;
+        message += used;
+        count -= used;
+        if(output->head_bytes < FRAME_HEADER_SIZE)
+            return 1;
+        if(acceptStreamHead(output) == 0)
+            return 0;
+    }
+    if(output->done || count == 0)
+        return 1;
+    if(output->expanded != NULL)
+        return writeStreamCompressed(output, message, count);
+    return writeStreamPayload(output, message, count);
+}
+
+/**
+ * Decodes one row wider than the chunk size, reading it in pieces of whole pixels so memory stays bounded by the
+ * chunk size however wide the row is.
+ *
+ * @param bitmapFilePtr bitmap file positioned at the start of the row.
+ * @param pixels decoding state.
+ * @param output output state.
+ * @param rowPixels number of pixels in the row.
+ * @param piece buffer for a piece.
+ * @param piecePixels number of pixels the piece buffer holds.
+ * @param message destination for the message bytes of a piece.
+ * @return 1 on success, 0 if reading or writing failed.
+ */
+static uint32_t decodeStreamRowPieces(FILE *bitmapFilePtr, streamPixels_t *pixels, streamOutput_t *output,
+                                      uint32_t rowPixels, uint8_t *piece, size_t piecePixels, uint8_t *message) {
+    for(size_t pixel = 0; !output->done && pixel < rowPixels; pixel += piecePixels) {
+        size_t count = (rowPixels - pixel < piecePixels) ? rowPixels - pixel : piecePixels;
+        STATS_START(pieceTimer);
+        size_t read = fread(piece, pixels->bytes_per_pixel, count, bitmapFilePtr);
+        STATS_STOP(pieceTimer, STATS_PIXELS, read * pixels->bytes_per_pixel);
+        if(read != count)
+            return 0;
+        if(writeStreamMessage(output, message, decodeStreamPixels(pixels, piece, count, message)) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Decodes the message of a bitmap file while reading it in chunks of rows, handing it to an output.
+ *
+ * Headers are read with readBMPFileHeader() and readDIBHeader(), then whole rows are read one chunk at a time and
+ * the pixel bytes of each row are fed to an lsbUnpacker_t for the default configuration on 24 bit pixels, or to the
+ * kernel of selectDecodeKernel() otherwise, skipping row padding. A row wider than the chunk size is read in pieces
+ * of whole pixels instead. Reading stops as soon as the output is done, so memory use is bounded by the chunk size
+ * and only the rows holding the message are read. Sizes are 64 bit, so carriers larger than memory are decoded in
+ * bounded windows. The headers of a regular file are checked against its size before anything is allocated.
+ * Top-down bitmaps are decoded bottom row first like decodeMessage(), which requires a seekable file. A keyed pixel
+ * order visits the rows out of order and is not supported.
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start, or after its headers when they are given. Only top-down
+ *                      bitmaps need a seekable file.
+ * @param headers bitmap with the headers already read from the file, NULL to read them.
+ * @param config decode configuration.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param output output state, its result is set to DECODE_ERROR if the file cannot be decoded.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t streamMessage(FILE *bitmapFilePtr, const bitmap_t *headers, const decodeConfig_t *config,
+                              size_t chunkSize, streamOutput_t *output) {
+    bitmap_t bitmap;
+    struct stat fileStat;
+
+    output->result = DECODE_ERROR;
+    if(chunkSize == 0)
+        chunkSize = STREAM_DEFAULT_CHUNK_SIZE;
+    if(config->order_key != 0)
+        return 0;
+
+    // read headers, unless the caller already did, so a pipe is never rewound
+    uint32_t dibHeaderSize;
+    if(headers != NULL) {
+        bitmap.bmpFileHeader = headers->bmpFileHeader;
+        bitmap.dibHeader = headers->dibHeader;
+        dibHeaderSize = headers->dibHeader.type;
+    } else {
+        STATS_START(headerTimer);
+        dibHeaderSize = readBMPFileHeader(bitmapFilePtr, &(bitmap.bmpFileHeader));
+        uint32_t parsed = dibHeaderSize != 0 && readDIBHeader(bitmapFilePtr, dibHeaderSize, &(bitmap.dibHeader)) != 0;
+        STATS_STOP(headerTimer, STATS_HEADERS, (uint64_t) BMPFILEHEADERSIZE + dibHeaderSize);
+        if(parsed == 0)
+            return 0;
+    }
+    bitmap.pixel_array = NULL;
+    bitmap.color_table = NULL;
+    bitmap.file_mapping = NULL;
+    bitmap.file_mapping_size = 0;
+    if(isDecodeable(&bitmap) != 1 || getMessageCapacityWithConfig(&bitmap, config, &(output->capacity)) == 0)
+        return 0;
+
+    // a regular file must hold the pixel array, a pipe has no size, so only overflow of the header sizes is checked
+    uint64_t fileSize = UINT64_MAX;
+    if(fstat(fileno(bitmapFilePtr), &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+        fileSize = (uint64_t) fileStat.st_size;
+    uint64_t rowSize = getRowSize(&(bitmap.dibHeader));
+    uint32_t rowCount = getBitmapHeight(&(bitmap.dibHeader));
+    uint32_t width = getBitmapWidth(&(bitmap.dibHeader));
+    uint64_t headerBytes = (uint64_t) BMPFILEHEADERSIZE + dibHeaderSize + getBitfieldMasksSize(&(bitmap.dibHeader));
+    if(rowSize == 0 || rowSize > SIZE_MAX || checkPixelArrayBounds(&bitmap, fileSize) == 0 ||
+            bitmap.bmpFileHeader.img_offset < headerBytes)
+        return 0;
+
+    // 24 bit pixels with the default configuration use the vectorized unpacker, anything else a pixel kernel
+    streamPixels_t pixels;
+    pixelFormat_t format;
+    if(getPixelFormat(&(bitmap.dibHeader), &format) == 0)
+        return 0;
+    pixels.kernel = NULL;
+    if(format.bytes_per_pixel != 3 || config->bits_per_channel != 1 || config->channel_mask != CHANNEL_RGB) {
+        pixels.kernel = selectDecodeKernel(&bitmap, config);
+        if(pixels.kernel == NULL)
+            return 0;
+    }
+    pixels.accumulator.bits = 0;
+    pixels.accumulator.count = 0;
+    lsbUnpackerInit(&(pixels.unpacker));
+    pixels.bytes_per_pixel = format.bytes_per_pixel;
+    uint32_t messageBits = config->bits_per_channel * (uint32_t) __builtin_popcount(config->channel_mask);
+    size_t pixelBytes = (size_t) width * format.bytes_per_pixel;
+
+    // buffers hold whole rows, or a piece of one row when a row does not fit in the chunk size
+    size_t rowsPerChunk = chunkSize / rowSize;
+    size_t piecePixels = 0;
+    size_t bufferSize = rowsPerChunk * rowSize;
+    uint64_t bufferPixels = (uint64_t) rowsPerChunk * width;
+    if(rowsPerChunk == 0) {
+        rowsPerChunk = 1;
+        piecePixels = chunkSize / format.bytes_per_pixel > 0 ? chunkSize / format.bytes_per_pixel : 1;
+        bufferSize = piecePixels * format.bytes_per_pixel;
+        bufferPixels = piecePixels;
+    }
+    uint8_t *chunk = malloc(bufferSize);
+    uint8_t *message = malloc((size_t) (bufferPixels * messageBits / 8 + 2));
+    if(chunk == NULL || message == NULL) {
+        free(chunk);
+        free(message);
+        return 0;
+    }
+
+    // move to offset of array
+    uint32_t success = skipBytes(bitmapFilePtr, bitmap.bmpFileHeader.img_offset - headerBytes, chunk, bufferSize);
+
+    // top-down bitmaps store the bottom row last, so chunks are read back to front, which needs a seekable file
+    uint32_t topDown = isTopDown(&(bitmap.dibHeader));
+    off_t pixelArrayOffset = topDown ? ftello(bitmapFilePtr) : 0;
+    if(pixelArrayOffset < 0)
+        success = 0;
+
+    output->result = DECODE_OK;
+    for(uint32_t row = 0; success && !output->done && row < rowCount; row += rowsPerChunk) {
+        size_t rows = (rowCount - row < rowsPerChunk) ? rowCount - row : rowsPerChunk;
+        if(topDown && fseeko(bitmapFilePtr, pixelArrayOffset + (off_t) ((rowCount - row - rows) * rowSize),
+                             SEEK_SET) != 0) {
+            success = 0;
+            break;
+        }
+
+        // a wide row is read piece by piece, then its padding is skipped
+        if(piecePixels != 0) {
+            success = decodeStreamRowPieces(bitmapFilePtr, &pixels, output, width, chunk, piecePixels, message);
+            if(success && !output->done && !topDown)
+                success = skipBytes(bitmapFilePtr, rowSize - pixelBytes, chunk, bufferSize);
+            continue;
+        }
+
+        STATS_START(chunkTimer);
+        if(fread(chunk, rowSize, rows, bitmapFilePtr) != rows)
+            success = 0;
+        STATS_STOP(chunkTimer, STATS_PIXELS, rows * rowSize);
+        if(!success)
+            break;
+
+        size_t count = 0;
+        for(size_t r = 0; r < rows; r++) {
+            size_t stored = topDown ? rows - 1 - r : r;
+            count += decodeStreamPixels(&pixels, chunk + stored * rowSize, width, message + count);
+        }
+        success = writeStreamMessage(output, message, count);
+    }
+
+    free(chunk);
+    free(message);
+
+    // a head shorter than a frame header is the whole message, a frame must be complete
+    if(success && output->find_frame)
+        success = acceptStreamHead(output);
+    if(success && output->framed && !output->done)
+        output->result = DECODE_CORRUPT;
+    if(!success && output->result == DECODE_OK)
+        output->result = DECODE_ERROR;
+    return output->result == DECODE_OK;
+}
+
+/**
+ * Decodes the secret message embedded with a decode configuration while reading the bitmap file in chunks of rows.
+ *
+ * Headers are read with readBMPFileHeader() and readDIBHeader(), then whole rows are read one chunk at a time and
+ * the pixel bytes of each row are fed to an lsbUnpacker_t for the default configuration on 24 bit pixels, or to the
+ * kernel of selectDecodeKernel() otherwise, skipping row padding. A row wider than the chunk size is read in pieces
+ * of whole pixels instead. Reading stops as soon as the end of string marker, or payloadLength bytes, have been
+ * decoded, so memory use is bounded by the chunk size and only the rows holding the message are read. Sizes are 64
+ * bit, so carriers larger than memory are decoded in bounded windows. The headers of a regular file are checked
+ * against its size before anything is allocated. Top-down bitmaps are decoded bottom row first like decodeMessage(),
+ * which requires a seekable file. A keyed pixel order visits the rows out of order and is not supported.
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start. Only top-down bitmaps need a seekable file.
+ * @param outputFilePtr file the message is written to.
+ * @param config decode configuration.
+ * @param payloadLength number of message bytes to decode, 0 to stop at the end of string marker.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param written number of message bytes written, may be NULL.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeMessageStreamWithConfig(FILE *bitmapFilePtr, FILE *outputFilePtr, const decodeConfig_t *config,
+                                       uint64_t payloadLength, size_t chunkSize, uint64_t *written) {
+    streamOutput_t output;
+
+    memset(&output, 0, sizeof(streamOutput_t));
+    output.writer = writeStreamFile;
+    output.context = outputFilePtr;
+    output.payload_length = payloadLength;
+    uint32_t success = streamMessage(bitmapFilePtr, NULL, config, chunkSize, &output);
+    if(written != NULL)
+        *written = output.total;
+    return success;
+}
+
+/**
+ * Decodes the message of a bitmap file while reading it in chunks of rows, handing it to a writer, and reads a
+ * framed payload, see frame.h, in place of the message.
+ *
+ * Works like decodeMessageStreamWithConfig(). The first FRAME_HEADER_SIZE message bytes are held back until it is
+ * known whether they are a frame header. If they are, exactly the payload length is handed on and fed to
+ * crc32cUpdate() block by block, then checked against the header, so a framed payload costs no second pass. The
+ * stream of a compressed frame is fed to an lzDecoder_t chunk by chunk, and the bytes each chunk decompresses to are
+ * handed on. Its matches reach back anywhere, so the decompressed payload is held in memory, like
+ * decodeFramedPayload() does. The checksum can only be verified after the last block, so a writer may have received
+ * a payload that turns out to be corrupt.
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start, or after its headers when they are given. Only top-down
+ *                      bitmaps need a seekable file.
+ * @param headers bitmap with the headers already read from the file with readBMPFileHeader() and readDIBHeader(),
+ *                NULL to read them, so a pipe can be decoded after its headers were looked at.
+ * @param config decode configuration.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param writer writer receiving the message, or the payload of a frame.
+ * @param context context of the writer.
+ * @param length number of bytes handed to the writer.
+ * @return DECODE_OK, DECODE_CORRUPT if a frame does not fit or its checksum does not match, or DECODE_ERROR if the
+ *         file cannot be decoded, memory ran out or the writer failed.
+ */
+uint32_t decodeMessageStreamToWriter(FILE *bitmapFilePtr, const bitmap_t *headers, const decodeConfig_t *config,
+                                     size_t chunkSize, messageWriter_t writer, void *context, uint64_t *length) {
+    streamOutput_t output;
+
+    memset(&output, 0, sizeof(streamOutput_t));
+    output.writer = writer;
+    output.context = context;
+    output.find_frame = 1;
+    streamMessage(bitmapFilePtr, headers, config, chunkSize, &output);
+    free(output.expanded);
+    *length = output.total;
+    return output.result;
+}
@@ -0,0 +1,66 @@
+/** @file decodestream.h
+ *
+ * @brief Decodes message hidden in bitmap file while streaming it, without loading the pixel array.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef DECODESTREAM_H_
+#define DECODESTREAM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitmap.h"
+#include "decoder.h"
+
+/**
+ * Default number of pixel array bytes read per chunk.
+ */
+#define STREAM_DEFAULT_CHUNK_SIZE   (1024 * 1024)
+
+/**
+ * Decodes the secret message while reading the bitmap file in chunks of rows.
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start. Only top-down bitmaps need a seekable file.
+ * @param outputFilePtr file the message is written to.
+ * @param payloadLength number of message bytes to decode, 0 to stop at the end of string marker.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param written number of message bytes written, may be NULL.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeMessageStream(FILE *bitmapFilePtr, FILE *outputFilePtr, uint64_t payloadLength, size_t chunkSize,
+                             uint64_t *written);
+
+/**
+ * Decodes the secret message embedded with a decode configuration while reading the bitmap file in chunks of rows.
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start. Only top-down bitmaps need a seekable file.
+ * @param outputFilePtr file the message is written to.
+ * @param config decode configuration.
+ * @param payloadLength number of message bytes to decode, 0 to stop at the end of string marker.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param written number of message bytes written, may be NULL.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t decodeMessageStreamWithConfig(FILE *bitmapFilePtr, FILE *outputFilePtr, const decodeConfig_t *config,
+                                       uint64_t payloadLength, size_t chunkSize, uint64_t *written);
+
+/**
+ * Decodes the message of a bitmap file while reading it in chunks of rows, handing it to a writer, and reads a
+ * framed payload, see frame.h, in place of the message.
+ *
+ * @param bitmapFilePtr bitmap file positioned at its start, or after its headers when they are given. Only top-down
+ *                      bitmaps need a seekable file.
+ * @param headers bitmap with the headers already read from the file, NULL to read them.
+ * @param config decode configuration.
+ * @param chunkSize number of pixel array bytes to read at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param writer writer receiving the message, or the payload of a frame.
+ * @param context context of the writer.
+ * @param length number of bytes handed to the writer.
+ * @return DECODE_OK, DECODE_CORRUPT if a frame does not fit or its checksum does not match, or DECODE_ERROR if the
+ *         file cannot be decoded, memory ran out or the writer failed.
+ */
+uint32_t decodeMessageStreamToWriter(FILE *bitmapFilePtr, const bitmap_t *headers, const decodeConfig_t *config,
+                                     size_t chunkSize, messageWriter_t writer, void *context, uint64_t *length);
+
+#endif
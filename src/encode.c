@@ -0,0 +1,312 @@
+/** @file encode.c
+ *
+ * @brief Hide data in BMP image.
+ * @author Daniel Jaramillo
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bitmap.h"
+#include "encoder.h"
+#include "frame.h"
+#include "pixelorder.h"
+#include "probe.h"
+#include "shard.h"
+
+/**
+ * Prints command line usage.
+ *
+ * @param program name of the program.
+ */
+static void printUsage(const char *program) {
+    printf("Usage: %s [options] <carrier.bmp> <message file> <output.bmp>\n"
+           "       %s --shards [options] <message file> <carrier.bmp> <output.bmp> [<carrier.bmp> <output.bmp>...]\n"
+           "       %s --update [options] <stego.bmp> <message file>\n"
+           "Hides the message file in a copy of the carrier, as a C string or as a frame. With --shards, splits it\n"
+           "over copies of several carriers, one shard each. With --update, replaces the message of a stego bitmap\n"
+           "in place, writing only the pages that change.\n"
+           "\n"
+           "  -f, --framed           embed the message as a frame with length and CRC-32C instead of a C string\n"
+           "  -z, --compress         embed the message as a frame with its payload LZ compressed, implies -f\n"
+           "      --key PASSPHRASE   scatter the message over the carrier in the keyed order of PASSPHRASE instead of\n"
+           "                         along the rows, the carrier is read whole\n"
+           "      --shards           split the message into shards in proportion to the capacity of each carrier,\n"
+           "                         decoded with decode --shards, -z compresses each shard\n"
+           "      --update           embed the message into the stego bitmap itself, reading only the rows the\n"
+           "                         message covers and writing back only the pages whose low bits change\n"
+           "  -h, --help             print this help\n", program, program, program);
+}
+
+/**
+ * Reads a whole file into memory and appends an end of string marker.
+ *
+ * @param messageFilePtr file to read.
+ * @param length number of bytes read, including the end of string marker.
+ * @return pointer to buffer on success, NULL otherwise.
+ */
+static uint8_t *readMessageFile(FILE *messageFilePtr, size_t *length) {
+    size_t capacity = 4096;
+    size_t count = 0;
+    uint8_t *buffer = malloc(capacity);
+
+    while(buffer != NULL) {
+        count += fread(buffer + count, 1, capacity - count, messageFilePtr);
+        if(count < capacity)
+            break;
+        capacity *= 2;
+        uint8_t *grown = realloc(buffer, capacity);
+        if(grown == NULL)
+            free(buffer);
+        buffer = grown;
+    }
+    if(buffer == NULL || ferror(messageFilePtr)) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[count] = '\0';
+    *length = count + 1;
+    return buffer;
+}
+
+/**
+ * Embeds a payload in a copy of a carrier file.
+ *
+ * @param carrierPath carrier bitmap file.
+ * @param outputPath file the stego bitmap is written to.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param key key of the pixel order, 0 to embed along the rows while copying the carrier in chunks.
+ * @return 0 on success, -1 otherwise, with the error printed.
+ */
+static int embedFile(const char *carrierPath, const char *outputPath, const uint8_t *payload, size_t length,
+                     uint64_t key) {
+    FILE *carrierFilePtr, *outputFilePtr;
+
+    // open carrier and output files
+    carrierFilePtr = fopen(carrierPath, "rb");
+    if(carrierFilePtr == NULL) {
+        printf("Error: Unable to open bitmap file %s.\n", carrierPath);
+        return -1;
+    }
+    outputFilePtr = fopen(outputPath, "wb");
+    if(outputFilePtr == NULL) {
+        printf("Error: Unable to open output file %s.\n", outputPath);
+        fclose(carrierFilePtr);
+        return -1;
+    }
+
+    // embed message while copying carrier to output, a keyed order scatters it over the whole carrier in memory
+    uint32_t success;
+    if(key != 0) {
+        bitmap_t bitmap;
+        success = readBitmapFile(carrierFilePtr, &bitmap);
+        if(success == 1) {
+            success = embedKeyedPayload(&bitmap, payload, length, key) && writeBitmapFile(outputFilePtr, &bitmap);
+            releaseBitmap(&bitmap);
+        }
+    } else {
+        success = embedPayloadStream(carrierFilePtr, outputFilePtr, payload, length, 0);
+    }
+    if(fclose(outputFilePtr) != 0)
+        success = 0;
+    if(success != 1)
+        printf("Error: Unable to embed message in %s. Carrier must be a decodeable 24 bit bitmap large enough for "
+               "the message.\n", carrierPath);
+
+    fclose(carrierFilePtr);
+    return success == 1 ? 0 : -1;
+}
+
+/**
+ * Replaces the payload of a stego bitmap file in place and prints how much was written.
+ *
+ * @param bitmapPath stego bitmap file.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 0 on success, -1 otherwise, with the error printed.
+ */
+static int updateFile(const char *bitmapPath, const uint8_t *payload, size_t length) {
+    payloadUpdate_t update;
+
+    FILE *bitmapFilePtr = fopen(bitmapPath, "r+b");
+    if(bitmapFilePtr == NULL) {
+        printf("Error: Unable to open bitmap file %s for writing.\n", bitmapPath);
+        return -1;
+    }
+    uint32_t success = updatePayloadFile(bitmapFilePtr, payload, length, 0, &update);
+    if(fclose(bitmapFilePtr) != 0)
+        success = 0;
+    if(success != 1) {
+        printf("Error: Unable to update message in %s. Bitmap must be a decodeable 24 bit bitmap large enough for "
+               "the message.\n", bitmapPath);
+        return -1;
+    }
+    printf("Changed %llu subpixels, wrote %llu bytes in %llu pages after reading %llu bytes.\n",
+           (unsigned long long) update.bytes_changed, (unsigned long long) update.bytes_written,
+           (unsigned long long) update.pages_written, (unsigned long long) update.bytes_read);
+    return 0;
+}
+
+/**
+ * Splits a payload into shards over copies of carrier files, see shard.h.
+ *
+ * The capacity of each carrier is read from its headers first, so the split is known before any carrier is copied.
+ *
+ * @param paths carrier and output file paths, in pairs.
+ * @param pairCount number of carriers.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param compress 1 to compress each shard.
+ * @param key key of the pixel order, 0 to embed along the rows.
+ * @return 0 on success, -1 otherwise, with the error printed.
+ */
+static int embedShards(char *const *paths, uint32_t pairCount, const uint8_t *payload, size_t length,
+                       uint32_t compress, uint64_t key) {
+    uint64_t *capacities = malloc(2 * (size_t) pairCount * sizeof(uint64_t));
+    if(capacities == NULL) {
+        printf("Error: Out of memory.\n");
+        return -1;
+    }
+    uint64_t *lengths = capacities + pairCount;
+
+    // a carrier holds a frame header, a shard header and its slice
+    for(uint32_t i = 0; i < pairCount; i++) {
+        bitmapProbe_t probe;
+        if(probeBitmapFile(paths[2 * i], &probe) != 1 || !probe.decodeable || probe.bits_per_pixel != 24) {
+            printf("Error: %s is not a decodeable 24 bit bitmap.\n", paths[2 * i]);
+            free(capacities);
+            return -1;
+        }
+        uint64_t overhead = FRAME_HEADER_SIZE + SHARD_HEADER_SIZE;
+        capacities[i] = probe.capacity > overhead ? probe.capacity - overhead : 0;
+    }
+    if(planShards(capacities, pairCount, length, lengths) == 0) {
+        printf("Error: The message does not fit in the carriers.\n");
+        free(capacities);
+        return -1;
+    }
+
+    shardHeader_t header;
+    header.count = pairCount;
+    header.set_id = getShardSetId(payload, length);
+    header.offset = 0;
+    header.total_length = length;
+    int result = 0;
+    for(uint32_t i = 0; i < pairCount && result == 0; i++) {
+        size_t frameLength;
+        header.index = i;
+        uint8_t *frame = buildShardFrame(&header, payload + header.offset, (size_t) lengths[i], compress,
+                                         &frameLength);
+        if(frame == NULL) {
+            printf("Error: Out of memory.\n");
+            result = -1;
+            break;
+        }
+        result = embedFile(paths[2 * i], paths[2 * i + 1], frame, frameLength, key);
+        free(frame);
+        header.offset += lengths[i];
+    }
+    free(capacities);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"framed",   no_argument, NULL, 'f'},
+        {"compress", no_argument, NULL, 'z'},
+        {"key",      required_argument, NULL, 'k'},
+        {"shards",   no_argument, NULL, 'S'},
+        {"update",   no_argument, NULL, 'U'},
+        {"help",     no_argument, NULL, 'h'},
+        {NULL,       0,           NULL, 0}
+    };
+    FILE *messageFilePtr;
+    uint8_t *message;
+    size_t length;
+    uint32_t framed = 0;
+    uint32_t compress = 0;
+    uint64_t key = 0;
+    uint32_t shards = 0;
+    uint32_t update = 0;
+    int opt;
+
+    while((opt = getopt_long(argc, argv, "fzh", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 'f':
+                framed = 1;
+                break;
+            case 'z':
+                compress = 1;
+                break;
+            case 'k':
+                key = getPixelOrderKey(optarg);
+                break;
+            case 'S':
+                shards = 1;
+                break;
+            case 'U':
+                update = 1;
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return -1;
+        }
+    }
+    // shards take the message file first, then carrier and output pairs
+    // an update takes the stego bitmap, then the message file
+    int argCount = argc - optind;
+    if((!shards && !update && argCount != 3) || (shards && (argCount < 3 || argCount % 2 == 0)) ||
+            (update && argCount != 2)) {
+        printUsage(argv[0]);
+        return -1;
+    }
+    if(update && (shards || key != 0)) {
+        printf("Error: --update cannot be combined with --shards or --key.\n");
+        return -1;
+    }
+    const char *messagePath = argv[shards ? optind : optind + 1];
+
+    // read message
+    messageFilePtr = fopen(messagePath, "rb");
+    if(messageFilePtr == NULL) {
+        printf("Error: Unable to open message file.\n");
+        return -1;
+    }
+    message = readMessageFile(messageFilePtr, &length);
+    fclose(messageFilePtr);
+    if(message == NULL) {
+        printf("Error: Unable to read message file.\n");
+        return -1;
+    }
+
+    // a frame carries its own length, so the end of string marker is left out
+    if(shards) {
+        int result = embedShards(argv + optind + 1, (uint32_t) (argCount / 2), message, length - 1, compress, key);
+        free(message);
+        return result;
+    }
+    if(framed || compress) {
+        uint8_t *frame = compress ? buildCompressedFramedPayload(message, length - 1, &length)
+                                  : buildFramedPayload(message, length - 1, &length);
+        free(message);
+        message = frame;
+        if(message == NULL) {
+            printf("Error: Unable to read message file.\n");
+            return -1;
+        }
+    }
+
+    int result = update ? updateFile(argv[optind], message, length)
+                        : embedFile(argv[optind], argv[optind + 2], message, length, key);
+    free(message);
+    return result;
+}
+/*** end of file ***/
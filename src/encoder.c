@@ -0,0 +1,471 @@
+/** @file encoder.c
+ *
+ * @brief Embeds message in bitmap file.
+ * @author Daniel Jaramillo
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "decodestream.h"
+#include "encoder.h"
+#include "frame.h"
+#include "lsbkernels.h"
+#include "pixelorder.h"
+
+/**
+ * Embeds a payload into the pixel array of a bitmap in memory.
+ *
+ * Uses the same layout decodeMessage() reads: bit n of the payload goes to the LSB of subpixel n, counted along the
+ * rows from the bottom of the image up with padding skipped. Subpixels past the payload are left unchanged.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 1 on success, 0 if the bitmap is not a decodeable 24 bit bitmap or the payload does not fit.
+ */
+uint32_t embedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length) {
+    uint64_t charCount;
+    bitmapRows_t rows;
+
+    // 32 bit carriers are only decoded, embedding would have to skip the alpha byte
+    if(isDecodeable(bitmap) != 1 || getBitsPerPixel(&(bitmap->dibHeader)) != 24 ||
+            getMessageCapacity(bitmap, &charCount) == 0 || length > charCount || getBitmapRows(bitmap, &rows) == 0)
+        return 0;
+
+    uint64_t bitCount = (uint64_t) length * 8;
+    uint64_t bit = 0;
+    for(uint32_t row = 0; bit < bitCount && row < rows.row_count; row++) {
+        size_t count = (bitCount - bit < rows.row_bytes) ? (size_t) (bitCount - bit) : rows.row_bytes;
+        embedLSBBitRange((uint8_t *) getRow(&rows, row), count, payload, bit);
+        bit += count;
+    }
+    return 1;
+}
+
+/**
+ * Embeds a payload into the pixel array of a bitmap in memory, taking the pixels in a keyed order.
+ *
+ * Works one block of the order at a time: the pixels of the block are gathered next to each other, their low bits
+ * are replaced with embedLSBBitRange() like embedPayload() does along the rows, and they are scattered back.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param key key of the pixel order, see getPixelOrderKey(), not 0.
+ * @return 1 on success, 0 if the bitmap is not a decodeable 24 bit bitmap or the payload does not fit.
+ */
+uint32_t embedKeyedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length, uint64_t key) {
+    uint8_t pixels[PIXEL_ORDER_BLOCK_PIXELS * 3];
+    pixelOrder_t order;
+    uint64_t charCount;
+    bitmapRows_t rows;
+
+    if(key == 0 || isDecodeable(bitmap) != 1 || getBitsPerPixel(&(bitmap->dibHeader)) != 24 ||
+            getMessageCapacity(bitmap, &charCount) == 0 || length > charCount || getBitmapRows(bitmap, &rows) == 0)
+        return 0;
+
+    pixelOrderInit(&order, key, (uint64_t) rows.row_pixels * rows.row_count);
+    uint64_t bitCount = (uint64_t) length * 8;
+    uint64_t bit = 0;
+    for(uint64_t slot = 0; bit < bitCount; slot += PIXEL_ORDER_BLOCK_PIXELS) {
+        uint64_t left = bitCount - bit;
+        size_t count = PIXEL_ORDER_BLOCK_PIXELS;
+        if(left < (uint64_t) count * 3)
+            count = (size_t) ((left + 2) / 3);
+        size_t bits = (left < (uint64_t) count * 3) ? (size_t) left : count * 3;
+        gatherOrderedPixels(&order, &rows, slot, count, pixels);
+        embedLSBBitRange(pixels, bits, payload, bit);
+        scatterOrderedPixels(&order, &rows, slot, count, pixels);
+        bit += bits;
+    }
+    return 1;
+}
+
+/**
+ * Embeds a C string, including its end of string marker, into the pixel array of a bitmap in memory.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param message message to embed.
+ * @return 1 on success, 0 if the bitmap is not decodeable or the message does not fit.
+ */
+uint32_t encodeMessage(bitmap_t *bitmap, const char *message) {
+    return embedPayload(bitmap, (const uint8_t *) message, strlen(message) + 1);
+}
+
+/**
+ * Embeds a payload as a frame, see frame.h, into the pixel array of a bitmap in memory.
+ *
+ * The frame header carries the payload length and CRC-32C, so decodeFramedPayload() reads exactly the payload and
+ * can tell it from noise.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 1 on success, 0 if the bitmap is not decodeable, the frame does not fit or memory ran out.
+ */
+uint32_t embedFramedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length) {
+    size_t framedLength;
+    uint8_t *frame = buildFramedPayload(payload, length, &framedLength);
+    if(frame == NULL)
+        return 0;
+
+    uint32_t success = embedPayload(bitmap, frame, framedLength);
+    free(frame);
+    return success;
+}
+
+/**
+ * Embeds a payload as a compressed frame, see frame.h, into the pixel array of a bitmap in memory.
+ *
+ * Compressible payloads touch fewer pixels, so they fit smaller carriers and decode faster.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 1 on success, 0 if the bitmap is not decodeable, the frame does not fit or memory ran out.
+ */
+uint32_t embedCompressedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length) {
+    size_t framedLength;
+    uint8_t *frame = buildCompressedFramedPayload(payload, length, &framedLength);
+    if(frame == NULL)
+        return 0;
+
+    uint32_t success = embedPayload(bitmap, frame, framedLength);
+    free(frame);
+    return success;
+}
+
+/**
+ * Copies bytes from one file to another through a buffer.
+ *
+ * @param inputFilePtr file to read from.
+ * @param outputFilePtr file to write to.
+ * @param count number of bytes to copy.
+ * @param buffer scratch buffer.
+ * @param bufferSize size of scratch buffer.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t copyBytes(FILE *inputFilePtr, FILE *outputFilePtr, uint64_t count, uint8_t *buffer,
+                          size_t bufferSize) {
+    while(count > 0) {
+        size_t step = count < bufferSize ? (size_t) count : bufferSize;
+        if(fread(buffer, 1, step, inputFilePtr) != step || fwrite(buffer, 1, step, outputFilePtr) != step)
+            return 0;
+        count -= step;
+    }
+    return 1;
+}
+
+/**
+ * Copies a carrier bitmap file to an output file, embedding a payload on the way.
+ *
+ * Headers are read with readBMPFileHeader() and readDIBHeader() and written back with the serializers. Bytes
+ * between the headers and the pixel array are copied unchanged. The pixel array is then read, embedded and written
+ * one chunk of rows at a time in file order, so no buffer of the whole image is needed. Each stored row gets the
+ * payload bits of its position in decode order, which also covers top-down bitmaps without seeking. Anything after
+ * the pixel array is copied unchanged.
+ *
+ * @param carrierFilePtr carrier bitmap file positioned at its start. Does not need to be seekable.
+ * @param outputFilePtr file the stego bitmap is written to.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param chunkSize number of pixel array bytes processed at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t embedPayloadStream(FILE *carrierFilePtr, FILE *outputFilePtr, const uint8_t *payload, size_t length,
+                            size_t chunkSize) {
+    bitmap_t bitmap;
+    uint64_t charCount;
+    uint8_t headers[BMPFILEHEADERSIZE + BITMAPV5HEADER];
+
+    if(chunkSize == 0)
+        chunkSize = STREAM_DEFAULT_CHUNK_SIZE;
+
+    // read headers
+    uint32_t dibHeaderSize = readBMPFileHeader(carrierFilePtr, &(bitmap.bmpFileHeader));
+    if(dibHeaderSize == 0)
+        return 0;
+    if(readDIBHeader(carrierFilePtr, dibHeaderSize, &(bitmap.dibHeader)) == 0)
+        return 0;
+    bitmap.pixel_array = NULL;
+    bitmap.color_table = NULL;
+    bitmap.file_mapping = NULL;
+    bitmap.file_mapping_size = 0;
+    if(isDecodeable(&bitmap) != 1 || getBitsPerPixel(&(bitmap.dibHeader)) != 24 ||
+            getMessageCapacity(&bitmap, &charCount) == 0 || length > charCount)
+        return 0;
+
+    uint64_t rowSize = getRowSize(&(bitmap.dibHeader));
+    uint32_t rowCount = getBitmapHeight(&(bitmap.dibHeader));
+    size_t pixelBytes = (size_t) getBitsPerPixel(&(bitmap.dibHeader)) * getBitmapWidth(&(bitmap.dibHeader)) / 8;
+    uint32_t topDown = isTopDown(&(bitmap.dibHeader));
+    uint64_t headerBytes = (uint64_t) BMPFILEHEADERSIZE + dibHeaderSize + getBitfieldMasksSize(&(bitmap.dibHeader));
+    if(rowSize == 0 || rowSize > SIZE_MAX || checkPixelArrayBounds(&bitmap, UINT64_MAX) == 0 ||
+            bitmap.bmpFileHeader.img_offset < headerBytes)
+        return 0;
+
+    // write headers
+    uint32_t size = serializeBMPFileHeader(&(bitmap.bmpFileHeader), headers);
+    size += serializeDIBHeader(&(bitmap.dibHeader), headers + size);
+    if(fwrite(headers, 1, size, outputFilePtr) != size)
+        return 0;
+
+    size_t rowsPerChunk = chunkSize / rowSize;
+    if(rowsPerChunk == 0)
+        rowsPerChunk = 1;
+    uint8_t *chunk = malloc(rowsPerChunk * rowSize);
+    if(chunk == NULL)
+        return 0;
+
+    uint32_t success = copyBytes(carrierFilePtr, outputFilePtr, bitmap.bmpFileHeader.img_offset - headerBytes,
+                                 chunk, rowsPerChunk * rowSize);
+
+    uint64_t bitCount = (uint64_t) length * 8;
+    for(uint32_t row = 0; success && row < rowCount; row += rowsPerChunk) {
+        size_t rows = (rowCount - row < rowsPerChunk) ? rowCount - row : rowsPerChunk;
+        if(fread(chunk, rowSize, rows, carrierFilePtr) != rows) {
+            success = 0;
+            break;
+        }
+
+        for(size_t r = 0; r < rows; r++) {
+            uint32_t decodeRow = topDown ? rowCount - 1 - (row + (uint32_t) r) : row + (uint32_t) r;
+            uint64_t firstBit = (uint64_t) decodeRow * pixelBytes;
+            if(firstBit >= bitCount)
+                continue;
+            size_t count = (bitCount - firstBit < pixelBytes) ? (size_t) (bitCount - firstBit) : pixelBytes;
+            embedLSBBitRange(chunk + r * rowSize, count, payload, firstBit);
+        }
+
+        if(fwrite(chunk, rowSize, rows, outputFilePtr) != rows)
+            success = 0;
+    }
+
+    // copy trailing data such as an embedded color profile
+    while(success) {
+        size_t count = fread(chunk, 1, rowsPerChunk * rowSize, carrierFilePtr);
+        if(count == 0) {
+            success = !ferror(carrierFilePtr);
+            break;
+        }
+        if(fwrite(chunk, 1, count, outputFilePtr) != count)
+            success = 0;
+    }
+
+    free(chunk);
+    return success;
+}
+
+/**
+ * Reads exactly size bytes at a file offset, continuing after short reads and interrupted calls.
+ *
+ * @param fd file.
+ * @param buffer destination.
+ * @param size number of bytes.
+ * @param offset file offset.
+ * @return 1 on success, 0 on error or end of file.
+ */
+static uint32_t preadAll(int fd, uint8_t *buffer, size_t size, uint64_t offset) {
+    while(size > 0) {
+        ssize_t count = pread(fd, buffer, size, (off_t) offset);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return 0;
+        buffer += count;
+        size -= (size_t) count;
+        offset += (uint64_t) count;
+    }
+    return 1;
+}
+
+/**
+ * Writes exactly size bytes at a file offset, continuing after short writes and interrupted calls.
+ *
+ * @param fd file.
+ * @param buffer bytes to write.
+ * @param size number of bytes.
+ * @param offset file offset.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t pwriteAll(int fd, const uint8_t *buffer, size_t size, uint64_t offset) {
+    while(size > 0) {
+        ssize_t count = pwrite(fd, buffer, size, (off_t) offset);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return 0;
+        buffer += count;
+        size -= (size_t) count;
+        offset += (uint64_t) count;
+    }
+    return 1;
+}
+
+/**
+ * Writes back the changed bytes of a block of rows read from a file.
+ *
+ * The block is compared one file page at a time. Each run of neighbouring pages holding a changed byte is written
+ * with one pwrite(), from its first to its last changed byte, so pages whose bytes are all unchanged are never
+ * written.
+ *
+ * @param fd file.
+ * @param rows block with the new payload embedded.
+ * @param original block as read from the file.
+ * @param size number of bytes in the block.
+ * @param offset file offset of the block.
+ * @param pageSize size of a file page.
+ * @param lastPage index of the last page counted, so a page shared by two blocks is counted once. Updated.
+ * @param update totals, updated.
+ * @return 1 on success, 0 if writing failed.
+ */
+static uint32_t writeChangedPages(int fd, const uint8_t *rows, const uint8_t *original, size_t size, uint64_t offset,
+                                  uint64_t pageSize, uint64_t *lastPage, payloadUpdate_t *update) {
+    size_t runStart = 0;
+    size_t runEnd = 0;          // end of the changed bytes of the current run, 0 if there is none
+    uint64_t runPage = 0;       // last page of the current run
+
+    for(size_t pos = 0; pos < size;) {
+        uint64_t page = (offset + pos) / pageSize;
+        size_t end = (size_t) ((page + 1) * pageSize - offset);
+        if(end > size)
+            end = size;
+        if(memcmp(rows + pos, original + pos, end - pos) != 0) {
+            size_t first = pos;
+            size_t last = end;
+            while(rows[first] == original[first])
+                first++;
+            while(rows[last - 1] == original[last - 1])
+                last--;
+            for(size_t i = first; i < last; i++)
+                update->bytes_changed += rows[i] != original[i];
+            if(page != *lastPage)
+                update->pages_written++;
+            *lastPage = page;
+
+            // a page next to the run extends it, any other starts a new one
+            if(runEnd == 0 || page != runPage + 1) {
+                if(runEnd != 0 && pwriteAll(fd, rows + runStart, runEnd - runStart, offset + runStart) == 0)
+                    return 0;
+                update->bytes_written += runEnd - runStart;
+                runStart = first;
+            }
+            runEnd = last;
+            runPage = page;
+        }
+        pos = end;
+    }
+    if(runEnd != 0 && pwriteAll(fd, rows + runStart, runEnd - runStart, offset + runStart) == 0)
+        return 0;
+    update->bytes_written += runEnd - runStart;
+    return 1;
+}
+
+/**
+ * Replaces the payload of a stego bitmap file in place, writing back only the file pages whose subpixels change.
+ *
+ * Headers are read with readBMPFileHeader() and readDIBHeader(), and locate the stored rows holding the payload:
+ * the bottom rows of the image, which are one run of rows in the file whether the bitmap is bottom-up or top-down.
+ * Only those rows are read with pread(), one chunk at a time, and the payload bits are embedded into a copy. Comparing
+ * the old and new low bits then finds the pages to write with pwrite(). Reads scale with the payload and writes with
+ * the change, so rotating a payload that mostly stays the same rewrites a few pages of a large carrier instead of
+ * the whole file.
+ *
+ * @param bitmapFilePtr bitmap file opened for reading and writing, positioned at its start. Must be a regular file.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param chunkSize number of pixel array bytes compared at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param update totals of the update, may be NULL.
+ * @return 1 on success, 0 if the bitmap is not a decodeable 24 bit bitmap, the payload does not fit, memory ran out
+ *         or reading or writing failed.
+ */
+uint32_t updatePayloadFile(FILE *bitmapFilePtr, const uint8_t *payload, size_t length, size_t chunkSize,
+                           payloadUpdate_t *update) {
+    payloadUpdate_t totals;
+    bitmap_t bitmap;
+    uint64_t charCount;
+    struct stat fileStat;
+
+    memset(&totals, 0, sizeof(payloadUpdate_t));
+    if(update != NULL)
+        *update = totals;
+    if(chunkSize == 0)
+        chunkSize = STREAM_DEFAULT_CHUNK_SIZE;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if(pageSize <= 0)
+        pageSize = 4096;
+
+    // read headers, the pixels are then read and written at their offsets without the stream
+    uint32_t dibHeaderSize = readBMPFileHeader(bitmapFilePtr, &(bitmap.bmpFileHeader));
+    if(dibHeaderSize == 0)
+        return 0;
+    if(readDIBHeader(bitmapFilePtr, dibHeaderSize, &(bitmap.dibHeader)) == 0)
+        return 0;
+    bitmap.pixel_array = NULL;
+    bitmap.color_table = NULL;
+    bitmap.file_mapping = NULL;
+    bitmap.file_mapping_size = 0;
+    int fd = fileno(bitmapFilePtr);
+    if(fd < 0 || fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+        return 0;
+    if(isDecodeable(&bitmap) != 1 || getBitsPerPixel(&(bitmap.dibHeader)) != 24 ||
+            getMessageCapacity(&bitmap, &charCount) == 0 || length > charCount ||
+            checkPixelArrayBounds(&bitmap, (uint64_t) fileStat.st_size) == 0)
+        return 0;
+
+    uint64_t rowSize = getRowSize(&(bitmap.dibHeader));
+    uint32_t rowCount = getBitmapHeight(&(bitmap.dibHeader));
+    size_t pixelBytes = (size_t) getBitmapWidth(&(bitmap.dibHeader)) * 3;
+    uint32_t topDown = isTopDown(&(bitmap.dibHeader));
+    if(rowSize == 0 || rowSize > SIZE_MAX || pixelBytes == 0)
+        return 0;
+
+    // rows in decode order holding the payload, stored last in a top-down bitmap
+    uint64_t bitCount = (uint64_t) length * 8;
+    uint32_t usedRows = (uint32_t) ((bitCount + pixelBytes - 1) / pixelBytes);
+    uint32_t firstStored = topDown ? rowCount - usedRows : 0;
+
+    size_t rowsPerChunk = chunkSize / rowSize;
+    if(rowsPerChunk == 0)
+        rowsPerChunk = 1;
+    if(rowsPerChunk > usedRows)
+        rowsPerChunk = usedRows > 0 ? usedRows : 1;
+    uint8_t *chunk = malloc(2 * rowsPerChunk * rowSize);
+    if(chunk == NULL)
+        return 0;
+    uint8_t *original = chunk + rowsPerChunk * rowSize;
+
+    uint32_t success = 1;
+    uint64_t lastPage = UINT64_MAX;
+    for(uint32_t row = 0; success && row < usedRows; row += rowsPerChunk) {
+        size_t rows = (usedRows - row < rowsPerChunk) ? usedRows - row : rowsPerChunk;
+        uint32_t stored = firstStored + row;
+        uint64_t offset = bitmap.bmpFileHeader.img_offset + stored * rowSize;
+        if(preadAll(fd, chunk, rows * rowSize, offset) == 0) {
+            success = 0;
+            break;
+        }
+        totals.bytes_read += rows * rowSize;
+        memcpy(original, chunk, rows * rowSize);
+
+        for(size_t r = 0; r < rows; r++) {
+            uint32_t decodeRow = topDown ? rowCount - 1 - (stored + (uint32_t) r) : stored + (uint32_t) r;
+            uint64_t firstBit = (uint64_t) decodeRow * pixelBytes;
+            if(firstBit >= bitCount)
+                continue;
+            size_t count = (bitCount - firstBit < pixelBytes) ? (size_t) (bitCount - firstBit) : pixelBytes;
+            embedLSBBitRange(chunk + r * rowSize, count, payload, firstBit);
+        }
+        success = writeChangedPages(fd, chunk, original, rows * rowSize, offset, (uint64_t) pageSize, &lastPage,
+                                    &totals);
+    }
+
+    free(chunk);
+    if(update != NULL)
+        *update = totals;
+    return success;
+}
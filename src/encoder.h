@@ -0,0 +1,107 @@
+/** @file encoder.h
+ *
+ * @brief Embeds message in bitmap file.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef ENCODER_H_
+#define ENCODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitmap.h"
+
+/**
+ * Totals of updating the payload of a stego bitmap file in place with updatePayloadFile().
+ */
+typedef struct payloadUpdate {
+    uint64_t bytes_read;        // pixel array bytes read to compare the old and new low bits
+    uint64_t bytes_changed;     // subpixels whose low bit changed
+    uint64_t bytes_written;     // bytes written back, from the first to the last changed subpixel of each run of pages
+    uint64_t pages_written;     // file pages holding changed subpixels
+} payloadUpdate_t;
+
+/**
+ * Embeds a payload into the pixel array of a bitmap in memory.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 1 on success, 0 if the bitmap is not a decodeable 24 bit bitmap or the payload does not fit.
+ */
+uint32_t embedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length);
+
+/**
+ * Embeds a payload into the pixel array of a bitmap in memory, taking the pixels in a keyed order, see pixelorder.h.
+ * Decoded with the order_key of decodeConfig_t set to the same key.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param key key of the pixel order, see getPixelOrderKey(), not 0.
+ * @return 1 on success, 0 if the bitmap is not a decodeable 24 bit bitmap or the payload does not fit.
+ */
+uint32_t embedKeyedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length, uint64_t key);
+
+/**
+ * Embeds a C string, including its end of string marker, into the pixel array of a bitmap in memory.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param message message to embed.
+ * @return 1 on success, 0 if the bitmap is not decodeable or the message does not fit.
+ */
+uint32_t encodeMessage(bitmap_t *bitmap, const char *message);
+
+/**
+ * Embeds a payload as a frame, see frame.h, into the pixel array of a bitmap in memory.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 1 on success, 0 if the bitmap is not decodeable, the frame does not fit or memory ran out.
+ */
+uint32_t embedFramedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length);
+
+/**
+ * Embeds a payload as a compressed frame, see frame.h, into the pixel array of a bitmap in memory.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile(), the pixel array is modified in place.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @return 1 on success, 0 if the bitmap is not decodeable, the frame does not fit or memory ran out.
+ */
+uint32_t embedCompressedPayload(bitmap_t *bitmap, const uint8_t *payload, size_t length);
+
+/**
+ * Copies a carrier bitmap file to an output file, embedding a payload on the way.
+ *
+ * @param carrierFilePtr carrier bitmap file positioned at its start. Does not need to be seekable.
+ * @param outputFilePtr file the stego bitmap is written to.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param chunkSize number of pixel array bytes processed at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @return 1 on success, 0 on error.
+ */
+uint32_t embedPayloadStream(FILE *carrierFilePtr, FILE *outputFilePtr, const uint8_t *payload, size_t length,
+                            size_t chunkSize);
+
+/**
+ * Replaces the payload of a stego bitmap file in place, writing back only the file pages whose subpixels change.
+ *
+ * Uses the layout of embedPayload(). Subpixels past the payload are left unchanged, so the file ends up as if the
+ * payload had been embedded into it with embedPayload().
+ *
+ * @param bitmapFilePtr bitmap file opened for reading and writing, positioned at its start. Must be a regular file.
+ * @param payload bytes to embed.
+ * @param length number of bytes to embed.
+ * @param chunkSize number of pixel array bytes compared at a time, 0 for STREAM_DEFAULT_CHUNK_SIZE.
+ * @param update totals of the update, may be NULL.
+ * @return 1 on success, 0 if the bitmap is not a decodeable 24 bit bitmap, the payload does not fit, memory ran out
+ *         or reading or writing failed.
+ */
+uint32_t updatePayloadFile(FILE *bitmapFilePtr, const uint8_t *payload, size_t length, size_t chunkSize,
+                           payloadUpdate_t *update);
+
+#endif
@@ -0,0 +1,114 @@
+/** @file frame.c
+ *
+ * @brief Framed payload format: magic, 64 bit length and CRC-32C of the payload in front of the payload.
+ * @author Daniel Jaramillo
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+#include "frame.h"
+#include "lz.h"
+
+/**
+ * Serializes a frame header.
+ *
+ * @param header frame header.
+ * @param buffer destination, FRAME_HEADER_SIZE bytes long.
+ */
+void serializeFrameHeader(const frameHeader_t *header, uint8_t *buffer) {
+    memcpy(buffer, header->compressed ? FRAME_MAGIC_COMPRESSED : FRAME_MAGIC, 4);
+    for(uint32_t b = 0; b < 8; b++)
+        buffer[4 + b] = (uint8_t) (header->length >> (8 * b));
+    for(uint32_t b = 0; b < 4; b++)
+        buffer[12 + b] = (uint8_t) (header->crc >> (8 * b));
+}
+
+/**
+ * Parses a frame header.
+ *
+ * @param buffer FRAME_HEADER_SIZE bytes.
+ * @param header frame header to fill in.
+ * @return 1 if the buffer starts with FRAME_MAGIC or FRAME_MAGIC_COMPRESSED, 0 otherwise.
+ */
+uint32_t parseFrameHeader(const uint8_t *buffer, frameHeader_t *header) {
+    if(memcmp(buffer, FRAME_MAGIC, 4) == 0)
+        header->compressed = 0;
+    else if(memcmp(buffer, FRAME_MAGIC_COMPRESSED, 4) == 0)
+        header->compressed = 1;
+    else
+        return 0;
+
+    header->length = 0;
+    for(uint32_t b = 0; b < 8; b++)
+        header->length |= (uint64_t) buffer[4 + b] << (8 * b);
+    header->crc = 0;
+    for(uint32_t b = 0; b < 4; b++)
+        header->crc |= (uint32_t) buffer[12 + b] << (8 * b);
+    return 1;
+}
+
+/**
+ * Builds a frame of a payload, the frame header followed by the payload.
+ *
+ * @param payload payload bytes.
+ * @param length number of payload bytes.
+ * @param framedLength number of bytes in the frame.
+ * @return pointer to the frame, NULL if memory ran out.
+ */
+uint8_t *buildFramedPayload(const uint8_t *payload, size_t length, size_t *framedLength) {
+    frameHeader_t header;
+
+    if(length > SIZE_MAX - FRAME_HEADER_SIZE)
+        return NULL;
+    uint8_t *frame = malloc(length + FRAME_HEADER_SIZE);
+    if(frame == NULL)
+        return NULL;
+
+    header.length = length;
+    header.crc = crc32cUpdate(0, payload, length);
+    header.compressed = 0;
+    serializeFrameHeader(&header, frame);
+    memcpy(frame + FRAME_HEADER_SIZE, payload, length);
+    *framedLength = length + FRAME_HEADER_SIZE;
+    return frame;
+}
+
+/**
+ * Builds a compressed frame of a payload, the frame header followed by the payload compressed with lzCompress().
+ * A payload that does not shrink is framed uncompressed by buildFramedPayload().
+ *
+ * The header holds the length and CRC-32C of the uncompressed payload, so the decoder checks what it hands out.
+ *
+ * @param payload payload bytes.
+ * @param length number of payload bytes.
+ * @param framedLength number of bytes in the frame.
+ * @return pointer to the frame, NULL if memory ran out.
+ */
+uint8_t *buildCompressedFramedPayload(const uint8_t *payload, size_t length, size_t *framedLength) {
+    frameHeader_t header;
+    size_t compressedLength;
+
+    uint8_t *compressed = lzCompress(payload, length, &compressedLength);
+    if(compressed == NULL)
+        return NULL;
+    if(compressedLength >= length) {
+        free(compressed);
+        return buildFramedPayload(payload, length, framedLength);
+    }
+
+    uint8_t *frame = malloc(compressedLength + FRAME_HEADER_SIZE);
+    if(frame == NULL) {
+        free(compressed);
+        return NULL;
+    }
+    header.length = length;
+    header.crc = crc32cUpdate(0, payload, length);
+    header.compressed = 1;
+    serializeFrameHeader(&header, frame);
+    memcpy(frame + FRAME_HEADER_SIZE, compressed, compressedLength);
+    free(compressed);
+    *framedLength = compressedLength + FRAME_HEADER_SIZE;
+    return frame;
+}
@@ -0,0 +1,84 @@
+/** @file frame.h
+ *
+ * @brief Framed payload format: magic, 64 bit length and CRC-32C of the payload in front of the payload.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * First bytes of a frame header.
+ */
+#define FRAME_MAGIC             "SGF1"
+
+/**
+ * First bytes of the header of a frame whose payload is compressed with lzCompress(), see lz.h.
+ */
+#define FRAME_MAGIC_COMPRESSED  "SGZ1"
+
+/**
+ * Size of a frame header: 4 magic bytes, 8 byte little endian payload length and 4 byte little endian CRC-32C.
+ */
+#define FRAME_HEADER_SIZE       16
+
+/**
+ * Results of decoding a framed payload.
+ */
+#define FRAME_NOT_FOUND     0   // no frame header at the start of the message
+#define FRAME_OK            1   // payload decoded and checksum matched
+#define FRAME_CORRUPT       2   // frame header found, but the length does not fit, the compressed payload is malformed
+                                // or the checksum does not match
+#define FRAME_ERROR         3   // memory ran out
+
+/**
+ * Parsed frame header.
+ */
+typedef struct frameHeader {
+    uint64_t length;        // payload bytes, after decompression for a compressed frame
+    uint32_t crc;           // CRC-32C of the payload, after decompression for a compressed frame
+    uint32_t compressed;    // 1 if the header is followed by the compressed payload, 0 for the payload itself
+} frameHeader_t;
+
+/**
+ * Serializes a frame header.
+ *
+ * @param header frame header.
+ * @param buffer destination, FRAME_HEADER_SIZE bytes long.
+ */
+void serializeFrameHeader(const frameHeader_t *header, uint8_t *buffer);
+
+/**
+ * Parses a frame header.
+ *
+ * @param buffer FRAME_HEADER_SIZE bytes.
+ * @param header frame header to fill in.
+ * @return 1 if the buffer starts with FRAME_MAGIC or FRAME_MAGIC_COMPRESSED, 0 otherwise.
+ */
+uint32_t parseFrameHeader(const uint8_t *buffer, frameHeader_t *header);
+
+/**
+ * Builds a frame of a payload, the frame header followed by the payload.
+ *
+ * @param payload payload bytes.
+ * @param length number of payload bytes.
+ * @param framedLength number of bytes in the frame.
+ * @return pointer to the frame, NULL if memory ran out.
+ */
+uint8_t *buildFramedPayload(const uint8_t *payload, size_t length, size_t *framedLength);
+
+/**
+ * Builds a compressed frame of a payload, the frame header followed by the payload compressed with lzCompress().
+ * A payload that does not shrink is framed uncompressed by buildFramedPayload().
+ *
+ * @param payload payload bytes.
+ * @param length number of payload bytes.
+ * @param framedLength number of bytes in the frame.
+ * @return pointer to the frame, NULL if memory ran out.
+ */
+uint8_t *buildCompressedFramedPayload(const uint8_t *payload, size_t length, size_t *framedLength);
+
+#endif
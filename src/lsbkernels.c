@@ -0,0 +1,582 @@
+/** @file lsbkernels.c
+ *
+ * @brief Kernels that pack the least significant bit of subpixel bytes into message bytes.
+ * @author Daniel Jaramillo
+ */
+
+#include <string.h>
+
+#include "lsbkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LSBKERNELS_X86 1
+#endif
+
+typedef void (*packLSBBytesFn_t)(const uint8_t *src, uint8_t *dst, size_t count);
+typedef void (*embedLSBBytesFn_t)(uint8_t *dst, const uint8_t *src, size_t count);
+
+/**
+ * Portable reference implementation of packLSBBytes().
+ *
+ * Same bit order as the original per-byte decode loop: least significant bit of the first source byte becomes the
+ * least significant bit of the destination byte.
+ *
+ * @param src subpixel bytes, at least 8 * count bytes long.
+ * @param dst destination for packed bytes, at least count bytes long.
+ * @param count number of destination bytes to produce.
+ */
+void packLSBBytesScalar(const uint8_t *src, uint8_t *dst, size_t count) {
+    for(size_t c = 0; c < count; c++) {
+        uint8_t tempChar = 0;
+        for(uint8_t bit = 0; bit < 8; bit++)
+            tempChar |= (src[bit] & 1) << bit;
+        dst[c] = tempChar;
+        src += 8;
+    }
+}
+
+#ifdef LSBKERNELS_X86
+/**
+ * SSE2 kernel. Shifts each subpixel's LSB into its sign bit and collects 16 sign bits at once with movemask.
+ *
+ * A 16 bit lane shift is used since SSE2 has no 8 bit shift. Bits carried from the low byte into the high byte are
+ * never in the high byte's sign bit, so they do not affect the mask.
+ */
+__attribute__((target("sse2")))
+static void packLSBBytesSSE2(const uint8_t *src, uint8_t *dst, size_t count) {
+    while(count >= 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *) src);
+        uint16_t mask = (uint16_t) _mm_movemask_epi8(_mm_slli_epi16(v, 7));
+        memcpy(dst, &mask, sizeof(mask));
+        src += 16;
+        dst += 2;
+        count -= 2;
+    }
+    packLSBBytesScalar(src, dst, count);
+}
+
+/**
+ * AVX2 kernel. Same approach as the SSE2 kernel with 32 subpixels per iteration.
+ */
+__attribute__((target("avx2")))
+static void packLSBBytesAVX2(const uint8_t *src, uint8_t *dst, size_t count) {
+    while(count >= 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) src);
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+        memcpy(dst, &mask, sizeof(mask));
+        src += 32;
+        dst += 4;
+        count -= 4;
+    }
+    packLSBBytesSSE2(src, dst, count);
+}
+#endif
+
+/**
+ * Selects the fastest kernel supported by the running CPU.
+ *
+ * @return kernel function.
+ */
+static packLSBBytesFn_t selectPackLSBBytes(void) {
+#ifdef LSBKERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return packLSBBytesAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return packLSBBytesSSE2;
+#endif
+    return packLSBBytesScalar;
+}
+
+static void packLSBBytesResolve(const uint8_t *src, uint8_t *dst, size_t count);
+
+// kernel used by packLSBBytes(), replaced by the selected kernel on first call
+static packLSBBytesFn_t packLSBBytesImpl = packLSBBytesResolve;
+
+/**
+ * Resolves the kernel on first use and forwards the call to it.
+ */
+static void packLSBBytesResolve(const uint8_t *src, uint8_t *dst, size_t count) {
+    packLSBBytesFn_t kernel = selectPackLSBBytes();
+    __atomic_store_n(&packLSBBytesImpl, kernel, __ATOMIC_RELAXED);
+    kernel(src, dst, count);
+}
+
+/**
+ * Packs the least significant bit of each of 8 * count source bytes into count destination bytes.
+ *
+ * Bit n of destination byte i is the least significant bit of source byte 8 * i + n.
+ *
+ * @param src subpixel bytes, at least 8 * count bytes long.
+ * @param dst destination for packed bytes, at least count bytes long.
+ * @param count number of destination bytes to produce.
+ */
+void packLSBBytes(const uint8_t *src, uint8_t *dst, size_t count) {
+    __atomic_load_n(&packLSBBytesImpl, __ATOMIC_RELAXED)(src, dst, count);
+}
+
+/**
+ * Portable reference implementation of embedLSBBytes().
+ *
+ * @param dst subpixel bytes, at least 8 * count bytes long.
+ * @param src message bytes, at least count bytes long.
+ * @param count number of message bytes to embed.
+ */
+void embedLSBBytesScalar(uint8_t *dst, const uint8_t *src, size_t count) {
+    for(size_t c = 0; c < count; c++) {
+        for(uint8_t bit = 0; bit < 8; bit++)
+            dst[bit] = (dst[bit] & 0xFE) | ((src[c] >> bit) & 1);
+        dst += 8;
+    }
+}
+
+#ifdef LSBKERNELS_X86
+/**
+ * SSE2 kernel. Spreads 2 message bytes over 16 lanes, tests lane n against bit n % 8 and merges the resulting 0/1
+ * bytes into the cleared subpixel LSBs.
+ */
+__attribute__((target("sse2")))
+static void embedLSBBytesSSE2(uint8_t *dst, const uint8_t *src, size_t count) {
+    const __m128i bitMask = _mm_set_epi8((char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                         (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i clear = _mm_set1_epi8((char) 0xFE);
+
+    while(count >= 2) {
+        // b0 b1 -> b0 x8, b1 x8
+        __m128i v = _mm_cvtsi32_si128(src[0] | (src[1] << 8));
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+        __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, bitMask), bitMask), one);
+
+        __m128i pixels = _mm_loadu_si128((const __m128i *) dst);
+        _mm_storeu_si128((__m128i *) dst, _mm_or_si128(_mm_and_si128(pixels, clear), bits));
+        src += 2;
+        dst += 16;
+        count -= 2;
+    }
+    embedLSBBytesScalar(dst, src, count);
+}
+
+/**
+ * AVX2 kernel. Same approach as the SSE2 kernel with 4 message bytes per iteration, spread with a byte shuffle.
+ */
+__attribute__((target("avx2")))
+static void embedLSBBytesAVX2(uint8_t *dst, const uint8_t *src, size_t count) {
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bitMask = _mm256_set1_epi64x((long long) 0x8040201008040201ULL);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i clear = _mm256_set1_epi8((char) 0xFE);
+
+    while(count >= 4) {
+        uint32_t word;
+        memcpy(&word, src, sizeof(word));
+        __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int) word), spread);
+        __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, bitMask), bitMask), one);
+
+        __m256i pixels = _mm256_loadu_si256((const __m256i *) dst);
+        _mm256_storeu_si256((__m256i *) dst, _mm256_or_si256(_mm256_and_si256(pixels, clear), bits));
+        src += 4;
+        dst += 32;
+        count -= 4;
+    }
+    embedLSBBytesSSE2(dst, src, count);
+}
+#endif
+
+/**
+ * Selects the fastest embed kernel supported by the running CPU.
+ *
+ * @return kernel function.
+ */
+static embedLSBBytesFn_t selectEmbedLSBBytes(void) {
+#ifdef LSBKERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return embedLSBBytesAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return embedLSBBytesSSE2;
+#endif
+    return embedLSBBytesScalar;
+}
+
+static void embedLSBBytesResolve(uint8_t *dst, const uint8_t *src, size_t count);
+
+// kernel used by embedLSBBytes(), replaced by the selected kernel on first call
+static embedLSBBytesFn_t embedLSBBytesImpl = embedLSBBytesResolve;
+
+/**
+ * Resolves the embed kernel on first use and forwards the call to it.
+ */
+static void embedLSBBytesResolve(uint8_t *dst, const uint8_t *src, size_t count) {
+    embedLSBBytesFn_t kernel = selectEmbedLSBBytes();
+    __atomic_store_n(&embedLSBBytesImpl, kernel, __ATOMIC_RELAXED);
+    kernel(dst, src, count);
+}
+
+/**
+ * Sets the least significant bit of each of 8 * count destination bytes from count source bytes.
+ *
+ * @param dst subpixel bytes, at least 8 * count bytes long.
+ * @param src message bytes, at least count bytes long.
+ * @param count number of message bytes to embed.
+ */
+void embedLSBBytes(uint8_t *dst, const uint8_t *src, size_t count) {
+    __atomic_load_n(&embedLSBBytesImpl, __ATOMIC_RELAXED)(dst, src, count);
+}
+
+/**
+ * Embeds a range of message bits into consecutive subpixel bytes.
+ *
+ * Bits up to the next message byte boundary and after the last whole byte are embedded one at a time, whole bytes
+ * in between go through embedLSBBytes().
+ *
+ * @param dst subpixel bytes.
+ * @param dstLen number of subpixel bytes, one message bit each.
+ * @param message message bytes, at least (firstBit + dstLen + 7) / 8 bytes long.
+ * @param firstBit index of the message bit embedded in dst[0].
+ */
+void embedLSBBitRange(uint8_t *dst, size_t dstLen, const uint8_t *message, uint64_t firstBit) {
+    // leading bits of a byte started in an earlier range
+    while(dstLen > 0 && (firstBit & 7) != 0) {
+        *dst = (*dst & 0xFE) | ((message[firstBit >> 3] >> (firstBit & 7)) & 1);
+        dst++;
+        dstLen--;
+        firstBit++;
+    }
+
+    size_t whole = dstLen / 8;
+    embedLSBBytes(dst, message + (firstBit >> 3), whole);
+    dst += whole * 8;
+    dstLen -= whole * 8;
+    firstBit += (uint64_t) whole * 8;
+
+    // trailing bits of a byte finished in a later range
+    for(size_t b = 0; b < dstLen; b++)
+        dst[b] = (dst[b] & 0xFE) | ((message[firstBit >> 3] >> b) & 1);
+}
+
+/**
+ * Resets an unpacker to the start of a message.
+ *
+ * @param unpacker unpacker to reset.
+ */
+void lsbUnpackerInit(lsbUnpacker_t *unpacker) {
+    unpacker->partial = 0;
+    unpacker->bitCount = 0;
+}
+
+/**
+ * Feeds subpixel bytes to an unpacker and writes every completed message byte.
+ *
+ * Completes a byte left over from the previous block bit by bit, packs whole bytes with packLSBBytes() and keeps the
+ * remaining bits for the next block.
+ *
+ * @param unpacker unpacker state.
+ * @param src subpixel bytes.
+ * @param srcLen number of subpixel bytes.
+ * @param dst destination for message bytes, at least (srcLen + 7) / 8 bytes long.
+ * @return number of message bytes written to dst.
+ */
+size_t lsbUnpackerFeed(lsbUnpacker_t *unpacker, const uint8_t *src, size_t srcLen, uint8_t *dst) {
+    size_t written = 0;
+
+    // finish the byte started by the previous block
+    if(unpacker->bitCount != 0) {
+        while(srcLen > 0 && unpacker->bitCount < 8) {
+            unpacker->partial |= (*src & 1) << unpacker->bitCount;
+            unpacker->bitCount++;
+            src++;
+            srcLen--;
+        }
+        if(unpacker->bitCount < 8)
+            return 0;
+        dst[written++] = unpacker->partial;
+        unpacker->partial = 0;
+        unpacker->bitCount = 0;
+    }
+
+    size_t whole = srcLen / 8;
+    packLSBBytes(src, dst + written, whole);
+    written += whole;
+    src += whole * 8;
+    srcLen -= whole * 8;
+
+    // keep the leftover bits
+    for(size_t b = 0; b < srcLen; b++)
+        unpacker->partial |= (src[b] & 1) << b;
+    unpacker->bitCount = (uint8_t) srcLen;
+
+    return written;
+}
+
+/**
+ * Appends the low BITS bits of byte CHANNEL of a pixel to the accumulator when bit CHANNEL of MASK is set. MASK and
+ * BITS are compile time constants, so unselected bytes cost nothing.
+ */
+#define ACCUMULATE_CHANNEL(BITS, MASK, CHANNEL)                                                 \
+    if((MASK) & (1 << (CHANNEL))) {                                                             \
+        bits |= (uint64_t) (pixels[CHANNEL] & ((1 << (BITS)) - 1)) << count;                    \
+        count += (BITS);                                                                        \
+    }
+
+/**
+ * Defines the kernel for one pixel size, one number of bits per channel and one byte mask.
+ *
+ * The accumulator holds fewer than 32 bits between pixels and at most 16 bits are added per pixel, so 4 message bytes
+ * are written whenever 32 bits are complete.
+ */
+#define DEFINE_LSB_PIXEL_KERNEL(BPP, BITS, MASK)                                                \
+static size_t extractLSB##BPP##_##BITS##_##MASK(const uint8_t *pixels, size_t pixelCount,       \
+                                                bitAccumulator_t *accumulator, uint8_t *dst) {  \
+    uint64_t bits = accumulator->bits;                                                          \
+    uint32_t count = accumulator->count;                                                        \
+    size_t written = 0;                                                                         \
+    for(size_t p = 0; p < pixelCount; p++) {                                                    \
+        ACCUMULATE_CHANNEL(BITS, MASK, 0)                                                       \
+        ACCUMULATE_CHANNEL(BITS, MASK, 1)                                                       \
+        ACCUMULATE_CHANNEL(BITS, MASK, 2)                                                       \
+        ACCUMULATE_CHANNEL(BITS, MASK, 3)                                                       \
+        pixels += (BPP) / 8;                                                                    \
+        if(count >= 32) {                                                                       \
+            dst[written] = (uint8_t) bits;                                                      \
+            dst[written + 1] = (uint8_t) (bits >> 8);                                           \
+            dst[written + 2] = (uint8_t) (bits >> 16);                                          \
+            dst[written + 3] = (uint8_t) (bits >> 24);                                          \
+            written += 4;                                                                       \
+            bits >>= 32;                                                                        \
+            count -= 32;                                                                        \
+        }                                                                                       \
+    }                                                                                           \
+    accumulator->bits = bits;                                                                   \
+    accumulator->count = count;                                                                 \
+    return written + flushBitAccumulator(accumulator, dst + written);                           \
+}
+
+#define DEFINE_LSB_PIXEL_KERNELS_24(BITS)                                                       \
+    DEFINE_LSB_PIXEL_KERNEL(24, BITS, 1) DEFINE_LSB_PIXEL_KERNEL(24, BITS, 2)                   \
+    DEFINE_LSB_PIXEL_KERNEL(24, BITS, 3) DEFINE_LSB_PIXEL_KERNEL(24, BITS, 4)                   \
+    DEFINE_LSB_PIXEL_KERNEL(24, BITS, 5) DEFINE_LSB_PIXEL_KERNEL(24, BITS, 6)                   \
+    DEFINE_LSB_PIXEL_KERNEL(24, BITS, 7)
+
+#define DEFINE_LSB_PIXEL_KERNELS_32(BITS)                                                       \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 1) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 2)                   \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 3) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 4)                   \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 5) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 6)                   \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 7) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 8)                   \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 9) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 10)                  \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 11) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 12)                 \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 13) DEFINE_LSB_PIXEL_KERNEL(32, BITS, 14)                 \
+    DEFINE_LSB_PIXEL_KERNEL(32, BITS, 15)
+
+#define LSB_PIXEL_KERNEL_ROW_24(BITS)                                                           \
+    {NULL, extractLSB24_##BITS##_1, extractLSB24_##BITS##_2, extractLSB24_##BITS##_3,           \
+     extractLSB24_##BITS##_4, extractLSB24_##BITS##_5, extractLSB24_##BITS##_6,                 \
+     extractLSB24_##BITS##_7}
+
+#define LSB_PIXEL_KERNEL_ROW_32(BITS)                                                           \
+    {NULL, extractLSB32_##BITS##_1, extractLSB32_##BITS##_2, extractLSB32_##BITS##_3,           \
+     extractLSB32_##BITS##_4, extractLSB32_##BITS##_5, extractLSB32_##BITS##_6,                 \
+     extractLSB32_##BITS##_7, extractLSB32_##BITS##_8, extractLSB32_##BITS##_9,                 \
+     extractLSB32_##BITS##_10, extractLSB32_##BITS##_11, extractLSB32_##BITS##_12,              \
+     extractLSB32_##BITS##_13, extractLSB32_##BITS##_14, extractLSB32_##BITS##_15}
+
+DEFINE_LSB_PIXEL_KERNELS_24(1)
+DEFINE_LSB_PIXEL_KERNELS_24(2)
+DEFINE_LSB_PIXEL_KERNELS_24(3)
+DEFINE_LSB_PIXEL_KERNELS_24(4)
+DEFINE_LSB_PIXEL_KERNELS_32(1)
+DEFINE_LSB_PIXEL_KERNELS_32(2)
+DEFINE_LSB_PIXEL_KERNELS_32(3)
+DEFINE_LSB_PIXEL_KERNELS_32(4)
+
+// kernels indexed by bits per channel - 1 and byte mask
+static const lsbPixelKernel_t lsbPixelKernels24[LSB_MAX_BITS_PER_CHANNEL][8] = {
+    LSB_PIXEL_KERNEL_ROW_24(1),
+    LSB_PIXEL_KERNEL_ROW_24(2),
+    LSB_PIXEL_KERNEL_ROW_24(3),
+    LSB_PIXEL_KERNEL_ROW_24(4)
+};
+
+static const lsbPixelKernel_t lsbPixelKernels32[LSB_MAX_BITS_PER_CHANNEL][16] = {
+    LSB_PIXEL_KERNEL_ROW_32(1),
+    LSB_PIXEL_KERNEL_ROW_32(2),
+    LSB_PIXEL_KERNEL_ROW_32(3),
+    LSB_PIXEL_KERNEL_ROW_32(4)
+};
+
+#ifdef LSBKERNELS_X86
+/**
+ * Drops the bit of one byte per 4 byte pixel from a movemask of 8 pixels, packing the 24 remaining bits.
+ *
+ * Each nibble of the mask holds the bits of one pixel. Bits below the skipped byte are kept by low, bits above it
+ * move down one place through high, then the 3 bit groups are packed pairwise in three shift and mask steps.
+ *
+ * @param mask one bit per byte of 8 pixels.
+ * @param low bits below the skipped byte, repeated in every nibble.
+ * @param high bits at and above the skipped byte, repeated in every nibble.
+ * @return 24 packed message bits.
+ */
+static inline uint32_t compressSkippedByte(uint32_t mask, uint32_t low, uint32_t high) {
+    uint32_t bits = (mask & low) | ((mask >> 1) & high);
+    bits = (bits & 0x07070707) | ((bits >> 1) & 0x38383838);
+    bits = (bits & 0x003F003F) | ((bits >> 2) & 0x0FC00FC0);
+    return (bits & 0x00000FFF) | ((bits >> 4) & 0x00FFF000);
+}
+
+/**
+ * Defines a kernel taking the LSB of the 3 color bytes of 32 bit pixels, 8 pixels per iteration.
+ *
+ * LOAD_MASK collects the LSB of the 32 bytes of 8 pixels. The skipped
+ * alpha byte is removed by compressSkippedByte() without a per-pixel branch. The tail goes to the scalar kernel,
+ * which also flushes the accumulator.
+ */
+#define DEFINE_LSB_SKIP_KERNEL(ISA, TARGET, LOAD_MASK)                                          \
+__attribute__((target(TARGET)))                                                                \
+static inline size_t extractLSB32Skip##ISA(const uint8_t *pixels, size_t pixelCount,            \
+                                           bitAccumulator_t *accumulator, uint8_t *dst,         \
+                                           uint32_t skip) {                                     \
+    uint32_t low = 0x11111111u * ((1u << skip) - 1);                                            \
+    uint32_t high = 0x11111111u * (7u & ~((1u << skip) - 1));                                   \
+    uint64_t bits = accumulator->bits;                                                          \
+    uint32_t count = accumulator->count;                                                        \
+    size_t written = 0;                                                                         \
+    while(pixelCount >= 8) {                                                                    \
+        uint32_t mask = LOAD_MASK(pixels);                                                      \
+        bits |= (uint64_t) compressSkippedByte(mask, low, high) << count;                       \
+        count += 24;                                                                            \
+        if(count >= 32) {                                                                       \
+            uint32_t word = (uint32_t) bits;                                                    \
+            memcpy(dst + written, &word, sizeof(word));                                         \
+            written += 4;                                                                       \
+            bits >>= 32;                                                                        \
+            count -= 32;                                                                        \
+        }                                                                                       \
+        pixels += 32;                                                                           \
+        pixelCount -= 8;                                                                        \
+    }                                                                                           \
+    accumulator->bits = bits;                                                                   \
+    accumulator->count = count;                                                                 \
+    return written + lsbPixelKernels32[0][0xF & ~(1u << skip)](pixels, pixelCount, accumulator, \
+                                                               dst + written);                  \
+}                                                                                               \
+__attribute__((target(TARGET)))                                                                \
+static size_t extractLSB32Skip0##ISA(const uint8_t *pixels, size_t pixelCount,                  \
+                                     bitAccumulator_t *accumulator, uint8_t *dst) {             \
+    return extractLSB32Skip##ISA(pixels, pixelCount, accumulator, dst, 0);                      \
+}                                                                                               \
+__attribute__((target(TARGET)))                                                                \
+static size_t extractLSB32Skip1##ISA(const uint8_t *pixels, size_t pixelCount,                  \
+                                     bitAccumulator_t *accumulator, uint8_t *dst) {             \
+    return extractLSB32Skip##ISA(pixels, pixelCount, accumulator, dst, 1);                      \
+}                                                                                               \
+__attribute__((target(TARGET)))                                                                \
+static size_t extractLSB32Skip2##ISA(const uint8_t *pixels, size_t pixelCount,                  \
+                                     bitAccumulator_t *accumulator, uint8_t *dst) {             \
+    return extractLSB32Skip##ISA(pixels, pixelCount, accumulator, dst, 2);                      \
+}                                                                                               \
+__attribute__((target(TARGET)))                                                                \
+static size_t extractLSB32Skip3##ISA(const uint8_t *pixels, size_t pixelCount,                  \
+                                     bitAccumulator_t *accumulator, uint8_t *dst) {             \
+    return extractLSB32Skip##ISA(pixels, pixelCount, accumulator, dst, 3);                      \
+}                                                                                               \
+static const lsbPixelKernel_t lsbSkipKernels##ISA[4] = {                                        \
+    extractLSB32Skip0##ISA, extractLSB32Skip1##ISA, extractLSB32Skip2##ISA, extractLSB32Skip3##ISA \
+};
+
+/**
+ * Collects the LSB of 32 bytes, bit n of the result is the LSB of byte n.
+ */
+__attribute__((target("sse2")))
+static inline uint32_t loadLSBMaskSSE2(const uint8_t *src) {
+    uint32_t low = (uint16_t) _mm_movemask_epi8(_mm_slli_epi16(_mm_loadu_si128((const __m128i *) src), 7));
+    uint32_t high = (uint16_t) _mm_movemask_epi8(_mm_slli_epi16(_mm_loadu_si128((const __m128i *) (src + 16)), 7));
+    return low | (high << 16);
+}
+
+/**
+ * Collects the LSB of 32 bytes, bit n of the result is the LSB of byte n.
+ */
+__attribute__((target("avx2")))
+static inline uint32_t loadLSBMaskAVX2(const uint8_t *src) {
+    return (uint32_t) _mm256_movemask_epi8(_mm256_slli_epi16(_mm256_loadu_si256((const __m256i *) src), 7));
+}
+
+DEFINE_LSB_SKIP_KERNEL(SSE2, "sse2", loadLSBMaskSSE2)
+DEFINE_LSB_SKIP_KERNEL(AVX2, "avx2", loadLSBMaskAVX2)
+#endif
+
+/**
+ * Writes the completed message bytes left in an accumulator.
+ *
+ * @param accumulator bits carried between kernel calls.
+ * @param dst destination for completed message bytes.
+ * @return number of message bytes written to dst.
+ */
+size_t flushBitAccumulator(bitAccumulator_t *accumulator, uint8_t *dst) {
+    size_t written = 0;
+    while(accumulator->count >= 8) {
+        dst[written++] = (uint8_t) accumulator->bits;
+        accumulator->bits >>= 8;
+        accumulator->count -= 8;
+    }
+    return written;
+}
+
+/**
+ * Returns the kernel specialized for a pixel size, a number of low bits per channel and a byte mask.
+ *
+ * Selected once per decode, so the per-pixel loop never branches on the configuration. Taking 1 bit from 3 of the 4
+ * bytes of a 32 bit pixel, the common case of skipping alpha, uses a vectorized kernel when the CPU supports one.
+ *
+ * @param bytesPerPixel size of a pixel, 3 or 4 bytes.
+ * @param bitsPerChannel number of low bits taken from each selected byte, 1 to LSB_MAX_BITS_PER_CHANNEL.
+ * @param byteMask bytes of each pixel to take bits from, bit n selects byte n.
+ * @return kernel, NULL if the configuration is not supported.
+ */
+lsbPixelKernel_t selectLSBPixelKernel(uint32_t bytesPerPixel, uint32_t bitsPerChannel, uint32_t byteMask) {
+    if(bitsPerChannel < 1 || bitsPerChannel > LSB_MAX_BITS_PER_CHANNEL || byteMask < 1)
+        return NULL;
+
+    switch(bytesPerPixel) {
+        case 3:
+            return byteMask < 8 ? lsbPixelKernels24[bitsPerChannel - 1][byteMask] : NULL;
+
+        case 4:
+            if(byteMask > 15)
+                return NULL;
+#ifdef LSBKERNELS_X86
+            if(bitsPerChannel == 1 && __builtin_popcount(byteMask) == 3) {
+                uint32_t skip = (uint32_t) __builtin_ctz(~byteMask & 0xF);
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2"))
+                    return lsbSkipKernelsAVX2[skip];
+                if(__builtin_cpu_supports("sse2"))
+                    return lsbSkipKernelsSSE2[skip];
+            }
+#endif
+            return lsbPixelKernels32[bitsPerChannel - 1][byteMask];
+
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * Returns the name of the kernel selected by packLSBBytes() on this CPU.
+ *
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char *packLSBBytesKernelName(void) {
+    packLSBBytesFn_t kernel = selectPackLSBBytes();
+#ifdef LSBKERNELS_X86
+    if(kernel == packLSBBytesAVX2)
+        return "avx2";
+    if(kernel == packLSBBytesSSE2)
+        return "sse2";
+#endif
+    return "scalar";
+}
@@ -0,0 +1,148 @@
+/** @file lsbkernels.h
+ *
+ * @brief Kernels that pack the least significant bit of subpixel bytes into message bytes.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef LSBKERNELS_H_
+#define LSBKERNELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Incremental LSB unpacker. Holds the bits of a message byte that is split across two fed blocks.
+ */
+typedef struct lsbUnpacker {
+    uint8_t partial;    // bits of the current message byte collected so far
+    uint8_t bitCount;   // number of bits in partial
+} lsbUnpacker_t;
+
+/**
+ * Bits extracted from pixels but not yet written as a message byte, least significant bit first.
+ */
+typedef struct bitAccumulator {
+    uint64_t bits;
+    uint32_t count;
+} bitAccumulator_t;
+
+/**
+ * Kernel extracting the low bits of selected bytes from 24 or 32 bit pixels.
+ *
+ * @param pixels first pixel, 3 or 4 bytes per pixel.
+ * @param pixelCount number of pixels.
+ * @param accumulator bits carried between calls.
+ * @param dst destination for every completed message byte.
+ * @return number of message bytes written to dst.
+ */
+typedef size_t (*lsbPixelKernel_t)(const uint8_t *pixels, size_t pixelCount, bitAccumulator_t *accumulator,
+                                   uint8_t *dst);
+
+/**
+ * Highest number of low bits per channel a kernel extracts.
+ */
+#define LSB_MAX_BITS_PER_CHANNEL    4
+
+/**
+ * Packs the least significant bit of each of 8 * count source bytes into count destination bytes.
+ *
+ * Bit n of destination byte i is the least significant bit of source byte 8 * i + n. Dispatches at runtime to the
+ * fastest kernel supported by the CPU.
+ *
+ * @param src subpixel bytes, at least 8 * count bytes long.
+ * @param dst destination for packed bytes, at least count bytes long.
+ * @param count number of destination bytes to produce.
+ */
+void packLSBBytes(const uint8_t *src, uint8_t *dst, size_t count);
+
+/**
+ * Portable reference implementation of packLSBBytes().
+ *
+ * @param src subpixel bytes, at least 8 * count bytes long.
+ * @param dst destination for packed bytes, at least count bytes long.
+ * @param count number of destination bytes to produce.
+ */
+void packLSBBytesScalar(const uint8_t *src, uint8_t *dst, size_t count);
+
+/**
+ * Sets the least significant bit of each of 8 * count destination bytes from count source bytes.
+ *
+ * Inverse of packLSBBytes(): the least significant bit of destination byte 8 * i + n is set to bit n of source byte
+ * i, all other bits are kept. Dispatches at runtime to the fastest kernel supported by the CPU.
+ *
+ * @param dst subpixel bytes, at least 8 * count bytes long.
+ * @param src message bytes, at least count bytes long.
+ * @param count number of message bytes to embed.
+ */
+void embedLSBBytes(uint8_t *dst, const uint8_t *src, size_t count);
+
+/**
+ * Portable reference implementation of embedLSBBytes().
+ *
+ * @param dst subpixel bytes, at least 8 * count bytes long.
+ * @param src message bytes, at least count bytes long.
+ * @param count number of message bytes to embed.
+ */
+void embedLSBBytesScalar(uint8_t *dst, const uint8_t *src, size_t count);
+
+/**
+ * Embeds a range of message bits into consecutive subpixel bytes.
+ *
+ * Bit b of the message is bit b % 8 of message byte b / 8. Subpixel byte i receives message bit firstBit + i.
+ *
+ * @param dst subpixel bytes.
+ * @param dstLen number of subpixel bytes, one message bit each.
+ * @param message message bytes, at least (firstBit + dstLen + 7) / 8 bytes long.
+ * @param firstBit index of the message bit embedded in dst[0].
+ */
+void embedLSBBitRange(uint8_t *dst, size_t dstLen, const uint8_t *message, uint64_t firstBit);
+
+/**
+ * Resets an unpacker to the start of a message.
+ *
+ * @param unpacker unpacker to reset.
+ */
+void lsbUnpackerInit(lsbUnpacker_t *unpacker);
+
+/**
+ * Feeds subpixel bytes to an unpacker and writes every completed message byte.
+ *
+ * @param unpacker unpacker state.
+ * @param src subpixel bytes.
+ * @param srcLen number of subpixel bytes.
+ * @param dst destination for message bytes, at least (srcLen + 7) / 8 bytes long.
+ * @return number of message bytes written to dst.
+ */
+size_t lsbUnpackerFeed(lsbUnpacker_t *unpacker, const uint8_t *src, size_t srcLen, uint8_t *dst);
+
+/**
+ * Returns the kernel specialized for a pixel size, a number of low bits per channel and a byte mask.
+ *
+ * Bit n of the byte mask selects byte n of each pixel, so for 24 bit pixels bit 0 is blue, bit 1 green and bit 2 red.
+ * For every pixel the low bits of each selected byte are appended to the message, least significant bit first, in
+ * byte order.
+ *
+ * @param bytesPerPixel size of a pixel, 3 or 4 bytes.
+ * @param bitsPerChannel number of low bits taken from each selected byte, 1 to LSB_MAX_BITS_PER_CHANNEL.
+ * @param byteMask bytes of each pixel to take bits from, bit n selects byte n.
+ * @return kernel, NULL if the configuration is not supported.
+ */
+lsbPixelKernel_t selectLSBPixelKernel(uint32_t bytesPerPixel, uint32_t bitsPerChannel, uint32_t byteMask);
+
+/**
+ * Writes the completed message bytes left in an accumulator.
+ *
+ * @param accumulator bits carried between kernel calls.
+ * @param dst destination for completed message bytes.
+ * @return number of message bytes written to dst.
+ */
+size_t flushBitAccumulator(bitAccumulator_t *accumulator, uint8_t *dst);
+
+/**
+ * Returns the name of the kernel selected by packLSBBytes() on this CPU.
+ *
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char *packLSBBytesKernelName(void);
+
+#endif
@@ -0,0 +1,619 @@
+/** @file lsbplane.c
+ *
+ * @brief Packed plane of the least significant bit of every pixel byte, for trying many decode variants.
+ * @author Daniel Jaramillo
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "decoder.h"
+#include "frame.h"
+#include "lsbkernels.h"
+#include "lsbplane.h"
+#include "lz.h"
+#include "probe.h"
+
+/**
+ * Bytes allocated past the last plane byte, so reads of the byte after the last bit stay inside the allocation.
+ */
+#define LSB_PLANE_SLACK         8
+
+/**
+ * Bytes of a compressed frame stream decoded from the plane at a time, in a buffer on the stack.
+ */
+#define PLANE_FRAME_BLOCK_BYTES 4096
+
+/**
+ * Sidecar file layout: a fixed header followed by the plane bits.
+ */
+#define SIDECAR_MAGIC           "LSBPLANE"
+#define SIDECAR_VERSION         1
+#define SIDECAR_HEADER_SIZE     64
+
+/**
+ * Identifies the exact bitmap file a sidecar was written for.
+ */
+typedef struct sidecarKey {
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t header_hash;   // FNV-1a hash of the first PROBE_SIZE bytes of the file
+} sidecarKey_t;
+
+/**
+ * Variant resolved against the pixel format of a plane.
+ */
+typedef struct resolvedVariant {
+    uint8_t select[16];         // selected bits of each value of the pixel LSBs, packed in channel order
+    uint32_t bits_per_pixel;    // number of selected bits per pixel
+    uint32_t identity;          // 1 if every bit of each pixel is selected in storage order
+} resolvedVariant_t;
+
+/**
+ * Allocates the zeroed bits of a plane.
+ *
+ * @param plane plane to fill in.
+ * @param width width of the image in pixels.
+ * @param height height of the image in pixels.
+ * @param format pixel format.
+ * @return 1 on success, 0 if the size overflows or memory ran out.
+ */
+static uint32_t allocateLSBPlane(lsbPlane_t *plane, uint32_t width, uint32_t height, const pixelFormat_t *format) {
+    uint64_t bitCount;
+
+    plane->bits = NULL;
+    if(__builtin_mul_overflow((uint64_t) width * height, format->bytes_per_pixel, &bitCount) ||
+            bitCount / 8 + 1 + LSB_PLANE_SLACK > SIZE_MAX)
+        return 0;
+
+    plane->bits = calloc((size_t) (bitCount / 8) + 1 + LSB_PLANE_SLACK, 1);
+    if(plane->bits == NULL)
+        return 0;
+    plane->bit_count = bitCount;
+    plane->width = width;
+    plane->height = height;
+    plane->format = *format;
+    return 1;
+}
+
+/**
+ * Extracts the plane of a decodeable bitmap in memory.
+ *
+ * Rows are fed to an lsbUnpacker in decode order, so the packing runs on the fastest packLSBBytes() kernel and rows
+ * whose pixel bytes are not a multiple of 8 continue the plane without a gap.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile() or mapBitmapFile().
+ * @param plane plane to fill in, release with releaseLSBPlane().
+ * @return 1 on success, 0 if the bitmap is not decodeable or memory ran out.
+ */
+uint32_t extractLSBPlane(bitmap_t *bitmap, lsbPlane_t *plane) {
+    bitmapRows_t rows;
+    pixelFormat_t format;
+    lsbUnpacker_t unpacker;
+
+    plane->bits = NULL;
+    if(isDecodeable(bitmap) != 1 || getPixelFormat(&(bitmap->dibHeader), &format) == 0 ||
+            getBitmapRows(bitmap, &rows) == 0)
+        return 0;
+    if(allocateLSBPlane(plane, rows.row_pixels, rows.row_count, &format) == 0)
+        return 0;
+
+    uint8_t *dst = plane->bits;
+    lsbUnpackerInit(&unpacker);
+    for(uint32_t row = 0; row < rows.row_count; row++)
+        dst += lsbUnpackerFeed(&unpacker, getRow(&rows, row), rows.row_bytes, dst);
+    if(unpacker.bitCount != 0)
+        *dst = unpacker.partial;
+
+    return 1;
+}
+
+/**
+ * Stores a 32 bit value little endian.
+ *
+ * @param buffer destination.
+ * @param value value to store.
+ */
+static void storeUint32(uint8_t *buffer, uint32_t value) {
+    for(uint32_t b = 0; b < 4; b++)
+        buffer[b] = (uint8_t) (value >> (8 * b));
+}
+
+/**
+ * Stores a 64 bit value little endian.
+ *
+ * @param buffer destination.
+ * @param value value to store.
+ */
+static void storeUint64(uint8_t *buffer, uint64_t value) {
+    for(uint32_t b = 0; b < 8; b++)
+        buffer[b] = (uint8_t) (value >> (8 * b));
+}
+
+/**
+ * Loads a little endian 32 bit value.
+ *
+ * @param buffer source.
+ * @return value.
+ */
+static uint32_t loadUint32(const uint8_t *buffer) {
+    uint32_t value = 0;
+    for(uint32_t b = 0; b < 4; b++)
+        value |= (uint32_t) buffer[b] << (8 * b);
+    return value;
+}
+
+/**
+ * Builds the sidecar key of a bitmap file from its size, modification time and headers.
+ *
+ * Only the headers are hashed, so checking a sidecar costs one small read instead of a pass over the pixel array.
+ *
+ * @param path path of the bitmap file.
+ * @param key key to fill in.
+ * @return 1 on success, 0 if the file could not be read or is not a regular file.
+ */
+static uint32_t getSidecarKey(const char *path, sidecarKey_t *key) {
+    uint8_t buffer[PROBE_SIZE];
+    struct stat fileStat;
+    ssize_t count = -1;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+    if(fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+        count = read(fd, buffer, sizeof(buffer));
+    close(fd);
+    if(count < 0)
+        return 0;
+
+    key->file_size = (uint64_t) fileStat.st_size;
+    key->mtime_sec = (int64_t) fileStat.st_mtim.tv_sec;
+    key->mtime_nsec = (int64_t) fileStat.st_mtim.tv_nsec;
+    key->header_hash = 0xCBF29CE484222325ULL;
+    for(ssize_t b = 0; b < count; b++) {
+        key->header_hash ^= buffer[b];
+        key->header_hash *= 0x100000001B3ULL;
+    }
+    return 1;
+}
+
+/**
+ * Serializes the sidecar header of a plane.
+ *
+ * @param key key of the bitmap file.
+ * @param plane plane.
+ * @param buffer destination, SIDECAR_HEADER_SIZE bytes long.
+ */
+static void serializeSidecarHeader(const sidecarKey_t *key, const lsbPlane_t *plane, uint8_t *buffer) {
+    memset(buffer, 0, SIDECAR_HEADER_SIZE);
+    memcpy(buffer, SIDECAR_MAGIC, 8);
+    storeUint32(buffer + 8, SIDECAR_VERSION);
+    buffer[12] = (uint8_t) plane->format.bytes_per_pixel;
+    buffer[13] = plane->format.blue_byte;
+    buffer[14] = plane->format.green_byte;
+    buffer[15] = plane->format.red_byte;
+    storeUint32(buffer + 16, plane->width);
+    storeUint32(buffer + 20, plane->height);
+    storeUint64(buffer + 24, key->file_size);
+    storeUint64(buffer + 32, (uint64_t) key->mtime_sec);
+    storeUint64(buffer + 40, (uint64_t) key->mtime_nsec);
+    storeUint64(buffer + 48, key->header_hash);
+    storeUint64(buffer + 56, plane->bit_count);
+}
+
+/**
+ * Reads a plane from a sidecar file written for the bitmap file with the given key.
+ *
+ * @param sidecarPath path of the sidecar file.
+ * @param key key of the bitmap file.
+ * @param plane plane to fill in.
+ * @return 1 on success, 0 if the sidecar is missing, stale or damaged.
+ */
+static uint32_t readSidecar(const char *sidecarPath, const sidecarKey_t *key, lsbPlane_t *plane) {
+    uint8_t header[SIDECAR_HEADER_SIZE], expected[SIDECAR_HEADER_SIZE];
+    pixelFormat_t format;
+
+    plane->bits = NULL;
+    FILE *sidecarFilePtr = fopen(sidecarPath, "rb");
+    if(sidecarFilePtr == NULL)
+        return 0;
+    if(fread(header, 1, sizeof(header), sidecarFilePtr) != sizeof(header)) {
+        fclose(sidecarFilePtr);
+        return 0;
+    }
+
+    // the format and size must be sane before allocating, everything else is compared below
+    format.bytes_per_pixel = header[12];
+    format.blue_byte = header[13];
+    format.green_byte = header[14];
+    format.red_byte = header[15];
+    uint32_t width = loadUint32(header + 16);
+    uint32_t height = loadUint32(header + 20);
+    if((format.bytes_per_pixel != 3 && format.bytes_per_pixel != 4) ||
+            (uint64_t) width * height * format.bytes_per_pixel / 8 > key->file_size ||
+            allocateLSBPlane(plane, width, height, &format) == 0) {
+        fclose(sidecarFilePtr);
+        return 0;
+    }
+
+    serializeSidecarHeader(key, plane, expected);
+    size_t size = (size_t) ((plane->bit_count + 7) / 8);
+    uint32_t success = memcmp(header, expected, sizeof(header)) == 0 &&
+                       fread(plane->bits, 1, size, sidecarFilePtr) == size;
+    fclose(sidecarFilePtr);
+    if(!success)
+        releaseLSBPlane(plane);
+    return success;
+}
+
+/**
+ * Writes a plane to a sidecar file. The file is written under a temporary name and renamed, so concurrent readers
+ * never see a partial sidecar.
+ *
+ * @param sidecarPath path of the sidecar file.
+ * @param key key of the bitmap file.
+ * @param plane plane.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t writeSidecar(const char *sidecarPath, const sidecarKey_t *key, const lsbPlane_t *plane) {
+    uint8_t header[SIDECAR_HEADER_SIZE];
+
+    size_t length = strlen(sidecarPath) + 8;
+    char *tempPath = malloc(length);
+    if(tempPath == NULL)
+        return 0;
+    snprintf(tempPath, length, "%s.XXXXXX", sidecarPath);
+    int fd = mkstemp(tempPath);
+    if(fd < 0) {
+        free(tempPath);
+        return 0;
+    }
+    FILE *sidecarFilePtr = fdopen(fd, "wb");
+    if(sidecarFilePtr == NULL) {
+        close(fd);
+        unlink(tempPath);
+        free(tempPath);
+        return 0;
+    }
+
+    serializeSidecarHeader(key, plane, header);
+    size_t size = (size_t) ((plane->bit_count + 7) / 8);
+    uint32_t success = fwrite(header, 1, sizeof(header), sidecarFilePtr) == sizeof(header) &&
+                       fwrite(plane->bits, 1, size, sidecarFilePtr) == size;
+    if(fclose(sidecarFilePtr) != 0)
+        success = 0;
+    if(success)
+        success = rename(tempPath, sidecarPath) == 0;
+    if(!success)
+        unlink(tempPath);
+    free(tempPath);
+    return success;
+}
+
+/**
+ * Loads the plane of a bitmap file, optionally through its sidecar file.
+ *
+ * The sidecar is used only if the size, modification time and headers of the bitmap file still match the ones it
+ * was written for. Otherwise the file is memory mapped and the plane extracted, and a fresh sidecar replaces the old
+ * one. A sidecar that cannot be written is not an error, the next run just extracts the plane again.
+ *
+ * @param path path of the bitmap file.
+ * @param useSidecar 1 to read the plane from <path>.lsbplane when it matches the file and to write it otherwise.
+ * @param plane plane to fill in, release with releaseLSBPlane().
+ * @return 1 on success, 0 on error.
+ */
+uint32_t loadLSBPlaneFile(const char *path, uint32_t useSidecar, lsbPlane_t *plane) {
+    sidecarKey_t key, keyAfter;
+    char *sidecarPath = NULL;
+    bitmap_t bitmap;
+
+    plane->bits = NULL;
+    if(useSidecar) {
+        size_t length = strlen(path) + sizeof(LSB_PLANE_SIDECAR_SUFFIX);
+        sidecarPath = malloc(length);
+        if(sidecarPath == NULL || getSidecarKey(path, &key) == 0) {
+            free(sidecarPath);
+            return 0;
+        }
+        snprintf(sidecarPath, length, "%s%s", path, LSB_PLANE_SIDECAR_SUFFIX);
+        if(readSidecar(sidecarPath, &key, plane) == 1) {
+            free(sidecarPath);
+            return 1;
+        }
+    }
+
+    uint32_t success = mapBitmapFile(path, &bitmap);
+    if(success) {
+        success = extractLSBPlane(&bitmap, plane);
+        releaseBitmap(&bitmap);
+    }
+
+    // only keep the plane if the file did not change while it was extracted
+    if(success && useSidecar && getSidecarKey(path, &keyAfter) == 1 &&
+            memcmp(&key, &keyAfter, sizeof(key)) == 0)
+        writeSidecar(sidecarPath, &key, plane);
+    free(sidecarPath);
+    return success;
+}
+
+/**
+ * Frees the bits of a plane.
+ *
+ * @param plane plane to release.
+ */
+void releaseLSBPlane(lsbPlane_t *plane) {
+    free(plane->bits);
+    plane->bits = NULL;
+}
+
+/**
+ * Resolves the channel order of a variant to the bytes of the pixel format of a plane.
+ *
+ * @param format pixel format.
+ * @param variant decode variant.
+ * @param resolved resolved variant to fill in.
+ * @return 1 on success, 0 if a channel is repeated or not a single CHANNEL_ bit.
+ */
+static uint32_t resolveVariant(const pixelFormat_t *format, const lsbPlaneVariant_t *variant,
+                               resolvedVariant_t *resolved) {
+    uint8_t bytes[3];
+    uint32_t count = 0;
+
+    if(variant->channel_order[0] == 0) {
+        for(uint32_t b = 0; b < format->bytes_per_pixel; b++) {
+            if(b == format->blue_byte || b == format->green_byte || b == format->red_byte)
+                bytes[count++] = (uint8_t) b;
+        }
+    } else {
+        uint32_t seen = 0;
+        for(uint32_t c = 0; c < 3 && variant->channel_order[c] != 0; c++) {
+            uint32_t channel = variant->channel_order[c];
+            if((seen & channel) != 0)
+                return 0;
+            seen |= channel;
+            switch(channel) {
+                case CHANNEL_BLUE: bytes[count++] = format->blue_byte; break;
+                case CHANNEL_GREEN: bytes[count++] = format->green_byte; break;
+                case CHANNEL_RED: bytes[count++] = format->red_byte; break;
+                default: return 0;
+            }
+        }
+    }
+
+    resolved->bits_per_pixel = count;
+    resolved->identity = count == format->bytes_per_pixel;
+    for(uint32_t k = 0; k < count; k++) {
+        if(bytes[k] != k)
+            resolved->identity = 0;
+    }
+    for(uint32_t value = 0; value < (1u << format->bytes_per_pixel); value++) {
+        uint8_t selected = 0;
+        for(uint32_t k = 0; k < count; k++)
+            selected |= ((value >> bytes[k]) & 1) << k;
+        resolved->select[value] = selected;
+    }
+    return 1;
+}
+
+/**
+ * Calculates the number of message characters a plane holds for a variant.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @param charCount number of characters the plane holds, excluding end of string marker.
+ * @return 1 on success, 0 if the variant is not valid for the pixel format.
+ */
+uint32_t getLSBPlaneCapacity(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant, uint64_t *charCount) {
+    resolvedVariant_t resolved;
+
+    *charCount = 0;
+    if(resolveVariant(&(plane->format), variant, &resolved) == 0)
+        return 0;
+
+    uint64_t selectedBits = plane->bit_count / plane->format.bytes_per_pixel * resolved.bits_per_pixel;
+    if(variant->start_bit < selectedBits)
+        *charCount = (selectedBits - variant->start_bit) / 8;
+    return 1;
+}
+
+/**
+ * Copies message bytes from a plane whose bits are all selected in storage order, starting at any bit.
+ *
+ * @param bits plane bits.
+ * @param firstBit first plane bit of the message.
+ * @param dst destination for message bytes.
+ * @param count number of message bytes.
+ */
+static void copyPlaneBits(const uint8_t *bits, uint64_t firstBit, uint8_t *dst, size_t count) {
+    const uint8_t *src = bits + firstBit / 8;
+    uint32_t shift = firstBit % 8;
+
+    if(shift == 0) {
+        memcpy(dst, src, count);
+        return;
+    }
+    for(size_t i = 0; i < count; i++)
+        dst[i] = (uint8_t) ((src[i] >> shift) | (src[i + 1] << (8 - shift)));
+}
+
+/**
+ * Gathers the selected bits of each pixel of a plane into message bytes.
+ *
+ * @param plane plane.
+ * @param resolved resolved variant.
+ * @param firstBit number of selected bits to skip.
+ * @param dst destination for message bytes.
+ * @param count number of message bytes, at most the capacity of the plane.
+ */
+static void gatherPlaneBits(const lsbPlane_t *plane, const resolvedVariant_t *resolved, uint64_t firstBit,
+                            uint8_t *dst, size_t count) {
+    uint32_t bytesPerPixel = plane->format.bytes_per_pixel;
+    uint32_t valueMask = (1u << bytesPerPixel) - 1;
+    uint64_t position = firstBit / resolved->bits_per_pixel * bytesPerPixel;
+    uint32_t skip = firstBit % resolved->bits_per_pixel;
+    uint32_t bits = 0;
+    uint32_t held = 0;
+    size_t written = 0;
+
+    while(written < count) {
+        const uint8_t *src = plane->bits + position / 8;
+        uint32_t value = ((src[0] | (uint32_t) src[1] << 8) >> (position % 8)) & valueMask;
+        bits |= (uint32_t) (resolved->select[value] >> skip) << held;
+        held += resolved->bits_per_pixel - skip;
+        skip = 0;
+        position += bytesPerPixel;
+        if(held >= 8) {
+            dst[written++] = (uint8_t) bits;
+            bits >>= 8;
+            held -= 8;
+        }
+    }
+}
+
+/**
+ * Reverses the order of the bits of a byte.
+ *
+ * @param byte byte to reverse.
+ * @return reversed byte.
+ */
+static uint8_t reverseBits(uint8_t byte) {
+    byte = (uint8_t) ((byte & 0xF0) >> 4 | (byte & 0x0F) << 4);
+    byte = (uint8_t) ((byte & 0xCC) >> 2 | (byte & 0x33) << 2);
+    return (uint8_t) ((byte & 0xAA) >> 1 | (byte & 0x55) << 1);
+}
+
+/**
+ * Decodes the first message bytes of a plane with a variant.
+ *
+ * A variant selecting every bit of 24 bit pixels in storage order is a shifted copy of the plane. Other variants
+ * look up the selected bits of each pixel in a table built once per call.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @param dst destination for message bytes.
+ * @param count number of message bytes wanted.
+ * @return number of message bytes written, less than count if the plane holds fewer, 0 if the variant is not valid.
+ */
+size_t decodeLSBPlaneBytes(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant, uint8_t *dst, size_t count) {
+    resolvedVariant_t resolved;
+    uint64_t charCount;
+
+    if(resolveVariant(&(plane->format), variant, &resolved) == 0 ||
+            getLSBPlaneCapacity(plane, variant, &charCount) == 0)
+        return 0;
+    if(count > charCount)
+        count = (size_t) charCount;
+
+    if(resolved.identity)
+        copyPlaneBits(plane->bits, variant->start_bit, dst, count);
+    else
+        gatherPlaneBits(plane, &resolved, variant->start_bit, dst, count);
+
+    if(variant->msb_first) {
+        for(size_t i = 0; i < count; i++)
+            dst[i] = reverseBits(dst[i]);
+    }
+    return count;
+}
+
+/**
+ * Decodes the secret message of a plane with a variant.
+ *
+ * Like decodeMessage() the whole capacity is decoded and terminated, so the message ends at its first end of string
+ * marker.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @return pointer to char string with secret message, NULL if the variant is not valid or memory ran out.
+ */
+char *decodeLSBPlaneMessage(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant) {
+    uint64_t charCount;
+
+    if(getLSBPlaneCapacity(plane, variant, &charCount) == 0 || charCount >= SIZE_MAX)
+        return NULL;
+    char *str = malloc((size_t) charCount + 1);
+    if(str == NULL)
+        return NULL;
+    str[charCount] = '\0';
+
+    decodeLSBPlaneBytes(plane, variant, (uint8_t *) str, (size_t) charCount);
+    return str;
+}
+
+/**
+ * Decodes a framed payload, see frame.h, from a plane with a variant.
+ *
+ * Only the header is decoded first, so a message without a frame header costs 16 bytes. The payload of an
+ * uncompressed frame is decoded straight into the returned buffer by moving the start bit of the variant past the
+ * header. The stream of a compressed frame is decoded one block of PLANE_FRAME_BLOCK_BYTES at a time and fed to an
+ * lzDecoder_t until the payload is complete. Either way the payload is checked against the CRC-32C of the header.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @param payload payload on FRAME_OK, followed by an end of string marker, to be freed by the caller.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR.
+ */
+uint32_t decodeLSBPlaneFrame(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant, uint8_t **payload,
+                             uint64_t *length) {
+    uint8_t head[FRAME_HEADER_SIZE];
+    frameHeader_t header;
+    uint64_t charCount;
+
+    *payload = NULL;
+    *length = 0;
+    if(getLSBPlaneCapacity(plane, variant, &charCount) == 0 || charCount < FRAME_HEADER_SIZE ||
+            decodeLSBPlaneBytes(plane, variant, head, FRAME_HEADER_SIZE) != FRAME_HEADER_SIZE ||
+            parseFrameHeader(head, &header) == 0)
+        return FRAME_NOT_FOUND;
+
+    // a compressed payload may be longer than the capacity, but not by more than the best compression ratio
+    uint64_t maxLength = charCount - FRAME_HEADER_SIZE;
+    if(header.compressed)
+        maxLength = (maxLength > UINT64_MAX / LZ_MAX_RATIO) ? UINT64_MAX : maxLength * LZ_MAX_RATIO;
+    if(header.length > maxLength || header.length >= SIZE_MAX)
+        return FRAME_CORRUPT;
+    uint8_t *dst = malloc((size_t) header.length + 1);
+    if(dst == NULL)
+        return FRAME_ERROR;
+
+    // the payload starts after the selected bits of the header
+    lsbPlaneVariant_t rest = *variant;
+    rest.start_bit += (uint64_t) FRAME_HEADER_SIZE * 8;
+    uint32_t result = FRAME_OK;
+    if(!header.compressed) {
+        if(decodeLSBPlaneBytes(plane, &rest, dst, (size_t) header.length) != header.length)
+            result = FRAME_CORRUPT;
+    } else {
+        uint8_t block[PLANE_FRAME_BLOCK_BYTES];
+        lzDecoder_t decoder;
+        lzDecoderInit(&decoder, dst, header.length);
+        uint32_t status = lzDecoderFeed(&decoder, block, 0);
+        while(status == LZ_NEED_MORE) {
+            size_t count = decodeLSBPlaneBytes(plane, &rest, block, sizeof(block));
+            if(count == 0)
+                break;
+            status = lzDecoderFeed(&decoder, block, count);
+            rest.start_bit += (uint64_t) count * 8;
+        }
+        if(status != LZ_DONE)
+            result = FRAME_CORRUPT;
+    }
+    if(result == FRAME_OK && crc32cUpdate(0, dst, (size_t) header.length) != header.crc)
+        result = FRAME_CORRUPT;
+    if(result != FRAME_OK) {
+        free(dst);
+        return result;
+    }
+
+    dst[header.length] = '\0';
+    *payload = dst;
+    *length = header.length;
+    return FRAME_OK;
+}
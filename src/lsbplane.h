@@ -0,0 +1,116 @@
+/** @file lsbplane.h
+ *
+ * @brief Packed plane of the least significant bit of every pixel byte, for trying many decode variants.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef LSBPLANE_H_
+#define LSBPLANE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+
+/**
+ * Suffix appended to the path of a bitmap file to name its plane sidecar file.
+ */
+#define LSB_PLANE_SIDECAR_SUFFIX    ".lsbplane"
+
+/**
+ * Least significant bits of all pixel bytes of a bitmap, one eighth of the unpadded pixel array.
+ *
+ * Pixel bytes are numbered in decode order: row by row from the bottom row of the image up, padding skipped. Bit n
+ * of byte i of bits is the least significant bit of pixel byte 8 * i + n. Alpha bytes of 32 bit pixels are kept, so
+ * pixel p always starts at bit p * format.bytes_per_pixel.
+ */
+typedef struct lsbPlane {
+    uint8_t *bits;
+    uint64_t bit_count;     // width * height * format.bytes_per_pixel
+    uint32_t width;
+    uint32_t height;
+    pixelFormat_t format;
+} lsbPlane_t;
+
+/**
+ * How a message is read from a plane.
+ *
+ * The default variant, all fields 0, reads the color bytes of each pixel in storage order and fills message bytes
+ * from the least significant bit, the same bits decodeMessage() reads.
+ */
+typedef struct lsbPlaneVariant {
+    uint8_t channel_order[3];   // CHANNEL_ bits in the order their bits are taken from each pixel, unused entries 0,
+                                // all 0 for the color bytes in storage order
+    uint32_t msb_first;         // fill message bytes from the most significant bit
+    uint64_t start_bit;         // selected bits skipped before the first message bit
+} lsbPlaneVariant_t;
+
+/**
+ * Extracts the plane of a decodeable bitmap in memory.
+ *
+ * @param bitmap bitmap loaded by readBitmapFile() or mapBitmapFile().
+ * @param plane plane to fill in, release with releaseLSBPlane().
+ * @return 1 on success, 0 if the bitmap is not decodeable or memory ran out.
+ */
+uint32_t extractLSBPlane(bitmap_t *bitmap, lsbPlane_t *plane);
+
+/**
+ * Loads the plane of a bitmap file, optionally through its sidecar file.
+ *
+ * @param path path of the bitmap file.
+ * @param useSidecar 1 to read the plane from <path>.lsbplane when it matches the file and to write it otherwise.
+ * @param plane plane to fill in, release with releaseLSBPlane().
+ * @return 1 on success, 0 on error.
+ */
+uint32_t loadLSBPlaneFile(const char *path, uint32_t useSidecar, lsbPlane_t *plane);
+
+/**
+ * Frees the bits of a plane.
+ *
+ * @param plane plane to release.
+ */
+void releaseLSBPlane(lsbPlane_t *plane);
+
+/**
+ * Calculates the number of message characters a plane holds for a variant.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @param charCount number of characters the plane holds, excluding end of string marker.
+ * @return 1 on success, 0 if the variant is not valid for the pixel format.
+ */
+uint32_t getLSBPlaneCapacity(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant, uint64_t *charCount);
+
+/**
+ * Decodes the first message bytes of a plane with a variant.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @param dst destination for message bytes.
+ * @param count number of message bytes wanted.
+ * @return number of message bytes written, less than count if the plane holds fewer, 0 if the variant is not valid.
+ */
+size_t decodeLSBPlaneBytes(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant, uint8_t *dst, size_t count);
+
+/**
+ * Decodes the secret message of a plane with a variant.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @return pointer to char string with secret message, NULL if the variant is not valid or memory ran out.
+ */
+char *decodeLSBPlaneMessage(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant);
+
+/**
+ * Decodes a framed payload, see frame.h, from a plane with a variant. A compressed payload is decompressed.
+ *
+ * @param plane plane.
+ * @param variant decode variant.
+ * @param payload payload on FRAME_OK, followed by an end of string marker, to be freed by the caller.
+ * @param length number of payload bytes on FRAME_OK.
+ * @return FRAME_OK, FRAME_NOT_FOUND, FRAME_CORRUPT or FRAME_ERROR.
+ */
+uint32_t decodeLSBPlaneFrame(const lsbPlane_t *plane, const lsbPlaneVariant_t *variant, uint8_t **payload,
+                             uint64_t *length);
+
+#endif
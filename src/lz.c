@@ -0,0 +1,316 @@
+/** @file lz.c
+ *
+ * @brief LZ77 byte codec with a streaming decoder, used for compressed payloads.
+ * @author Daniel Jaramillo
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+/**
+ * Bits of the hash of 4 bytes indexing the match finder table.
+ */
+#define LZ_HASH_BITS        16
+
+/**
+ * Every 2 ^ LZ_SKIP_SHIFT positions without a match the compressor steps one byte further, so incompressible input
+ * is passed over quickly.
+ */
+#define LZ_SKIP_SHIFT       6
+
+/**
+ * Lengths of up to LZ_TOKEN_LENGTH - 1 fit in a token, longer ones are extended by following bytes.
+ */
+#define LZ_TOKEN_LENGTH     15
+
+/**
+ * Parts of a sequence the decoder expects next.
+ */
+#define LZ_STATE_TOKEN          0
+#define LZ_STATE_LITERAL_LENGTH 1
+#define LZ_STATE_LITERALS       2
+#define LZ_STATE_OFFSET_LOW     3
+#define LZ_STATE_OFFSET_HIGH    4
+#define LZ_STATE_MATCH_LENGTH   5
+#define LZ_STATE_DONE           6
+#define LZ_STATE_CORRUPT        7
+
+/**
+ * Returns the largest compressed length of a number of bytes.
+ *
+ * A stream is never longer than one run of all bytes as literals.
+ *
+ * @param length number of bytes to compress.
+ * @return worst case compressed length.
+ */
+size_t getLZCompressBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+/**
+ * Reads 4 bytes in host byte order.
+ *
+ * @param src bytes to read.
+ * @return the 4 bytes as one value.
+ */
+static uint32_t readSequence(const uint8_t *src) {
+    uint32_t sequence;
+    memcpy(&sequence, src, sizeof(sequence));
+    return sequence;
+}
+
+/**
+ * Returns the match finder table slot of 4 bytes.
+ *
+ * @param sequence 4 bytes read by readSequence().
+ * @return slot index, below 2 ^ LZ_HASH_BITS.
+ */
+static uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * Writes the extension bytes of a length that does not fit in a token.
+ *
+ * @param out destination.
+ * @param extra length beyond LZ_TOKEN_LENGTH.
+ * @return pointer past the bytes written.
+ */
+static uint8_t *writeLength(uint8_t *out, size_t extra) {
+    for(; extra >= 255; extra -= 255)
+        *out++ = 255;
+    *out++ = (uint8_t) extra;
+    return out;
+}
+
+/**
+ * Writes one sequence, a run of literals optionally followed by a match.
+ *
+ * @param out destination.
+ * @param literals literal bytes.
+ * @param literalCount number of literal bytes.
+ * @param offset distance back to the match, unused without a match.
+ * @param matchLength match length, at least LZ_MIN_MATCH, or 0 for the literals ending the stream.
+ * @return pointer past the bytes written.
+ */
+static uint8_t *writeSequence(uint8_t *out, const uint8_t *literals, size_t literalCount, size_t offset,
+                              size_t matchLength) {
+    uint8_t *token = out++;
+    uint32_t literalCode = literalCount < LZ_TOKEN_LENGTH ? (uint32_t) literalCount : LZ_TOKEN_LENGTH;
+    if(literalCount >= LZ_TOKEN_LENGTH)
+        out = writeLength(out, literalCount - LZ_TOKEN_LENGTH);
+    memcpy(out, literals, literalCount);
+    out += literalCount;
+
+    uint32_t matchCode = 0;
+    if(matchLength != 0) {
+        *out++ = (uint8_t) offset;
+        *out++ = (uint8_t) (offset >> 8);
+        size_t code = matchLength - LZ_MIN_MATCH;
+        matchCode = code < LZ_TOKEN_LENGTH ? (uint32_t) code : LZ_TOKEN_LENGTH;
+        if(code >= LZ_TOKEN_LENGTH)
+            out = writeLength(out, code - LZ_TOKEN_LENGTH);
+    }
+    *token = (uint8_t) (literalCode << 4 | matchCode);
+    return out;
+}
+
+/**
+ * Compresses bytes into a single stream.
+ *
+ * Greedy parse with a single entry hash table of the last position of every 4 byte hash. Each match is extended as
+ * far as it goes.
+ *
+ * @param src bytes to compress.
+ * @param length number of bytes.
+ * @param compressedLength number of bytes in the stream.
+ * @return pointer to the stream, NULL if memory ran out.
+ */
+uint8_t *lzCompress(const uint8_t *src, size_t length, size_t *compressedLength) {
+    if(length > SIZE_MAX / 2)
+        return NULL;
+    uint8_t *stream = malloc(getLZCompressBound(length));
+    // positions are stored plus 1, so 0 marks an empty slot
+    size_t *table = calloc((size_t) 1 << LZ_HASH_BITS, sizeof(size_t));
+    if(stream == NULL || table == NULL) {
+        free(stream);
+        free(table);
+        return NULL;
+    }
+
+    uint8_t *out = stream;
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t misses = 0;
+    while(length >= LZ_MIN_MATCH && position <= length - LZ_MIN_MATCH) {
+        uint32_t sequence = readSequence(src + position);
+        size_t *slot = &table[hashSequence(sequence)];
+        size_t candidate = *slot;
+        *slot = position + 1;
+        if(candidate == 0 || position + 1 - candidate > LZ_MAX_OFFSET ||
+                readSequence(src + candidate - 1) != sequence) {
+            position += 1 + (misses++ >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        candidate--;
+        size_t matchLength = LZ_MIN_MATCH;
+        while(position + matchLength < length && src[candidate + matchLength] == src[position + matchLength])
+            matchLength++;
+        out = writeSequence(out, src + anchor, position - anchor, position - candidate, matchLength);
+        position += matchLength;
+        anchor = position;
+        misses = 0;
+    }
+    if(anchor < length)
+        out = writeSequence(out, src + anchor, length - anchor, 0, 0);
+
+    free(table);
+    *compressedLength = (size_t) (out - stream);
+    return stream;
+}
+
+/**
+ * Starts a streaming decode into a buffer.
+ *
+ * @param decoder decoder state.
+ * @param dst destination, length bytes long.
+ * @param length decoded length.
+ */
+void lzDecoderInit(lzDecoder_t *decoder, uint8_t *dst, uint64_t length) {
+    decoder->dst = dst;
+    decoder->length = length;
+    decoder->written = 0;
+    decoder->count = 0;
+    decoder->offset = 0;
+    decoder->token = 0;
+    decoder->state = length == 0 ? LZ_STATE_DONE : LZ_STATE_TOKEN;
+}
+
+/**
+ * Returns the state after a run of literals, which ends the stream once the decoded length is reached.
+ *
+ * @param decoder decoder state.
+ * @return next state.
+ */
+static uint32_t endLiterals(const lzDecoder_t *decoder) {
+    return decoder->written == decoder->length ? LZ_STATE_DONE : LZ_STATE_OFFSET_LOW;
+}
+
+/**
+ * Returns the state once the literal length is known.
+ *
+ * @param decoder decoder state with the literal length in count.
+ * @return next state.
+ */
+static uint32_t startLiterals(const lzDecoder_t *decoder) {
+    if(decoder->count > decoder->length - decoder->written)
+        return LZ_STATE_CORRUPT;
+    return decoder->count == 0 ? endLiterals(decoder) : LZ_STATE_LITERALS;
+}
+
+/**
+ * Copies a match once its offset and length are known. Overlapping matches repeat the bytes they copy.
+ *
+ * @param decoder decoder state with the match length in count.
+ * @return next state.
+ */
+static uint32_t copyMatch(lzDecoder_t *decoder) {
+    if(decoder->offset == 0 || decoder->offset > decoder->written ||
+            decoder->count > decoder->length - decoder->written)
+        return LZ_STATE_CORRUPT;
+
+    uint8_t *out = decoder->dst + decoder->written;
+    const uint8_t *from = out - decoder->offset;
+    if(decoder->offset >= decoder->count) {
+        memcpy(out, from, (size_t) decoder->count);
+    } else {
+        for(uint64_t i = 0; i < decoder->count; i++)
+            out[i] = from[i];
+    }
+    decoder->written += decoder->count;
+    return decoder->written == decoder->length ? LZ_STATE_DONE : LZ_STATE_TOKEN;
+}
+
+/**
+ * Decodes the next bytes of a stream.
+ *
+ * Literals are copied straight from the bytes fed and matches from the bytes already decoded, so no compressed
+ * bytes are kept between calls.
+ *
+ * @param decoder decoder state.
+ * @param src next stream bytes.
+ * @param count number of bytes.
+ * @return LZ_NEED_MORE, LZ_DONE or LZ_CORRUPT.
+ */
+uint32_t lzDecoderFeed(lzDecoder_t *decoder, const uint8_t *src, size_t count) {
+    const uint8_t *end = src + count;
+
+    while(decoder->state < LZ_STATE_DONE) {
+        if(decoder->state == LZ_STATE_LITERALS) {
+            size_t step = (size_t) (end - src);
+            if(step > decoder->count)
+                step = (size_t) decoder->count;
+            if(step == 0)
+                break;
+            memcpy(decoder->dst + decoder->written, src, step);
+            src += step;
+            decoder->written += step;
+            decoder->count -= step;
+            if(decoder->count == 0)
+                decoder->state = endLiterals(decoder);
+            continue;
+        }
+        if(src == end)
+            break;
+
+        uint8_t byte = *src++;
+        switch(decoder->state) {
+            case LZ_STATE_TOKEN:
+                decoder->token = byte;
+                decoder->count = byte >> 4;
+                decoder->state = decoder->count == LZ_TOKEN_LENGTH ? LZ_STATE_LITERAL_LENGTH : startLiterals(decoder);
+                break;
+
+            case LZ_STATE_LITERAL_LENGTH:
+                decoder->count += byte;
+                if(byte != 255)
+                    decoder->state = startLiterals(decoder);
+                else if(decoder->count > decoder->length)
+                    decoder->state = LZ_STATE_CORRUPT;
+                break;
+
+            case LZ_STATE_OFFSET_LOW:
+                decoder->offset = byte;
+                decoder->state = LZ_STATE_OFFSET_HIGH;
+                break;
+
+            case LZ_STATE_OFFSET_HIGH:
+                decoder->offset |= (uint32_t) byte << 8;
+                decoder->count = (decoder->token & LZ_TOKEN_LENGTH) + LZ_MIN_MATCH;
+                if((decoder->token & LZ_TOKEN_LENGTH) == LZ_TOKEN_LENGTH)
+                    decoder->state = LZ_STATE_MATCH_LENGTH;
+                else
+                    decoder->state = copyMatch(decoder);
+                break;
+
+            case LZ_STATE_MATCH_LENGTH:
+                decoder->count += byte;
+                if(byte != 255)
+                    decoder->state = copyMatch(decoder);
+                else if(decoder->count > decoder->length)
+                    decoder->state = LZ_STATE_CORRUPT;
+                break;
+
+            default:
+                decoder->state = LZ_STATE_CORRUPT;
+                break;
+        }
+    }
+
+    if(decoder->state == LZ_STATE_DONE)
+        return LZ_DONE;
+    return decoder->state == LZ_STATE_CORRUPT ? LZ_CORRUPT : LZ_NEED_MORE;
+}
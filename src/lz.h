@@ -0,0 +1,90 @@
+/** @file lz.h
+ *
+ * @brief LZ77 byte codec with a streaming decoder, used for compressed payloads.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Shortest match the compressor emits.
+ */
+#define LZ_MIN_MATCH        4
+
+/**
+ * Farthest back a match may reach.
+ */
+#define LZ_MAX_OFFSET       65535
+
+/**
+ * No compressed stream decodes to more than LZ_MAX_RATIO times its own length, which bounds the decoded length a
+ * header may claim.
+ */
+#define LZ_MAX_RATIO        256
+
+/**
+ * Results of lzDecoderFeed().
+ */
+#define LZ_NEED_MORE        0   // all bytes fed were consumed and the output is not complete yet
+#define LZ_DONE             1   // the output is complete, bytes fed after it are ignored
+#define LZ_CORRUPT          2   // the stream reaches before the start or past the end of the output
+
+/**
+ * State of a streaming decode. Bytes may be fed in chunks split anywhere.
+ */
+typedef struct lzDecoder {
+    uint8_t *dst;           // output buffer, matches are copied from the bytes already written to it
+    uint64_t length;        // decoded length, known up front
+    uint64_t written;       // bytes written to dst
+    uint64_t count;         // literal or match length being read or copied
+    uint32_t offset;        // match offset being read
+    uint32_t token;         // last sequence token
+    uint32_t state;         // part of the sequence expected next
+} lzDecoder_t;
+
+/**
+ * Returns the largest compressed length of a number of bytes.
+ *
+ * @param length number of bytes to compress.
+ * @return worst case compressed length.
+ */
+size_t getLZCompressBound(size_t length);
+
+/**
+ * Compresses bytes into a single stream.
+ *
+ * The stream is a sequence of tokens, each a literal length and a match length in one byte, extended by 255 bytes
+ * when a length does not fit, followed by the literals, a 2 byte little endian offset and the match. The stream ends
+ * when the decoded length is reached, so it carries no end marker and its decoded length is stored elsewhere.
+ *
+ * @param src bytes to compress.
+ * @param length number of bytes.
+ * @param compressedLength number of bytes in the stream.
+ * @return pointer to the stream, NULL if memory ran out.
+ */
+uint8_t *lzCompress(const uint8_t *src, size_t length, size_t *compressedLength);
+
+/**
+ * Starts a streaming decode into a buffer.
+ *
+ * @param decoder decoder state.
+ * @param dst destination, length bytes long.
+ * @param length decoded length.
+ */
+void lzDecoderInit(lzDecoder_t *decoder, uint8_t *dst, uint64_t length);
+
+/**
+ * Decodes the next bytes of a stream.
+ *
+ * @param decoder decoder state.
+ * @param src next stream bytes.
+ * @param count number of bytes.
+ * @return LZ_NEED_MORE, LZ_DONE or LZ_CORRUPT.
+ */
+uint32_t lzDecoderFeed(lzDecoder_t *decoder, const uint8_t *src, size_t count);
+
+#endif
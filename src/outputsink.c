@@ -0,0 +1,147 @@
+/** @file outputsink.c
+ *
+ * @brief Binary safe output to a file, pipe or stdout, written in large aligned blocks as data is produced.
+ * @author Daniel Jaramillo
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "outputsink.h"
+#include "stats.h"
+
+/**
+ * Writes all bytes of a list of buffers, continuing after partial writes and interrupted calls.
+ *
+ * @param fd file descriptor.
+ * @param vectors buffers to write, modified to track progress.
+ * @param count number of buffers.
+ * @return 1 on success, 0 on error.
+ */
+static uint32_t writeVectors(int fd, struct iovec *vectors, int count) {
+    while(count > 0) {
+        STATS_START(writeTimer);
+        ssize_t written = writev(fd, vectors, count);
+        STATS_STOP(writeTimer, STATS_OUTPUT, written > 0 ? (uint64_t) written : 0);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        // drop the buffers written completely and move into the one written partly
+        size_t done = (size_t) written;
+        while(count > 0 && done >= vectors->iov_len) {
+            done -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if(count > 0) {
+            vectors->iov_base = (uint8_t *) vectors->iov_base + done;
+            vectors->iov_len -= done;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Opens a sink writing to a file, which is created or truncated.
+ *
+ * stdout is flushed first, so text printed before stays in front of the bytes written by the sink.
+ *
+ * @param sink sink to open.
+ * @param path file path, - for stdout.
+ * @return 1 on success, 0 if the file cannot be opened or memory ran out.
+ */
+uint32_t outputSinkOpen(outputSink_t *sink, const char *path) {
+    void *buffer;
+
+    if(posix_memalign(&buffer, OUTPUT_SINK_ALIGN, OUTPUT_SINK_BUFFER_SIZE) != 0)
+        return 0;
+    if(strcmp(path, "-") == 0) {
+        fflush(stdout);
+        sink->fd = STDOUT_FILENO;
+        sink->ownsFd = 0;
+    } else {
+        sink->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        sink->ownsFd = 1;
+        if(sink->fd < 0) {
+            free(buffer);
+            return 0;
+        }
+    }
+    sink->buffer = buffer;
+    sink->used = 0;
+    sink->written = 0;
+    return 1;
+}
+
+/**
+ * Writes bytes to a sink. Bytes may include NUL bytes.
+ *
+ * Small writes are gathered in the staging buffer. A write that would fill the buffer goes out at once together
+ * with the bytes already waiting, in one writev() call that reads it in place. So a block decoded by the caller
+ * reaches the file or pipe as soon as it is handed over, without being copied.
+ *
+ * @param sink open sink.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+uint32_t outputSinkWrite(outputSink_t *sink, const uint8_t *bytes, size_t count) {
+    sink->written += count;
+    if(count < OUTPUT_SINK_BUFFER_SIZE - sink->used) {
+        memcpy(sink->buffer + sink->used, bytes, count);
+        sink->used += count;
+        return 1;
+    }
+
+    struct iovec vectors[2] = {{sink->buffer, sink->used}, {(void *) bytes, count}};
+    sink->used = 0;
+    return writeVectors(sink->fd, vectors, 2);
+}
+
+/**
+ * Writes the bytes waiting in the staging buffer.
+ *
+ * @param sink open sink.
+ * @return 1 on success, 0 if writing failed.
+ */
+uint32_t outputSinkFlush(outputSink_t *sink) {
+    struct iovec vector = {sink->buffer, sink->used};
+    sink->used = 0;
+    return writeVectors(sink->fd, &vector, 1);
+}
+
+/**
+ * Flushes and closes a sink. stdout is flushed but left open.
+ *
+ * @param sink open sink.
+ * @return 1 on success, 0 if writing or closing failed.
+ */
+uint32_t outputSinkClose(outputSink_t *sink) {
+    uint32_t success = outputSinkFlush(sink);
+    if(sink->ownsFd && close(sink->fd) != 0)
+        success = 0;
+    free(sink->buffer);
+    sink->buffer = NULL;
+    sink->fd = -1;
+    return success;
+}
+
+/**
+ * Adapter of outputSinkWrite() to messageWriter_t, see decoder.h.
+ *
+ * @param context open sink.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+uint32_t outputSinkWriter(void *context, const uint8_t *bytes, size_t count) {
+    return outputSinkWrite(context, bytes, count);
+}
@@ -0,0 +1,79 @@
+/** @file outputsink.h
+ *
+ * @brief Binary safe output to a file, pipe or stdout, written in large aligned blocks as data is produced.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef OUTPUTSINK_H_
+#define OUTPUTSINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size of the staging buffer of a sink. Writes at least this long skip the buffer.
+ */
+#define OUTPUT_SINK_BUFFER_SIZE     (64 * 1024)
+
+/**
+ * Alignment of the staging buffer, one page.
+ */
+#define OUTPUT_SINK_ALIGN           4096
+
+/**
+ * Output file descriptor with a staging buffer for small writes.
+ */
+typedef struct outputSink {
+    int fd;
+    uint32_t ownsFd;        // 1 if outputSinkClose() closes fd
+    uint8_t *buffer;        // OUTPUT_SINK_BUFFER_SIZE bytes aligned to OUTPUT_SINK_ALIGN
+    size_t used;            // bytes waiting in buffer
+    uint64_t written;       // bytes handed to the sink
+} outputSink_t;
+
+/**
+ * Opens a sink writing to a file, which is created or truncated.
+ *
+ * @param sink sink to open.
+ * @param path file path, - for stdout.
+ * @return 1 on success, 0 if the file cannot be opened or memory ran out.
+ */
+uint32_t outputSinkOpen(outputSink_t *sink, const char *path);
+
+/**
+ * Writes bytes to a sink. Bytes may include NUL bytes.
+ *
+ * @param sink open sink.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+uint32_t outputSinkWrite(outputSink_t *sink, const uint8_t *bytes, size_t count);
+
+/**
+ * Writes the bytes waiting in the staging buffer.
+ *
+ * @param sink open sink.
+ * @return 1 on success, 0 if writing failed.
+ */
+uint32_t outputSinkFlush(outputSink_t *sink);
+
+/**
+ * Flushes and closes a sink. stdout is flushed but left open.
+ *
+ * @param sink open sink.
+ * @return 1 on success, 0 if writing or closing failed.
+ */
+uint32_t outputSinkClose(outputSink_t *sink);
+
+/**
+ * Adapter of outputSinkWrite() to messageWriter_t, see decoder.h.
+ *
+ * @param context open sink.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @return 1 on success, 0 if writing failed.
+ */
+uint32_t outputSinkWriter(void *context, const uint8_t *bytes, size_t count);
+
+#endif
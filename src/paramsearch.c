@@ -0,0 +1,533 @@
+/** @file paramsearch.c
+ *
+ * @brief Finds the embedding parameters of a message by scoring decoded prefixes of many candidates.
+ * @author Daniel Jaramillo
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "lsbkernels.h"
+#include "paramsearch.h"
+
+/**
+ * Candidates scored by one task.
+ */
+#define SEARCH_CANDIDATES_PER_TASK      32
+
+/**
+ * Message bytes decoded at a time while scoring or decoding a result.
+ */
+#define SEARCH_BLOCK_BYTES              256
+
+/**
+ * Pixel rows and layout shared by all candidates of a search.
+ */
+typedef struct searchImage {
+    bitmapRows_t rows;
+    pixelFormat_t format;
+} searchImage_t;
+
+/**
+ * Candidate with its channels resolved to pixel bytes and its score so far.
+ */
+typedef struct candidateState {
+    searchCandidate_t candidate;
+    uint8_t bytes[3];           // pixel bytes holding message bits, in the order they are taken
+    uint32_t channel_count;
+    uint64_t capacity;          // message bytes the candidate can decode
+    uint64_t decoded;           // message bytes scored so far
+    textScore_t score;
+    uint32_t index;             // enumeration order, the baseline candidate is 0
+} candidateState_t;
+
+/**
+ * Slice of candidates scored by one task up to a number of message bytes.
+ */
+typedef struct scoreSlice {
+    const searchImage_t *image;
+    candidateState_t *states;
+    size_t count;
+    uint64_t targetBytes;
+} scoreSlice_t;
+
+/**
+ * Resets a score to empty text.
+ *
+ * @param score score to reset.
+ */
+void textScoreInit(textScore_t *score) {
+    memset(score, 0, sizeof(textScore_t));
+}
+
+/**
+ * Adds decoded bytes to a score. Bytes after the end of string marker are ignored.
+ *
+ * Printable ASCII, tab, line feed and carriage return count as plausible, and so does every byte of a complete
+ * UTF-8 sequence. Other bytes, and the bytes of a broken UTF-8 sequence, count only towards the length.
+ *
+ * @param score score state.
+ * @param bytes decoded bytes.
+ * @param count number of bytes.
+ */
+void textScoreFeed(textScore_t *score, const uint8_t *bytes, size_t count) {
+    for(size_t i = 0; i < count && !score->terminated; i++) {
+        uint8_t byte = bytes[i];
+        if(byte == '\0') {
+            score->terminated = 1;
+            break;
+        }
+        score->length++;
+
+        // continuation of a multi-byte sequence
+        if(score->pending != 0) {
+            if((byte & 0xC0) == 0x80) {
+                score->sequence++;
+                if(--score->pending == 0) {
+                    score->plausible += score->sequence;
+                    score->sequence = 0;
+                }
+                continue;
+            }
+            score->pending = 0;
+            score->sequence = 0;
+        }
+
+        if((byte >= 0x20 && byte < 0x7F) || byte == '\t' || byte == '\n' || byte == '\r') {
+            score->plausible++;
+        } else if(byte >= 0xC2 && byte <= 0xF4) {
+            score->pending = byte < 0xE0 ? 1 : byte < 0xF0 ? 2 : 3;
+            score->sequence = 1;
+        }
+    }
+}
+
+/**
+ * Returns the plausibility of the text scored so far.
+ *
+ * @param score score state.
+ * @return plausible bytes divided by the number of bytes scored, at least SEARCH_MIN_SCORED_LENGTH.
+ */
+double getTextScore(const textScore_t *score) {
+    uint64_t length = score->length < SEARCH_MIN_SCORED_LENGTH ? SEARCH_MIN_SCORED_LENGTH : score->length;
+    return (double) score->plausible / (double) length;
+}
+
+/**
+ * Resolves the channel order of a candidate to pixel bytes and calculates its capacity.
+ *
+ * @param image image searched.
+ * @param state candidate state whose candidate is set.
+ * @return 1 on success, 0 if a channel is repeated or not a single CHANNEL_ bit.
+ */
+static uint32_t resolveCandidate(const searchImage_t *image, candidateState_t *state) {
+    const pixelFormat_t *format = &(image->format);
+    const searchCandidate_t *candidate = &(state->candidate);
+
+    state->channel_count = 0;
+    if(candidate->channel_order[0] == 0) {
+        for(uint32_t b = 0; b < format->bytes_per_pixel; b++) {
+            if(b == format->blue_byte || b == format->green_byte || b == format->red_byte)
+                state->bytes[state->channel_count++] = (uint8_t) b;
+        }
+    } else {
+        uint32_t seen = 0;
+        for(uint32_t c = 0; c < 3 && candidate->channel_order[c] != 0; c++) {
+            uint32_t channel = candidate->channel_order[c];
+            if((seen & channel) != 0)
+                return 0;
+            seen |= channel;
+            switch(channel) {
+                case CHANNEL_BLUE: state->bytes[state->channel_count++] = format->blue_byte; break;
+                case CHANNEL_GREEN: state->bytes[state->channel_count++] = format->green_byte; break;
+                case CHANNEL_RED: state->bytes[state->channel_count++] = format->red_byte; break;
+                default: return 0;
+            }
+        }
+    }
+
+    uint64_t pixels = (uint64_t) image->rows.row_pixels * image->rows.row_count;
+    uint64_t bits = pixels * state->channel_count * candidate->bits_per_channel;
+    state->capacity = candidate->start_bit < bits ? (bits - candidate->start_bit) / 8 : 0;
+    return 1;
+}
+
+/**
+ * Reverses the order of the bits of a byte.
+ *
+ * @param byte byte to reverse.
+ * @return reversed byte.
+ */
+static uint8_t reverseBits(uint8_t byte) {
+    byte = (uint8_t) ((byte & 0xF0) >> 4 | (byte & 0x0F) << 4);
+    byte = (uint8_t) ((byte & 0xCC) >> 2 | (byte & 0x33) << 2);
+    return (uint8_t) ((byte & 0xAA) >> 1 | (byte & 0x55) << 1);
+}
+
+/**
+ * Decodes message bytes of a candidate starting at any message byte.
+ *
+ * Bits are taken like the lsbPixelKernel_t kernels take them, low bits of each channel least significant bit first,
+ * but from the channels in candidate order and from the rows in candidate direction. Only prefixes and the few
+ * reported results are decoded, so a scalar walk is fast enough.
+ *
+ * @param image image searched.
+ * @param state resolved candidate.
+ * @param firstByte first message byte to decode.
+ * @param dst destination for message bytes.
+ * @param count number of message bytes, firstByte + count at most the capacity of the candidate.
+ */
+static void decodeCandidateBytes(const searchImage_t *image, const candidateState_t *state, uint64_t firstByte,
+                                 uint8_t *dst, size_t count) {
+    const bitmapRows_t *rows = &(image->rows);
+    const searchCandidate_t *candidate = &(state->candidate);
+    uint32_t bytesPerPixel = image->format.bytes_per_pixel;
+    uint32_t channelMask = (1u << candidate->bits_per_channel) - 1;
+    uint32_t bitsPerPixel = state->channel_count * candidate->bits_per_channel;
+
+    uint64_t bit = candidate->start_bit + firstByte * 8;
+    uint64_t pixel = bit / bitsPerPixel;
+    uint32_t skip = bit % bitsPerPixel;
+    uint32_t x = (uint32_t) (pixel % rows->row_pixels);
+    uint32_t row = (uint32_t) (pixel / rows->row_pixels);
+    const uint8_t *rowPtr = getRow(rows, candidate->top_down ? rows->row_count - 1 - row : row);
+
+    uint32_t bits = 0;
+    uint32_t held = 0;
+    size_t written = 0;
+    while(written < count) {
+        const uint8_t *pixelPtr = rowPtr + (size_t) x * bytesPerPixel;
+        uint32_t value = 0;
+        for(uint32_t c = 0; c < state->channel_count; c++)
+            value |= (pixelPtr[state->bytes[c]] & channelMask) << (c * candidate->bits_per_channel);
+        bits |= (value >> skip) << held;
+        held += bitsPerPixel - skip;
+        skip = 0;
+        while(held >= 8 && written < count) {
+            dst[written++] = (uint8_t) bits;
+            bits >>= 8;
+            held -= 8;
+        }
+
+        if(++x == rows->row_pixels && written < count) {
+            x = 0;
+            row++;
+            rowPtr = getRow(rows, candidate->top_down ? rows->row_count - 1 - row : row);
+        }
+    }
+
+    if(candidate->msb_first) {
+        for(size_t i = 0; i < count; i++)
+            dst[i] = reverseBits(dst[i]);
+    }
+}
+
+/**
+ * Scores a candidate up to a number of message bytes, continuing where its last scoring stopped.
+ *
+ * @param image image searched.
+ * @param state candidate state.
+ * @param targetBytes number of message bytes scored when done.
+ */
+static void scoreCandidate(const searchImage_t *image, candidateState_t *state, uint64_t targetBytes) {
+    uint8_t block[SEARCH_BLOCK_BYTES];
+
+    if(targetBytes > state->capacity)
+        targetBytes = state->capacity;
+    while(state->decoded < targetBytes && !state->score.terminated) {
+        size_t count = targetBytes - state->decoded < sizeof(block) ? (size_t) (targetBytes - state->decoded)
+                                                                      : sizeof(block);
+        decodeCandidateBytes(image, state, state->decoded, block, count);
+        textScoreFeed(&(state->score), block, count);
+        state->decoded += count;
+    }
+}
+
+/**
+ * Worker task scoring a slice of candidates.
+ *
+ * @param arg scoreSlice_t to score.
+ */
+static void scoreSliceTask(void *arg) {
+    scoreSlice_t *slice = arg;
+    for(size_t s = 0; s < slice->count; s++)
+        scoreCandidate(slice->image, &(slice->states[s]), slice->targetBytes);
+}
+
+/**
+ * Scores candidates up to a number of message bytes, spread over the pool in slices.
+ *
+ * @param image image searched.
+ * @param states candidate states.
+ * @param count number of candidates.
+ * @param targetBytes number of message bytes scored per candidate.
+ * @param pool thread pool, NULL to score on the calling thread.
+ * @return 1 on success, 0 if memory ran out.
+ */
+static uint32_t scoreCandidates(const searchImage_t *image, candidateState_t *states, size_t count,
+                                uint64_t targetBytes, threadPool_t *pool) {
+    size_t sliceCount = (count + SEARCH_CANDIDATES_PER_TASK - 1) / SEARCH_CANDIDATES_PER_TASK;
+    scoreSlice_t *slices = malloc((sliceCount ? sliceCount : 1) * sizeof(scoreSlice_t));
+    if(slices == NULL)
+        return 0;
+
+    taskGroup_t group;
+    taskGroupInit(&group);
+    for(size_t s = 0; s < sliceCount; s++) {
+        slices[s].image = image;
+        slices[s].states = states + s * SEARCH_CANDIDATES_PER_TASK;
+        slices[s].count = (count - s * SEARCH_CANDIDATES_PER_TASK < SEARCH_CANDIDATES_PER_TASK) ?
+                          count - s * SEARCH_CANDIDATES_PER_TASK : SEARCH_CANDIDATES_PER_TASK;
+        slices[s].targetBytes = targetBytes;
+
+        // run the slice on the calling thread if it cannot be queued
+        if(pool == NULL || threadPoolSubmit(pool, &group, scoreSliceTask, &slices[s]) == 0)
+            scoreSliceTask(&slices[s]);
+    }
+    taskGroupWait(&group);
+    taskGroupDestroy(&group);
+    free(slices);
+    return 1;
+}
+
+/**
+ * Orders candidates by descending score. Of equal scores a message with an end of string marker ranks first, then
+ * enumeration order decides so the baseline candidate wins remaining ties.
+ *
+ * @param a first candidateState_t.
+ * @param b second candidateState_t.
+ * @return negative if a ranks first, positive if b ranks first.
+ */
+static int compareCandidates(const void *a, const void *b) {
+    const candidateState_t *first = a, *second = b;
+    double firstScore = getTextScore(&(first->score)), secondScore = getTextScore(&(second->score));
+    if(firstScore != secondScore)
+        return firstScore > secondScore ? -1 : 1;
+    if(first->score.terminated != second->score.terminated)
+        return first->score.terminated ? -1 : 1;
+    return first->index < second->index ? -1 : first->index > second->index;
+}
+
+/**
+ * Returns 1 if a resolved channel order takes every color byte in storage order.
+ *
+ * @param image image searched.
+ * @param state resolved candidate.
+ * @return 1 for the storage order, 0 otherwise.
+ */
+static uint32_t isStorageOrder(const searchImage_t *image, const candidateState_t *state) {
+    candidateState_t storage;
+    memset(&storage, 0, sizeof(storage));
+    storage.candidate.bits_per_channel = 1;
+    resolveCandidate(image, &storage);
+    return state->channel_count == storage.channel_count &&
+           memcmp(state->bytes, storage.bytes, state->channel_count) == 0;
+}
+
+/**
+ * Enumerates every candidate of a search. The baseline candidate comes first.
+ *
+ * Channel orders are all orderings of all non-empty subsets of the three channels. The ordering equal to the storage
+ * order is stored as the default order, so it is enumerated once.
+ *
+ * @param image image searched.
+ * @param maxBits highest bits per channel.
+ * @param offsetCount number of start bits.
+ * @param count number of candidates.
+ * @return candidate states, NULL if memory ran out.
+ */
+static candidateState_t *enumerateCandidates(const searchImage_t *image, uint32_t maxBits, uint32_t offsetCount,
+                                             size_t *count) {
+    static const uint8_t channels[3] = {CHANNEL_BLUE, CHANNEL_GREEN, CHANNEL_RED};
+    uint8_t orders[16][3];
+    uint32_t orderCount = 1;
+
+    // default order first, then every other ordering of one, two or three channels
+    memset(orders, 0, sizeof(orders));
+    for(uint32_t a = 0; a < 3; a++) {
+        for(uint32_t b = 0; b < 4; b++) {
+            for(uint32_t c = 0; c < 4; c++) {
+                if(b == a || (b == 3 && c != 3) || (c != 3 && (c == a || c == b)))
+                    continue;
+                candidateState_t state;
+                memset(&state, 0, sizeof(state));
+                state.candidate.bits_per_channel = 1;
+                state.candidate.channel_order[0] = channels[a];
+                state.candidate.channel_order[1] = b < 3 ? channels[b] : 0;
+                state.candidate.channel_order[2] = c < 3 ? channels[c] : 0;
+                resolveCandidate(image, &state);
+                if(isStorageOrder(image, &state))
+                    continue;
+                memcpy(orders[orderCount++], state.candidate.channel_order, 3);
+            }
+        }
+    }
+
+    *count = (size_t) maxBits * orderCount * 2 * 2 * offsetCount;
+    candidateState_t *states = calloc(*count, sizeof(candidateState_t));
+    if(states == NULL)
+        return NULL;
+
+    size_t index = 0;
+    for(uint32_t bits = 1; bits <= maxBits; bits++) {
+        for(uint32_t order = 0; order < orderCount; order++) {
+            for(uint32_t msbFirst = 0; msbFirst < 2; msbFirst++) {
+                for(uint32_t topDown = 0; topDown < 2; topDown++) {
+                    for(uint32_t offset = 0; offset < offsetCount; offset++) {
+                        candidateState_t *state = &states[index];
+                        state->candidate.bits_per_channel = bits;
+                        memcpy(state->candidate.channel_order, orders[order], 3);
+                        state->candidate.msb_first = msbFirst;
+                        state->candidate.top_down = topDown;
+                        state->candidate.start_bit = offset;
+                        state->index = (uint32_t) index;
+                        textScoreInit(&(state->score));
+                        resolveCandidate(image, state);
+                        index++;
+                    }
+                }
+            }
+        }
+    }
+    return states;
+}
+
+/**
+ * Fills in a search result for a scored candidate, decoding its message up to the end of string marker.
+ *
+ * @param image image searched.
+ * @param state scored candidate.
+ * @param resultLength longest message decoded.
+ * @param result result to fill in.
+ * @return 1 on success, 0 if memory ran out.
+ */
+static uint32_t fillSearchResult(const searchImage_t *image, const candidateState_t *state, size_t resultLength,
+                                 searchResult_t *result) {
+    static const char letters[3] = {'b', 'g', 'r'};
+    const pixelFormat_t *format = &(image->format);
+
+    memset(result, 0, sizeof(searchResult_t));
+    result->candidate = state->candidate;
+    result->score = getTextScore(&(state->score));
+    for(uint32_t c = 0; c < state->channel_count; c++) {
+        uint8_t byte = state->bytes[c];
+        result->channels[c] = letters[byte == format->blue_byte ? 0 : byte == format->green_byte ? 1 : 2];
+    }
+
+    uint64_t limit = state->capacity;
+    if(resultLength < limit)
+        limit = resultLength;
+    if(limit >= SIZE_MAX)
+        return 0;
+
+    size_t capacity = SEARCH_BLOCK_BYTES;
+    result->message = malloc(capacity + 1);
+    if(result->message == NULL)
+        return 0;
+    while(result->length < limit) {
+        if(result->length + SEARCH_BLOCK_BYTES > capacity) {
+            char *message = realloc(result->message, capacity * 2 + 1);
+            if(message == NULL) {
+                free(result->message);
+                result->message = NULL;
+                return 0;
+            }
+            result->message = message;
+            capacity *= 2;
+        }
+        size_t count = limit - result->length < SEARCH_BLOCK_BYTES ? (size_t) (limit - result->length)
+                                                                     : SEARCH_BLOCK_BYTES;
+        uint8_t *block = (uint8_t *) result->message + result->length;
+        decodeCandidateBytes(image, state, result->length, block, count);
+        uint8_t *end = memchr(block, '\0', count);
+        if(end != NULL) {
+            result->length += (size_t) (end - block);
+            break;
+        }
+        result->length += count;
+    }
+    result->message[result->length] = '\0';
+    return 1;
+}
+
+/**
+ * Searches bits per channel, channel order, bit order, row direction and start bit for the most plausible message.
+ *
+ * Every candidate is scored on its first pruneBytes message bytes. Only the best SEARCH_SURVIVORS_PER_RESULT
+ * candidates per result asked for are scored further, up to scoreBytes. A candidate stops being decoded at its end
+ * of string marker, so a short message costs no more than its length. Candidates are scored in slices on the pool.
+ *
+ * @param bitmap decodeable bitmap in memory.
+ * @param options search options, may be NULL for the defaults.
+ * @param pool thread pool scoring the candidates, NULL to score on the calling thread.
+ * @param results destination for the best results, room for options->topCount entries.
+ * @param resultCount number of results written, best first.
+ * @return 1 on success, 0 if the bitmap is not decodeable or memory ran out.
+ */
+uint32_t searchParameters(bitmap_t *bitmap, const searchOptions_t *options, threadPool_t *pool,
+                          searchResult_t *results, size_t *resultCount) {
+    searchOptions_t settings = {0};
+    searchImage_t image;
+    size_t count;
+
+    *resultCount = 0;
+    if(options != NULL)
+        settings = *options;
+    if(settings.topCount == 0)
+        settings.topCount = SEARCH_DEFAULT_TOP_COUNT;
+    if(settings.maxBits == 0 || settings.maxBits > LSB_MAX_BITS_PER_CHANNEL)
+        settings.maxBits = LSB_MAX_BITS_PER_CHANNEL;
+    if(settings.offsetCount == 0)
+        settings.offsetCount = SEARCH_DEFAULT_OFFSET_COUNT;
+    if(settings.resultLength == 0)
+        settings.resultLength = SEARCH_DEFAULT_RESULT_LENGTH;
+    if(settings.pruneBytes == 0)
+        settings.pruneBytes = SEARCH_DEFAULT_PRUNE_BYTES;
+    if(settings.scoreBytes < settings.pruneBytes)
+        settings.scoreBytes = settings.pruneBytes < SEARCH_DEFAULT_SCORE_BYTES ? SEARCH_DEFAULT_SCORE_BYTES
+                                                                              : settings.pruneBytes;
+
+    if(isDecodeable(bitmap) != 1 || getPixelFormat(&(bitmap->dibHeader), &(image.format)) == 0 ||
+            getBitmapRows(bitmap, &(image.rows)) == 0 || image.rows.row_pixels == 0 || image.rows.row_count == 0)
+        return 0;
+
+    candidateState_t *states = enumerateCandidates(&image, settings.maxBits, settings.offsetCount, &count);
+    if(states == NULL)
+        return 0;
+
+    // score everything on a short prefix, then only the best on a longer one
+    uint32_t success = scoreCandidates(&image, states, count, settings.pruneBytes, pool);
+    qsort(states, count, sizeof(candidateState_t), compareCandidates);
+    size_t survivors = (size_t) settings.topCount * SEARCH_SURVIVORS_PER_RESULT;
+    if(survivors > count)
+        survivors = count;
+    if(success)
+        success = scoreCandidates(&image, states, survivors, settings.scoreBytes, pool);
+    qsort(states, survivors, sizeof(candidateState_t), compareCandidates);
+
+    for(size_t r = 0; success && r < settings.topCount && r < survivors; r++) {
+        success = fillSearchResult(&image, &states[r], settings.resultLength, &results[r]);
+        if(success)
+            *resultCount = r + 1;
+    }
+    free(states);
+    if(!success) {
+        releaseSearchResults(results, *resultCount);
+        *resultCount = 0;
+    }
+    return success;
+}
+
+/**
+ * Frees the messages of search results.
+ *
+ * @param results search results.
+ * @param count number of results.
+ */
+void releaseSearchResults(searchResult_t *results, size_t count) {
+    for(size_t r = 0; r < count; r++) {
+        free(results[r].message);
+        results[r].message = NULL;
+    }
+}
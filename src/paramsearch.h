@@ -0,0 +1,146 @@
+/** @file paramsearch.h
+ *
+ * @brief Finds the embedding parameters of a message by scoring decoded prefixes of many candidates.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef PARAMSEARCH_H_
+#define PARAMSEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "threadpool.h"
+
+/**
+ * Default number of results returned by a search.
+ */
+#define SEARCH_DEFAULT_TOP_COUNT        5
+
+/**
+ * Default number of message bytes every candidate is scored on before losing candidates are dropped.
+ */
+#define SEARCH_DEFAULT_PRUNE_BYTES      256
+
+/**
+ * Default number of message bytes the surviving candidates are scored on.
+ */
+#define SEARCH_DEFAULT_SCORE_BYTES      4096
+
+/**
+ * Default number of start bits tried, 0 to SEARCH_DEFAULT_OFFSET_COUNT - 1.
+ */
+#define SEARCH_DEFAULT_OFFSET_COUNT     8
+
+/**
+ * Default longest message decoded per result.
+ */
+#define SEARCH_DEFAULT_RESULT_LENGTH    (1024 * 1024)
+
+/**
+ * Candidates kept after pruning, per result asked for.
+ */
+#define SEARCH_SURVIVORS_PER_RESULT     4
+
+/**
+ * Messages shorter than this are scored as if the missing bytes were implausible, so a short accidental run of text
+ * does not beat a real message.
+ */
+#define SEARCH_MIN_SCORED_LENGTH        16
+
+/**
+ * Embedding parameters of one candidate.
+ *
+ * The baseline candidate, 1 bit per channel with all other fields 0, reads the same bits as decodeMessage().
+ */
+typedef struct searchCandidate {
+    uint32_t bits_per_channel;  // low bits of each channel holding message bits, 1 to LSB_MAX_BITS_PER_CHANNEL
+    uint8_t channel_order[3];   // CHANNEL_ bits in the order their bits are taken from each pixel, unused entries 0,
+                                // all 0 for the color bytes in storage order
+    uint32_t msb_first;         // fill message bytes from the most significant bit
+    uint32_t top_down;          // read rows from the top row of the image down instead of from the bottom up
+    uint64_t start_bit;         // message bits skipped before the first message byte
+} searchCandidate_t;
+
+/**
+ * Incremental plausibility score of decoded text.
+ */
+typedef struct textScore {
+    uint64_t length;        // bytes scored, up to the end of string marker
+    uint64_t plausible;     // printable ASCII, whitespace and bytes of complete UTF-8 sequences
+    uint32_t sequence;      // bytes of the UTF-8 sequence in progress
+    uint32_t pending;       // continuation bytes the UTF-8 sequence in progress still needs
+    uint32_t terminated;    // 1 once the end of string marker was seen
+} textScore_t;
+
+/**
+ * One ranked decoding found by a search.
+ */
+typedef struct searchResult {
+    searchCandidate_t candidate;
+    char channels[4];       // channel letters in the order bits are taken from each pixel, such as "bgr"
+    double score;           // 0 to 1, higher is more plausible text
+    char *message;          // decoded message, NUL terminated, freed by releaseSearchResults()
+    size_t length;          // length of message
+} searchResult_t;
+
+/**
+ * Options of a search. Fields left 0 take their defaults.
+ */
+typedef struct searchOptions {
+    uint32_t topCount;      // results returned, default SEARCH_DEFAULT_TOP_COUNT
+    uint32_t maxBits;       // highest bits per channel tried, default LSB_MAX_BITS_PER_CHANNEL
+    uint32_t offsetCount;   // start bits tried, default SEARCH_DEFAULT_OFFSET_COUNT
+    uint32_t pruneBytes;    // bytes scored before pruning, default SEARCH_DEFAULT_PRUNE_BYTES
+    uint32_t scoreBytes;    // bytes scored for survivors, default SEARCH_DEFAULT_SCORE_BYTES
+    size_t resultLength;    // longest message decoded per result, default SEARCH_DEFAULT_RESULT_LENGTH, decoding
+                            // always stops at the end of string marker
+} searchOptions_t;
+
+/**
+ * Resets a score to empty text.
+ *
+ * @param score score to reset.
+ */
+void textScoreInit(textScore_t *score);
+
+/**
+ * Adds decoded bytes to a score. Bytes after the end of string marker are ignored.
+ *
+ * @param score score state.
+ * @param bytes decoded bytes.
+ * @param count number of bytes.
+ */
+void textScoreFeed(textScore_t *score, const uint8_t *bytes, size_t count);
+
+/**
+ * Returns the plausibility of the text scored so far.
+ *
+ * @param score score state.
+ * @return plausible bytes divided by the number of bytes scored, at least SEARCH_MIN_SCORED_LENGTH.
+ */
+double getTextScore(const textScore_t *score);
+
+/**
+ * Searches bits per channel, channel order, bit order, row direction and start bit for the most plausible message.
+ *
+ * @param bitmap decodeable bitmap in memory.
+ * @param options search options, may be NULL for the defaults.
+ * @param pool thread pool scoring the candidates, NULL to score on the calling thread.
+ * @param results destination for the best results, room for options->topCount entries.
+ * @param resultCount number of results written, best first.
+ * @return 1 on success, 0 if the bitmap is not decodeable or memory ran out.
+ */
+uint32_t searchParameters(bitmap_t *bitmap, const searchOptions_t *options, threadPool_t *pool,
+                          searchResult_t *results, size_t *resultCount);
+
+/**
+ * Frees the messages of search results.
+ *
+ * @param results search results.
+ * @param count number of results.
+ */
+void releaseSearchResults(searchResult_t *results, size_t count);
+
+#endif
@@ -0,0 +1,325 @@
+/** @file pixelorder.c
+ *
+ * @brief Keyed pixel order scattering a message over the carrier without a permutation table of the image.
+ * @author Daniel Jaramillo
+ */
+
+#include <string.h>
+
+#include "pixelorder.h"
+
+/**
+ * Rounds of the Feistel permutations.
+ */
+#define FEISTEL_ROUNDS      4
+
+/**
+ * Salts keeping the keyed functions of the block order, the table and the block masks apart.
+ */
+#define BLOCK_ORDER_SALT    0x243f6a8885a308d3ULL
+#define TABLE_SALT          0x13198a2e03707344ULL
+#define BLOCK_MASK_SALT     0xa4093822299f31d0ULL
+
+/**
+ * Mixes the bits of a 64 bit value, the finalizer of splitmix64.
+ *
+ * @param value value.
+ * @return mixed value.
+ */
+static uint64_t mix64(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+/**
+ * Keyed balanced Feistel permutation of the values of 2 * halfBits bits.
+ *
+ * @param value value to permute.
+ * @param halfBits bits of each half, at most 32.
+ * @param key round key.
+ * @return permuted value.
+ */
+static uint64_t feistel(uint64_t value, uint32_t halfBits, uint64_t key) {
+    uint64_t mask = (1ULL << halfBits) - 1;
+    uint64_t left = value >> halfBits;
+    uint64_t right = value & mask;
+    for(uint32_t round = 0; round < FEISTEL_ROUNDS; round++) {
+        uint64_t next = left ^ (mix64(key ^ ((uint64_t) round << 56) ^ right) & mask);
+        left = right;
+        right = next;
+    }
+    return (left << halfBits) | right;
+}
+
+/**
+ * Derives a pixel order key from a passphrase, hashing it with FNV-1a and mixing the hash.
+ *
+ * @param passphrase passphrase.
+ * @return key, never 0, which stands for the rows in decode order.
+ */
+uint64_t getPixelOrderKey(const char *passphrase) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(const uint8_t *c = (const uint8_t *) passphrase; *c != '\0'; c++)
+        hash = (hash ^ *c) * 0x100000001b3ULL;
+    hash = mix64(hash);
+    return hash != 0 ? hash : 1;
+}
+
+/**
+ * Prepares the keyed order of the pixels of an image.
+ *
+ * Builds the table of the order inside a block, the only table kept, and sizes the Feistel permutation of the
+ * whole blocks to the smallest even number of bits covering them.
+ *
+ * @param order order to fill in.
+ * @param key key, see getPixelOrderKey().
+ * @param pixelCount number of pixels of the image.
+ */
+void pixelOrderInit(pixelOrder_t *order, uint64_t key, uint64_t pixelCount) {
+    order->key = key;
+    order->pixel_count = pixelCount;
+    order->block_count = pixelCount >> PIXEL_ORDER_BLOCK_BITS;
+    order->tail_pixels = (uint32_t) (pixelCount & (PIXEL_ORDER_BLOCK_PIXELS - 1));
+
+    uint32_t bits = order->block_count > 1 ? 64 - (uint32_t) __builtin_clzll(order->block_count - 1) : 0;
+    order->block_half_bits = (bits + 1) / 2;
+
+    for(uint32_t i = 0; i < PIXEL_ORDER_BLOCK_PIXELS; i++)
+        order->table[i] = (uint16_t) feistel(i, PIXEL_ORDER_BLOCK_BITS / 2, key ^ TABLE_SALT);
+}
+
+/**
+ * Maps a block of the keyed order to the block of pixels it visits. Whole blocks are permuted by cycle walking the
+ * Feistel permutation until it lands on a block, the short last block stays last.
+ *
+ * @param order pixel order.
+ * @param block block of the keyed order.
+ * @return block of pixels.
+ */
+static uint64_t getOrderedBlock(const pixelOrder_t *order, uint64_t block) {
+    if(block >= order->block_count || order->block_count == 1)
+        return block;
+
+    uint64_t value = block;
+    do {
+        value = feistel(value, order->block_half_bits, order->key ^ BLOCK_ORDER_SALT);
+    } while(value >= order->block_count);
+    return value;
+}
+
+/**
+ * Masks mixing the table into the order inside one block.
+ */
+typedef struct blockMasks {
+    uint32_t in;
+    uint32_t out;
+} blockMasks_t;
+
+/**
+ * Derives the masks of a block of pixels.
+ *
+ * @param order pixel order.
+ * @param block block of pixels.
+ * @param masks masks to fill in.
+ */
+static void getBlockMasks(const pixelOrder_t *order, uint64_t block, blockMasks_t *masks) {
+    uint64_t bits = mix64(order->key ^ BLOCK_MASK_SALT ^ block);
+    masks->in = (uint32_t) bits & (PIXEL_ORDER_BLOCK_PIXELS - 1);
+    masks->out = (uint32_t) (bits >> 32) & (PIXEL_ORDER_BLOCK_PIXELS - 1);
+}
+
+/**
+ * Maps a position inside a block to its pixel. A short block cycle walks the order of a whole block until it lands
+ * inside the block.
+ *
+ * @param order pixel order.
+ * @param masks masks of the block.
+ * @param size number of pixels in the block.
+ * @param position position inside the block.
+ * @return pixel inside the block.
+ */
+static uint32_t getBlockPixel(const pixelOrder_t *order, const blockMasks_t *masks, uint32_t size,
+                              uint32_t position) {
+    uint32_t value = position;
+    do {
+        value = order->table[value ^ masks->in] ^ masks->out;
+    } while(value >= size);
+    return value;
+}
+
+/**
+ * Returns the number of pixels in a block of pixels.
+ *
+ * @param order pixel order.
+ * @param block block of pixels.
+ * @return pixels in the block.
+ */
+static uint32_t getBlockSize(const pixelOrder_t *order, uint64_t block) {
+    return block < order->block_count ? PIXEL_ORDER_BLOCK_PIXELS : order->tail_pixels;
+}
+
+/**
+ * Maps a position in the keyed order to its pixel.
+ *
+ * Meant for single lookups, runs of positions are copied faster by gatherOrderedPixels().
+ *
+ * @param order pixel order.
+ * @param slot position in the keyed order.
+ * @return index of the pixel counted along the rows in decode order.
+ */
+uint64_t getOrderedPixel(const pixelOrder_t *order, uint64_t slot) {
+    blockMasks_t masks;
+    uint64_t block = getOrderedBlock(order, slot >> PIXEL_ORDER_BLOCK_BITS);
+    getBlockMasks(order, block, &masks);
+    uint32_t position = (uint32_t) (slot & (PIXEL_ORDER_BLOCK_PIXELS - 1));
+    return (block << PIXEL_ORDER_BLOCK_BITS) + getBlockPixel(order, &masks, getBlockSize(order, block), position);
+}
+
+/**
+ * Copies the pixels of a block between the rows and a buffer holding them next to each other.
+ *
+ * @param rows rows of the pixel array.
+ * @param first first pixel of the block, in decode order.
+ * @param size number of pixels in the block.
+ * @param buffer buffer, size pixels long.
+ * @param toRows 1 to copy the buffer to the rows, 0 to copy the rows to the buffer.
+ */
+static void copyBlock(const bitmapRows_t *rows, uint64_t first, uint32_t size, uint8_t *buffer, uint32_t toRows) {
+    size_t pixelBytes = rows->row_bytes / rows->row_pixels;
+    uint32_t row = (uint32_t) (first / rows->row_pixels);
+    uint32_t column = (uint32_t) (first % rows->row_pixels);
+    while(size > 0) {
+        uint32_t count = rows->row_pixels - column < size ? rows->row_pixels - column : size;
+        uint8_t *pixels = (uint8_t *) getRow(rows, row) + (size_t) column * pixelBytes;
+        if(toRows)
+            memcpy(pixels, buffer, (size_t) count * pixelBytes);
+        else
+            memcpy(buffer, pixels, (size_t) count * pixelBytes);
+        buffer += (size_t) count * pixelBytes;
+        size -= count;
+        row++;
+        column = 0;
+    }
+}
+
+/**
+ * Returns the pixels of a block next to each other, in place if the block lies in one row, otherwise copied into a
+ * buffer.
+ *
+ * @param rows rows of the pixel array.
+ * @param first first pixel of the block, in decode order.
+ * @param size number of pixels in the block.
+ * @param buffer buffer, size pixels long.
+ * @return pixels of the block.
+ */
+static uint8_t *loadBlock(const bitmapRows_t *rows, uint64_t first, uint32_t size, uint8_t *buffer) {
+    uint32_t column = (uint32_t) (first % rows->row_pixels);
+    if(rows->row_pixels - column >= size)
+        return (uint8_t *) getRow(rows, (uint32_t) (first / rows->row_pixels)) +
+               (size_t) column * (rows->row_bytes / rows->row_pixels);
+
+    copyBlock(rows, first, size, buffer, 0);
+    return buffer;
+}
+
+/**
+ * Copies a pixel of 3 or 4 bytes.
+ *
+ * @param dst destination.
+ * @param src source.
+ * @param pixelBytes bytes per pixel.
+ */
+static inline void copyPixel(uint8_t *dst, const uint8_t *src, size_t pixelBytes) {
+    if(pixelBytes == 3) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    } else {
+        memcpy(dst, src, 4);
+    }
+}
+
+/**
+ * Copies the pixels of a run of positions in the keyed order next to each other, or back.
+ *
+ * Works one block at a time: the pixels of the block are brought next to each other, in place when the block lies
+ * in one row, and then picked in the order of the block. The block stays in the L1 cache while its pixels are picked,
+ * so the scattered accesses cost about as much as a sequential copy.
+ *
+ * @param order pixel order.
+ * @param rows rows of the pixel array.
+ * @param firstSlot first position in the keyed order.
+ * @param count number of positions.
+ * @param pixels pixels in the keyed order, count pixels long.
+ * @param toRows 1 to copy the pixels to the rows, 0 to copy the rows to the pixels.
+ */
+static void moveOrderedPixels(const pixelOrder_t *order, const bitmapRows_t *rows, uint64_t firstSlot, size_t count,
+                              uint8_t *pixels, uint32_t toRows) {
+    uint8_t buffer[PIXEL_ORDER_BLOCK_PIXELS * 4];
+    size_t pixelBytes = rows->row_bytes / rows->row_pixels;
+
+    while(count > 0) {
+        uint64_t block = getOrderedBlock(order, firstSlot >> PIXEL_ORDER_BLOCK_BITS);
+        uint32_t size = getBlockSize(order, block);
+        uint32_t position = (uint32_t) (firstSlot & (PIXEL_ORDER_BLOCK_PIXELS - 1));
+        uint32_t run = size - position < count ? size - position : (uint32_t) count;
+        uint64_t first = block << PIXEL_ORDER_BLOCK_BITS;
+        blockMasks_t masks;
+        getBlockMasks(order, block, &masks);
+
+        // 24 bit pixels are gathered from the buffer, which has room past every pixel, as one 32 bit word each
+        if(!toRows && pixelBytes == 3) {
+            copyBlock(rows, first, size, buffer, 0);
+            for(uint32_t i = 0; i + 1 < run; i++, pixels += 3)
+                memcpy(pixels, buffer + getBlockPixel(order, &masks, size, position + i) * 3, 4);
+            copyPixel(pixels, buffer + getBlockPixel(order, &masks, size, position + run - 1) * 3, 3);
+            pixels += 3;
+        } else {
+            uint8_t *blockPixels = loadBlock(rows, first, size, buffer);
+            for(uint32_t i = 0; i < run; i++, pixels += pixelBytes) {
+                uint8_t *pixel = blockPixels + getBlockPixel(order, &masks, size, position + i) * pixelBytes;
+                if(toRows)
+                    copyPixel(pixel, pixels, pixelBytes);
+                else
+                    copyPixel(pixels, pixel, pixelBytes);
+            }
+            if(toRows && blockPixels == buffer)
+                copyBlock(rows, first, size, buffer, 1);
+        }
+
+        firstSlot += run;
+        count -= run;
+    }
+}
+
+/**
+ * Copies the pixels of a run of positions in the keyed order next to each other.
+ *
+ * @param order pixel order.
+ * @param rows rows of the pixel array.
+ * @param firstSlot first position in the keyed order.
+ * @param count number of positions.
+ * @param dst destination, count pixels long.
+ */
+void gatherOrderedPixels(const pixelOrder_t *order, const bitmapRows_t *rows, uint64_t firstSlot, size_t count,
+                         uint8_t *dst) {
+    moveOrderedPixels(order, rows, firstSlot, count, dst, 0);
+}
+
+/**
+ * Copies pixels back to a run of positions in the keyed order, undoing gatherOrderedPixels().
+ *
+ * @param order pixel order.
+ * @param rows rows of the pixel array, written through.
+ * @param firstSlot first position in the keyed order.
+ * @param count number of positions.
+ * @param src pixels, count pixels long.
+ */
+void scatterOrderedPixels(const pixelOrder_t *order, const bitmapRows_t *rows, uint64_t firstSlot, size_t count,
+                          const uint8_t *src) {
+    moveOrderedPixels(order, rows, firstSlot, count, (uint8_t *) src, 1);
+}
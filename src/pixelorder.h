@@ -0,0 +1,95 @@
+/** @file pixelorder.h
+ *
+ * @brief Keyed pixel order scattering a message over the carrier without a permutation table of the image.
+ *
+ * The pixels, counted along the rows in decode order, are cut into blocks of PIXEL_ORDER_BLOCK_PIXELS. The message
+ * visits the whole blocks in a keyed order, a Feistel permutation of the block indices with cycle walking, and the
+ * pixels inside each block in a keyed order of their own. The order inside a block comes from one keyed table of
+ * PIXEL_ORDER_BLOCK_PIXELS entries, mixed per block with two keyed masks, so each block gets a different order. A
+ * block is small enough to stay in the L1 or L2 cache and spans a few pages, so the scattered accesses stay cheap.
+ * The last block, shorter when the pixels do not fill it, is visited last, in an order found by cycle walking the
+ * table.
+ *
+ * Scattering hides where the message lies, it is not encryption. The bits are still the plain message bits.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef PIXELORDER_H_
+#define PIXELORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+
+/**
+ * Pixels per block, a power of 2. 12 KiB of 24 bit pixels.
+ */
+#define PIXEL_ORDER_BLOCK_BITS      12
+#define PIXEL_ORDER_BLOCK_PIXELS    (1u << PIXEL_ORDER_BLOCK_BITS)
+
+/**
+ * Keyed pixel order of one image.
+ */
+typedef struct pixelOrder {
+    uint64_t key;
+    uint64_t pixel_count;
+    uint64_t block_count;                           // whole blocks
+    uint32_t tail_pixels;                           // pixels of the last, short block, 0 if there is none
+    uint32_t block_half_bits;                       // bits of each half of the Feistel permutation of blocks
+    uint16_t table[PIXEL_ORDER_BLOCK_PIXELS];       // keyed order inside a block, before the per block masks
+} pixelOrder_t;
+
+/**
+ * Derives a pixel order key from a passphrase.
+ *
+ * @param passphrase passphrase.
+ * @return key, never 0, which stands for the rows in decode order.
+ */
+uint64_t getPixelOrderKey(const char *passphrase);
+
+/**
+ * Prepares the keyed order of the pixels of an image.
+ *
+ * @param order order to fill in.
+ * @param key key, see getPixelOrderKey().
+ * @param pixelCount number of pixels of the image.
+ */
+void pixelOrderInit(pixelOrder_t *order, uint64_t key, uint64_t pixelCount);
+
+/**
+ * Maps a position in the keyed order to its pixel.
+ *
+ * Meant for single lookups, runs of positions are copied faster by gatherOrderedPixels().
+ *
+ * @param order pixel order.
+ * @param slot position in the keyed order.
+ * @return index of the pixel counted along the rows in decode order.
+ */
+uint64_t getOrderedPixel(const pixelOrder_t *order, uint64_t slot);
+
+/**
+ * Copies the pixels of a run of positions in the keyed order next to each other.
+ *
+ * @param order pixel order.
+ * @param rows rows of the pixel array.
+ * @param firstSlot first position in the keyed order.
+ * @param count number of positions.
+ * @param dst destination, count pixels long.
+ */
+void gatherOrderedPixels(const pixelOrder_t *order, const bitmapRows_t *rows, uint64_t firstSlot, size_t count,
+                         uint8_t *dst);
+
+/**
+ * Copies pixels back to a run of positions in the keyed order, undoing gatherOrderedPixels().
+ *
+ * @param order pixel order.
+ * @param rows rows of the pixel array, written through.
+ * @param firstSlot first position in the keyed order.
+ * @param count number of positions.
+ * @param src pixels, count pixels long.
+ */
+void scatterOrderedPixels(const pixelOrder_t *order, const bitmapRows_t *rows, uint64_t firstSlot, size_t count,
+                          const uint8_t *src);
+
+#endif
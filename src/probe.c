@@ -0,0 +1,94 @@
+/** @file probe.c
+ *
+ * @brief Reads only the headers of a bitmap file to report its format and message capacity.
+ * @author Daniel Jaramillo
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "probe.h"
+#include "stats.h"
+
+/**
+ * Builds a probe from a block of memory holding the start of a bitmap file.
+ *
+ * Parses the headers with parseBMPFileHeader() and parseDIBHeader() into a bitmap without pixel array, so
+ * decodeability and capacity follow exactly the rules of isDecodeable() and getMessageCapacity().
+ *
+ * @param buffer start of the bitmap file.
+ * @param length number of bytes in buffer.
+ * @param probe probe to fill in.
+ * @return 1 if the file header could be parsed, 0 otherwise.
+ */
+uint32_t parseBitmapProbe(const uint8_t *buffer, size_t length, bitmapProbe_t *probe) {
+    bitmap_t bitmap;
+
+    memset(probe, 0, sizeof(bitmapProbe_t));
+    if(length < BMPFILEHEADERSIZE + 4)
+        return 0;
+
+    memset(&bitmap, 0, sizeof(bitmap));
+    uint32_t dibHeaderSize = parseBMPFileHeader(buffer, &(bitmap.bmpFileHeader));
+    probe->signature = bitmap.bmpFileHeader.signature;
+    probe->dib_header_size = dibHeaderSize;
+
+    // only parse header types that are supported and completely inside the buffer
+    if(dibHeaderSize != BITMAPCOREHEADER && dibHeaderSize != BITMAPINFOHEADER && dibHeaderSize != BITMAPV4HEADER &&
+            dibHeaderSize != BITMAPV5HEADER)
+        return 1;
+    if(dibHeaderSize > length - BMPFILEHEADERSIZE ||
+            parseDIBHeader(buffer + BMPFILEHEADERSIZE + 4, dibHeaderSize - 4, &(bitmap.dibHeader)) != 1 ||
+            parseBitfieldMasks(buffer + BMPFILEHEADERSIZE + dibHeaderSize, length - BMPFILEHEADERSIZE - dibHeaderSize,
+                               &(bitmap.dibHeader)) != 1)
+        return 1;
+
+    probe->parsed = 1;
+    probe->width = getBitmapWidth(&(bitmap.dibHeader));
+    probe->bits_per_pixel = getBitsPerPixel(&(bitmap.dibHeader));
+    if(bitmap.dibHeader.type != BITMAPCOREHEADER) {
+        probe->height = bitmap.dibHeader.header.bitMapInfoHeader.bitmap_height;
+        probe->compression_method = bitmap.dibHeader.header.bitMapInfoHeader.compression_method;
+    } else {
+        probe->height = bitmap.dibHeader.header.bitMapCoreHeader.bitmap_height;
+        probe->compression_method = BI_RGB;
+    }
+
+    uint64_t charCount;
+    probe->decodeable = isDecodeable(&bitmap) == 1;
+    if(probe->decodeable && getMessageCapacity(&bitmap, &charCount) == 1)
+        probe->capacity = charCount;
+
+    return 1;
+}
+
+/**
+ * Probes a bitmap file with a single read of at most PROBE_SIZE bytes.
+ *
+ * Uses open() and read() instead of stdio so no stream buffer is allocated or filled beyond the headers. Keeps no
+ * shared state, so many files can be probed in parallel.
+ *
+ * @param path path of the bitmap file.
+ * @param probe probe to fill in.
+ * @return 1 if the file header could be read and parsed, 0 otherwise.
+ */
+uint32_t probeBitmapFile(const char *path, bitmapProbe_t *probe) {
+    uint8_t buffer[PROBE_SIZE];
+
+    memset(probe, 0, sizeof(bitmapProbe_t));
+    STATS_START(openTimer);
+    int fd = open(path, O_RDONLY);
+    STATS_STOP(openTimer, STATS_OPEN, 0);
+    if(fd < 0)
+        return 0;
+    STATS_START(readTimer);
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    close(fd);
+    STATS_STOP(readTimer, STATS_HEADERS, count > 0 ? (uint64_t) count : 0);
+    if(count < 0)
+        return 0;
+
+    return parseBitmapProbe(buffer, (size_t) count, probe);
+}
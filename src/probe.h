@@ -0,0 +1,54 @@
+/** @file probe.h
+ *
+ * @brief Reads only the headers of a bitmap file to report its format and message capacity.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef PROBE_H_
+#define PROBE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+
+/**
+ * Number of bytes read by a probe, the file header followed by the largest DIB header.
+ */
+#define PROBE_SIZE  (BMPFILEHEADERSIZE + BITMAPV5HEADER)
+
+/**
+ * Summary of a bitmap file built from its headers alone.
+ */
+typedef struct bitmapProbe {
+    uint16_t signature;
+    uint32_t dib_header_size;       // identifies the DIB header type
+    uint32_t parsed;                // 1 if the DIB header type is supported and the fields below are valid
+    uint32_t width;
+    int32_t height;                 // negative for top-down bitmaps
+    uint16_t bits_per_pixel;
+    uint32_t compression_method;
+    uint32_t decodeable;            // result of isDecodeable()
+    uint64_t capacity;              // message bytes the bitmap holds, 0 if not decodeable
+} bitmapProbe_t;
+
+/**
+ * Builds a probe from a block of memory holding the start of a bitmap file.
+ *
+ * @param buffer start of the bitmap file.
+ * @param length number of bytes in buffer.
+ * @param probe probe to fill in.
+ * @return 1 if the file header could be parsed, 0 otherwise.
+ */
+uint32_t parseBitmapProbe(const uint8_t *buffer, size_t length, bitmapProbe_t *probe);
+
+/**
+ * Probes a bitmap file with a single read of at most PROBE_SIZE bytes.
+ *
+ * @param path path of the bitmap file.
+ * @param probe probe to fill in.
+ * @return 1 if the file header could be read and parsed, 0 otherwise.
+ */
+uint32_t probeBitmapFile(const char *path, bitmapProbe_t *probe);
+
+#endif
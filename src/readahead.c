@@ -0,0 +1,461 @@
+/** @file readahead.c
+ *
+ * @brief Reads a list of files whole ahead of their consumers, with several reads in flight, so reading the next
+ *        files overlaps decoding the last ones. Uses io_uring when built with HAVE_LIBURING and reader threads
+ *        otherwise.
+ * @author Daniel Jaramillo
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "readahead.h"
+
+/**
+ * Largest single read. io_uring reads take a 32 bit length.
+ */
+#define READ_AHEAD_CHUNK_SIZE   (1U << 30)
+
+#ifdef HAVE_LIBURING
+/**
+ * File being read through io_uring.
+ */
+typedef struct readAheadSlot {
+    int fd;                     // -1 while the slot is free
+    size_t done;                // bytes read so far
+    readAheadBuffer_t buffer;
+} readAheadSlot_t;
+#endif
+
+/**
+ * State of a read-ahead. The counters and the ready queue are protected by lock.
+ */
+struct readAhead {
+    char *const *paths;
+    size_t count;
+    uint32_t depth;
+    uint32_t limit;             // depth + held, most buffers not released at once
+    uint64_t sizeLimit;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // signaled when a read completes, a buffer is released or the read-ahead stops
+    size_t next;                // index of the next file to read
+    size_t returned;            // files returned by readAheadNext()
+    uint32_t outstanding;       // files started and not released yet
+    uint32_t stopping;
+    readAheadBuffer_t *ready;   // reads completed and not returned yet, a ring of limit entries
+    uint32_t readyHead;
+    uint32_t readyCount;
+    pthread_t *threads;
+    uint32_t threadCount;
+#ifdef HAVE_LIBURING
+    uint32_t useRing;
+    struct io_uring ring;
+    readAheadSlot_t *slots;     // depth entries
+    uint32_t inFlight;
+#endif
+};
+
+/**
+ * Opens a file of the list and allocates a buffer for its contents.
+ *
+ * @param readAhead read-ahead.
+ * @param index index of the file.
+ * @param buffer buffer of the file.
+ * @param fd open file on success, -1 otherwise.
+ * @return 1 if the file is open and needs reading, 0 if buffer is final: empty, failed, too large or not a regular
+ *         file.
+ */
+static uint32_t openFile(readAhead_t *readAhead, size_t index, readAheadBuffer_t *buffer, int *fd) {
+    struct stat fileStat;
+
+    buffer->index = index;
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->error = 0;
+
+    *fd = open(readAhead->paths[index], O_RDONLY | O_CLOEXEC);
+    if(*fd < 0) {
+        buffer->error = errno;
+        return 0;
+    }
+    if(fstat(*fd, &fileStat) != 0)
+        buffer->error = errno;
+    else if(S_ISREG(fileStat.st_mode) && (uint64_t) fileStat.st_size <= readAhead->sizeLimit &&
+            (uint64_t) fileStat.st_size < SIZE_MAX) {
+        buffer->size = (size_t) fileStat.st_size;
+        buffer->data = malloc(buffer->size ? buffer->size : 1);
+        if(buffer->data == NULL)
+            buffer->error = ENOMEM;
+        else if(buffer->size > 0)
+            return 1;
+    }
+    close(*fd);
+    *fd = -1;
+    return 0;
+}
+
+/**
+ * Marks a read as failed and frees its buffer.
+ *
+ * @param buffer buffer of the file.
+ * @param error errno of the failure.
+ */
+static void failRead(readAheadBuffer_t *buffer, int error) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->error = error;
+}
+
+/**
+ * Reads a file of the list whole with blocking reads.
+ *
+ * @param readAhead read-ahead.
+ * @param index index of the file.
+ * @param buffer buffer of the file.
+ */
+static void readFile(readAhead_t *readAhead, size_t index, readAheadBuffer_t *buffer) {
+    int fd;
+
+    if(openFile(readAhead, index, buffer, &fd) == 0)
+        return;
+    size_t done = 0;
+    while(done < buffer->size) {
+        size_t wanted = buffer->size - done;
+        ssize_t count = pread(fd, buffer->data + done, wanted < READ_AHEAD_CHUNK_SIZE ? wanted : READ_AHEAD_CHUNK_SIZE,
+                              (off_t) done);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0) {
+            // a file that shrank since it was opened ends early
+            failRead(buffer, count < 0 ? errno : EIO);
+            break;
+        }
+        done += (size_t) count;
+    }
+    close(fd);
+}
+
+/**
+ * Reader thread of the fallback backend. Reads the next file whenever the buffer limit allows it.
+ *
+ * @param arg readAhead_t the thread reads for.
+ * @return NULL.
+ */
+static void *readerThread(void *arg) {
+    readAhead_t *readAhead = arg;
+
+    pthread_mutex_lock(&readAhead->lock);
+    for(;;) {
+        while(!readAhead->stopping && readAhead->next < readAhead->count &&
+                readAhead->outstanding >= readAhead->limit)
+            pthread_cond_wait(&readAhead->changed, &readAhead->lock);
+        if(readAhead->stopping || readAhead->next >= readAhead->count)
+            break;
+        size_t index = readAhead->next++;
+        readAhead->outstanding++;
+        pthread_mutex_unlock(&readAhead->lock);
+
+        readAheadBuffer_t buffer;
+        readFile(readAhead, index, &buffer);
+
+        pthread_mutex_lock(&readAhead->lock);
+        readAhead->ready[(readAhead->readyHead + readAhead->readyCount) % readAhead->limit] = buffer;
+        readAhead->readyCount++;
+        pthread_cond_broadcast(&readAhead->changed);
+    }
+    pthread_mutex_unlock(&readAhead->lock);
+    return NULL;
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * Queues the read of the next chunk of a file. Submitted by the next io_uring_submit().
+ *
+ * The ring has one entry per slot and each slot has at most one read queued, so an entry is always free.
+ *
+ * @param readAhead read-ahead.
+ * @param slot slot of the file.
+ */
+static void queueSlotRead(readAhead_t *readAhead, readAheadSlot_t *slot) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&readAhead->ring);
+    size_t wanted = slot->buffer.size - slot->done;
+    io_uring_prep_read(sqe, slot->fd, slot->buffer.data + slot->done,
+                       (unsigned) (wanted < READ_AHEAD_CHUNK_SIZE ? wanted : READ_AHEAD_CHUNK_SIZE), slot->done);
+    io_uring_sqe_set_data(sqe, slot);
+}
+
+/**
+ * Waits for the next file read through io_uring.
+ *
+ * The ring is driven by the calling thread alone. Reads are started while fewer than depth are in flight and the
+ * buffer limit allows it, then one completion is reaped. Short reads are continued where they stopped.
+ *
+ * @param readAhead read-ahead.
+ * @param buffer file read.
+ * @return 1 if a file was returned, 0 once every file has been returned or the ring failed.
+ */
+static uint32_t nextFromRing(readAhead_t *readAhead, readAheadBuffer_t *buffer) {
+    for(;;) {
+        // start reads, a file that needs none is returned at once
+        while(readAhead->next < readAhead->count && readAhead->inFlight < readAhead->depth) {
+            pthread_mutex_lock(&readAhead->lock);
+            uint32_t room = readAhead->outstanding < readAhead->limit;
+            if(room)
+                readAhead->outstanding++;
+            pthread_mutex_unlock(&readAhead->lock);
+            if(!room)
+                break;
+
+            readAheadSlot_t *slot = readAhead->slots;
+            while(slot->fd >= 0)
+                slot++;
+            if(openFile(readAhead, readAhead->next++, &(slot->buffer), &(slot->fd)) == 0) {
+                *buffer = slot->buffer;
+                readAhead->returned++;
+                return 1;
+            }
+            slot->done = 0;
+            queueSlotRead(readAhead, slot);
+            readAhead->inFlight++;
+        }
+
+        // with every buffer held by the consumers, wait until one is released
+        if(readAhead->inFlight == 0) {
+            if(readAhead->next >= readAhead->count)
+                return 0;
+            pthread_mutex_lock(&readAhead->lock);
+            while(readAhead->outstanding >= readAhead->limit)
+                pthread_cond_wait(&readAhead->changed, &readAhead->lock);
+            pthread_mutex_unlock(&readAhead->lock);
+            continue;
+        }
+
+        struct io_uring_cqe *cqe = NULL;
+        int result = io_uring_submit(&readAhead->ring);
+        if(result >= 0 || result == -EINTR || result == -EAGAIN || result == -EBUSY)
+            result = io_uring_wait_cqe(&readAhead->ring, &cqe);
+        if(result == -EINTR || result == -EAGAIN)
+            continue;
+        if(result < 0)
+            return 0;
+
+        readAheadSlot_t *slot = io_uring_cqe_get_data(cqe);
+        int count = cqe->res;
+        io_uring_cqe_seen(&readAhead->ring, cqe);
+        if(count == -EINTR || count == -EAGAIN) {
+            queueSlotRead(readAhead, slot);
+            continue;
+        }
+        if(count <= 0) {
+            failRead(&(slot->buffer), count < 0 ? -count : EIO);
+        } else {
+            slot->done += (size_t) count;
+            if(slot->done < slot->buffer.size) {
+                queueSlotRead(readAhead, slot);
+                continue;
+            }
+        }
+
+        close(slot->fd);
+        slot->fd = -1;
+        readAhead->inFlight--;
+        *buffer = slot->buffer;
+        readAhead->returned++;
+        return 1;
+    }
+}
+
+/**
+ * Waits for the reads still in flight, so their buffers can be freed. Buffers of reads that cannot be waited for
+ * are leaked rather than freed under the kernel.
+ *
+ * @param readAhead read-ahead.
+ */
+static void drainRing(readAhead_t *readAhead) {
+    io_uring_submit(&readAhead->ring);
+    while(readAhead->inFlight > 0) {
+        struct io_uring_cqe *cqe = NULL;
+        int result = io_uring_wait_cqe(&readAhead->ring, &cqe);
+        if(result == -EINTR || result == -EAGAIN)
+            continue;
+        if(result < 0)
+            return;
+
+        readAheadSlot_t *slot = io_uring_cqe_get_data(cqe);
+        io_uring_cqe_seen(&readAhead->ring, cqe);
+        close(slot->fd);
+        slot->fd = -1;
+        free(slot->buffer.data);
+        readAhead->inFlight--;
+    }
+}
+#endif
+
+/**
+ * Starts reading a list of files.
+ *
+ * Buffers not released yet count against depth + held, so memory stays bounded by that many files however far the
+ * reads run ahead of the consumers. With HAVE_LIBURING the files are read through an io_uring of depth entries,
+ * driven by readAheadNext(). Where io_uring is missing or not allowed, depth reader threads read one file each.
+ *
+ * @param paths file paths, kept until readAheadDestroy().
+ * @param count number of paths.
+ * @param depth reads in flight, 1 to READ_AHEAD_MAX_DEPTH.
+ * @param held buffers the consumers may hold at once besides the reads in flight, such as one per decode worker.
+ * @param sizeLimit files larger than this are not read and are left to the consumer.
+ * @return pointer to the read-ahead on success, NULL otherwise.
+ */
+readAhead_t *readAheadCreate(char *const *paths, size_t count, uint32_t depth, uint32_t held, uint64_t sizeLimit) {
+    if(depth == 0)
+        depth = 1;
+    if(depth > READ_AHEAD_MAX_DEPTH)
+        depth = READ_AHEAD_MAX_DEPTH;
+
+    readAhead_t *readAhead = calloc(1, sizeof(readAhead_t));
+    if(readAhead == NULL)
+        return NULL;
+    readAhead->paths = paths;
+    readAhead->count = count;
+    readAhead->depth = depth;
+    readAhead->limit = depth + held;
+    readAhead->sizeLimit = sizeLimit;
+    readAhead->ready = calloc(readAhead->limit, sizeof(readAheadBuffer_t));
+    if(readAhead->ready == NULL) {
+        free(readAhead);
+        return NULL;
+    }
+    pthread_mutex_init(&readAhead->lock, NULL);
+    pthread_cond_init(&readAhead->changed, NULL);
+
+#ifdef HAVE_LIBURING
+    readAhead->slots = calloc(depth, sizeof(readAheadSlot_t));
+    if(readAhead->slots != NULL && io_uring_queue_init(depth, &readAhead->ring, 0) == 0) {
+        for(uint32_t s = 0; s < depth; s++)
+            readAhead->slots[s].fd = -1;
+        readAhead->useRing = 1;
+        return readAhead;
+    }
+    free(readAhead->slots);
+    readAhead->slots = NULL;
+#endif
+
+    // no more reader threads than files
+    uint32_t threadCount = (count < depth) ? (uint32_t) count : depth;
+    readAhead->threads = calloc(threadCount ? threadCount : 1, sizeof(pthread_t));
+    for(uint32_t t = 0; readAhead->threads != NULL && t < threadCount; t++) {
+        if(pthread_create(&readAhead->threads[t], NULL, readerThread, readAhead) != 0)
+            break;
+        readAhead->threadCount++;
+    }
+    if(readAhead->threadCount == 0 && count > 0) {
+        readAheadDestroy(readAhead);
+        return NULL;
+    }
+    return readAhead;
+}
+
+/**
+ * Returns the name of the backend reading the files, "io_uring" or "threads".
+ *
+ * @param readAhead read-ahead.
+ * @return backend name.
+ */
+const char *readAheadBackend(const readAhead_t *readAhead) {
+#ifdef HAVE_LIBURING
+    if(readAhead->useRing)
+        return "io_uring";
+#else
+    (void) readAhead;
+#endif
+    return "threads";
+}
+
+/**
+ * Waits for the next file to finish reading. Files are returned in the order their reads complete.
+ *
+ * Called from one thread only.
+ *
+ * @param readAhead read-ahead.
+ * @param buffer file read, to be handed to readAheadRelease() once consumed.
+ * @return 1 if a file was returned, 0 once every file has been returned or if io_uring failed, which leaves the
+ *         files not returned to the caller.
+ */
+uint32_t readAheadNext(readAhead_t *readAhead, readAheadBuffer_t *buffer) {
+#ifdef HAVE_LIBURING
+    if(readAhead->useRing)
+        return nextFromRing(readAhead, buffer);
+#endif
+
+    pthread_mutex_lock(&readAhead->lock);
+    while(readAhead->readyCount == 0 && readAhead->returned < readAhead->count)
+        pthread_cond_wait(&readAhead->changed, &readAhead->lock);
+    uint32_t found = readAhead->readyCount > 0;
+    if(found) {
+        *buffer = readAhead->ready[readAhead->readyHead];
+        readAhead->readyHead = (readAhead->readyHead + 1) % readAhead->limit;
+        readAhead->readyCount--;
+        readAhead->returned++;
+    }
+    pthread_mutex_unlock(&readAhead->lock);
+    return found;
+}
+
+/**
+ * Frees a buffer returned by readAheadNext() and lets another read start. May be called from any thread.
+ *
+ * @param readAhead read-ahead.
+ * @param buffer buffer to free.
+ */
+void readAheadRelease(readAhead_t *readAhead, readAheadBuffer_t *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+
+    pthread_mutex_lock(&readAhead->lock);
+    readAhead->outstanding--;
+    pthread_cond_broadcast(&readAhead->changed);
+    pthread_mutex_unlock(&readAhead->lock);
+}
+
+/**
+ * Stops the reads and frees the read-ahead. Every buffer returned must have been released.
+ *
+ * Reads in flight are finished and their buffers freed along with the ones not returned yet.
+ *
+ * @param readAhead read-ahead.
+ */
+void readAheadDestroy(readAhead_t *readAhead) {
+    if(readAhead == NULL)
+        return;
+
+    pthread_mutex_lock(&readAhead->lock);
+    readAhead->stopping = 1;
+    pthread_cond_broadcast(&readAhead->changed);
+    pthread_mutex_unlock(&readAhead->lock);
+    for(uint32_t t = 0; t < readAhead->threadCount; t++)
+        pthread_join(readAhead->threads[t], NULL);
+
+#ifdef HAVE_LIBURING
+    if(readAhead->useRing) {
+        drainRing(readAhead);
+        io_uring_queue_exit(&readAhead->ring);
+    }
+    free(readAhead->slots);
+#endif
+
+    for(uint32_t r = 0; r < readAhead->readyCount; r++)
+        free(readAhead->ready[(readAhead->readyHead + r) % readAhead->limit].data);
+    free(readAhead->ready);
+    free(readAhead->threads);
+    pthread_cond_destroy(&readAhead->changed);
+    pthread_mutex_destroy(&readAhead->lock);
+    free(readAhead);
+}
@@ -0,0 +1,85 @@
+/** @file readahead.h
+ *
+ * @brief Reads a list of files whole ahead of their consumers, with several reads in flight, so reading the next
+ *        files overlaps decoding the last ones. Uses io_uring when built with HAVE_LIBURING and reader threads
+ *        otherwise.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef READAHEAD_H_
+#define READAHEAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Largest number of reads in flight.
+ */
+#define READ_AHEAD_MAX_DEPTH    256
+
+/**
+ * One file read by readAheadNext().
+ */
+typedef struct readAheadBuffer {
+    size_t index;           // index of the file in the path list
+    uint8_t *data;          // file contents, NULL if the file failed or was larger than the size limit
+    size_t size;            // number of bytes in data
+    int error;              // errno of the failed open or read, 0 if the file was read or too large
+} readAheadBuffer_t;
+
+/**
+ * Opaque read-ahead handle.
+ */
+typedef struct readAhead readAhead_t;
+
+/**
+ * Starts reading a list of files.
+ *
+ * Buffers not released yet count against depth + held, so memory stays bounded by that many files however far the
+ * reads run ahead of the consumers.
+ *
+ * @param paths file paths, kept until readAheadDestroy().
+ * @param count number of paths.
+ * @param depth reads in flight, 1 to READ_AHEAD_MAX_DEPTH.
+ * @param held buffers the consumers may hold at once besides the reads in flight, such as one per decode worker.
+ * @param sizeLimit files larger than this are not read and are left to the consumer.
+ * @return pointer to the read-ahead on success, NULL otherwise.
+ */
+readAhead_t *readAheadCreate(char *const *paths, size_t count, uint32_t depth, uint32_t held, uint64_t sizeLimit);
+
+/**
+ * Returns the name of the backend reading the files, "io_uring" or "threads".
+ *
+ * @param readAhead read-ahead.
+ * @return backend name.
+ */
+const char *readAheadBackend(const readAhead_t *readAhead);
+
+/**
+ * Waits for the next file to finish reading. Files are returned in the order their reads complete.
+ *
+ * Called from one thread only.
+ *
+ * @param readAhead read-ahead.
+ * @param buffer file read, to be handed to readAheadRelease() once consumed.
+ * @return 1 if a file was returned, 0 once every file has been returned or if io_uring failed, which leaves the
+ *         files not returned to the caller.
+ */
+uint32_t readAheadNext(readAhead_t *readAhead, readAheadBuffer_t *buffer);
+
+/**
+ * Frees a buffer returned by readAheadNext() and lets another read start. May be called from any thread.
+ *
+ * @param readAhead read-ahead.
+ * @param buffer buffer to free.
+ */
+void readAheadRelease(readAhead_t *readAhead, readAheadBuffer_t *buffer);
+
+/**
+ * Stops the reads and frees the read-ahead. Every buffer returned must have been released.
+ *
+ * @param readAhead read-ahead.
+ */
+void readAheadDestroy(readAhead_t *readAhead);
+
+#endif
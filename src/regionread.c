@@ -0,0 +1,427 @@
+/** @file regionread.c
+ *
+ * @brief Random access to a byte range of the message, or the bits of a pixel rectangle, reading only the rows
+ * holding them.
+ * @author Daniel Jaramillo
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frame.h"
+#include "probe.h"
+#include "regionread.h"
+#include "stats.h"
+
+/**
+ * Runs of pixels, one per row in decode order. The first row starts at first_column and the last one ends at
+ * last_end, every other row covers column to end.
+ */
+typedef struct pixelRuns {
+    uint32_t first_row;
+    uint32_t row_count;
+    uint32_t first_column;
+    uint32_t column;
+    uint32_t end;
+    uint32_t last_end;
+} pixelRuns_t;
+
+/**
+ * Reads exactly size bytes at a file offset, continuing after short reads and interrupted calls.
+ *
+ * @param fd file.
+ * @param buffer destination.
+ * @param size number of bytes.
+ * @param offset file offset.
+ * @return 1 on success, 0 on error or end of file.
+ */
+static uint32_t preadAll(int fd, uint8_t *buffer, size_t size, uint64_t offset) {
+    while(size > 0) {
+        ssize_t count = pread(fd, buffer, size, (off_t) offset);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            return 0;
+        buffer += count;
+        size -= (size_t) count;
+        offset += (uint64_t) count;
+    }
+    return 1;
+}
+
+/**
+ * Grows a buffer to hold at least size bytes, keeping it when it is large enough.
+ *
+ * @param buffer buffer, replaced when it grows.
+ * @param capacity size of buffer, updated when it grows.
+ * @param size number of bytes needed.
+ * @return 1 on success, 0 if memory ran out.
+ */
+static uint32_t reserveBuffer(uint8_t **buffer, size_t *capacity, size_t size) {
+    if(size <= *capacity)
+        return 1;
+    free(*buffer);
+    *buffer = malloc(size);
+    *capacity = *buffer != NULL ? size : 0;
+    return *buffer != NULL;
+}
+
+/**
+ * Opens a bitmap file for random access, reading only its headers.
+ *
+ * Headers are read with a single pread() of at most PROBE_SIZE bytes, and the pixel array is checked against the
+ * file size, so every offset computed later lies inside the file.
+ *
+ * @param reader reader to fill in.
+ * @param fd bitmap file, read with pread() so its file offset is left alone. Must stay open until the reader is
+ *           closed.
+ * @param config decode configuration, NULL for the default configuration of decodeMessage().
+ * @return 1 on success, 0 if the file cannot be read, is not decodeable or the configuration is not supported.
+ */
+uint32_t regionReaderOpen(regionReader_t *reader, int fd, const decodeConfig_t *config) {
+    uint8_t buffer[PROBE_SIZE];
+    struct stat fileStat;
+
+    memset(reader, 0, sizeof(regionReader_t));
+    reader->fd = fd;
+    reader->config.bits_per_channel = config ? config->bits_per_channel : 1;
+    reader->config.channel_mask = config ? config->channel_mask : CHANNEL_RGB;
+    // a keyed pixel order scatters every range over the whole image
+    if((config != NULL && config->order_key != 0) || fstat(fd, &fileStat) != 0)
+        return 0;
+
+    // read headers
+    STATS_START(headerTimer);
+    ssize_t count;
+    do {
+        count = pread(fd, buffer, sizeof(buffer), 0);
+    } while(count < 0 && errno == EINTR);
+    STATS_STOP(headerTimer, STATS_HEADERS, count > 0 ? (uint64_t) count : 0);
+    if(count < BMPFILEHEADERSIZE + 4)
+        return 0;
+    bitmap_t *bitmap = &(reader->bitmap);
+    uint32_t dibHeaderSize = parseBMPFileHeader(buffer, &(bitmap->bmpFileHeader));
+    if(dibHeaderSize < 4 || dibHeaderSize > (size_t) count - BMPFILEHEADERSIZE ||
+            parseDIBHeader(buffer + BMPFILEHEADERSIZE + 4, dibHeaderSize - 4, &(bitmap->dibHeader)) != 1 ||
+            parseBitfieldMasks(buffer + BMPFILEHEADERSIZE + dibHeaderSize,
+                               (size_t) count - BMPFILEHEADERSIZE - dibHeaderSize, &(bitmap->dibHeader)) != 1)
+        return 0;
+    if(isDecodeable(bitmap) != 1 || checkPixelArrayBounds(bitmap, (uint64_t) fileStat.st_size) == 0)
+        return 0;
+
+    pixelFormat_t format;
+    reader->kernel = selectDecodeKernel(bitmap, &(reader->config));
+    if(reader->kernel == NULL || getPixelFormat(&(bitmap->dibHeader), &format) == 0)
+        return 0;
+    reader->pixelOffset = bitmap->bmpFileHeader.img_offset;
+    reader->rowSize = getRowSize(&(bitmap->dibHeader));
+    reader->width = getBitmapWidth(&(bitmap->dibHeader));
+    reader->height = getBitmapHeight(&(bitmap->dibHeader));
+    reader->pixelBytes = format.bytes_per_pixel;
+    reader->messageBits = reader->config.bits_per_channel * (uint32_t) __builtin_popcount(reader->config.channel_mask);
+    if(reader->rowSize == 0 || reader->rowSize > SIZE_MAX)
+        return 0;
+
+    // whole message bytes, dividing first so no pixel count overflows
+    uint64_t pixels = (uint64_t) reader->width * reader->height;
+    reader->capacity = pixels / 8 * reader->messageBits + pixels % 8 * reader->messageBits / 8;
+
+    // one row of message bytes plus the bits carried over from the row before
+    size_t messageSize = (size_t) ((uint64_t) reader->width * reader->messageBits / 8 + 2);
+    if(reserveBuffer(&(reader->message), &(reader->messageCapacity), messageSize) == 0)
+        return 0;
+    return 1;
+}
+
+/**
+ * Frees the buffers of a reader. The file is left open.
+ *
+ * @param reader reader.
+ */
+void regionReaderClose(regionReader_t *reader) {
+    free(reader->rows);
+    free(reader->message);
+    reader->rows = NULL;
+    reader->message = NULL;
+    reader->rowsCapacity = 0;
+    reader->messageCapacity = 0;
+}
+
+/**
+ * Maps a row in decode order to the row it is stored in, the bottom row of the image is stored first unless the
+ * bitmap is top-down.
+ *
+ * @param reader reader.
+ * @param row row in decode order.
+ * @return stored row.
+ */
+static uint32_t getStoredRow(const regionReader_t *reader, uint32_t row) {
+    return isTopDown(&(reader->bitmap.dibHeader)) ? reader->height - 1 - row : row;
+}
+
+/**
+ * Maps a pixel in decode order to its offset in the file, accounting for row padding and bottom-up or top-down
+ * row order.
+ *
+ * @param reader reader.
+ * @param pixel index of the pixel counted along the rows in decode order, bottom row first.
+ * @return file offset of the first byte of the pixel.
+ */
+uint64_t getPixelFileOffset(const regionReader_t *reader, uint64_t pixel) {
+    uint32_t row = (uint32_t) (pixel / reader->width);
+    uint32_t column = (uint32_t) (pixel % reader->width);
+    return reader->pixelOffset + getStoredRow(reader, row) * reader->rowSize + (uint64_t) column * reader->pixelBytes;
+}
+
+/**
+ * Returns the first column of a run.
+ *
+ * @param runs runs.
+ * @param row row relative to the first row of the runs.
+ * @return first column.
+ */
+static uint32_t getRunStart(const pixelRuns_t *runs, uint32_t row) {
+    return row == 0 ? runs->first_column : runs->column;
+}
+
+/**
+ * Returns the column after the last one of a run.
+ *
+ * @param runs runs.
+ * @param row row relative to the first row of the runs.
+ * @return end column.
+ */
+static uint32_t getRunEnd(const pixelRuns_t *runs, uint32_t row) {
+    return row == runs->row_count - 1 ? runs->last_end : runs->end;
+}
+
+/**
+ * Reads the runs of pixels and decodes their message bits.
+ *
+ * Rows are read in blocks of neighbouring stored rows with one pread() each, up to REGION_READ_SIZE bytes, as long
+ * as the gap between the runs of two rows is at most REGION_READ_MAX_GAP bytes. Otherwise each run is read on its
+ * own. Bits are carried across runs, so the runs decode as one stream of bits.
+ *
+ * @param reader reader.
+ * @param runs runs of pixels.
+ * @param skip number of decoded bytes dropped before the first byte written.
+ * @param dst destination.
+ * @param size number of bytes to write at most.
+ * @param accumulator bits carried across runs, left holding the bits of an incomplete last byte.
+ * @return number of bytes written, less than size if the runs hold fewer bytes, or SIZE_MAX if reading failed.
+ */
+static size_t decodePixelRuns(regionReader_t *reader, const pixelRuns_t *runs, uint64_t skip, uint8_t *dst,
+                              size_t size, bitAccumulator_t *accumulator) {
+    uint64_t rowSize = reader->rowSize;
+    uint32_t topDown = isTopDown(&(reader->bitmap.dibHeader));
+
+    // runs are read together only when the rows between them are cheap to read along
+    uint64_t runBytes = (uint64_t) (runs->end - runs->column) * reader->pixelBytes;
+    uint32_t blockRows = 1;
+    if(rowSize - runBytes <= REGION_READ_MAX_GAP && rowSize <= REGION_READ_SIZE)
+        blockRows = (uint32_t) (REGION_READ_SIZE / rowSize);
+    if(blockRows > runs->row_count)
+        blockRows = runs->row_count;
+    if(reserveBuffer(&(reader->rows), &(reader->rowsCapacity), (size_t) (blockRows * rowSize)) == 0)
+        return SIZE_MAX;
+
+    size_t written = 0;
+    for(uint32_t block = 0; block < runs->row_count && written < size; block += blockRows) {
+        uint32_t count = runs->row_count - block < blockRows ? runs->row_count - block : blockRows;
+
+        // stored rows of the block are contiguous, in reverse decode order for top-down bitmaps
+        uint32_t lowRow = getStoredRow(reader, runs->first_row + (topDown ? block + count - 1 : block));
+        uint32_t lowColumn = getRunStart(runs, block);
+        uint32_t highColumn = getRunEnd(runs, block);
+        for(uint32_t r = block + 1; r < block + count; r++) {
+            if(getRunStart(runs, r) < lowColumn)
+                lowColumn = getRunStart(runs, r);
+            if(getRunEnd(runs, r) > highColumn)
+                highColumn = getRunEnd(runs, r);
+        }
+        uint64_t start = reader->pixelOffset + lowRow * rowSize + (uint64_t) lowColumn * reader->pixelBytes;
+        size_t length = (size_t) ((count - 1) * rowSize + (uint64_t) (highColumn - lowColumn) * reader->pixelBytes);
+        STATS_START(readTimer);
+        uint32_t success = preadAll(reader->fd, reader->rows, length, start);
+        STATS_STOP(readTimer, STATS_PIXELS, length);
+        if(success == 0)
+            return SIZE_MAX;
+
+        STATS_START(decodeTimer);
+        size_t blockStart = written;
+        for(uint32_t r = block; r < block + count && written < size; r++) {
+            uint32_t stored = getStoredRow(reader, runs->first_row + r);
+            uint32_t column = getRunStart(runs, r);
+            const uint8_t *pixels = reader->rows + (stored - lowRow) * rowSize +
+                                    (uint64_t) (column - lowColumn) * reader->pixelBytes;
+            size_t decoded = reader->kernel(pixels, getRunEnd(runs, r) - column, accumulator, reader->message);
+
+            // drop the bytes before the range and keep the ones that fit
+            size_t first = skip < decoded ? (size_t) skip : decoded;
+            skip -= first;
+            size_t kept = decoded - first < size - written ? decoded - first : size - written;
+            memcpy(dst + written, reader->message + first, kept);
+            written += kept;
+        }
+        STATS_STOP(decodeTimer, STATS_DECODE, written - blockStart);
+    }
+    return written;
+}
+
+/**
+ * Maps a byte range of the message to the run of pixels holding it.
+ *
+ * Every 8 / gcd(bits per pixel, 8) pixels hold a whole number of message bytes, so a run starting on a multiple of
+ * that starts on a message byte. Offsets are counted in those groups, so no bit index overflows.
+ *
+ * @param reader reader.
+ * @param offset first message byte.
+ * @param length number of message bytes.
+ * @param firstPixel first pixel of the run, in decode order.
+ * @param pixelCount number of pixels in the run.
+ * @param skip number of message bytes decoded from the run before offset.
+ * @return 1 on success, 0 if the range is empty or does not lie inside the capacity of the bitmap.
+ */
+uint32_t getMessageRangePixels(const regionReader_t *reader, uint64_t offset, uint64_t length, uint64_t *firstPixel,
+                               uint64_t *pixelCount, uint32_t *skip) {
+    if(length == 0 || offset > reader->capacity || length > reader->capacity - offset)
+        return 0;
+
+    uint32_t lowestBit = reader->messageBits & -reader->messageBits;
+    uint32_t groupPixels = 8 / (lowestBit < 8 ? lowestBit : 8);
+    uint32_t groupBytes = groupPixels * reader->messageBits / 8;
+    uint64_t pixels = (uint64_t) reader->width * reader->height;
+    uint64_t end = offset + length;
+
+    *firstPixel = offset / groupBytes * groupPixels;
+    *skip = (uint32_t) (offset % groupBytes);
+    uint64_t lastPixel = (end / groupBytes + (end % groupBytes != 0)) * groupPixels;
+    *pixelCount = (lastPixel < pixels ? lastPixel : pixels) - *firstPixel;
+    return 1;
+}
+
+/**
+ * Reads a byte range of the message.
+ *
+ * @param reader reader.
+ * @param offset first message byte.
+ * @param length number of message bytes.
+ * @param dst destination, length bytes long.
+ * @return 1 on success, 0 if the range does not lie inside the capacity of the bitmap or reading failed.
+ */
+uint32_t readMessageRange(regionReader_t *reader, uint64_t offset, size_t length, uint8_t *dst) {
+    uint64_t firstPixel;
+    uint64_t pixelCount;
+    uint32_t skip;
+
+    if(getMessageRangePixels(reader, offset, length, &firstPixel, &pixelCount, &skip) == 0)
+        return 0;
+
+    uint64_t lastPixel = firstPixel + pixelCount - 1;
+    pixelRuns_t runs;
+    runs.first_row = (uint32_t) (firstPixel / reader->width);
+    runs.row_count = (uint32_t) (lastPixel / reader->width) - runs.first_row + 1;
+    runs.first_column = (uint32_t) (firstPixel % reader->width);
+    runs.column = 0;
+    runs.end = reader->width;
+    runs.last_end = (uint32_t) (lastPixel % reader->width) + 1;
+
+    bitAccumulator_t accumulator = {0, 0};
+    return decodePixelRuns(reader, &runs, skip, dst, length, &accumulator) == length;
+}
+
+/**
+ * Reads a byte range of the payload. If the message starts with an uncompressed frame header, offsets count from
+ * the start of the framed payload and the range must lie inside it. Otherwise they count from the start of the
+ * message like readMessageRange().
+ *
+ * The checksum of a frame covers the whole payload, so it is not verified. A compressed frame cannot be read at
+ * random and fails.
+ *
+ * @param reader reader.
+ * @param offset first payload byte.
+ * @param length number of payload bytes.
+ * @param dst destination, length bytes long.
+ * @param payloadLength length of the framed payload, or the capacity of the bitmap without frame, may be NULL.
+ * @return 1 on success, 0 if the range does not lie inside the payload, the frame is compressed or reading failed.
+ */
+uint32_t readPayloadRange(regionReader_t *reader, uint64_t offset, size_t length, uint8_t *dst,
+                          uint64_t *payloadLength) {
+    uint8_t buffer[FRAME_HEADER_SIZE];
+    frameHeader_t header;
+
+    if(payloadLength != NULL)
+        *payloadLength = reader->capacity;
+    if(reader->capacity < FRAME_HEADER_SIZE || readMessageRange(reader, 0, FRAME_HEADER_SIZE, buffer) == 0 ||
+            parseFrameHeader(buffer, &header) == 0)
+        return readMessageRange(reader, offset, length, dst);
+
+    if(payloadLength != NULL)
+        *payloadLength = header.length;
+    if(header.compressed || offset > header.length || length > header.length - offset)
+        return 0;
+    return readMessageRange(reader, FRAME_HEADER_SIZE + offset, length, dst);
+}
+
+/**
+ * Returns the buffer size readPixelRectBits() needs for a rectangle.
+ *
+ * @param reader reader.
+ * @param rect rectangle.
+ * @param size number of bytes holding the bits of the rectangle.
+ * @return 1 on success, 0 if the rectangle is empty or does not lie inside the bitmap.
+ */
+uint32_t getPixelRectSize(const regionReader_t *reader, const pixelRect_t *rect, uint64_t *size) {
+    *size = 0;
+    if(rect->width == 0 || rect->height == 0 || rect->x > reader->width || rect->width > reader->width - rect->x ||
+            rect->y > reader->height || rect->height > reader->height - rect->y)
+        return 0;
+
+    uint64_t pixels = (uint64_t) rect->width * rect->height;
+    *size = pixels / 8 * reader->messageBits + (pixels % 8 * reader->messageBits + 7) / 8;
+    return 1;
+}
+
+/**
+ * Reads the message bits held by the pixels of a rectangle.
+ *
+ * Bits are taken row by row in decode order, bottom row of the rectangle first and left to right, and packed least
+ * significant bit first like the message. The last byte is padded with zero bits.
+ *
+ * @param reader reader.
+ * @param rect rectangle.
+ * @param dst destination.
+ * @param size size of the destination, at least the size reported by getPixelRectSize().
+ * @param length number of bytes written.
+ * @return 1 on success, 0 if the rectangle does not lie inside the bitmap, the destination is too small or reading
+ *         failed.
+ */
+uint32_t readPixelRectBits(regionReader_t *reader, const pixelRect_t *rect, uint8_t *dst, size_t size,
+                           uint64_t *length) {
+    uint64_t needed;
+
+    *length = 0;
+    if(getPixelRectSize(reader, rect, &needed) == 0 || needed > size)
+        return 0;
+
+    // image rows count from the top, decode rows from the bottom
+    pixelRuns_t runs;
+    runs.first_row = reader->height - rect->y - rect->height;
+    runs.row_count = rect->height;
+    runs.first_column = rect->x;
+    runs.column = rect->x;
+    runs.end = rect->x + rect->width;
+    runs.last_end = rect->x + rect->width;
+
+    bitAccumulator_t accumulator = {0, 0};
+    size_t written = decodePixelRuns(reader, &runs, 0, dst, (size_t) needed, &accumulator);
+    if(written == SIZE_MAX)
+        return 0;
+    if(accumulator.count > 0)
+        dst[written++] = (uint8_t) (accumulator.bits & ((1u << accumulator.count) - 1));
+    *length = written;
+    return written == needed;
+}
@@ -0,0 +1,162 @@
+/** @file regionread.h
+ *
+ * @brief Random access to a byte range of the message, or the bits of a pixel rectangle, reading only the rows
+ * holding them.
+ *
+ * The message is laid out along the rows in decode order, bottom row of the image first, each pixel holding
+ * bits_per_channel times the number of selected channels bits. A byte range therefore maps to one run of pixels and
+ * a rectangle to one run per row, and each run to an exact offset in the file, so only the pixels of those runs are
+ * read with pread() instead of the whole pixel array.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef REGIONREAD_H_
+#define REGIONREAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "decoder.h"
+#include "lsbkernels.h"
+
+/**
+ * Largest block of rows read with one pread(), in bytes. Runs of neighbouring rows are read together when the gap
+ * between them is at most REGION_READ_MAX_GAP bytes.
+ */
+#define REGION_READ_SIZE        (1024 * 1024)
+#define REGION_READ_MAX_GAP     4096
+
+/**
+ * Rectangle of pixels in image coordinates, x from the left and y from the top row of the image.
+ */
+typedef struct pixelRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} pixelRect_t;
+
+/**
+ * Bitmap file opened for random access. Holds the headers only, and buffers reused by every read.
+ */
+typedef struct regionReader {
+    int fd;                     // bitmap file, owned by the caller
+    bitmap_t bitmap;            // headers, without pixel array
+    decodeConfig_t config;
+    lsbPixelKernel_t kernel;
+    uint64_t pixelOffset;       // file offset of the pixel array
+    uint64_t rowSize;           // stored row including padding
+    uint64_t capacity;          // whole message bytes held by the pixels
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelBytes;        // bytes per pixel
+    uint32_t messageBits;       // message bits per pixel
+    uint8_t *rows;              // block of rows read with pread()
+    size_t rowsCapacity;
+    uint8_t *message;           // message bytes of one row
+    size_t messageCapacity;
+} regionReader_t;
+
+/**
+ * Opens a bitmap file for random access, reading only its headers.
+ *
+ * @param reader reader to fill in.
+ * @param fd bitmap file, read with pread() so its file offset is left alone. Must stay open until the reader is
+ *           closed.
+ * @param config decode configuration, NULL for the default configuration of decodeMessage().
+ * @return 1 on success, 0 if the file cannot be read, is not decodeable or the configuration is not supported.
+ */
+uint32_t regionReaderOpen(regionReader_t *reader, int fd, const decodeConfig_t *config);
+
+/**
+ * Frees the buffers of a reader. The file is left open.
+ *
+ * @param reader reader.
+ */
+void regionReaderClose(regionReader_t *reader);
+
+/**
+ * Maps a pixel in decode order to its offset in the file, accounting for row padding and bottom-up or top-down
+ * row order.
+ *
+ * @param reader reader.
+ * @param pixel index of the pixel counted along the rows in decode order, bottom row first.
+ * @return file offset of the first byte of the pixel.
+ */
+uint64_t getPixelFileOffset(const regionReader_t *reader, uint64_t pixel);
+
+/**
+ * Maps a byte range of the message to the run of pixels holding it.
+ *
+ * A run starts on a pixel whose first bit starts a message byte, at most 8 pixels before the range, so the bytes
+ * decoded from it up to skip are dropped.
+ *
+ * @param reader reader.
+ * @param offset first message byte.
+ * @param length number of message bytes.
+ * @param firstPixel first pixel of the run, in decode order.
+ * @param pixelCount number of pixels in the run.
+ * @param skip number of message bytes decoded from the run before offset.
+ * @return 1 on success, 0 if the range is empty or does not lie inside the capacity of the bitmap.
+ */
+uint32_t getMessageRangePixels(const regionReader_t *reader, uint64_t offset, uint64_t length, uint64_t *firstPixel,
+                               uint64_t *pixelCount, uint32_t *skip);
+
+/**
+ * Reads a byte range of the message.
+ *
+ * @param reader reader.
+ * @param offset first message byte.
+ * @param length number of message bytes.
+ * @param dst destination, length bytes long.
+ * @return 1 on success, 0 if the range does not lie inside the capacity of the bitmap or reading failed.
+ */
+uint32_t readMessageRange(regionReader_t *reader, uint64_t offset, size_t length, uint8_t *dst);
+
+/**
+ * Reads a byte range of the payload. If the message starts with an uncompressed frame header, offsets count from
+ * the start of the framed payload and the range must lie inside it. Otherwise they count from the start of the
+ * message like readMessageRange().
+ *
+ * The checksum of a frame covers the whole payload, so it is not verified. A compressed frame cannot be read at
+ * random and fails.
+ *
+ * @param reader reader.
+ * @param offset first payload byte.
+ * @param length number of payload bytes.
+ * @param dst destination, length bytes long.
+ * @param payloadLength length of the framed payload, or the capacity of the bitmap without frame, may be NULL.
+ * @return 1 on success, 0 if the range does not lie inside the payload, the frame is compressed or reading failed.
+ */
+uint32_t readPayloadRange(regionReader_t *reader, uint64_t offset, size_t length, uint8_t *dst,
+                          uint64_t *payloadLength);
+
+/**
+ * Returns the buffer size readPixelRectBits() needs for a rectangle.
+ *
+ * @param reader reader.
+ * @param rect rectangle.
+ * @param size number of bytes holding the bits of the rectangle.
+ * @return 1 on success, 0 if the rectangle is empty or does not lie inside the bitmap.
+ */
+uint32_t getPixelRectSize(const regionReader_t *reader, const pixelRect_t *rect, uint64_t *size);
+
+/**
+ * Reads the message bits held by the pixels of a rectangle.
+ *
+ * Bits are taken row by row in decode order, bottom row of the rectangle first and left to right, and packed least
+ * significant bit first like the message. The last byte is padded with zero bits.
+ *
+ * @param reader reader.
+ * @param rect rectangle.
+ * @param dst destination.
+ * @param size size of the destination, at least the size reported by getPixelRectSize().
+ * @param length number of bytes written.
+ * @return 1 on success, 0 if the rectangle does not lie inside the bitmap, the destination is too small or reading
+ *         failed.
+ */
+uint32_t readPixelRectBits(regionReader_t *reader, const pixelRect_t *rect, uint8_t *dst, size_t size,
+                           uint64_t *length);
+
+#endif
@@ -0,0 +1,597 @@
+/** @file shard.c
+ *
+ * @brief Payloads split into self-describing shards over a set of carriers, decoded in parallel and reassembled in
+ * any order.
+ * @author Daniel Jaramillo
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "frame.h"
+#include "shard.h"
+#include "stats.h"
+#include "threadpool.h"
+
+/**
+ * States of a shard of the set.
+ */
+#define SLICE_NONE      0   // not decoded yet, or its carrier failed
+#define SLICE_WRITING   1   // a worker is decoding it
+#define SLICE_DONE      2   // written, or held until the slices before it are written
+
+/**
+ * Slice decoded out of order onto a sink that takes slices in payload order only.
+ */
+typedef struct pendingSlice {
+    struct pendingSlice *next;
+    uint64_t offset;
+    uint64_t length;
+    uint8_t *data;
+} pendingSlice_t;
+
+/**
+ * Reassembly state of one payload.
+ */
+struct shardAssembler {
+    outputSink_t *sink;
+    uint32_t seekable;          // 1 if slices are written at their offsets with pwrite()
+    pthread_mutex_t lock;
+    uint32_t started;           // 1 once a shard fixed the set
+    shardHeader_t set;          // header of the first shard found
+    uint8_t *states;            // SLICE_ state of each shard
+    uint32_t doneCount;
+    uint64_t doneBytes;
+    uint64_t nextOffset;        // payload bytes written in order, when not seekable
+    pendingSlice_t *pending;    // slices waiting for the ones before them, when not seekable
+    uint32_t failed;            // writing failed, or a slice written in order turned out corrupt
+};
+
+/**
+ * Shard being decoded from one carrier, the context of writeShardBytes().
+ */
+typedef struct shardWrite {
+    shardAssembler_t *assembler;
+    uint8_t head[SHARD_HEADER_SIZE];
+    size_t headBytes;
+    shardHeader_t header;
+    uint32_t status;            // SHARD_OK while the shard is accepted
+    uint32_t accepted;          // 1 once the shard holds its SLICE_WRITING state
+    uint32_t direct;            // 1 if the slice goes out as it is decoded
+    uint64_t position;          // slice bytes received
+    uint8_t *data;              // slice held in memory when not direct
+    size_t capacity;
+} shardWrite_t;
+
+/**
+ * Reads a little endian integer.
+ *
+ * @param buffer first byte.
+ * @param size number of bytes, at most 8.
+ * @return value.
+ */
+static uint64_t readLittleEndian(const uint8_t *buffer, uint32_t size) {
+    uint64_t value = 0;
+    for(uint32_t b = 0; b < size; b++)
+        value |= (uint64_t) buffer[b] << (8 * b);
+    return value;
+}
+
+/**
+ * Writes a little endian integer.
+ *
+ * @param buffer first byte.
+ * @param value value.
+ * @param size number of bytes, at most 8.
+ */
+static void writeLittleEndian(uint8_t *buffer, uint64_t value, uint32_t size) {
+    for(uint32_t b = 0; b < size; b++)
+        buffer[b] = (uint8_t) (value >> (8 * b));
+}
+
+/**
+ * Serializes a shard header.
+ *
+ * @param header shard header.
+ * @param buffer destination, SHARD_HEADER_SIZE bytes long.
+ */
+void serializeShardHeader(const shardHeader_t *header, uint8_t *buffer) {
+    memcpy(buffer, SHARD_MAGIC, 4);
+    writeLittleEndian(buffer + 4, header->count, 4);
+    writeLittleEndian(buffer + 8, header->index, 4);
+    writeLittleEndian(buffer + 12, header->set_id, 8);
+    writeLittleEndian(buffer + 20, header->offset, 8);
+    writeLittleEndian(buffer + 28, header->total_length, 8);
+}
+
+/**
+ * Parses a shard header and checks that its fields agree.
+ *
+ * @param buffer SHARD_HEADER_SIZE bytes.
+ * @param header shard header to fill in.
+ * @return 1 if the buffer starts with SHARD_MAGIC and the index and offset lie inside the set, 0 otherwise.
+ */
+uint32_t parseShardHeader(const uint8_t *buffer, shardHeader_t *header) {
+    if(memcmp(buffer, SHARD_MAGIC, 4) != 0)
+        return 0;
+
+    header->count = (uint32_t) readLittleEndian(buffer + 4, 4);
+    header->index = (uint32_t) readLittleEndian(buffer + 8, 4);
+    header->set_id = readLittleEndian(buffer + 12, 8);
+    header->offset = readLittleEndian(buffer + 20, 8);
+    header->total_length = readLittleEndian(buffer + 28, 8);
+    return header->index < header->count && header->offset <= header->total_length;
+}
+
+/**
+ * Derives the set identifier of a payload from its CRC-32C and length, so shards of different payloads do not mix.
+ *
+ * @param payload payload bytes.
+ * @param length number of payload bytes.
+ * @return set identifier.
+ */
+uint64_t getShardSetId(const uint8_t *payload, size_t length) {
+    return ((uint64_t) crc32cUpdate(0, payload, length) << 32) ^ (uint64_t) length;
+}
+
+/**
+ * Splits a payload over carriers in proportion to the slice each can hold, so every carrier holds a shard and
+ * decoding them in parallel takes about as long for each.
+ *
+ * Each carrier gets its share rounded down, the bytes left over go to the first carriers with room to spare.
+ *
+ * @param capacities payload bytes each carrier holds, framed payload capacity minus SHARD_HEADER_SIZE.
+ * @param count number of carriers.
+ * @param length number of payload bytes.
+ * @param lengths slice length of each carrier, count entries.
+ * @return 1 on success, 0 if there are no carriers or the payload does not fit.
+ */
+uint32_t planShards(const uint64_t *capacities, uint32_t count, uint64_t length, uint64_t *lengths) {
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        if(capacities[i] > UINT64_MAX - total)
+            return 0;
+        total += capacities[i];
+    }
+    if(count == 0 || length > total)
+        return 0;
+
+    uint64_t left = length;
+    for(uint32_t i = 0; i < count; i++) {
+        lengths[i] = (uint64_t) ((unsigned __int128) length * capacities[i] / total);
+        left -= lengths[i];
+    }
+    for(uint32_t i = 0; i < count && left > 0; i++) {
+        uint64_t extra = capacities[i] - lengths[i] < left ? capacities[i] - lengths[i] : left;
+        lengths[i] += extra;
+        left -= extra;
+    }
+    return 1;
+}
+
+/**
+ * Builds the frame of a shard, the frame header followed by the shard header and the slice.
+ *
+ * @param header shard header.
+ * @param slice slice bytes.
+ * @param length number of slice bytes.
+ * @param compress 1 to compress the shard like buildCompressedFramedPayload(), 0 for buildFramedPayload().
+ * @param framedLength number of bytes in the frame.
+ * @return pointer to the frame, NULL if memory ran out.
+ */
+uint8_t *buildShardFrame(const shardHeader_t *header, const uint8_t *slice, size_t length, uint32_t compress,
+                         size_t *framedLength) {
+    if(length > SIZE_MAX - SHARD_HEADER_SIZE)
+        return NULL;
+    uint8_t *shard = malloc(length + SHARD_HEADER_SIZE);
+    if(shard == NULL)
+        return NULL;
+
+    serializeShardHeader(header, shard);
+    memcpy(shard + SHARD_HEADER_SIZE, slice, length);
+    uint8_t *frame = compress ? buildCompressedFramedPayload(shard, length + SHARD_HEADER_SIZE, framedLength)
+                              : buildFramedPayload(shard, length + SHARD_HEADER_SIZE, framedLength);
+    free(shard);
+    return frame;
+}
+
+/**
+ * Writes bytes at an offset of a file, retrying partial writes.
+ *
+ * @param fd file descriptor.
+ * @param bytes bytes to write.
+ * @param count number of bytes.
+ * @param offset file offset.
+ * @return 1 on success, 0 if writing failed.
+ */
+static uint32_t writeAt(int fd, const uint8_t *bytes, size_t count, uint64_t offset) {
+    while(count > 0) {
+        STATS_START(writeTimer);
+        ssize_t written = pwrite(fd, bytes, count, (off_t) offset);
+        STATS_STOP(writeTimer, STATS_OUTPUT, written > 0 ? (uint64_t) written : 0);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            return 0;
+        }
+        bytes += written;
+        count -= (size_t) written;
+        offset += (uint64_t) written;
+    }
+    return 1;
+}
+
+/**
+ * Creates the reassembly state of a payload written to a sink.
+ *
+ * @param sink open sink nothing was written to yet.
+ * @return pointer to assembler on success, NULL if memory ran out.
+ */
+shardAssembler_t *shardAssemblerCreate(outputSink_t *sink) {
+    struct stat fileStat;
+
+    shardAssembler_t *assembler = calloc(1, sizeof(shardAssembler_t));
+    if(assembler == NULL)
+        return NULL;
+    if(pthread_mutex_init(&(assembler->lock), NULL) != 0) {
+        free(assembler);
+        return NULL;
+    }
+    assembler->sink = sink;
+    assembler->seekable = sink->used == 0 && fstat(sink->fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+    return assembler;
+}
+
+/**
+ * Writes the held slices that continue the output, in payload order. The lock must be held.
+ *
+ * @param assembler reassembly state.
+ */
+static void flushPendingSlices(shardAssembler_t *assembler) {
+    pendingSlice_t **link = &(assembler->pending);
+    while(*link != NULL) {
+        pendingSlice_t *slice = *link;
+        if(slice->offset != assembler->nextOffset) {
+            link = &(slice->next);
+            continue;
+        }
+
+        if(slice->length > 0 && outputSinkWrite(assembler->sink, slice->data, (size_t) slice->length) == 0)
+            assembler->failed = 1;
+        assembler->nextOffset += slice->length;
+        *link = slice->next;
+        free(slice->data);
+        free(slice);
+        link = &(assembler->pending);
+    }
+}
+
+/**
+ * Checks a shard header against the set and takes its shard. The first shard found fixes the set.
+ *
+ * @param write shard being decoded, with its header parsed into head.
+ * @return SHARD_OK, SHARD_NOT_FOUND, SHARD_CORRUPT, SHARD_ERROR or SHARD_DUPLICATE.
+ */
+static uint32_t acceptShard(shardWrite_t *write) {
+    shardAssembler_t *assembler = write->assembler;
+    shardHeader_t *header = &(write->header);
+    if(parseShardHeader(write->head, header) == 0)
+        return SHARD_NOT_FOUND;
+
+    uint32_t status = SHARD_OK;
+    pthread_mutex_lock(&(assembler->lock));
+    if(!assembler->started) {
+        assembler->states = calloc(header->count, 1);
+        if(assembler->states == NULL) {
+            pthread_mutex_unlock(&(assembler->lock));
+            return SHARD_ERROR;
+        }
+        assembler->set = *header;
+        assembler->started = 1;
+    }
+    if(header->set_id != assembler->set.set_id || header->count != assembler->set.count ||
+            header->total_length != assembler->set.total_length)
+        status = SHARD_CORRUPT;
+    else if(assembler->states[header->index] != SLICE_NONE)
+        status = SHARD_DUPLICATE;
+    else {
+        assembler->states[header->index] = SLICE_WRITING;
+        write->accepted = 1;
+        write->direct = assembler->seekable || header->offset == assembler->nextOffset;
+    }
+    pthread_mutex_unlock(&(assembler->lock));
+    return status;
+}
+
+/**
+ * Receives the shard of a carrier as it is decoded, see messageWriter_t. The shard header comes first and may be
+ * split over several calls, the slice after it is written at its offset, passed on in payload order or held.
+ *
+ * @param context shardWrite_t of the carrier.
+ * @param bytes next bytes of the shard.
+ * @param count number of bytes.
+ * @return 1 on success, 0 to stop the decode.
+ */
+static uint32_t writeShardBytes(void *context, const uint8_t *bytes, size_t count) {
+    shardWrite_t *write = context;
+    shardAssembler_t *assembler = write->assembler;
+
+    if(write->headBytes < SHARD_HEADER_SIZE) {
+        size_t take = SHARD_HEADER_SIZE - write->headBytes < count ? SHARD_HEADER_SIZE - write->headBytes : count;
+        memcpy(write->head + write->headBytes, bytes, take);
+        write->headBytes += take;
+        bytes += take;
+        count -= take;
+        if(write->headBytes < SHARD_HEADER_SIZE)
+            return 1;
+        write->status = acceptShard(write);
+        if(write->status != SHARD_OK)
+            return 0;
+    }
+    if(count == 0)
+        return 1;
+
+    // the slice must end inside the payload
+    uint64_t offset = write->header.offset + write->position;
+    if(count > write->header.total_length - offset) {
+        write->status = SHARD_CORRUPT;
+        return 0;
+    }
+    write->position += count;
+
+    if(assembler->seekable) {
+        if(writeAt(assembler->sink->fd, bytes, count, offset))
+            return 1;
+        write->status = SHARD_ERROR;
+        return 0;
+    }
+    if(write->direct) {
+        pthread_mutex_lock(&(assembler->lock));
+        uint32_t written = outputSinkWrite(assembler->sink, bytes, count);
+        assembler->nextOffset += count;
+        pthread_mutex_unlock(&(assembler->lock));
+        if(written)
+            return 1;
+        write->status = SHARD_ERROR;
+        return 0;
+    }
+
+    // held until the slices before it are written
+    if(write->position > write->capacity) {
+        size_t capacity = write->capacity ? write->capacity : count;
+        while(capacity < write->position)
+            capacity *= 2;
+        uint8_t *data = realloc(write->data, capacity);
+        if(data == NULL) {
+            write->status = SHARD_ERROR;
+            return 0;
+        }
+        write->data = data;
+        write->capacity = capacity;
+    }
+    memcpy(write->data + write->position - count, bytes, count);
+    return 1;
+}
+
+/**
+ * Records the outcome of a shard and writes the held slices it unblocks.
+ *
+ * @param write shard decoded.
+ * @param status SHARD_ result of the shard.
+ */
+static void finishShard(shardWrite_t *write, uint32_t status) {
+    shardAssembler_t *assembler = write->assembler;
+    pendingSlice_t *slice = NULL;
+    if(status == SHARD_OK && !write->direct) {
+        slice = malloc(sizeof(pendingSlice_t));
+        if(slice == NULL)
+            status = SHARD_ERROR;
+    }
+
+    pthread_mutex_lock(&(assembler->lock));
+    if(status == SHARD_OK) {
+        assembler->states[write->header.index] = SLICE_DONE;
+        assembler->doneCount++;
+        assembler->doneBytes += write->position;
+        if(slice != NULL) {
+            slice->offset = write->header.offset;
+            slice->length = write->position;
+            slice->data = write->data;
+            slice->next = assembler->pending;
+            assembler->pending = slice;
+            write->data = NULL;
+        }
+        if(!assembler->seekable)
+            flushPendingSlices(assembler);
+    } else {
+        // another carrier may hold the shard again, unless part of it went out in order
+        assembler->states[write->header.index] = SLICE_NONE;
+        if(!assembler->seekable && write->direct && write->position > 0)
+            assembler->failed = 1;
+    }
+    pthread_mutex_unlock(&(assembler->lock));
+    free(write->data);
+}
+
+/**
+ * Decodes the shard of one carrier and writes its slice. May be called from several threads at once.
+ *
+ * The frame is decoded with decodeFramedPayloadToWriter(), so a slice on a seekable sink or next in payload order is
+ * written block by block and never held whole. Its checksum is verified once the last block is out, a corrupt slice
+ * is overwritten by a later carrier holding the same shard on a seekable sink and fails the payload otherwise.
+ *
+ * @param assembler reassembly state.
+ * @param bitmap carrier in memory.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @return SHARD_OK, SHARD_NOT_FOUND, SHARD_CORRUPT, SHARD_ERROR or SHARD_DUPLICATE.
+ */
+uint32_t shardAssemblerDecode(shardAssembler_t *assembler, bitmap_t *bitmap, const decodeConfig_t *config) {
+    shardWrite_t write;
+    uint64_t length;
+
+    memset(&write, 0, sizeof(write));
+    write.assembler = assembler;
+    write.status = SHARD_OK;
+    uint32_t frame = decodeFramedPayloadToWriter(bitmap, config, writeShardBytes, &write, &length);
+
+    uint32_t status;
+    if(frame == FRAME_OK)
+        status = write.headBytes == SHARD_HEADER_SIZE ? write.status : SHARD_NOT_FOUND;
+    else if(frame == FRAME_CORRUPT)
+        status = SHARD_CORRUPT;
+    else if(frame == FRAME_NOT_FOUND)
+        status = SHARD_NOT_FOUND;
+    else
+        status = write.status != SHARD_OK ? write.status : SHARD_ERROR;
+
+    if(write.accepted)
+        finishShard(&write, status);
+    else
+        free(write.data);
+    return status;
+}
+
+/**
+ * Checks that every shard of the set was written.
+ *
+ * @param assembler reassembly state.
+ * @param missing number of shards not written, 0 if no shard was found at all, may be NULL.
+ * @param length payload bytes, may be NULL.
+ * @return 1 if the payload was written whole, 0 otherwise.
+ */
+uint32_t shardAssemblerFinish(shardAssembler_t *assembler, uint32_t *missing, uint64_t *length) {
+    pthread_mutex_lock(&(assembler->lock));
+    uint32_t whole = assembler->started && !assembler->failed && assembler->doneCount == assembler->set.count &&
+                     assembler->doneBytes == assembler->set.total_length &&
+                     (assembler->seekable || assembler->nextOffset == assembler->set.total_length);
+    if(missing != NULL)
+        *missing = assembler->started ? assembler->set.count - assembler->doneCount : 0;
+    if(length != NULL)
+        *length = assembler->started ? assembler->set.total_length : 0;
+    pthread_mutex_unlock(&(assembler->lock));
+    return whole;
+}
+
+/**
+ * Frees the reassembly state. The sink is left open.
+ *
+ * @param assembler reassembly state.
+ */
+void shardAssemblerDestroy(shardAssembler_t *assembler) {
+    while(assembler->pending != NULL) {
+        pendingSlice_t *slice = assembler->pending;
+        assembler->pending = slice->next;
+        free(slice->data);
+        free(slice);
+    }
+    pthread_mutex_destroy(&(assembler->lock));
+    free(assembler->states);
+    free(assembler);
+}
+
+/**
+ * Carrier decoded by one worker of decodeShardFiles().
+ */
+typedef struct shardTask {
+    shardAssembler_t *assembler;
+    const char *path;
+    const decodeConfig_t *config;
+    uint32_t useMmap;
+    uint32_t status;            // SHARD_ result, SHARD_ERROR if the carrier could not be read
+} shardTask_t;
+
+/**
+ * Worker task loading one carrier and decoding its shard.
+ *
+ * @param arg shardTask_t to run.
+ */
+static void decodeShardTask(void *arg) {
+    shardTask_t *task = arg;
+    bitmap_t bitmap;
+    uint32_t loaded = 0;
+
+    if(task->useMmap) {
+        loaded = mapBitmapFile(task->path, &bitmap);
+    } else {
+        FILE *bitmapFilePtr = fopen(task->path, "rb");
+        if(bitmapFilePtr != NULL) {
+            loaded = readBitmapFile(bitmapFilePtr, &bitmap);
+            fclose(bitmapFilePtr);
+        }
+    }
+    if(loaded != 1) {
+        task->status = SHARD_ERROR;
+        return;
+    }
+    task->status = shardAssemblerDecode(task->assembler, &bitmap, task->config);
+    releaseBitmap(&bitmap);
+}
+
+/**
+ * Decodes the carriers of a sharded payload in parallel, one carrier per worker, writing each slice as soon as its
+ * carrier is decoded.
+ *
+ * Carriers are handed to the workers in the order given, and slices are written in the order the workers finish
+ * them, see shardAssemblerCreate(). A carrier holding a shard already written is counted as decoded.
+ *
+ * @param paths carrier file paths, in any order.
+ * @param count number of carriers.
+ * @param sink open sink the payload is written to.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param threadCount worker threads, 0 for one per online processor.
+ * @param useMmap 1 to memory map the carriers with mapBitmapFile(), 0 to read them with readBitmapFile().
+ * @param summary totals of the run.
+ * @return 1 if the payload was written whole, 0 otherwise.
+ */
+uint32_t decodeShardFiles(char *const *paths, size_t count, outputSink_t *sink, const decodeConfig_t *config,
+                          uint32_t threadCount, uint32_t useMmap, shardSummary_t *summary) {
+    memset(summary, 0, sizeof(shardSummary_t));
+    summary->failed = count;
+    if(threadCount == 0)
+        threadCount = getProcessorCount();
+    if(threadCount > count)
+        threadCount = count > 0 ? (uint32_t) count : 1;
+
+    shardTask_t *tasks = calloc(count > 0 ? count : 1, sizeof(shardTask_t));
+    shardAssembler_t *assembler = shardAssemblerCreate(sink);
+    threadPool_t *pool = threadPoolCreate(threadCount);
+    if(tasks == NULL || assembler == NULL || pool == NULL) {
+        if(pool != NULL)
+            threadPoolDestroy(pool);
+        if(assembler != NULL)
+            shardAssemblerDestroy(assembler);
+        free(tasks);
+        return 0;
+    }
+
+    taskGroup_t group;
+    taskGroupInit(&group);
+    for(size_t i = 0; i < count; i++) {
+        tasks[i].assembler = assembler;
+        tasks[i].path = paths[i];
+        tasks[i].config = config;
+        tasks[i].useMmap = useMmap;
+        if(threadPoolSubmit(pool, &group, decodeShardTask, &tasks[i]) == 0)
+            decodeShardTask(&tasks[i]);
+    }
+    taskGroupWait(&group);
+    taskGroupDestroy(&group);
+    threadPoolDestroy(pool);
+
+    summary->failed = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(tasks[i].status == SHARD_OK || tasks[i].status == SHARD_DUPLICATE)
+            summary->decoded++;
+        else
+            summary->failed++;
+    }
+    uint32_t whole = shardAssemblerFinish(assembler, &(summary->missing), &(summary->length));
+    shardAssemblerDestroy(assembler);
+    free(tasks);
+    return whole;
+}
@@ -0,0 +1,178 @@
+/** @file shard.h
+ *
+ * @brief Payloads split into self-describing shards over a set of carriers, decoded in parallel and reassembled in
+ * any order.
+ *
+ * Each carrier holds one frame, see frame.h, whose payload is a shard: a header of SHARD_HEADER_SIZE bytes followed
+ * by a slice of the payload. The header holds the magic SHARD_MAGIC and, little endian, the number of shards in the
+ * set, the index of the shard, the set identifier, the offset of the slice in the payload and the payload length.
+ * So a shard tells where its slice goes without the other carriers, the frame checksum covers header and slice, and
+ * the slice may be compressed like any framed payload.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef SHARD_H_
+#define SHARD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "decoder.h"
+#include "outputsink.h"
+
+/**
+ * First bytes of a shard header.
+ */
+#define SHARD_MAGIC             "SGS1"
+
+/**
+ * Size of a shard header: 4 magic bytes, 4 byte shard count, 4 byte shard index, 8 byte set identifier, 8 byte
+ * offset and 8 byte payload length.
+ */
+#define SHARD_HEADER_SIZE       36
+
+/**
+ * Results of decoding the shard of one carrier.
+ */
+#define SHARD_NOT_FOUND     0   // the carrier holds no frame or the frame holds no shard
+#define SHARD_OK            1   // slice written and checksum matched
+#define SHARD_CORRUPT       2   // checksum does not match, or the shard does not fit the set of the shards before
+#define SHARD_ERROR         3   // memory ran out or writing failed
+#define SHARD_DUPLICATE     4   // a carrier decoded before held the same shard, skipped
+
+/**
+ * Parsed shard header.
+ */
+typedef struct shardHeader {
+    uint32_t count;         // shards in the set
+    uint32_t index;         // index of the shard, 0 to count - 1
+    uint64_t set_id;        // identifier shared by the shards of one payload, see getShardSetId()
+    uint64_t offset;        // offset of the slice in the payload
+    uint64_t total_length;  // payload bytes
+} shardHeader_t;
+
+/**
+ * Totals of decoding a set of carriers with decodeShardFiles().
+ */
+typedef struct shardSummary {
+    size_t decoded;         // carriers whose shard was written
+    size_t failed;          // carriers that could not be read or hold no usable shard of the set
+    uint32_t missing;       // shards of the set no carrier held, 0 if no shard was found at all
+    uint64_t length;        // payload bytes once every shard was written
+} shardSummary_t;
+
+/**
+ * Opaque reassembly state of one payload.
+ */
+typedef struct shardAssembler shardAssembler_t;
+
+/**
+ * Serializes a shard header.
+ *
+ * @param header shard header.
+ * @param buffer destination, SHARD_HEADER_SIZE bytes long.
+ */
+void serializeShardHeader(const shardHeader_t *header, uint8_t *buffer);
+
+/**
+ * Parses a shard header and checks that its fields agree.
+ *
+ * @param buffer SHARD_HEADER_SIZE bytes.
+ * @param header shard header to fill in.
+ * @return 1 if the buffer starts with SHARD_MAGIC and the index and offset lie inside the set, 0 otherwise.
+ */
+uint32_t parseShardHeader(const uint8_t *buffer, shardHeader_t *header);
+
+/**
+ * Derives the set identifier of a payload from its CRC-32C and length, so shards of different payloads do not mix.
+ *
+ * @param payload payload bytes.
+ * @param length number of payload bytes.
+ * @return set identifier.
+ */
+uint64_t getShardSetId(const uint8_t *payload, size_t length);
+
+/**
+ * Splits a payload over carriers in proportion to the slice each can hold, so every carrier holds a shard and
+ * decoding them in parallel takes about as long for each.
+ *
+ * @param capacities payload bytes each carrier holds, framed payload capacity minus SHARD_HEADER_SIZE.
+ * @param count number of carriers.
+ * @param length number of payload bytes.
+ * @param lengths slice length of each carrier, count entries.
+ * @return 1 on success, 0 if there are no carriers or the payload does not fit.
+ */
+uint32_t planShards(const uint64_t *capacities, uint32_t count, uint64_t length, uint64_t *lengths);
+
+/**
+ * Builds the frame of a shard, the frame header followed by the shard header and the slice.
+ *
+ * @param header shard header.
+ * @param slice slice bytes.
+ * @param length number of slice bytes.
+ * @param compress 1 to compress the shard like buildCompressedFramedPayload(), 0 for buildFramedPayload().
+ * @param framedLength number of bytes in the frame.
+ * @return pointer to the frame, NULL if memory ran out.
+ */
+uint8_t *buildShardFrame(const shardHeader_t *header, const uint8_t *slice, size_t length, uint32_t compress,
+                         size_t *framedLength);
+
+/**
+ * Creates the reassembly state of a payload written to a sink.
+ *
+ * A sink on a regular file takes each slice at its offset with pwrite() as soon as it is decoded. Any other sink,
+ * such as a pipe, takes the slices in payload order: a slice that starts where the output ends is written as it is
+ * decoded, any other is held in memory until the slices before it are written.
+ *
+ * @param sink open sink nothing was written to yet.
+ * @return pointer to assembler on success, NULL if memory ran out.
+ */
+shardAssembler_t *shardAssemblerCreate(outputSink_t *sink);
+
+/**
+ * Decodes the shard of one carrier and writes its slice. May be called from several threads at once.
+ *
+ * The first shard found fixes the set, later ones must agree on its identifier, shard count and payload length.
+ *
+ * @param assembler reassembly state.
+ * @param bitmap carrier in memory.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @return SHARD_OK, SHARD_NOT_FOUND, SHARD_CORRUPT, SHARD_ERROR or SHARD_DUPLICATE.
+ */
+uint32_t shardAssemblerDecode(shardAssembler_t *assembler, bitmap_t *bitmap, const decodeConfig_t *config);
+
+/**
+ * Checks that every shard of the set was written.
+ *
+ * @param assembler reassembly state.
+ * @param missing number of shards not written, 0 if no shard was found at all, may be NULL.
+ * @param length payload bytes, may be NULL.
+ * @return 1 if the payload was written whole, 0 otherwise.
+ */
+uint32_t shardAssemblerFinish(shardAssembler_t *assembler, uint32_t *missing, uint64_t *length);
+
+/**
+ * Frees the reassembly state. The sink is left open.
+ *
+ * @param assembler reassembly state.
+ */
+void shardAssemblerDestroy(shardAssembler_t *assembler);
+
+/**
+ * Decodes the carriers of a sharded payload in parallel, one carrier per worker, writing each slice as soon as its
+ * carrier is decoded.
+ *
+ * @param paths carrier file paths, in any order.
+ * @param count number of carriers.
+ * @param sink open sink the payload is written to.
+ * @param config decode configuration, NULL for the one decodeMessage() uses.
+ * @param threadCount worker threads, 0 for one per online processor.
+ * @param useMmap 1 to memory map the carriers with mapBitmapFile(), 0 to read them with readBitmapFile().
+ * @param summary totals of the run.
+ * @return 1 if the payload was written whole, 0 otherwise.
+ */
+uint32_t decodeShardFiles(char *const *paths, size_t count, outputSink_t *sink, const decodeConfig_t *config,
+                          uint32_t threadCount, uint32_t useMmap, shardSummary_t *summary);
+
+#endif
@@ -0,0 +1,70 @@
+/** @file stats.c
+ *
+ * @brief Per phase timers and byte counters for decoding files, reported by decode --stats.
+ * @author Daniel Jaramillo
+ */
+
+#include <string.h>
+
+#include "stats.h"
+
+#ifndef NO_STATS
+__thread stats_t *statsCurrent = NULL;
+#endif
+
+/**
+ * Names of the phases in JSON output, by STATS_ phase.
+ */
+static const char *const phaseNames[STATS_PHASE_COUNT] = {"open", "headers", "pixels", "decode", "output"};
+
+/**
+ * Clears all phases.
+ *
+ * @param stats stats to clear.
+ */
+void statsReset(stats_t *stats) {
+    memset(stats, 0, sizeof(stats_t));
+}
+
+/**
+ * Binds stats to the calling thread, so the phases it runs are recorded into them.
+ *
+ * @param stats stats to record into, NULL to stop recording.
+ */
+void statsBind(stats_t *stats) {
+#ifndef NO_STATS
+    statsCurrent = stats;
+#else
+    (void) stats;
+#endif
+}
+
+/**
+ * Adds the phases of stats to a total.
+ *
+ * @param total total.
+ * @param stats stats to add.
+ */
+void statsAdd(stats_t *total, const stats_t *stats) {
+    for(uint32_t p = 0; p < STATS_PHASE_COUNT; p++) {
+        total->nanoseconds[p] += stats->nanoseconds[p];
+        total->calls[p] += stats->calls[p];
+        total->bytes[p] += stats->bytes[p];
+    }
+    total->stopped += stats->stopped;
+}
+
+/**
+ * Writes the phases as a JSON object holding seconds, calls and bytes of each phase.
+ *
+ * @param outputFilePtr stream to write to.
+ * @param stats stats to write.
+ */
+void writeStatsJSON(FILE *outputFilePtr, const stats_t *stats) {
+    fputc('{', outputFilePtr);
+    for(uint32_t p = 0; p < STATS_PHASE_COUNT; p++)
+        fprintf(outputFilePtr, "%s\"%s\":{\"seconds\":%.9f,\"calls\":%llu,\"bytes\":%llu}", p ? "," : "",
+                phaseNames[p], stats->nanoseconds[p] / 1e9, (unsigned long long) stats->calls[p],
+                (unsigned long long) stats->bytes[p]);
+    fputc('}', outputFilePtr);
+}
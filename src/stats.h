@@ -0,0 +1,131 @@
+/** @file stats.h
+ *
+ * @brief Per phase timers and byte counters for decoding files, reported by decode --stats.
+ *
+ * Instrumented code brackets each phase with STATS_START() and STATS_STOP(), which record into the stats_t bound to
+ * the calling thread with statsBind() and do nothing while none is bound. Built with NO_STATS both expand to
+ * nothing.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Phases of decoding a file.
+ */
+#define STATS_OPEN          0   // opening or memory mapping the file
+#define STATS_HEADERS       1   // reading and parsing the file and DIB headers
+#define STATS_PIXELS        2   // reading the pixel array
+#define STATS_DECODE        3   // extracting the message from the pixels
+#define STATS_OUTPUT        4   // writing the message out
+#define STATS_PHASE_COUNT   5
+
+/**
+ * Time and bytes per phase. The time of a phase leaves out the phases nested in it, so the phases add up to the
+ * time measured.
+ */
+typedef struct stats {
+    uint64_t nanoseconds[STATS_PHASE_COUNT];
+    uint64_t calls[STATS_PHASE_COUNT];
+    uint64_t bytes[STATS_PHASE_COUNT];     // bytes read, decoded or written
+    uint64_t stopped;                      // time of all phases stopped so far, to leave out nested ones
+} stats_t;
+
+/**
+ * Running timer of one phase.
+ */
+typedef struct statsTimer {
+    uint64_t start;
+    uint64_t stopped;   // stopped of the bound stats_t at the start
+} statsTimer_t;
+
+/**
+ * Returns the monotonic clock.
+ *
+ * @return nanoseconds since an arbitrary start.
+ */
+static inline uint64_t statsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+#ifndef NO_STATS
+/**
+ * Stats of the calling thread, NULL while none is bound.
+ */
+extern __thread stats_t *statsCurrent;
+
+/**
+ * Starts timing a phase, see STATS_START().
+ *
+ * @param timer timer of the phase.
+ */
+static inline void statsStart(statsTimer_t *timer) {
+    timer->start = statsCurrent ? statsNow() : 0;
+    timer->stopped = statsCurrent ? statsCurrent->stopped : 0;
+}
+
+/**
+ * Records a phase, see STATS_STOP().
+ *
+ * @param timer timer of the phase.
+ * @param phase STATS_ phase.
+ * @param bytes bytes read, decoded or written by the phase.
+ */
+static inline void statsStop(const statsTimer_t *timer, uint32_t phase, uint64_t bytes) {
+    if(statsCurrent != NULL) {
+        uint64_t elapsed = statsNow() - timer->start;
+        statsCurrent->nanoseconds[phase] += elapsed - (statsCurrent->stopped - timer->stopped);
+        statsCurrent->stopped = timer->stopped + elapsed;
+        statsCurrent->calls[phase]++;
+        statsCurrent->bytes[phase] += bytes;
+    }
+}
+
+#define STATS_ENABLED                   1
+#define STATS_START(timer)              statsTimer_t timer; statsStart(&timer)
+#define STATS_STOP(timer, phase, bytes) statsStop(&timer, (phase), (bytes))
+#else
+#define STATS_ENABLED                   0
+#define STATS_START(timer)
+// the byte count is still consumed, so a local kept only for it does not warn as unused
+#define STATS_STOP(timer, phase, bytes) ((void) (bytes))
+#endif
+
+/**
+ * Clears all phases.
+ *
+ * @param stats stats to clear.
+ */
+void statsReset(stats_t *stats);
+
+/**
+ * Binds stats to the calling thread, so the phases it runs are recorded into them.
+ *
+ * @param stats stats to record into, NULL to stop recording.
+ */
+void statsBind(stats_t *stats);
+
+/**
+ * Adds the phases of stats to a total.
+ *
+ * @param total total.
+ * @param stats stats to add.
+ */
+void statsAdd(stats_t *total, const stats_t *stats);
+
+/**
+ * Writes the phases as a JSON object holding seconds, calls and bytes of each phase.
+ *
+ * @param outputFilePtr stream to write to.
+ * @param stats stats to write.
+ */
+void writeStatsJSON(FILE *outputFilePtr, const stats_t *stats);
+
+#endif
@@ -0,0 +1,126 @@
+/** @file stegd.c
+ *
+ * @brief Resident decode server, answering decode requests on a Unix domain socket until interrupted.
+ * @author Daniel Jaramillo
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decodeserver.h"
+
+#define DEFAULT_SOCKET_PATH "/tmp/stegd.sock"
+
+/**
+ * Server stopped by the signal handler.
+ */
+static decodeServer_t *runningServer = NULL;
+
+/**
+ * Prints command line usage.
+ *
+ * @param program name of the program.
+ */
+static void printUsage(const char *program) {
+    printf("Usage: %s [options]\n"
+           "Decodes bitmap files sent as paths or file descriptors to a Unix domain socket, see decodeserver.h for\n"
+           "the protocol. Runs until interrupted.\n"
+           "\n"
+           "  -s, --socket PATH       socket path, default " DEFAULT_SOCKET_PATH "\n"
+           "  -j, --jobs N            number of worker threads, default one per processor\n"
+           "      --max-file-size SIZE  largest bitmap file read, such as 64M, default 1G\n"
+           "  -h, --help              show this help\n", program);
+}
+
+/**
+ * Parses a size such as 64K, 16M or 2G.
+ *
+ * @param text size text.
+ * @return size in bytes, 0 if invalid.
+ */
+static uint64_t parseSize(const char *text) {
+    char *end;
+    uint64_t size = strtoull(text, &end, 10);
+    switch(*end) {
+        case 'k': case 'K': return size << 10;
+        case 'm': case 'M': return size << 20;
+        case 'g': case 'G': return size << 30;
+        case '\0': return size;
+        default: return 0;
+    }
+}
+
+/**
+ * Stops the server on SIGINT and SIGTERM.
+ *
+ * @param signal signal number.
+ */
+static void handleStopSignal(int signal) {
+    (void) signal;
+    if(runningServer != NULL)
+        decodeServerStop(runningServer);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"socket",        required_argument, NULL, 's'},
+        {"jobs",          required_argument, NULL, 'j'},
+        {"max-file-size", required_argument, NULL, 'M'},
+        {"help",          no_argument,       NULL, 'h'},
+        {NULL,            0,                 NULL, 0}
+    };
+    decodeServerOptions_t options = {DEFAULT_SOCKET_PATH, 0, 0};
+    int opt;
+
+    while((opt = getopt_long(argc, argv, "s:j:h", longOptions, NULL)) != -1) {
+        switch(opt) {
+            case 's': options.socketPath = optarg; break;
+            case 'j': options.threadCount = (uint32_t) strtoul(optarg, NULL, 10); break;
+            case 'M':
+                options.maxFileSize = parseSize(optarg);
+                if(options.maxFileSize == 0) {
+                    printf("Error: Invalid maximum file size %s.\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'h': printUsage(argv[0]); return 0;
+            default: printUsage(argv[0]); return -1;
+        }
+    }
+
+    // workers inherit the signal mask, so only the main thread is interrupted
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    decodeServer_t *server = decodeServerCreate(&options);
+    if(server == NULL) {
+        printf("Error: Unable to listen on %s.\n", options.socketPath);
+        return -1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigemptyset(&action.sa_mask);
+    runningServer = server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    pthread_sigmask(SIG_UNBLOCK, &stopSignals, NULL);
+
+    fprintf(stderr, "Listening on %s.\n", options.socketPath);
+    uint32_t stopped = decodeServerRun(server);
+    if(stopped == 0)
+        fprintf(stderr, "Error: Unable to accept connections.\n");
+    decodeServerDestroy(server);
+
+    return stopped ? 0 : -1;
+}
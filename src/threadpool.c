@@ -0,0 +1,245 @@
+/** @file threadpool.c
+ *
+ * @brief Fixed size pool of worker threads running queued tasks.
+ * @author Daniel Jaramillo
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+/**
+ * Queued task.
+ */
+typedef struct poolTask {
+    threadPoolTask_t task;
+    void *arg;
+    taskGroup_t *group;
+    struct poolTask *next;
+} poolTask_t;
+
+/**
+ * Thread pool state. Queue and counters are protected by lock.
+ */
+struct threadPool {
+    pthread_mutex_t lock;
+    pthread_cond_t taskReady;
+    pthread_cond_t idle;
+    poolTask_t *head;
+    poolTask_t *tail;
+    uint32_t active;
+    uint32_t shutdown;
+    uint32_t threadCount;
+    pthread_t *threads;
+};
+
+/**
+ * Returns the number of online processors, at least 1.
+ *
+ * @return number of online processors.
+ */
+uint32_t getProcessorCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t) count : 1;
+}
+
+/**
+ * Marks one task of a group as finished and wakes the waiter when it was the last.
+ *
+ * @param group task group, may be NULL.
+ */
+static void taskGroupFinish(taskGroup_t *group) {
+    if(group == NULL)
+        return;
+
+    pthread_mutex_lock(&group->lock);
+    group->pending--;
+    if(group->pending == 0)
+        pthread_cond_broadcast(&group->done);
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Worker thread loop. Runs tasks until the pool is shut down and the queue is empty.
+ *
+ * @param arg thread pool.
+ * @return NULL.
+ */
+static void *threadPoolWorker(void *arg) {
+    threadPool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for(;;) {
+        while(pool->head == NULL && !pool->shutdown)
+            pthread_cond_wait(&pool->taskReady, &pool->lock);
+        if(pool->head == NULL)
+            break;
+
+        poolTask_t *task = pool->head;
+        pool->head = task->next;
+        if(pool->head == NULL)
+            pool->tail = NULL;
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->task(task->arg);
+        taskGroupFinish(task->group);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if(pool->head == NULL && pool->active == 0)
+            pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Creates a thread pool and starts its workers.
+ *
+ * @param threadCount number of worker threads, 0 for one per online processor.
+ * @return pointer to thread pool on success, NULL otherwise.
+ */
+threadPool_t *threadPoolCreate(uint32_t threadCount) {
+    if(threadCount == 0)
+        threadCount = getProcessorCount();
+
+    threadPool_t *pool = calloc(1, sizeof(threadPool_t));
+    if(pool == NULL)
+        return NULL;
+    pool->threads = calloc(threadCount, sizeof(pthread_t));
+    if(pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->taskReady, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for(uint32_t t = 0; t < threadCount; t++) {
+        if(pthread_create(&pool->threads[t], NULL, threadPoolWorker, pool) != 0)
+            break;
+        pool->threadCount++;
+    }
+    if(pool->threadCount == 0) {
+        threadPoolDestroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/**
+ * Returns the number of worker threads in the pool.
+ *
+ * @param pool thread pool.
+ * @return number of worker threads.
+ */
+uint32_t threadPoolSize(const threadPool_t *pool) {
+    return pool->threadCount;
+}
+
+/**
+ * Queues a task to be run by the next free worker.
+ *
+ * @param pool thread pool.
+ * @param group task group the task belongs to, or NULL.
+ * @param task function to run.
+ * @param arg argument passed to task.
+ * @return 1 on success, 0 otherwise.
+ */
+uint32_t threadPoolSubmit(threadPool_t *pool, taskGroup_t *group, threadPoolTask_t task, void *arg) {
+    poolTask_t *entry = malloc(sizeof(poolTask_t));
+    if(entry == NULL)
+        return 0;
+    entry->task = task;
+    entry->arg = arg;
+    entry->group = group;
+    entry->next = NULL;
+
+    if(group != NULL) {
+        pthread_mutex_lock(&group->lock);
+        group->pending++;
+        pthread_mutex_unlock(&group->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if(pool->tail == NULL)
+        pool->head = entry;
+    else
+        pool->tail->next = entry;
+    pool->tail = entry;
+    pthread_cond_signal(&pool->taskReady);
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
+
+/**
+ * Waits until every task submitted to the pool has finished.
+ *
+ * @param pool thread pool.
+ */
+void threadPoolWait(threadPool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->head != NULL || pool->active != 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Finishes queued tasks, stops the workers and frees the pool.
+ *
+ * @param pool thread pool.
+ */
+void threadPoolDestroy(threadPool_t *pool) {
+    if(pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->taskReady);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(uint32_t t = 0; t < pool->threadCount; t++)
+        pthread_join(pool->threads[t], NULL);
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->taskReady);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * Initializes an empty task group.
+ *
+ * @param group task group.
+ */
+void taskGroupInit(taskGroup_t *group) {
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->done, NULL);
+    group->pending = 0;
+}
+
+/**
+ * Waits until every task submitted with the group has finished.
+ *
+ * @param group task group.
+ */
+void taskGroupWait(taskGroup_t *group) {
+    pthread_mutex_lock(&group->lock);
+    while(group->pending != 0)
+        pthread_cond_wait(&group->done, &group->lock);
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Releases resources held by a task group. The group must have no pending tasks.
+ *
+ * @param group task group.
+ */
+void taskGroupDestroy(taskGroup_t *group) {
+    pthread_cond_destroy(&group->done);
+    pthread_mutex_destroy(&group->lock);
+}
@@ -0,0 +1,101 @@
+/** @file threadpool.h
+ *
+ * @brief Fixed size pool of worker threads running queued tasks.
+ * @author Daniel Jaramillo
+ */
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Function run by a worker thread.
+ */
+typedef void (*threadPoolTask_t)(void *arg);
+
+/**
+ * Opaque thread pool handle.
+ */
+typedef struct threadPool threadPool_t;
+
+/**
+ * Tracks completion of a set of tasks so a caller can wait for its own tasks on a shared pool.
+ */
+typedef struct taskGroup {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    uint32_t pending;
+} taskGroup_t;
+
+/**
+ * Returns the number of online processors, at least 1.
+ *
+ * @return number of online processors.
+ */
+uint32_t getProcessorCount(void);
+
+/**
+ * Creates a thread pool and starts its workers.
+ *
+ * @param threadCount number of worker threads, 0 for one per online processor.
+ * @return pointer to thread pool on success, NULL otherwise.
+ */
+threadPool_t *threadPoolCreate(uint32_t threadCount);
+
+/**
+ * Returns the number of worker threads in the pool.
+ *
+ * @param pool thread pool.
+ * @return number of worker threads.
+ */
+uint32_t threadPoolSize(const threadPool_t *pool);
+
+/**
+ * Queues a task to be run by the next free worker.
+ *
+ * @param pool thread pool.
+ * @param group task group the task belongs to, or NULL.
+ * @param task function to run.
+ * @param arg argument passed to task.
+ * @return 1 on success, 0 otherwise.
+ */
+uint32_t threadPoolSubmit(threadPool_t *pool, taskGroup_t *group, threadPoolTask_t task, void *arg);
+
+/**
+ * Waits until every task submitted to the pool has finished.
+ *
+ * @param pool thread pool.
+ */
+void threadPoolWait(threadPool_t *pool);
+
+/**
+ * Finishes queued tasks, stops the workers and frees the pool.
+ *
+ * @param pool thread pool.
+ */
+void threadPoolDestroy(threadPool_t *pool);
+
+/**
+ * Initializes an empty task group.
+ *
+ * @param group task group.
+ */
+void taskGroupInit(taskGroup_t *group);
+
+/**
+ * Waits until every task submitted with the group has finished.
+ *
+ * @param group task group.
+ */
+void taskGroupWait(taskGroup_t *group);
+
+/**
+ * Releases resources held by a task group. The group must have no pending tasks.
+ *
+ * @param group task group.
+ */
+void taskGroupDestroy(taskGroup_t *group);
+
+#endif